@@ -0,0 +1,125 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "control_flow.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Counts every global allocation so both strategies can be compared by
+// malloc traffic, not only by wall time.
+static size_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static constexpr int InstructionCount = 100000;
+// Constant values repeat in real code; both builders intern the same
+// bounded set so the constant pool is not what is being measured.
+static constexpr int ConstantCount = 64;
+static constexpr int Repetitions = 5;
+
+struct Result {
+    size_t allocations = 0;
+    size_t slabs = 0;
+    double millis = 0;
+};
+
+// Best of Repetitions runs; fn returns the arena slabs it allocated.
+template<typename Fn>
+static Result measure(Fn&& fn) {
+    Result best;
+    for (int run = 0; run < Repetitions; ++run) {
+        size_t before = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        size_t slabs = fn();
+        auto stop = std::chrono::steady_clock::now();
+        double millis = std::chrono::duration<double, std::milli>(stop - start).count();
+        if (run == 0 || millis < best.millis) {
+            best = {allocationCount - before, slabs, millis};
+        }
+    }
+    return best;
+}
+
+// Reproduces the old storage scheme: one heap object per instruction and
+// per Constant, each owned by a unique_ptr. Otherwise it builds the same IR
+// as buildWithArena: the instructions are linked into a block, get value
+// ids and read interned constants.
+static void buildWithHeap() {
+    Function func("bench");
+    Parameter* x = func.createParam("x");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    ConstantPool pool;
+    std::vector<std::unique_ptr<Constant>> constants;
+    std::vector<std::unique_ptr<Instruction>> instructions;
+    Value* last = x;
+    for (int i = 0; i < InstructionCount; ++i) {
+        int value = i % ConstantCount;
+        Constant* c = pool.lookup(value);
+        if (!c) {
+            constants.push_back(std::make_unique<Constant>(value, "c"));
+            c = constants.back().get();
+            func.assignId(c);
+            pool.insert(c);
+        }
+        instructions.push_back(std::make_unique<BinaryOp>(InstrKind::Add, last, c));
+        entry->getInstructions().push_back(instructions.back().get());
+        last = instructions.back().get();
+    }
+}
+
+static void buildWithArena(Function& func) {
+    Parameter* x = func.createParam("x");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    Value* last = x;
+    for (int i = 0; i < InstructionCount; ++i) {
+        Constant* c = func.createConstant(i % ConstantCount, "c");
+        last = &entry->createInstr<BinaryOp>(InstrKind::Add, last, c);
+    }
+}
+
+int main() {
+    Result heap = measure([] {
+        buildWithHeap();
+        return size_t(0);
+    });
+
+    Result arenaFresh = measure([] {
+        Function func("bench");
+        buildWithArena(func);
+        return func.getArena().getSlabCount();
+    });
+
+    // A long-lived function that is rebuilt: clear() destroys the previous
+    // body in bulk and the slabs are reused.
+    Function reused("bench");
+    buildWithArena(reused);
+    Result arenaReused = measure([&] {
+        size_t slabsBefore = reused.getArena().getSlabCount();
+        reused.clear();
+        buildWithArena(reused);
+        return reused.getArena().getSlabCount() - slabsBefore;
+    });
+
+    auto print = [](const char* label, const Result& result) {
+        std::cout << label << result.allocations << " allocations (" << result.slabs << " arena slabs), "
+                  << result.millis << " ms\n";
+    };
+    std::cout << "Building and destroying a " << InstructionCount << "-instruction function with "
+              << ConstantCount << " distinct constants, best of " << Repetitions << "\n";
+    print("  heap (unique_ptr per object): ", heap);
+    print("  arena (fresh):                ", arenaFresh);
+    print("  arena (after reset):          ", arenaReused);
+    return 0;
+}
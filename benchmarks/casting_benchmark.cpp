@@ -0,0 +1,99 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "liveness_analysis.h"
+#include "static_inliner.h"
+#include <chrono>
+#include <iostream>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+static constexpr int Blocks = 200;
+static constexpr int GroupsPerBlock = 100;
+static constexpr int Rounds = 20;
+
+// Straight-line blocks full of foldable and peephole-able arithmetic mixed
+// with checks and compares, each block starting with a phi.
+static void buildBody(Function& func) {
+    Parameter* x = func.createParam("x");
+    Parameter* arr = func.createParam("arr");
+    std::vector<BasicBlock*> blocks;
+    for (int b = 0; b < Blocks; ++b) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(b)));
+    }
+    Value* carried = x;
+    for (int b = 0; b < Blocks; ++b) {
+        BasicBlock* bb = blocks[b];
+        auto& phi = bb->createInstr<Phi>();
+        phi.addIncoming(b ? blocks[b - 1] : bb, carried);
+        Value* acc = &phi;
+        for (int g = 0; g < GroupsPerBlock; ++g) {
+            auto& folded = bb->createInstr<BinaryOp>(InstrKind::Mul, func.getConstant(g), func.getConstant(3));
+            auto& shifted = bb->createInstr<BinaryOp>(InstrKind::Mul, acc, func.getConstant(8));
+            auto& sum = bb->createInstr<BinaryOp>(InstrKind::Add, &shifted, &folded);
+            bb->createInstr<NullCheck>(arr);
+            bb->createInstr<BoundsCheck>(arr, &sum);
+            bb->createInstr<Cmp>(CmpOp::Lt, &sum, x);
+            acc = &bb->createInstr<BinaryOp>(InstrKind::And, &sum, func.getConstant(-1));
+        }
+        if (b + 1 < Blocks) {
+            bb->createInstr<Jump>(blocks[b + 1]);
+        } else {
+            bb->createInstr<Return>(acc);
+        }
+        carried = acc;
+    }
+}
+
+int main() {
+    double buildMs = 0, cfgMs = 0, foldMs = 0, peepholeMs = 0, livenessMs = 0, inlineMs = 0;
+    size_t instructions = 0;
+
+    for (int round = 0; round < Rounds; ++round) {
+        Program program;
+        Function& func = program.createFunction("body");
+        buildMs += millis([&] { buildBody(func); });
+        for (auto* bb : func.getBasicBlocks()) {
+            instructions += bb->getInstructions().size();
+        }
+
+        cfgMs += millis([&] { CFGAnalysis::buildCFG(func); });
+        livenessMs += millis([&] {
+            LivenessAnalysis liveness;
+            liveness.build(func);
+        });
+
+        // Inline the untouched body once per round, then optimize the callee.
+        Function& caller = program.createFunction("caller");
+        BasicBlock* entry = caller.createBasicBlock("entry");
+        auto& call = entry->createInstr<Call>(&func, std::vector<Value*>{caller.createParam("a"),
+                                                                         caller.createParam("b")});
+        entry->createInstr<Return>(&call);
+        StaticInlinerPass::Config config;
+        config.runLocalOptimizations = false;
+        config.maxCalleeInstructions = 1u << 20;
+        config.maxTotalInstructions = 1u << 20;
+        inlineMs += millis([&] { StaticInlinerPass::runOnFunction(caller, config); });
+
+        foldMs += millis([&] { ConstantFoldingPass::runOnFunction(func); });
+        peepholeMs += millis([&] { PeepholePass::runOnFunction(func); });
+    }
+
+    std::cout << "instructions per round: " << instructions / Rounds << ", rounds: " << Rounds << "\n";
+    std::cout << "build:            " << buildMs << " ms\n";
+    std::cout << "buildCFG:         " << cfgMs << " ms\n";
+    std::cout << "liveness:         " << livenessMs << " ms\n";
+    std::cout << "inline (clone):   " << inlineMs << " ms\n";
+    std::cout << "constant folding: " << foldMs << " ms\n";
+    std::cout << "peephole:         " << peepholeMs << " ms\n";
+    std::cout << "passes total:     " << cfgMs + livenessMs + inlineMs + foldMs + peepholeMs << " ms\n";
+    return 0;
+}
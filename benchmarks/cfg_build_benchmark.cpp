@@ -0,0 +1,92 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "block_name_index.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Chain of diamonds, four blocks each, wired by pointer.
+static void buildDiamonds(Function& func, int numBlocks) {
+    int diamonds = numBlocks / 4;
+    Parameter* cond = func.createParam("cond");
+    std::vector<BasicBlock*> blocks;
+    for (int i = 0; i < diamonds * 4; ++i) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(i)));
+    }
+    for (int d = 0; d < diamonds; ++d) {
+        BasicBlock* head = blocks[4 * d];
+        BasicBlock* left = blocks[4 * d + 1];
+        BasicBlock* right = blocks[4 * d + 2];
+        BasicBlock* join = blocks[4 * d + 3];
+        head->createInstr<CondJump>(cond, left, right);
+        left->createInstr<Jump>(join);
+        right->createInstr<Jump>(join);
+        if (d + 1 < diamonds) {
+            join->createInstr<Jump>(blocks[4 * d + 4]);
+        } else {
+            join->createInstr<Return>();
+        }
+    }
+}
+
+// What resolving every branch label cost when targets were names: one
+// linear scan over the blocks per label.
+static size_t resolveLabelsByScan(const Function& func) {
+    size_t found = 0;
+    for (BasicBlock* bb : func.getBasicBlocks()) {
+        for (BasicBlock* succ : bb->getSuccessors()) {
+            const std::string label = succ->getName();
+            for (BasicBlock* candidate : func.getBasicBlocks()) {
+                if (candidate->getName() == label) {
+                    ++found;
+                    break;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+static size_t resolveLabelsByIndex(const Function& func) {
+    BlockNameIndex index(func);
+    size_t found = 0;
+    for (BasicBlock* bb : func.getBasicBlocks()) {
+        for (BasicBlock* succ : bb->getSuccessors()) {
+            found += index.lookup(succ->getName()) != nullptr;
+        }
+    }
+    return found;
+}
+
+int main() {
+    for (int numBlocks : {5000, 10000, 50000}) {
+        Program program;
+        Function& func = program.createFunction("diamonds");
+        buildDiamonds(func, numBlocks);
+
+        double cfgMs = millis([&] { CFGAnalysis::buildCFG(func); });
+        size_t indexed = 0;
+        double indexMs = millis([&] { indexed = resolveLabelsByIndex(func); });
+
+        std::cout << numBlocks << " blocks: buildCFG " << cfgMs << " ms; "
+                  << indexed << " labels via BlockNameIndex " << indexMs << " ms";
+        // The quadratic scan is only run where it finishes in reasonable time.
+        if (numBlocks <= 10000) {
+            size_t scanned = 0;
+            double scanMs = millis([&] { scanned = resolveLabelsByScan(func); });
+            std::cout << ", " << scanned << " via linear scan " << scanMs << " ms";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "interpreter.h"
+#include "loop_check_hoisting.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Fills a body starting at the given block and returns the block that
+// should jump back to the loop header; acc is the running value.
+using BodyFn = std::function<BasicBlock*(BasicBlock* body, Value* iv, Value*& acc)>;
+
+// Emits "for (iv = 0; iv < bound; ++iv) body" after pred, which must not
+// have a terminator yet, testing in the header, and returns the exit block.
+static BasicBlock* emitLoop(Function& func, BasicBlock* pred, Value* bound, Value*& acc,
+                            const std::string& name, const BodyFn& fill) {
+    Constant* zero = func.getConstant(0);
+    Constant* one = func.getConstant(1);
+    BasicBlock* header = func.createBasicBlock(name + "_header");
+    BasicBlock* body = func.createBasicBlock(name + "_body");
+    BasicBlock* exit = func.createBasicBlock(name + "_exit");
+    pred->createInstr<Jump>(header);
+
+    auto& iv = header->createInstr<Phi>();
+    auto& accPhi = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &iv, bound);
+    header->createInstr<CondJump>(&more, body, exit);
+    Value* accIn = acc;
+    Value* bodyAcc = &accPhi;
+    BasicBlock* last = fill(body, &iv, bodyAcc);
+    auto& next = last->createInstr<BinaryOp>(InstrKind::Add, &iv, one);
+    last->createInstr<Jump>(header);
+
+    iv.addIncoming(pred, zero);
+    iv.addIncoming(last, &next);
+    accPhi.addIncoming(pred, accIn);
+    accPhi.addIncoming(last, bodyAcc);
+    acc = &accPhi;
+    return exit;
+}
+
+// An array access: a null check on the array and a bounds check on the
+// index, then some arithmetic standing in for the load.
+static BasicBlock* access(BasicBlock* body, Value* array, Value* index, Value*& acc) {
+    body->createInstr<NullCheck>(array);
+    body->createInstr<BoundsCheck>(array, index);
+    auto& t = body->createInstr<BinaryOp>(InstrKind::Add, array, index);
+    acc = &body->createInstr<BinaryOp>(InstrKind::Add, acc, &t);
+    return body;
+}
+
+struct Example {
+    const char* name;
+    std::function<void(Function&)> build;
+};
+
+static std::vector<Example> examples() {
+    return {
+        // for i < n: a[i]
+        {"one array", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* a = func.createParam("a");
+             func.createParam("b");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "loop", [&](BasicBlock* body, Value* i, Value*& x) {
+                 return access(body, a, i, x);
+             });
+             exit->createInstr<Return>(acc);
+         }},
+        // for i < n: a[i] + b[i]
+        {"two arrays", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* a = func.createParam("a");
+             Parameter* b = func.createParam("b");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "loop", [&](BasicBlock* body, Value* i, Value*& x) {
+                 return access(access(body, a, i, x), b, i, x);
+             });
+             exit->createInstr<Return>(acc);
+         }},
+        // for i < n: for j < n: a[j] + b[i]
+        {"two-deep nest", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* a = func.createParam("a");
+             Parameter* b = func.createParam("b");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "outer", [&](BasicBlock* body, Value* i, Value*& x) {
+                 BasicBlock* innerExit = emitLoop(func, body, n, x, "inner", [&](BasicBlock* ib, Value* j, Value*& y) {
+                     return access(access(ib, a, j, y), b, i, y);
+                 });
+                 return innerExit;
+             });
+             exit->createInstr<Return>(acc);
+         }},
+    };
+}
+
+int main() {
+    const std::vector<int> args = {50, 64, 64};
+    std::cout << "Dynamic checks and instructions, n = " << args[0] << "\n";
+    for (const Example& example : examples()) {
+        Program program;
+        Function& func = program.createFunction(example.name);
+        example.build(func);
+        CFGAnalysis::buildCFG(func);
+
+        Interpreter::Result before = Interpreter::run(func, args);
+        LoopCheckHoistingPass::runOnFunction(func);
+        Interpreter::Result after = Interpreter::run(func, args);
+
+        std::cout << "  " << example.name << ": checks " << before.checks << " -> " << after.checks
+                  << ", instructions " << before.instructions << " -> " << after.instructions
+                  << (before.value == after.value && before.status == after.status ? "" : "  RESULT MISMATCH")
+                  << "\n";
+    }
+
+    for (int copies : {1000, 10000}) {
+        Program program;
+        Function& func = program.createFunction("many");
+        Parameter* n = func.createParam("n");
+        Parameter* a = func.createParam("a");
+        Parameter* b = func.createParam("b");
+        BasicBlock* current = func.createBasicBlock("entry");
+        Value* acc = func.getConstant(0);
+        for (int c = 0; c < copies; ++c) {
+            std::string name = "n" + std::to_string(c);
+            current = emitLoop(func, current, n, acc, name, [&](BasicBlock* body, Value* i, Value*& x) {
+                return emitLoop(func, body, n, x, name + "_inner", [&](BasicBlock* ib, Value* j, Value*& y) {
+                    return access(access(ib, a, j, y), b, i, y);
+                });
+            });
+        }
+        current->createInstr<Return>(acc);
+        CFGAnalysis::buildCFG(func);
+
+        double ms = millis([&] { LoopCheckHoistingPass::runOnFunction(func); });
+        std::cout << copies << " nests, " << func.getBasicBlocks().size() << " blocks: check hoisting " << ms
+                  << " ms\n";
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "control_flow.h"
+#include "static_inliner.h"
+#include <chrono>
+#include <iostream>
+
+static constexpr int Calls = 10000;
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Inlines one callee Calls times into a single caller. Each inline moves
+// the calls still to come into the continuation block, so the reported time
+// grows faster than the number of calls; the constant counts do not.
+int main() {
+    Program program;
+    Function& callee = program.createFunction("poly");
+    Parameter* x = callee.createParam("x");
+    BasicBlock* calleeEntry = callee.createBasicBlock("entry");
+    Value* acc = x;
+    for (int c = 1; c <= 8; ++c) {
+        auto& mul = calleeEntry->createInstr<BinaryOp>(InstrKind::Mul, acc, callee.getConstant(c));
+        acc = &calleeEntry->createInstr<BinaryOp>(InstrKind::Add, &mul, callee.getConstant(c + 100));
+    }
+    calleeEntry->createInstr<Return>(acc);
+    const size_t calleeConstants = callee.getConstants().size();
+
+    Function& caller = program.createFunction("caller");
+    Value* value = caller.createParam("y");
+    BasicBlock* entry = caller.createBasicBlock("entry");
+    for (int i = 0; i < Calls; ++i) {
+        value = &entry->createInstr<Call>(&callee, std::vector<Value*>{value});
+    }
+    entry->createInstr<Return>(value);
+
+    StaticInlinerPass::Config config;
+    config.runLocalOptimizations = false;
+    config.maxTotalInstructions = 1u << 20;
+
+    double inlineMs = millis([&] { StaticInlinerPass::runOnFunction(caller, config); });
+
+    const size_t inlines = Calls;
+    // Copying every callee constant on every inline, as before pooling.
+    const size_t copiedConstants = calleeConstants * (inlines + 1);
+
+    std::cout << "inlines: " << inlines << " (" << inlineMs << " ms)\n";
+    std::cout << "callee constants: " << calleeConstants << "\n";
+    std::cout << "pooled constants in program: " << program.getNumConstants()
+              << ", pool memory: " << program.getConstantPoolMemoryUsage() << " bytes\n";
+    std::cout << "per-inline copies would be: " << copiedConstants << " constants, "
+              << copiedConstants * sizeof(Constant) << " bytes\n";
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "dominated_checks.h"
+#include "linear_order.h"
+#include "liveness_analysis.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// A chain of counted loops, three blocks each:
+//   pre_i:    jump header_i
+//   header_i: phi, nullcheck obj, condjump body_i / pre_{i+1}
+//   body_i:   nullcheck obj, add, jump header_i
+static void buildLoopChain(Function& func, int numLoops) {
+    Parameter* obj = func.createParam("obj");
+    Parameter* cond = func.createParam("cond");
+    Constant* one = func.createConstant(1, "1");
+
+    std::vector<BasicBlock*> pre, header, body;
+    for (int i = 0; i < numLoops; ++i) {
+        std::string n = std::to_string(i);
+        pre.push_back(func.createBasicBlock("pre" + n));
+        header.push_back(func.createBasicBlock("header" + n));
+        body.push_back(func.createBasicBlock("body" + n));
+    }
+    BasicBlock* exit = func.createBasicBlock("exit");
+
+    Value* carried = obj;
+    for (int i = 0; i < numLoops; ++i) {
+        BasicBlock* next = i + 1 < numLoops ? pre[i + 1] : exit;
+        pre[i]->createInstr<Jump>(header[i]);
+
+        auto& phi = header[i]->createInstr<Phi>();
+        header[i]->createInstr<NullCheck>(obj);
+        header[i]->createInstr<CondJump>(cond, body[i], next);
+
+        body[i]->createInstr<NullCheck>(obj);
+        auto& add = body[i]->createInstr<BinaryOp>(InstrKind::Add, &phi, one);
+        body[i]->createInstr<Jump>(header[i]);
+
+        phi.addIncoming(pre[i], carried);
+        phi.addIncoming(body[i], &add);
+        carried = &phi;
+    }
+    exit->createInstr<Return>(carried);
+}
+
+int main(int argc, char** argv) {
+    int numBlocks = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int numLoops = numBlocks / 3;
+
+    Program program;
+    Function& func = program.createFunction("chain");
+    buildLoopChain(func, numLoops);
+
+    double cfgMs = millis([&] { CFGAnalysis::buildCFG(func); });
+
+    size_t domCount = 0;
+    double domMs = millis([&] { domCount = CFGAnalysis::computeDominators(func).size(); });
+
+    size_t orderSize = 0;
+    double orderMs = millis([&] { orderSize = LinearOrder::compute(func).size(); });
+
+    LivenessAnalysis liveness;
+    double livenessMs = millis([&] { liveness.build(func); });
+
+    bool changed = false;
+    double checksMs = millis([&] { changed = DominatedCheckEliminationPass::runOnFunction(func); });
+
+    std::cout << "blocks: " << func.getBasicBlocks().size()
+              << ", values: " << func.getNumValueIds() << "\n";
+    std::cout << "buildCFG:            " << cfgMs << " ms\n";
+    std::cout << "dominators:          " << domMs << " ms (" << domCount << " entries)\n";
+    std::cout << "linear order:        " << orderMs << " ms (" << orderSize << " blocks)\n";
+    std::cout << "liveness:            " << livenessMs << " ms\n";
+    std::cout << "check elimination:   " << checksMs << " ms (changed: " << changed << ")\n";
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "program.h"
+#include "cfg.h"
+#include "control_dependence.h"
+#include "control_flow.h"
+#include "dominator_tree.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Alternating diamonds and single-block loops, chained one after another.
+static std::vector<BasicBlock*> buildStructuredCFG(Function& func, int numBlocks) {
+    Parameter* cond = func.createParam("cond");
+    std::vector<BasicBlock*> blocks;
+    for (int i = 0; i < numBlocks; ++i) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(i)));
+    }
+    int i = 0;
+    while (i + 4 < numBlocks) {
+        if ((i / 4) % 2 == 0) {
+            blocks[i]->createInstr<CondJump>(cond, blocks[i + 1], blocks[i + 2]);
+            blocks[i + 1]->createInstr<Jump>(blocks[i + 3]);
+            blocks[i + 2]->createInstr<Jump>(blocks[i + 3]);
+            blocks[i + 3]->createInstr<Jump>(blocks[i + 4]);
+        } else {
+            blocks[i]->createInstr<Jump>(blocks[i + 1]);
+            blocks[i + 1]->createInstr<CondJump>(cond, blocks[i + 2], blocks[i + 3]);
+            blocks[i + 2]->createInstr<Jump>(blocks[i + 1]);
+            blocks[i + 3]->createInstr<Jump>(blocks[i + 4]);
+        }
+        i += 4;
+    }
+    for (; i + 1 < numBlocks; ++i) {
+        blocks[i]->createInstr<Jump>(blocks[i + 1]);
+    }
+    blocks[numBlocks - 1]->createInstr<Return>();
+    return blocks;
+}
+
+// The previous formulation: every block starts with the full set and sets
+// are intersected until nothing changes.
+static BlockMap<BlockSet> setBasedDominators(Function& function) {
+    auto& basicBlocks = function.getBasicBlocks();
+    const size_t numBlocks = function.getNumBlockIds();
+    BlockMap<BlockSet> dominators(numBlocks);
+    BasicBlock* entry = basicBlocks[0];
+    for (auto& bb : basicBlocks) {
+        dominators[bb] = BlockSet(numBlocks, bb != entry);
+    }
+    dominators[entry].insert(entry);
+
+    bool changed;
+    do {
+        changed = false;
+        for (auto& bb : basicBlocks) {
+            auto& preds = bb->getPredecessors();
+            if (bb == entry || preds.empty()) continue;
+            BlockSet newDoms = dominators[preds[0]];
+            for (auto pred : preds) {
+                newDoms.intersectWith(dominators[pred]);
+            }
+            newDoms.insert(bb);
+            if (newDoms != dominators[bb]) {
+                dominators[bb] = std::move(newDoms);
+                changed = true;
+            }
+        }
+    } while (changed);
+    return dominators;
+}
+
+int main() {
+    for (int numBlocks : {1000, 10000, 100000}) {
+        Program program;
+        Function& func = program.createFunction("structured");
+        std::vector<BasicBlock*> blocks = buildStructuredCFG(func, numBlocks);
+        CFGAnalysis::buildCFG(func);
+
+        DominatorTree domTree;
+        double treeMs = millis([&] { domTree.recalculate(func); });
+
+        // Fixed stride over block pairs so the queries touch the whole tree.
+        const size_t numQueries = 1000000;
+        size_t dominated = 0;
+        double queryMs = millis([&] {
+            size_t a = 0, b = 0;
+            for (size_t q = 0; q < numQueries; ++q) {
+                a = (a + 7919) % blocks.size();
+                b = (b + 104729) % blocks.size();
+                dominated += domTree.dominates(blocks[a], blocks[b]);
+            }
+        });
+
+        PostDominatorTree postDomTree;
+        double postTreeMs = millis([&] { postDomTree.recalculate(func); });
+        ControlDependenceGraph cdg;
+        double cdgMs = millis([&] { cdg.recalculate(func, postDomTree); });
+
+        std::cout << numBlocks << " blocks: DominatorTree " << treeMs << " ms, "
+                  << numQueries << " dominates() " << queryMs << " ms (" << dominated << " true), "
+                  << "PostDominatorTree " << postTreeMs << " ms, control dependence " << cdgMs << " ms";
+        // The set formulation needs n^2 bits, so it is only run on the smaller CFGs.
+        if (numBlocks <= 10000) {
+            size_t setBytes = 0;
+            double setMs = millis([&] {
+                auto sets = setBasedDominators(func);
+                setBytes = sets.size() * (numBlocks + 7) / 8;
+            });
+            std::cout << "; set-based " << setMs << " ms, ~" << setBytes / 1024 << " KiB";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "cfg.h"
+#include "checks.h"
+#include "control_flow.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+static size_t heapAllocations = 0;
+static size_t heapBytes = 0;
+
+static void* countedAlloc(size_t size) {
+    ++heapAllocations;
+    heapBytes += size;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// Every form of new and delete is replaced, so each block is freed by the
+// allocator it came from.
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+struct HeapSnapshot {
+    size_t allocations = heapAllocations;
+    size_t bytes = heapBytes;
+};
+
+static constexpr int Diamonds = 5000;
+
+// Chain of diamonds: head -> (left | right) -> join -> next head. Each block
+// holds a few typical instructions; joins start with a phi.
+int main() {
+    Program program;
+    Function& func = program.createFunction("diamonds");
+    Parameter* c = func.createParam("c");
+    Parameter* x = func.createParam("x");
+    Parameter* arr = func.createParam("arr");
+    Constant* one = func.createConstant(1, "1");
+    Constant* two = func.createConstant(2, "2");
+
+    std::vector<BasicBlock*> heads, lefts, rights, joins;
+    for (int i = 0; i < Diamonds; ++i) {
+        std::string n = std::to_string(i);
+        heads.push_back(func.createBasicBlock("head" + n));
+        lefts.push_back(func.createBasicBlock("left" + n));
+        rights.push_back(func.createBasicBlock("right" + n));
+        joins.push_back(func.createBasicBlock("join" + n));
+    }
+
+    HeapSnapshot beforeInstrs;
+    size_t arenaBefore = func.getArena().getBytesReserved();
+    size_t arenaUsedBefore = func.getArena().getBytesAllocated();
+    size_t slabsBefore = func.getArena().getSlabCount();
+    size_t instructions = 0;
+    Value* carried = x;
+    for (int i = 0; i < Diamonds; ++i) {
+        auto& sum = heads[i]->createInstr<BinaryOp>(InstrKind::Add, carried, one);
+        heads[i]->createInstr<NullCheck>(arr);
+        heads[i]->createInstr<CondJump>(c, lefts[i], rights[i]);
+        auto& l = lefts[i]->createInstr<BinaryOp>(InstrKind::Mul, &sum, two);
+        lefts[i]->createInstr<Jump>(joins[i]);
+        auto& r = rights[i]->createInstr<BinaryOp>(InstrKind::Sub, &sum, one);
+        rights[i]->createInstr<Jump>(joins[i]);
+        auto& phi = joins[i]->createInstr<Phi>();
+        phi.addIncoming(lefts[i], &l);
+        phi.addIncoming(rights[i], &r);
+        auto& cmp = joins[i]->createInstr<Cmp>(CmpOp::Lt, &phi, x);
+        (void)cmp;
+        if (i + 1 < Diamonds) {
+            joins[i]->createInstr<Jump>(heads[i + 1]);
+        } else {
+            joins[i]->createInstr<Return>(&phi);
+        }
+        carried = &phi;
+        instructions += 10;
+    }
+    HeapSnapshot afterInstrs;
+    // Slabs are heap allocations too; report them separately.
+    size_t slabBytes = func.getArena().getBytesReserved() - arenaBefore;
+    size_t arenaUsed = func.getArena().getBytesAllocated() - arenaUsedBefore;
+    size_t operandHeapBytes = afterInstrs.bytes - beforeInstrs.bytes - slabBytes;
+    size_t operandHeapAllocs = afterInstrs.allocations - beforeInstrs.allocations -
+                               (func.getArena().getSlabCount() - slabsBefore);
+
+    HeapSnapshot beforeCFG;
+    CFGAnalysis::buildCFG(func);
+    HeapSnapshot afterCFG;
+    size_t blocks = func.getBasicBlocks().size();
+
+    std::printf("sizeof: Use %zu, Instruction %zu, BinaryOp %zu, Phi %zu, Jump %zu, CondJump %zu, BasicBlock %zu\n",
+                sizeof(Use), sizeof(Instruction), sizeof(BinaryOp), sizeof(Phi), sizeof(Jump),
+                sizeof(CondJump), sizeof(BasicBlock));
+    std::printf("instructions: %zu, blocks: %zu\n", instructions, blocks);
+    std::printf("per instruction: %.1f arena bytes, %.2f heap allocations, %.1f heap bytes\n",
+                double(arenaUsed) / instructions, double(operandHeapAllocs) / instructions,
+                double(operandHeapBytes) / instructions);
+    std::printf("per block (CFG edges): %.2f heap allocations, %.1f heap bytes\n",
+                double(afterCFG.allocations - beforeCFG.allocations) / blocks,
+                double(afterCFG.bytes - beforeCFG.bytes) / blocks);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include "dominator_tree.h"
+#include "static_inliner.h"
+#include <chrono>
+#include <iostream>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+static constexpr int CallSites = 1000;
+static constexpr int InstructionsPerSite = 20;
+
+// abs(x) with a branch, so every inline adds a small diamond.
+static Function& buildCallee(Program& program) {
+    Function& callee = program.createFunction("abs");
+    Parameter* x = callee.createParam("x");
+    BasicBlock* entry = callee.createBasicBlock("entry");
+    BasicBlock* negative = callee.createBasicBlock("negative");
+    BasicBlock* positive = callee.createBasicBlock("positive");
+    auto& isNegative = entry->createInstr<Cmp>(CmpOp::Lt, x, callee.getConstant(0));
+    entry->createInstr<CondJump>(&isNegative, negative, positive);
+    auto& negated = negative->createInstr<BinaryOp>(InstrKind::Sub, callee.getConstant(0), x);
+    negative->createInstr<Return>(&negated);
+    positive->createInstr<Return>(x);
+    return callee;
+}
+
+// One block per call site, chained through a loop every eight blocks, with
+// arithmetic around each call so the caller holds ~20k instructions.
+static void buildCaller(Function& caller, Function& callee) {
+    Parameter* x = caller.createParam("x");
+    std::vector<BasicBlock*> blocks;
+    for (int b = 0; b < CallSites; ++b) {
+        blocks.push_back(caller.createBasicBlock("bb" + std::to_string(b)));
+    }
+    BasicBlock* exit = caller.createBasicBlock("exit");
+    Value* acc = x;
+    for (int b = 0; b < CallSites; ++b) {
+        BasicBlock* bb = blocks[b];
+        for (int i = 0; i < InstructionsPerSite / 2 - 1; ++i) {
+            acc = &bb->createInstr<BinaryOp>(InstrKind::Add, acc, caller.getConstant(i));
+        }
+        acc = &bb->createInstr<Call>(&callee, std::vector<Value*>{acc});
+        for (int i = 0; i < InstructionsPerSite / 2 - 1; ++i) {
+            acc = &bb->createInstr<BinaryOp>(InstrKind::Mul, acc, caller.getConstant(3));
+        }
+        BasicBlock* next = b + 1 < CallSites ? blocks[b + 1] : exit;
+        if (b % 8 == 7) {
+            auto& more = bb->createInstr<Cmp>(CmpOp::Lt, acc, x);
+            bb->createInstr<CondJump>(&more, blocks[b - 7], next);
+        } else {
+            bb->createInstr<Jump>(next);
+        }
+    }
+    exit->createInstr<Return>(acc);
+}
+
+static size_t countInstructions(const Function& function) {
+    size_t count = 0;
+    for (const auto& bb : function.getBasicBlocks()) {
+        count += bb->getInstructions().size();
+    }
+    return count;
+}
+
+int main() {
+    for (bool localOptimizations : {false, true}) {
+        Program program;
+        Function& callee = buildCallee(program);
+        Function& caller = program.createFunction("caller");
+        buildCaller(caller, callee);
+        const size_t before = countInstructions(caller);
+
+        StaticInlinerPass::Config config;
+        config.maxTotalInstructions = 1u << 20;
+        config.runLocalOptimizations = localOptimizations;
+        double inlineMs = millis([&] { StaticInlinerPass::runOnFunction(caller, config); });
+
+        // What recomputing the CFG and dominators after every call site
+        // costs on the final function, for comparison.
+        double rebuildMs = millis([&] {
+            for (int i = 0; i < CallSites; ++i) {
+                CFGAnalysis::removeUnreachableBlocks(caller);
+                DominatorTree domTree(caller);
+            }
+        });
+
+        std::cout << (localOptimizations ? "with" : "without") << " local optimizations: " << before
+                  << " -> " << countInstructions(caller) << " instructions, " << caller.getBasicBlocks().size()
+                  << " blocks; " << CallSites << " inlines " << inlineMs << " ms; rebuilding CFG and dominators "
+                  << CallSites << " times " << rebuildMs << " ms\n";
+    }
+    return 0;
+}
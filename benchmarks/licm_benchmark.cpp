@@ -0,0 +1,182 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include "interpreter.h"
+#include "loop_invariant_code_motion.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Fills a body starting at the given block and returns the block that
+// should jump back to the loop header; acc is the running value.
+using BodyFn = std::function<BasicBlock*(BasicBlock* body, Value* iv, Value*& acc)>;
+
+// Emits "for (iv = 0; iv < bound; ++iv) body" after pred, which must not
+// have a terminator yet, and returns the exit block. pred jumps straight
+// to the header, so LICM has to create the preheaders itself.
+static BasicBlock* emitLoop(Function& func, BasicBlock* pred, Value* bound, Value*& acc,
+                            const std::string& name, const BodyFn& fill) {
+    Constant* zero = func.getConstant(0);
+    Constant* one = func.getConstant(1);
+    BasicBlock* header = func.createBasicBlock(name + "_header");
+    BasicBlock* body = func.createBasicBlock(name + "_body");
+    BasicBlock* exit = func.createBasicBlock(name + "_exit");
+    auto& cond = pred->createInstr<Cmp>(CmpOp::Gt, bound, zero);
+    pred->createInstr<CondJump>(&cond, header, exit);
+
+    auto& iv = header->createInstr<Phi>();
+    auto& accPhi = header->createInstr<Phi>();
+    Value* accIn = acc;
+    Value* bodyAcc = &accPhi;
+    BasicBlock* last = fill(body, &iv, bodyAcc);
+    auto& next = last->createInstr<BinaryOp>(InstrKind::Add, &iv, one);
+    auto& more = last->createInstr<Cmp>(CmpOp::Lt, &next, bound);
+    last->createInstr<CondJump>(&more, header, exit);
+    header->createInstr<Jump>(body);
+
+    iv.addIncoming(pred, zero);
+    iv.addIncoming(last, &next);
+    accPhi.addIncoming(pred, accIn);
+    accPhi.addIncoming(last, bodyAcc);
+    auto& accOut = exit->createInstr<Phi>();
+    accOut.addIncoming(pred, accIn);
+    accOut.addIncoming(last, bodyAcc);
+    acc = &accOut;
+    return exit;
+}
+
+// The per-iteration work: arithmetic on the parameters and a constant,
+// which is invariant, mixed with the induction variable, which is not.
+static BasicBlock* innerWork(Function& func, Parameter* p, Parameter* q, BasicBlock* body,
+                             Value* iv, Value*& acc) {
+    auto& pq = body->createInstr<BinaryOp>(InstrKind::Mul, p, q);
+    auto& k = body->createInstr<ConstantInstruction>(func.getConstant(5));
+    auto& scaled = body->createInstr<BinaryOp>(InstrKind::Add, &pq, &k);
+    auto& mask = body->createInstr<BinaryOp>(InstrKind::And, &scaled, q);
+    auto& t = body->createInstr<BinaryOp>(InstrKind::Add, &mask, iv);
+    acc = &body->createInstr<BinaryOp>(InstrKind::Add, acc, &t);
+    return body;
+}
+
+struct Example {
+    const char* name;
+    std::function<void(Function&)> build;
+};
+
+static std::vector<Example> examples() {
+    return {
+        // Like test 2 of the loop examples: one loop.
+        {"single loop", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* p = func.createParam("p");
+             Parameter* q = func.createParam("q");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "loop", [&](BasicBlock* body, Value* iv, Value*& a) {
+                 return innerWork(func, p, q, body, iv, a);
+             });
+             exit->createInstr<Return>(acc);
+         }},
+        // Like test 3: a loop nested in another one.
+        {"two-deep nest", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* p = func.createParam("p");
+             Parameter* q = func.createParam("q");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "outer", [&](BasicBlock* body, Value*, Value*& a) {
+                 return emitLoop(func, body, n, a, "inner", [&](BasicBlock* innerBody, Value* j, Value*& b) {
+                     return innerWork(func, p, q, innerBody, j, b);
+                 });
+             });
+             exit->createInstr<Return>(acc);
+         }},
+        // Like test 5: an outer loop around two loops one after the other.
+        {"siblings in a loop", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* p = func.createParam("p");
+             Parameter* q = func.createParam("q");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "outer", [&](BasicBlock* body, Value*, Value*& a) {
+                 BasicBlock* mid = emitLoop(func, body, n, a, "first", [&](BasicBlock* b1, Value* j, Value*& x) {
+                     return innerWork(func, p, q, b1, j, x);
+                 });
+                 return emitLoop(func, mid, n, a, "second", [&](BasicBlock* b2, Value* j, Value*& x) {
+                     return innerWork(func, q, p, b2, j, x);
+                 });
+             });
+             exit->createInstr<Return>(acc);
+         }},
+        // Three levels deep.
+        {"three-deep nest", [](Function& func) {
+             Parameter* n = func.createParam("n");
+             Parameter* p = func.createParam("p");
+             Parameter* q = func.createParam("q");
+             BasicBlock* entry = func.createBasicBlock("entry");
+             Value* acc = func.getConstant(0);
+             BasicBlock* exit = emitLoop(func, entry, n, acc, "l1", [&](BasicBlock* b1, Value*, Value*& a1) {
+                 return emitLoop(func, b1, n, a1, "l2", [&](BasicBlock* b2, Value*, Value*& a2) {
+                     return emitLoop(func, b2, n, a2, "l3", [&](BasicBlock* b3, Value* k, Value*& a3) {
+                         return innerWork(func, p, q, b3, k, a3);
+                     });
+                 });
+             });
+             exit->createInstr<Return>(acc);
+         }},
+    };
+}
+
+int main() {
+    const std::vector<int> args = {20, 7, 12};
+    std::cout << "Dynamic instructions, n = " << args[0] << "\n";
+    for (const Example& example : examples()) {
+        Program program;
+        Function& func = program.createFunction(example.name);
+        example.build(func);
+        CFGAnalysis::buildCFG(func);
+
+        Interpreter::Result before = Interpreter::run(func, args);
+        LoopInvariantCodeMotionPass::runOnFunction(func);
+        Interpreter::Result after = Interpreter::run(func, args);
+
+        std::cout << "  " << example.name << ": " << before.instructions << " -> " << after.instructions
+                  << " (" << 100.0 * after.instructions / before.instructions << "%)"
+                  << (before.value == after.value ? "" : "  RESULT MISMATCH") << "\n";
+    }
+
+    for (int copies : {1000, 10000}) {
+        Program program;
+        Function& func = program.createFunction("many");
+        Parameter* n = func.createParam("n");
+        Parameter* p = func.createParam("p");
+        Parameter* q = func.createParam("q");
+        BasicBlock* current = func.createBasicBlock("entry");
+        Value* acc = func.getConstant(0);
+        for (int c = 0; c < copies; ++c) {
+            std::string name = "n" + std::to_string(c);
+            current = emitLoop(func, current, n, acc, name, [&](BasicBlock* body, Value*, Value*& a) {
+                return emitLoop(func, body, n, a, name + "_inner", [&](BasicBlock* innerBody, Value* j, Value*& b) {
+                    return innerWork(func, p, q, innerBody, j, b);
+                });
+            });
+        }
+        current->createInstr<Return>(acc);
+        CFGAnalysis::buildCFG(func);
+
+        double ms = millis([&] { LoopInvariantCodeMotionPass::runOnFunction(func); });
+        std::cout << copies << " nests, " << func.getBasicBlocks().size() << " blocks: LICM " << ms << " ms\n";
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include "liveness_analysis.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// A chain of loops, each nested two deep, with a phi per loop header and a
+// few values per body that stay live until the end of the function.
+static void buildLoopNest(Function& func, int numLoops, int valuesPerBody) {
+    Parameter* cond = func.createParam("cond");
+    Parameter* seed = func.createParam("seed");
+    Constant* one = func.createConstant(1, "1");
+    std::vector<Value*> longLived;
+
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* current = entry;
+    Value* carried = seed;
+    for (int l = 0; l < numLoops; ++l) {
+        std::string suffix = std::to_string(l);
+        BasicBlock* outer = func.createBasicBlock("outer" + suffix);
+        BasicBlock* inner = func.createBasicBlock("inner" + suffix);
+        BasicBlock* body = func.createBasicBlock("body" + suffix);
+        BasicBlock* latch = func.createBasicBlock("latch" + suffix);
+        BasicBlock* next = func.createBasicBlock("next" + suffix);
+        current->createInstr<Jump>(outer);
+
+        Phi& outerPhi = outer->createInstr<Phi>();
+        outer->createInstr<Jump>(inner);
+        Phi& innerPhi = inner->createInstr<Phi>();
+        inner->createInstr<CondJump>(cond, body, latch);
+
+        Value* acc = &innerPhi;
+        for (int v = 0; v < valuesPerBody; ++v) {
+            acc = &body->createInstr<BinaryOp>(InstrKind::Add, acc, one);
+        }
+        body->createInstr<Jump>(inner);
+        auto& outerNext = latch->createInstr<BinaryOp>(InstrKind::Mul, &innerPhi, one);
+        latch->createInstr<CondJump>(cond, outer, next);
+
+        outerPhi.addIncoming(current, carried);
+        outerPhi.addIncoming(latch, &outerNext);
+        innerPhi.addIncoming(outer, &outerPhi);
+        innerPhi.addIncoming(body, acc);
+
+        longLived.push_back(&outerNext);
+        carried = &outerNext;
+        current = next;
+    }
+    Value* sum = carried;
+    for (Value* v : longLived) {
+        sum = &current->createInstr<BinaryOp>(InstrKind::Add, sum, v);
+    }
+    current->createInstr<Return>(sum);
+}
+
+// A chain of checks, each leaving the function on failure, over a few
+// values read after every check: they are dead in every exit block, so
+// each of their intervals has a hole per check.
+static void buildCheckChain(Function& func, int numChecks, int numValues) {
+    Parameter* cond = func.createParam("cond");
+    std::vector<Value*> values;
+    for (int v = 0; v < numValues; ++v) {
+        values.push_back(func.createParam("p" + std::to_string(v)));
+    }
+
+    BasicBlock* current = func.createBasicBlock("entry");
+    Value* acc = cond;
+    for (int c = 0; c < numChecks; ++c) {
+        std::string suffix = std::to_string(c);
+        BasicBlock* pass = func.createBasicBlock("pass" + suffix);
+        BasicBlock* fail = func.createBasicBlock("fail" + suffix);
+        current->createInstr<CondJump>(acc, pass, fail);
+        fail->createInstr<Return>(acc);
+        for (Value* v : values) {
+            acc = &pass->createInstr<BinaryOp>(InstrKind::Add, acc, v);
+        }
+        current = pass;
+    }
+    current->createInstr<Return>(acc);
+}
+
+static size_t countInstructions(Function& func) {
+    size_t count = 0;
+    for (BasicBlock* bb : func.getBasicBlocks()) {
+        count += bb->getInstructions().size();
+    }
+    return count;
+}
+
+static void report(const std::string& shape, Function& func) {
+    CFGAnalysis::buildCFG(func);
+
+    LivenessAnalysis liveness;
+    double ms = millis([&] { liveness.build(func); });
+
+    size_t ranges = 0;
+    for (Value* param : func.getParams()) {
+        ranges += liveness.getLiveRanges(param).size();
+    }
+    for (BasicBlock* bb : func.getBasicBlocks()) {
+        for (auto& instr : bb->getInstructions()) {
+            ranges += liveness.getLiveRanges(&instr).size();
+        }
+    }
+    const DataflowStats& stats = liveness.getDataflowStats();
+    std::cout << shape << ", " << func.getBasicBlocks().size() << " blocks, " << countInstructions(func)
+              << " instructions: " << ms << " ms, " << ranges << " ranges, " << stats.sweeps << " sweeps, "
+              << stats.blockVisits << " block visits, " << stats.wordOps << " word ops\n";
+}
+
+int main() {
+    for (int numLoops : {100, 1000, 4000}) {
+        Program program;
+        Function& func = program.createFunction("nest");
+        buildLoopNest(func, numLoops, 8);
+        report(std::to_string(numLoops) + " loops", func);
+    }
+    // About 50k instructions each.
+    for (int numValues : {1, 4, 16}) {
+        Program program;
+        Function& func = program.createFunction("checks");
+        int numChecks = 50000 / (numValues + 2);
+        buildCheckChain(func, numChecks, numValues);
+        report(std::to_string(numChecks) + " checks over " + std::to_string(numValues) + " values", func);
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "interpreter.h"
+#include "loop_unrolling.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+static size_t countInstructions(const Function& func) {
+    size_t count = 0;
+    for (const auto& bb : func.getBasicBlocks()) {
+        count += bb->getInstructions().size();
+    }
+    return count;
+}
+
+// Emits "for (iv = 0; iv < bound; ++iv) acc = acc + iv * 3 + a[iv & 7]"
+// after pred, which must not have a terminator yet, and returns the exit
+// block.
+static BasicBlock* emitLoop(Function& func, BasicBlock* pred, Value* bound, Value* array, Value*& acc,
+                            const std::string& name) {
+    BasicBlock* header = func.createBasicBlock(name + "_header");
+    BasicBlock* body = func.createBasicBlock(name + "_body");
+    BasicBlock* exit = func.createBasicBlock(name + "_exit");
+    pred->createInstr<Jump>(header);
+
+    auto& iv = header->createInstr<Phi>();
+    auto& accPhi = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &iv, bound);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& index = body->createInstr<BinaryOp>(InstrKind::And, &iv, func.getConstant(7));
+    body->createInstr<BoundsCheck>(array, &index);
+    auto& scaled = body->createInstr<BinaryOp>(InstrKind::Mul, &iv, func.getConstant(3));
+    auto& partial = body->createInstr<BinaryOp>(InstrKind::Add, &accPhi, &scaled);
+    auto& nextAcc = body->createInstr<BinaryOp>(InstrKind::Add, &partial, &index);
+    auto& next = body->createInstr<BinaryOp>(InstrKind::Add, &iv, func.getConstant(1));
+    body->createInstr<Jump>(header);
+
+    iv.addIncoming(pred, func.getConstant(0));
+    iv.addIncoming(body, &next);
+    accPhi.addIncoming(pred, acc);
+    accPhi.addIncoming(body, &nextAcc);
+    acc = &accPhi;
+    return exit;
+}
+
+// A loop of trip count bound, or n when bound is 0, nested copies deep in
+// loops of n iterations.
+static void buildNest(Function& func, int bound, int depth) {
+    Parameter* n = func.createParam("n");
+    Parameter* a = func.createParam("a");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    Value* acc = func.getConstant(0);
+    Value* innerBound = bound ? static_cast<Value*>(func.getConstant(bound)) : n;
+
+    std::function<BasicBlock*(BasicBlock*, int)> emit = [&](BasicBlock* pred, int level) -> BasicBlock* {
+        if (level == depth) {
+            return emitLoop(func, pred, innerBound, a, acc, "inner");
+        }
+        // An outer loop whose body is the next level down.
+        BasicBlock* header = func.createBasicBlock("outer" + std::to_string(level) + "_header");
+        BasicBlock* body = func.createBasicBlock("outer" + std::to_string(level) + "_body");
+        BasicBlock* exit = func.createBasicBlock("outer" + std::to_string(level) + "_exit");
+        pred->createInstr<Jump>(header);
+        auto& iv = header->createInstr<Phi>();
+        auto& accPhi = header->createInstr<Phi>();
+        auto& more = header->createInstr<Cmp>(CmpOp::Lt, &iv, n);
+        header->createInstr<CondJump>(&more, body, exit);
+        Value* accIn = acc;
+        acc = &accPhi;
+        BasicBlock* last = emit(body, level + 1);
+        auto& next = last->createInstr<BinaryOp>(InstrKind::Add, &iv, func.getConstant(1));
+        last->createInstr<Jump>(header);
+        iv.addIncoming(pred, func.getConstant(0));
+        iv.addIncoming(last, &next);
+        accPhi.addIncoming(pred, accIn);
+        accPhi.addIncoming(last, acc);
+        acc = &accPhi;
+        return exit;
+    };
+    emit(entry, 0)->createInstr<Return>(acc);
+    CFGAnalysis::buildCFG(func);
+}
+
+int main() {
+    struct Example {
+        const char* name;
+        int bound;
+        int depth;
+    };
+    const std::vector<int> args = {100, 8};
+    std::cout << "Dynamic and static instructions, n = " << args[0] << "\n";
+    for (const Example& example : {Example{"trip count 8", 8, 0}, Example{"trip count 8 in a loop", 8, 1},
+                                   Example{"trip count n", 0, 0}, Example{"trip count n in a loop", 0, 1}}) {
+        for (size_t factor : {2, 4, 8}) {
+            Program program;
+            Function& func = program.createFunction(example.name);
+            buildNest(func, example.bound, example.depth);
+            size_t sizeBefore = countInstructions(func);
+            Interpreter::Result before = Interpreter::run(func, args);
+
+            LoopUnrollingPass::Config config;
+            config.unrollFactor = factor;
+            LoopUnrollingPass::runOnFunction(func, config);
+            Interpreter::Result after = Interpreter::run(func, args);
+
+            std::cout << "  " << example.name;
+            if (example.bound == 0) {
+                std::cout << ", factor " << factor;
+            }
+            std::cout << ": executed " << before.instructions << " -> " << after.instructions << ", static "
+                      << sizeBefore << " -> " << countInstructions(func)
+                      << (before.value == after.value && before.status == after.status ? "" : "  RESULT MISMATCH")
+                      << "\n";
+            if (example.bound != 0) {
+                break;
+            }
+        }
+    }
+
+    for (int copies : {100, 1000}) {
+        for (int bound : {8, 0}) {
+            Program program;
+            Function& func = program.createFunction("many");
+            Parameter* n = func.createParam("n");
+            Parameter* a = func.createParam("a");
+            BasicBlock* current = func.createBasicBlock("entry");
+            Value* acc = func.getConstant(0);
+            Value* limit = bound ? static_cast<Value*>(func.getConstant(bound)) : n;
+            for (int c = 0; c < copies; ++c) {
+                current = emitLoop(func, current, limit, a, acc, "l" + std::to_string(c));
+            }
+            current->createInstr<Return>(acc);
+            CFGAnalysis::buildCFG(func);
+
+            double ms = millis([&] { LoopUnrollingPass::runOnFunction(func); });
+            std::cout << copies << " loops, trip count " << (bound ? std::to_string(bound) : "n") << ": unrolling "
+                      << ms << " ms, " << func.getBasicBlocks().size() << " blocks after\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "program.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include "interpreter.h"
+#include "liveness_analysis.h"
+#include "loop_analysis.h"
+#include "phi_elimination.h"
+#include "register_allocator.h"
+#include "spill_code.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// depth loops of n iterations each. The innermost body adds
+// iv * c0 + c1 + ... to an accumulator, so the invariants are read there
+// and nowhere else; every outer level adds its own counter on the way out.
+static void buildNest(Function& func, int depth, int invariants) {
+    Parameter* n = func.createParam("n");
+    std::vector<Value*> c;
+    for (int i = 0; i < invariants; ++i) {
+        c.push_back(func.createParam("c" + std::to_string(i)));
+    }
+    BasicBlock* entry = func.createBasicBlock("entry");
+    Value* acc = func.getConstant(0);
+
+    std::function<BasicBlock*(BasicBlock*, int)> emit = [&](BasicBlock* pred, int level) -> BasicBlock* {
+        std::string name = "l" + std::to_string(level);
+        BasicBlock* header = func.createBasicBlock(name + "_header");
+        BasicBlock* body = func.createBasicBlock(name + "_body");
+        BasicBlock* exit = func.createBasicBlock(name + "_exit");
+        pred->createInstr<Jump>(header);
+        auto& iv = header->createInstr<Phi>();
+        auto& accPhi = header->createInstr<Phi>();
+        auto& more = header->createInstr<Cmp>(CmpOp::Lt, &iv, n);
+        header->createInstr<CondJump>(&more, body, exit);
+        Value* accIn = acc;
+        acc = &accPhi;
+
+        BasicBlock* last = body;
+        if (level + 1 < depth) {
+            last = emit(body, level + 1);
+            acc = &last->createInstr<BinaryOp>(InstrKind::Add, acc, &iv);
+        } else {
+            Value* term = &body->createInstr<BinaryOp>(InstrKind::Mul, &iv, c[0]);
+            for (int i = 1; i < invariants; ++i) {
+                term = &body->createInstr<BinaryOp>(InstrKind::Add, term, c[i]);
+            }
+            acc = &body->createInstr<BinaryOp>(InstrKind::Add, acc, term);
+        }
+        auto& next = last->createInstr<BinaryOp>(InstrKind::Add, &iv, func.getConstant(1));
+        last->createInstr<Jump>(header);
+        iv.addIncoming(pred, func.getConstant(0));
+        iv.addIncoming(last, &next);
+        accPhi.addIncoming(pred, accIn);
+        accPhi.addIncoming(last, acc);
+        acc = &accPhi;
+        return exit;
+    };
+    emit(entry, 0)->createInstr<Return>(acc);
+    CFGAnalysis::buildCFG(func);
+}
+
+// Allocates, inserts the spill code and the phi moves, and runs the
+// result on the machine.
+static Interpreter::Result allocateAndRun(int depth, int invariants, int registers, bool split,
+                                          const std::vector<int>& args, int expected,
+                                          PhiEliminationPass::Stats* phiStats = nullptr) {
+    Program program;
+    Function& func = program.createFunction("nest");
+    buildNest(func, depth, invariants);
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    RegisterAllocator::Config config;
+    config.splitIntervals = split;
+    RegisterAllocator allocator(registers, config);
+    allocator.allocate(func, liveness);
+    SpillCodePass::runOnFunction(func, liveness, allocator);
+    PhiEliminationPass::Stats stats = PhiEliminationPass::runOnFunction(func, liveness, allocator);
+    if (phiStats) {
+        *phiStats = stats;
+    }
+    Interpreter::Result result = Interpreter::run(func, args, allocator, liveness);
+    if (!result.ok() || result.value != expected) {
+        std::cout << "  RESULT MISMATCH\n";
+    }
+    return result;
+}
+
+int main() {
+    // Without splitting, a value on the stack is read through a scratch
+    // register outside the allocatable ones, one per operand, so the fair
+    // comparison for r registers with splitting is r - 2 without.
+    std::cout << "Dynamic spills / reloads, n = 10: split with r registers vs whole intervals with r and r - 2\n";
+    for (int depth : {1, 2, 3}) {
+        for (int invariants : {2, 6}) {
+            std::vector<int> args(1 + invariants, 3);
+            args[0] = 10;
+            Program program;
+            Function& reference = program.createFunction("nest");
+            buildNest(reference, depth, invariants);
+            int expected = Interpreter::run(reference, args).value;
+
+            std::cout << "  depth " << depth << ", " << invariants << " invariants:\n";
+            for (int registers : {2, 4, 6, 8}) {
+                Interpreter::Result split = allocateAndRun(depth, invariants, registers, true, args, expected);
+                Interpreter::Result whole = allocateAndRun(depth, invariants, registers, false, args, expected);
+                Interpreter::Result fewer = allocateAndRun(depth, invariants, registers - 2, false, args, expected);
+                std::cout << "    r = " << registers << ": " << split.spills << " / " << split.reloads
+                          << "  vs  " << whole.spills << " / " << whole.reloads << ", " << fewer.spills << " / "
+                          << fewer.reloads << "\n";
+            }
+        }
+    }
+
+    // Each phi input is a copy on its edge; the allocator puts a phi and
+    // its inputs in one register where it can, and that copy is gone.
+    std::cout << "\nPhi copies, n = 10, split: static moves / coalesced / temporaries, dynamic moves\n";
+    for (int depth : {1, 2, 3}) {
+        std::vector<int> args(1 + 6, 3);
+        args[0] = 10;
+        Program program;
+        Function& reference = program.createFunction("nest");
+        buildNest(reference, depth, 6);
+        int expected = Interpreter::run(reference, args).value;
+        for (int registers : {2, 4, 8}) {
+            PhiEliminationPass::Stats stats;
+            Interpreter::Result result = allocateAndRun(depth, 6, registers, true, args, expected, &stats);
+            std::cout << "  depth " << depth << ", r = " << registers << ": " << stats.moves << " / "
+                      << stats.coalesced << " / " << stats.temporaries << ", " << result.moves << "\n";
+        }
+    }
+
+    for (int depth : {10, 100, 1000}) {
+        Program program;
+        Function& func = program.createFunction("deep");
+        buildNest(func, depth, 6);
+        LivenessAnalysis liveness;
+        liveness.build(func);
+        LoopInfo loops(func);
+        for (int registers : {4, 16}) {
+            RegisterAllocator allocator(registers);
+            double allocate = millis([&] { allocator.allocate(func, liveness, loops); });
+            std::cout << depth << " nested loops, " << registers << " registers: allocation " << allocate
+                      << " ms, " << allocator.getNumSpillSlots() << " slots\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "program.h"
+#include "bin_ops.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static constexpr int UserCount = 50000;
+
+// The previous scheme: each value kept a vector of unique users, so every
+// addUser was a linear find and every removeUser an erase-remove.
+struct VectorUsers {
+    std::vector<Instruction*> users;
+
+    void add(Instruction* user) {
+        if (std::find(users.begin(), users.end(), user) == users.end()) {
+            users.push_back(user);
+        }
+    }
+
+    void remove(Instruction* user) {
+        users.erase(std::remove(users.begin(), users.end(), user), users.end());
+    }
+};
+
+template<typename Fn>
+static double millis(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main() {
+    Program program;
+    Function& func = program.createFunction("users");
+    Parameter* x = func.createParam("x");
+    Parameter* y = func.createParam("y");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+
+    std::vector<Instruction*> users;
+    double buildMs = millis([&] {
+        for (int i = 0; i < UserCount; ++i) {
+            users.push_back(&entry->createInstr<BinaryOp>(InstrKind::Add, x, one));
+        }
+    });
+    double replaceMs = millis([&] { x->replaceAllUsesWith(y); });
+
+    VectorUsers oldX;
+    VectorUsers oldY;
+    double oldBuildMs = millis([&] {
+        for (Instruction* user : users) {
+            oldX.add(user);
+        }
+    });
+    double oldReplaceMs = millis([&] {
+        for (Instruction* user : users) {
+            oldX.remove(user);
+            oldY.add(user);
+        }
+    });
+
+    std::cout << "Value with " << UserCount << " users\n";
+    std::cout << "  vector users: add " << oldBuildMs << " ms, replace " << oldReplaceMs << " ms\n";
+    std::cout << "  use lists:    add " << buildMs << " ms, replace " << replaceMs << " ms\n";
+    std::cout << "  remaining uses of x: " << x->getNumUses() << ", uses of y: " << y->getNumUses() << "\n";
+    return 0;
+}
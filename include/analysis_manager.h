@@ -0,0 +1,264 @@
+#pragma once
+
+#include "basic_block.h"
+#include "cfg.h"
+#include "cfg_traversal.h"
+#include "dominator_tree.h"
+#include "function.h"
+#include "induction_variables.h"
+#include "linear_order.h"
+#include "liveness_analysis.h"
+#include "loop_analysis.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+enum class AnalysisKind {
+    CFG,
+    ReversePostOrder,
+    DominatorTree,
+    PostDominatorTree,
+    Loops,
+    InductionVariables,
+    LinearOrder,
+    Liveness,
+};
+
+constexpr size_t NumAnalysisKinds = static_cast<size_t>(AnalysisKind::Liveness) + 1;
+
+// The set of analyses a transformation leaves valid. Passes return the
+// narrowest set that is still true; everything else gets recomputed.
+class PreservedAnalyses {
+    unsigned mask = 0;
+
+    static unsigned bit(AnalysisKind kind) { return 1u << static_cast<unsigned>(kind); }
+
+public:
+    static PreservedAnalyses none() { return PreservedAnalyses(); }
+
+    static PreservedAnalyses all() {
+        PreservedAnalyses preserved;
+        preserved.mask = (1u << NumAnalysisKinds) - 1;
+        return preserved;
+    }
+
+    // For passes that rewrite instructions but leave every terminator and
+    // block alone: everything derived from the CFG stays valid, liveness
+    // does not.
+    static PreservedAnalyses cfgShape() {
+        return PreservedAnalyses()
+            .preserve(AnalysisKind::CFG)
+            .preserve(AnalysisKind::ReversePostOrder)
+            .preserve(AnalysisKind::DominatorTree)
+            .preserve(AnalysisKind::PostDominatorTree)
+            .preserve(AnalysisKind::Loops)
+            .preserve(AnalysisKind::LinearOrder);
+    }
+
+    PreservedAnalyses& preserve(AnalysisKind kind) {
+        mask |= bit(kind);
+        return *this;
+    }
+
+    bool isPreserved(AnalysisKind kind) const { return (mask & bit(kind)) != 0; }
+};
+
+// How often each analysis was computed and how often a cached result was
+// handed out instead.
+struct AnalysisStats {
+    size_t computed[NumAnalysisKinds] = {};
+    size_t reused[NumAnalysisKinds] = {};
+
+    size_t getComputed(AnalysisKind kind) const { return computed[static_cast<size_t>(kind)]; }
+    size_t getReused(AnalysisKind kind) const { return reused[static_cast<size_t>(kind)]; }
+
+    size_t getTotalComputed() const {
+        size_t total = 0;
+        for (size_t count : computed) {
+            total += count;
+        }
+        return total;
+    }
+
+    size_t getTotalReused() const {
+        size_t total = 0;
+        for (size_t count : reused) {
+            total += count;
+        }
+        return total;
+    }
+
+    AnalysisStats& operator+=(const AnalysisStats& other) {
+        for (size_t i = 0; i < NumAnalysisKinds; ++i) {
+            computed[i] += other.computed[i];
+            reused[i] += other.reused[i];
+        }
+        return *this;
+    }
+};
+
+// Caches the analyses of one function. Getters compute on first use and
+// then return the cached result until a pass reports, through invalidate(),
+// that it did not preserve it. Analyses built on top of another one (loops
+// on the dominator tree, liveness on the linear order and reverse
+// post-order) take their input from the cache too.
+//
+// The CFG is the predecessor/successor lists stored in the blocks; the
+// manager only tracks whether they are current and runs buildCFG() when
+// they are not. It starts out assuming they are stale.
+class FunctionAnalysisManager {
+public:
+    explicit FunctionAnalysisManager(Function& fn) : function(fn) {}
+
+    FunctionAnalysisManager(const FunctionAnalysisManager&) = delete;
+    FunctionAnalysisManager& operator=(const FunctionAnalysisManager&) = delete;
+
+    Function& getFunction() const { return function; }
+
+    void ensureCFG() {
+        if (cfgValid) {
+            noteReused(AnalysisKind::CFG);
+            return;
+        }
+        CFGAnalysis::buildCFG(function);
+        cfgValid = true;
+        noteComputed(AnalysisKind::CFG);
+    }
+
+    const ReversePostOrder& getReversePostOrder() {
+        if (rpo) {
+            noteReused(AnalysisKind::ReversePostOrder);
+            return *rpo;
+        }
+        ensureCFG();
+        rpo.emplace(function);
+        noteComputed(AnalysisKind::ReversePostOrder);
+        return *rpo;
+    }
+
+    const DominatorTree& getDominatorTree() {
+        if (domTree) {
+            noteReused(AnalysisKind::DominatorTree);
+            return *domTree;
+        }
+        ensureCFG();
+        domTree.emplace(function);
+        noteComputed(AnalysisKind::DominatorTree);
+        return *domTree;
+    }
+
+    // The cached tree, if any, for passes that keep it up to date through a
+    // CFGUpdater instead of invalidating it.
+    DominatorTree* getCachedDominatorTree() { return domTree ? &*domTree : nullptr; }
+
+    const PostDominatorTree& getPostDominatorTree() {
+        if (postDomTree) {
+            noteReused(AnalysisKind::PostDominatorTree);
+            return *postDomTree;
+        }
+        ensureCFG();
+        postDomTree.emplace(function);
+        noteComputed(AnalysisKind::PostDominatorTree);
+        return *postDomTree;
+    }
+
+    const LoopInfo& getLoopInfo() {
+        if (loopInfo) {
+            noteReused(AnalysisKind::Loops);
+            return *loopInfo;
+        }
+        const DominatorTree& tree = getDominatorTree();
+        loopInfo.emplace(function, tree);
+        noteComputed(AnalysisKind::Loops);
+        return *loopInfo;
+    }
+
+    const InductionVariableAnalysis& getInductionVariables() {
+        if (inductionVariables) {
+            noteReused(AnalysisKind::InductionVariables);
+            return *inductionVariables;
+        }
+        const LoopInfo& loops = getLoopInfo();
+        inductionVariables.emplace(function, loops);
+        noteComputed(AnalysisKind::InductionVariables);
+        return *inductionVariables;
+    }
+
+    // Like getCachedDominatorTree(), for passes that add blocks and keep the
+    // loop forest current themselves.
+    LoopInfo* getCachedLoopInfo() { return loopInfo ? &*loopInfo : nullptr; }
+
+    const std::vector<BasicBlock*>& getLinearOrder() {
+        if (linearOrder) {
+            noteReused(AnalysisKind::LinearOrder);
+            return *linearOrder;
+        }
+        linearOrder = LinearOrder::compute(function, getLoopInfo());
+        noteComputed(AnalysisKind::LinearOrder);
+        return *linearOrder;
+    }
+
+    const LivenessAnalysis& getLiveness() {
+        if (liveness) {
+            noteReused(AnalysisKind::Liveness);
+            return *liveness;
+        }
+        const std::vector<BasicBlock*>& order = getLinearOrder();
+        auto result = std::make_unique<LivenessAnalysis>();
+        result->build(function, order, getReversePostOrder());
+        liveness = std::move(result);
+        noteComputed(AnalysisKind::Liveness);
+        return *liveness;
+    }
+
+    void invalidate(const PreservedAnalyses& preserved) {
+        if (!preserved.isPreserved(AnalysisKind::CFG)) {
+            cfgValid = false;
+        }
+        if (!preserved.isPreserved(AnalysisKind::ReversePostOrder)) {
+            rpo.reset();
+        }
+        if (!preserved.isPreserved(AnalysisKind::DominatorTree)) {
+            domTree.reset();
+        }
+        if (!preserved.isPreserved(AnalysisKind::PostDominatorTree)) {
+            postDomTree.reset();
+        }
+        if (!preserved.isPreserved(AnalysisKind::Loops)) {
+            loopInfo.reset();
+        }
+        // Induction variables point at loops.
+        if (!preserved.isPreserved(AnalysisKind::InductionVariables) || !loopInfo) {
+            inductionVariables.reset();
+        }
+        if (!preserved.isPreserved(AnalysisKind::LinearOrder)) {
+            linearOrder.reset();
+        }
+        if (!preserved.isPreserved(AnalysisKind::Liveness)) {
+            liveness.reset();
+        }
+    }
+
+    void invalidateAll() { invalidate(PreservedAnalyses::none()); }
+
+    // For code that rebuilt the edges itself.
+    void markCFGValid() { cfgValid = true; }
+
+    const AnalysisStats& getStats() const { return stats; }
+
+private:
+    Function& function;
+    bool cfgValid = false;
+    std::optional<ReversePostOrder> rpo;
+    std::optional<DominatorTree> domTree;
+    std::optional<PostDominatorTree> postDomTree;
+    std::optional<LoopInfo> loopInfo;
+    std::optional<InductionVariableAnalysis> inductionVariables;
+    std::optional<std::vector<BasicBlock*>> linearOrder;
+    std::unique_ptr<LivenessAnalysis> liveness;
+    AnalysisStats stats;
+
+    void noteComputed(AnalysisKind kind) { ++stats.computed[static_cast<size_t>(kind)]; }
+    void noteReused(AnalysisKind kind) { ++stats.reused[static_cast<size_t>(kind)]; }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump-pointer arena for IR objects. Memory is carved out of large slabs and
+// is only given back in bulk: reset() runs the destructors of every object
+// created so far (newest first) and rewinds the arena so the slabs can be
+// reused by the next compilation.
+class Arena {
+public:
+    static constexpr size_t DefaultSlabSize = 16 * 1024;
+    static constexpr size_t MaxSlabSize = 1024 * 1024;
+
+    explicit Arena(size_t slabSize = DefaultSlabSize) : initialSlabSize(slabSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        runDestructors();
+        for (auto& slab : slabs) {
+            ::operator delete(slab.data);
+        }
+    }
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t aligned = alignUp(reinterpret_cast<uintptr_t>(cursor), align);
+        if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+            startSlab(size + align);
+            aligned = alignUp(reinterpret_cast<uintptr_t>(cursor), align);
+        }
+        cursor = reinterpret_cast<char*>(aligned + size);
+        bytesAllocated += size;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            void* mem = allocate(sizeof(T), alignof(T));
+            ++objectCount;
+            return new (mem) T(std::forward<Args>(args)...);
+        } else {
+            // The destructor record lives in the arena next to the object, so
+            // tracking non-trivial objects costs no extra heap allocation.
+            auto* record = static_cast<DtorRecord*>(allocate(sizeof(DtorRecord), alignof(DtorRecord)));
+            void* mem = allocate(sizeof(T), alignof(T));
+            T* object = new (mem) T(std::forward<Args>(args)...);
+            record->object = object;
+            record->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+            record->prev = lastDtor;
+            lastDtor = record;
+            ++objectCount;
+            return object;
+        }
+    }
+
+    // Destroys every object and rewinds to the first slab. Standard-sized
+    // slabs are kept for reuse; oversized ones are released.
+    void reset() {
+        runDestructors();
+        std::vector<Slab> kept;
+        for (auto& slab : slabs) {
+            if (slab.size <= MaxSlabSize) {
+                kept.push_back(slab);
+            } else {
+                ::operator delete(slab.data);
+            }
+        }
+        slabs = std::move(kept);
+        currentSlab = 0;
+        cursor = slabs.empty() ? nullptr : slabs[0].data;
+        end = slabs.empty() ? nullptr : slabs[0].data + slabs[0].size;
+        bytesAllocated = 0;
+        objectCount = 0;
+    }
+
+    size_t getBytesAllocated() const { return bytesAllocated; }
+    size_t getObjectCount() const { return objectCount; }
+    size_t getSlabCount() const { return slabs.size(); }
+
+    size_t getBytesReserved() const {
+        size_t total = 0;
+        for (const auto& slab : slabs) {
+            total += slab.size;
+        }
+        return total;
+    }
+
+private:
+    struct Slab {
+        char* data;
+        size_t size;
+    };
+
+    struct DtorRecord {
+        void* object;
+        void (*destroy)(void*);
+        DtorRecord* prev;
+    };
+
+    size_t initialSlabSize;
+    std::vector<Slab> slabs;
+    size_t currentSlab = 0;
+    char* cursor = nullptr;
+    char* end = nullptr;
+    DtorRecord* lastDtor = nullptr;
+    size_t bytesAllocated = 0;
+    size_t objectCount = 0;
+
+    static uintptr_t alignUp(uintptr_t value, size_t align) {
+        return (value + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+    }
+
+    void runDestructors() {
+        while (lastDtor) {
+            DtorRecord* record = lastDtor;
+            lastDtor = record->prev;
+            record->destroy(record->object);
+        }
+    }
+
+    void startSlab(size_t minSize) {
+        // Reuse slabs kept by a previous reset() before allocating new ones.
+        while (cursor && currentSlab + 1 < slabs.size()) {
+            ++currentSlab;
+            if (slabs[currentSlab].size >= minSize) {
+                cursor = slabs[currentSlab].data;
+                end = cursor + slabs[currentSlab].size;
+                return;
+            }
+        }
+
+        // Slabs grow geometrically so huge functions need few of them.
+        size_t size = initialSlabSize << std::min<size_t>(slabs.size() / 4, 6);
+        size = std::min(size, MaxSlabSize);
+        size = std::max(size, minSize);
+        char* data = static_cast<char*>(::operator new(size));
+        slabs.push_back({data, size});
+        currentSlab = slabs.size() - 1;
+        cursor = data;
+        end = data + size;
+    }
+};
@@ -4,38 +4,255 @@
 #include <vector>
 #include <memory>
 #include <iostream>
-#include <unordered_set>
+#include <iterator>
+#include <cstddef>
+#include <algorithm>
 
+#include "arena.h"
 #include "instruction.h"
 
 class NameContext;
+class Function;
+
+// Intrusive doubly-linked list of the instructions of one block. The links
+// live in Instruction itself, so insertion, removal and splicing never move
+// or reallocate anything and iterators stay valid until their instruction
+// is removed.
+class InstructionList {
+public:
+    template<typename InstrT>
+    class Iterator {
+        friend class InstructionList;
+        InstrT* node = nullptr;
+        const InstructionList* list = nullptr;
+
+        Iterator(InstrT* n, const InstructionList* l) : node(n), list(l) {}
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = InstrT;
+        using difference_type = std::ptrdiff_t;
+        using pointer = InstrT*;
+        using reference = InstrT&;
+
+        Iterator() = default;
+        template<typename OtherT>
+        Iterator(const Iterator<OtherT>& other) : node(other.getNode()), list(other.getList()) {}
+
+        reference operator*() const { return *node; }
+        pointer operator->() const { return node; }
+        InstrT* getNode() const { return node; }
+        const InstructionList* getList() const { return list; }
+
+        Iterator& operator++() {
+            node = node->getNext();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+        // Decrementing end() yields the last instruction.
+        Iterator& operator--() {
+            node = node ? node->getPrev() : list->tail;
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator old = *this;
+            --*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+    };
+
+    using iterator = Iterator<Instruction>;
+    using const_iterator = Iterator<const Instruction>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    explicit InstructionList(BasicBlock* parentBlock) : owner(parentBlock) {}
+    InstructionList(const InstructionList&) = delete;
+    InstructionList& operator=(const InstructionList&) = delete;
+
+    iterator begin() { return iterator(head, this); }
+    iterator end() { return iterator(nullptr, this); }
+    const_iterator begin() const { return const_iterator(head, this); }
+    const_iterator end() const { return const_iterator(nullptr, this); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Instruction& front() { return *head; }
+    Instruction& back() { return *tail; }
+    const Instruction& front() const { return *head; }
+    const Instruction& back() const { return *tail; }
+
+    iterator iteratorTo(Instruction* instr) { return iterator(instr, this); }
+
+    // Inserts before pos and returns an iterator to the inserted instruction.
+    iterator insert(iterator pos, Instruction* instr);
+
+    iterator insertAfter(iterator pos, Instruction* instr) {
+        return insert(std::next(pos), instr);
+    }
+
+    void push_back(Instruction* instr) { insert(end(), instr); }
+    void push_front(Instruction* instr) { insert(begin(), instr); }
+
+    // Unlinks the instruction at pos and returns the following position.
+    iterator erase(iterator pos) {
+        Instruction* instr = pos.node;
+        iterator next(instr->next, this);
+        remove(instr);
+        return next;
+    }
+
+    void remove(Instruction* instr) {
+        (instr->prev ? instr->prev->next : head) = instr->next;
+        (instr->next ? instr->next->prev : tail) = instr->prev;
+        instr->prev = nullptr;
+        instr->next = nullptr;
+        instr->parent = nullptr;
+        --count;
+    }
+
+    // Puts newInstr in place of the instruction at pos, which is unlinked.
+    iterator replace(iterator pos, Instruction* newInstr) {
+        iterator inserted = insert(pos, newInstr);
+        remove(pos.node);
+        return inserted;
+    }
+
+    // Moves [first, last) of other in front of pos. Relinking is O(1); the
+    // moved instructions only need their parent pointer refreshed.
+    void splice(iterator pos, InstructionList& other, iterator first, iterator last) {
+        if (first == last) {
+            return;
+        }
+        Instruction* firstNode = first.node;
+        Instruction* lastNode = last.node ? last.node->prev : other.tail;
+
+        size_t moved = 0;
+        for (Instruction* i = firstNode;; i = i->next) {
+            i->parent = owner;
+            ++moved;
+            if (i == lastNode) {
+                break;
+            }
+        }
+
+        (firstNode->prev ? firstNode->prev->next : other.head) = lastNode->next;
+        (lastNode->next ? lastNode->next->prev : other.tail) = firstNode->prev;
+        other.count -= moved;
+
+        Instruction* before = pos.node;
+        Instruction* after = before ? before->prev : tail;
+        firstNode->prev = after;
+        lastNode->next = before;
+        (after ? after->next : head) = firstNode;
+        (before ? before->prev : tail) = lastNode;
+        count += moved;
+    }
+
+private:
+    BasicBlock* owner;
+    Instruction* head = nullptr;
+    Instruction* tail = nullptr;
+    size_t count = 0;
+
+    void link(Instruction* instr, Instruction* after, Instruction* before) {
+        instr->prev = after;
+        instr->next = before;
+        (after ? after->next : head) = instr;
+        (before ? before->prev : tail) = instr;
+    }
+};
 
 class BasicBlock {
+    friend class Function;
+
+public:
+    using EdgeList = SmallVector<BasicBlock*, 2>;
+
+private:
     std::string name;
-    std::vector<std::unique_ptr<Instruction>> instructions;
-    std::unordered_set<BasicBlock*> predecessors;
-    std::unordered_set<BasicBlock*> successors;
+    Function* parent;
+    Arena* arena;
+    // Dense index within the parent function, assigned by Function.
+    unsigned id = NoId;
+    InstructionList instructions{this};
+    // Edges are kept unique and in insertion order; nearly every block has
+    // one or two of each.
+    EdgeList predecessors;
+    EdgeList successors;
 
 public:
-    BasicBlock(const std::string& nm) : name(nm) {}
+    static constexpr unsigned NoId = ~0u;
+
+    BasicBlock(const std::string& nm, Function* fn, Arena& ar) : name(nm), parent(fn), arena(&ar) {}
 
     const std::string& getName() const { return name; }
-    const std::vector<std::unique_ptr<Instruction>>& getInstructions() const { return instructions; }
-    std::vector<std::unique_ptr<Instruction>>& getInstructions() { return instructions; }
-    const std::unordered_set<BasicBlock*>& getPredecessors() const { return predecessors; }
-    const std::unordered_set<BasicBlock*>& getSuccessors() const { return successors; }
+    Function* getParent() const { return parent; }
+    Arena& getArena() const { return *arena; }
+    unsigned getId() const { return id; }
+    const InstructionList& getInstructions() const { return instructions; }
+    InstructionList& getInstructions() { return instructions; }
+    const EdgeList& getPredecessors() const { return predecessors; }
+    const EdgeList& getSuccessors() const { return successors; }
+
+    Instruction* getTerminator() { return instructions.empty() ? nullptr : &instructions.back(); }
+
+    Instruction* insertBeforeTerminator(Instruction* instr) {
+        instructions.insert(instructions.iteratorTo(getTerminator()), instr);
+        return instr;
+    }
 
     template<typename Instr, typename... Args>
     Instr& createInstr(Args&&... args) {
-        instructions.push_back(std::make_unique<Instr>(std::forward<Args>(args)...));
-        return static_cast<Instr&>(*instructions.back());
+        Instr* instr = arena->create<Instr>(std::forward<Args>(args)...);
+        instructions.push_back(instr);
+        return *instr;
     }
 
-    void addPredecessor(BasicBlock* pred) { predecessors.insert(pred); }
-    void addSuccessor(BasicBlock* succ) { successors.insert(succ); }
-    void removePredecessor(BasicBlock* pred) { predecessors.erase(pred); }
-    void removeSuccessor(BasicBlock* succ) { successors.erase(succ); }
+    // Gives an instruction entering this block a value id in the parent
+    // function if it does not have one yet.
+    void adopt(Instruction* instr);
+
+    void addPredecessor(BasicBlock* pred) { addEdge(predecessors, pred); }
+    void addSuccessor(BasicBlock* succ) { addEdge(successors, succ); }
+    void removePredecessor(BasicBlock* pred) { removeEdge(predecessors, pred); }
+    void removeSuccessor(BasicBlock* succ) { removeEdge(successors, succ); }
 
     void clearPredecessors() { predecessors.clear(); }
     void clearSuccessors() { successors.clear(); }
-};
\ No newline at end of file
+
+private:
+    static void addEdge(EdgeList& edges, BasicBlock* block) {
+        if (std::find(edges.begin(), edges.end(), block) == edges.end()) {
+            edges.push_back(block);
+        }
+    }
+
+    static void removeEdge(EdgeList& edges, BasicBlock* block) {
+        auto it = std::find(edges.begin(), edges.end(), block);
+        if (it != edges.end()) {
+            edges.erase(it);
+        }
+    }
+};
+
+inline InstructionList::iterator InstructionList::insert(iterator pos, Instruction* instr) {
+    Instruction* before = pos.node;
+    Instruction* after = before ? before->prev : tail;
+    link(instr, after, before);
+    instr->parent = owner;
+    ++count;
+    owner->adopt(instr);
+    return iterator(instr, this);
+}
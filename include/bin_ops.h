@@ -22,7 +22,7 @@ public:
             case InstrKind::And: op = "and"; break;
             default: op = "unknown"; break;
         }
-        return ctx.getValueName(this) + " = " + op + " " + ctx.getValueName(operands[0]) + ", " + ctx.getValueName(operands[1]);
+        return ctx.getValueName(this) + " = " + op + " " + ctx.getValueName(getOperand(0)) + ", " + ctx.getValueName(getOperand(1));
     }
 
     void updateCFG() override {
@@ -40,7 +40,25 @@ public:
             case InstrKind::And: op = "and"; break;
             default: op = "unknown"; break;
         }
-        os << op << " " << operands[0] << ", " << operands[1];
+        os << op << " " << getOperand(0) << ", " << getOperand(1);
+    }
+
+    static bool isBinaryKind(InstrKind k) {
+        switch (k) {
+            case InstrKind::Add:
+            case InstrKind::Mul:
+            case InstrKind::Sub:
+            case InstrKind::Shr:
+            case InstrKind::Shl:
+            case InstrKind::And:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool classof(const Value* v) {
+        return Instruction::classof(v) && isBinaryKind(static_cast<const Instruction*>(v)->getKind());
     }
 };
 
@@ -54,7 +72,7 @@ public:
 
     std::string str(NameContext& ctx) const override {
         const char* names[] = {"eq","ne","lt","le","gt","ge"};
-        return ctx.getValueName(this) + " = cmp." + names[(int)cmpOp] + " " + ctx.getValueName(operands[0]) + ", " + ctx.getValueName(operands[1]);
+        return ctx.getValueName(this) + " = cmp." + names[(int)cmpOp] + " " + ctx.getValueName(getOperand(0)) + ", " + ctx.getValueName(getOperand(1));
     }
 
     void updateCFG() override {
@@ -63,6 +81,8 @@ public:
 
     void print(std::ostream& os) const override {
         const char* names[] = {"eq","ne","lt","le","gt","ge"};
-        os << "cmp." << names[(int)cmpOp] << " " << operands[0] << ", " << operands[1];
+        os << "cmp." << names[(int)cmpOp] << " " << getOperand(0) << ", " << getOperand(1);
     }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Cmp); }
 };
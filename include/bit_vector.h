@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size set of small integers (value or block ids) packed into 64-bit
+// words. Set operations work a word at a time.
+class BitVector {
+    std::vector<uint64_t> words;
+    size_t numBits = 0;
+
+    static constexpr size_t WordBits = 64;
+
+public:
+    BitVector() = default;
+    explicit BitVector(size_t n, bool value = false)
+        : words((n + WordBits - 1) / WordBits, value ? ~uint64_t(0) : 0), numBits(n) {
+        clearUnusedBits();
+    }
+
+    size_t size() const { return numBits; }
+
+    void resize(size_t n) {
+        words.resize((n + WordBits - 1) / WordBits, 0);
+        numBits = n;
+        clearUnusedBits();
+    }
+
+    bool test(size_t i) const { return (words[i / WordBits] >> (i % WordBits)) & 1; }
+    void set(size_t i) { words[i / WordBits] |= uint64_t(1) << (i % WordBits); }
+    void reset(size_t i) { words[i / WordBits] &= ~(uint64_t(1) << (i % WordBits)); }
+
+    void setAll() {
+        for (auto& w : words) w = ~uint64_t(0);
+        clearUnusedBits();
+    }
+    void resetAll() {
+        for (auto& w : words) w = 0;
+    }
+
+    bool any() const {
+        for (uint64_t w : words) {
+            if (w) return true;
+        }
+        return false;
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t w : words) total += static_cast<size_t>(__builtin_popcountll(w));
+        return total;
+    }
+
+    // this |= other
+    void unionWith(const BitVector& other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] |= other.words[i];
+    }
+
+    // this &= other
+    void intersectWith(const BitVector& other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= other.words[i];
+    }
+
+    // this &= ~other
+    void subtract(const BitVector& other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= ~other.words[i];
+    }
+
+    // this = gen | (in & ~kill), the gen/kill transfer of a dataflow
+    // problem, in one pass over the words. Returns whether any bit changed.
+    // The loop has no early exit so the compiler can vectorize it.
+    bool assignTransfer(const BitVector& gen, const BitVector& in, const BitVector& kill) {
+        uint64_t changed = 0;
+        uint64_t* out = words.data();
+        const uint64_t* g = gen.words.data();
+        const uint64_t* i = in.words.data();
+        const uint64_t* k = kill.words.data();
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t next = g[w] | (i[w] & ~k[w]);
+            changed |= out[w] ^ next;
+            out[w] = next;
+        }
+        return changed != 0;
+    }
+
+    size_t numWords() const { return words.size(); }
+
+    bool operator==(const BitVector& other) const {
+        return numBits == other.numBits && words == other.words;
+    }
+    bool operator!=(const BitVector& other) const { return !(*this == other); }
+
+    // Calls fn(index) for every set bit in increasing order.
+    template<typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t bits = words[w];
+            while (bits) {
+                size_t bit = static_cast<size_t>(__builtin_ctzll(bits));
+                fn(w * WordBits + bit);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+private:
+    void clearUnusedBits() {
+        if (numBits % WordBits && !words.empty()) {
+            words.back() &= (uint64_t(1) << (numBits % WordBits)) - 1;
+        }
+    }
+};
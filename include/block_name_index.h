@@ -0,0 +1,34 @@
+#pragma once
+
+#include "basic_block.h"
+#include "function.h"
+#include <string>
+#include <unordered_map>
+
+// Label -> block lookup for front ends that refer to blocks by name, such as
+// a textual IR reader. Branches themselves hold BasicBlock pointers; build
+// the index once and add() blocks as they are created so resolving a label
+// is a hash lookup instead of a scan over the function.
+class BlockNameIndex {
+    std::unordered_map<std::string, BasicBlock*> blocks;
+
+public:
+    BlockNameIndex() = default;
+
+    explicit BlockNameIndex(const Function& function) {
+        blocks.reserve(function.getBasicBlocks().size());
+        for (BasicBlock* block : function.getBasicBlocks()) {
+            add(block);
+        }
+    }
+
+    // The first block registered under a name wins.
+    void add(BasicBlock* block) { blocks.emplace(block->getName(), block); }
+
+    BasicBlock* lookup(const std::string& name) const {
+        auto it = blocks.find(name);
+        return it == blocks.end() ? nullptr : it->second;
+    }
+
+    size_t size() const { return blocks.size(); }
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "cfg_updater.h"
+#include "control_flow.h"
+#include "function.h"
+#include <optional>
+
+// Turns conditional jumps whose outcome is known at compile time into plain
+// jumps. After inlining, a callee guard such as `if (n < 10)` often compares
+// two constants; folding it leaves the untaken arm without predecessors, and
+// the pass then drops every block that became unreachable.
+class BranchFolding {
+public:
+    // Returns the value a branch condition always has, if it is known.
+    static std::optional<bool> evaluateCondition(Value* condition) {
+        if (Constant* constant = asConstant(condition)) {
+            return constant->getValue() != 0;
+        }
+
+        auto* cmp = dyn_cast_or_null<Cmp>(condition);
+        if (!cmp) {
+            return std::nullopt;
+        }
+
+        Constant* lhs = asConstant(cmp->getOperand(0));
+        Constant* rhs = asConstant(cmp->getOperand(1));
+        if (lhs && rhs) {
+            return evaluateCmp(cmp->getCmpOp(), lhs->getValue(), rhs->getValue());
+        }
+        if (cmp->getOperand(0) == cmp->getOperand(1)) {
+            return evaluateCmp(cmp->getCmpOp(), 0, 0);
+        }
+        return std::nullopt;
+    }
+
+    // Returns the successor a CondJump always transfers to, or nullptr.
+    static BasicBlock* getKnownTarget(const CondJump* branch) {
+        if (branch->getTrueTarget() == branch->getFalseTarget()) {
+            return branch->getTrueTarget();
+        }
+        std::optional<bool> condition = evaluateCondition(branch->getCondition());
+        if (!condition.has_value()) {
+            return nullptr;
+        }
+        return *condition ? branch->getTrueTarget() : branch->getFalseTarget();
+    }
+
+    // Replaces the terminator of bb by a Jump when its outcome is known. The
+    // untaken successor loses its edge from bb, including its phi entries.
+    static bool foldBranch(BasicBlock& bb) {
+        CFGUpdater updater(*bb.getParent());
+        return foldBranch(bb, updater);
+    }
+
+    // Same, with the edge removal going through updater so that its
+    // dominator tree follows along.
+    static bool foldBranch(BasicBlock& bb, CFGUpdater& updater) {
+        auto* branch = dyn_cast_or_null<CondJump>(bb.getTerminator());
+        if (!branch) {
+            return false;
+        }
+        BasicBlock* taken = getKnownTarget(branch);
+        if (!taken) {
+            return false;
+        }
+        BasicBlock* untaken = taken == branch->getTrueTarget() ? branch->getFalseTarget()
+                                                               : branch->getTrueTarget();
+        Value* condition = branch->getCondition();
+
+        auto& instructions = bb.getInstructions();
+        branch->dropAllOperands();
+        instructions.replace(instructions.iteratorTo(branch), bb.getArena().create<Jump>(taken));
+
+        if (untaken && untaken != taken) {
+            updater.deleteEdge(&bb, untaken);
+        }
+
+        // The comparison usually feeds nothing but the branch.
+        auto* cmp = dyn_cast_or_null<Cmp>(condition);
+        if (cmp && !cmp->hasUses() && cmp->getParent()) {
+            cmp->eraseFromParent();
+        }
+        return true;
+    }
+
+private:
+    static bool evaluateCmp(CmpOp op, int lhs, int rhs) {
+        switch (op) {
+            case CmpOp::Eq: return lhs == rhs;
+            case CmpOp::Ne: return lhs != rhs;
+            case CmpOp::Lt: return lhs < rhs;
+            case CmpOp::Le: return lhs <= rhs;
+            case CmpOp::Gt: return lhs > rhs;
+            case CmpOp::Ge: return lhs >= rhs;
+        }
+        return false;
+    }
+};
+
+class BranchFoldingPass {
+public:
+    static bool runOnFunction(Function& function) {
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses);
+    }
+
+    // Leaves the edges up to date, and a cached dominator tree too, but
+    // changes the shape of the CFG.
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        bool changed = false;
+
+        analyses.ensureCFG();
+        DominatorTree* domTree = analyses.getCachedDominatorTree();
+        CFGUpdater updater(function, domTree);
+        for (auto& bb : function.getBasicBlocks()) {
+            if (BranchFolding::foldBranch(*bb, updater)) {
+                changed = true;
+            }
+        }
+
+        if (changed) {
+            updater.removeDeadBlocks();
+            PreservedAnalyses preserved = PreservedAnalyses::none().preserve(AnalysisKind::CFG);
+            if (domTree) {
+                preserved.preserve(AnalysisKind::DominatorTree);
+            }
+            analyses.invalidate(preserved);
+        }
+
+        return changed;
+    }
+};
@@ -18,11 +18,11 @@ public:
         std::ostringstream out;
         out << ctx.getValueName(this) << " = call ";
         out << (callee ? callee->getName() : "<unresolved>") << "(";
-        for (size_t i = 0; i < operands.size(); ++i) {
+        for (size_t i = 0; i < getNumOperands(); ++i) {
             if (i != 0) {
                 out << ", ";
             }
-            out << ctx.getValueName(operands[i]);
+            out << ctx.getValueName(getOperand(i));
         }
         out << ")";
         return out.str();
@@ -33,4 +33,6 @@ public:
     void print(std::ostream& os) const override {
         os << "call " << (callee ? callee->getName() : "<unresolved>");
     }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Call); }
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cassert>
+#include <type_traits>
+
+// Kind-based RTTI replacement. Every class in the Value hierarchy provides
+//     static bool classof(const Value* v);
+// which answers from Value::getValueKind() and Instruction::getKind(), so the
+// checks below are a load and a compare instead of a dynamic_cast.
+//
+//   isa<T>(v)             v is a T; v must not be null
+//   cast<T>(v)            checked downcast; asserts isa<T>(v)
+//   dyn_cast<T>(v)        T* if v is a T, else nullptr; v must not be null
+//   dyn_cast_or_null<T>   as dyn_cast, but accepts null
+//
+// Casting a pointer to const yields a pointer to const T.
+
+template<typename To, typename From>
+using CastResult = std::conditional_t<std::is_const_v<From>, const To*, To*>;
+
+template<typename To, typename From>
+inline bool isa(From* value) {
+    assert(value && "isa<> on a null pointer");
+    return To::classof(value);
+}
+
+template<typename To, typename From>
+inline CastResult<To, From> cast(From* value) {
+    assert(isa<To>(value) && "cast<> to an incompatible type");
+    return static_cast<CastResult<To, From>>(value);
+}
+
+template<typename To, typename From>
+inline CastResult<To, From> dyn_cast(From* value) {
+    return isa<To>(value) ? static_cast<CastResult<To, From>>(value) : nullptr;
+}
+
+template<typename To, typename From>
+inline CastResult<To, From> dyn_cast_or_null(From* value) {
+    return value && To::classof(value) ? static_cast<CastResult<To, From>>(value) : nullptr;
+}
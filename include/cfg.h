@@ -1,130 +1,139 @@
 #pragma once
 
 #include "basic_block.h"
+#include "cfg_traversal.h"
 #include "control_flow.h"
 #include "function.h"
+#include "control_dependence.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
 #include <unordered_set>
 #include <queue>
+#include <utility>
+#include <vector>
 
 class CFGAnalysis {
 public:
     static void buildCFG(Function& function) {
-        for (auto& bb : function.getBasicBlocks()) {
-            for (auto& instr : bb->getInstructions()) {
-                if (auto jump = dynamic_cast<Jump*>(instr.get())) {
-                    auto target = findBlockByName(function, jump->getTargetName());
-                    if (target) {
-                        jump->setTargetBlock(target);
-                        jump->setParentBlock(bb.get());
-                    }
-                }
-                else if (auto condJump = dynamic_cast<CondJump*>(instr.get())) {
-                    auto trueTarget = findBlockByName(function, condJump->getTrueTargetName());
-                    auto falseTarget = findBlockByName(function, condJump->getFalseTargetName());
-
-                    if (trueTarget && falseTarget) {
-                        condJump->setTrueTargetBlock(trueTarget);
-                        condJump->setFalseTargetBlock(falseTarget);
-                        condJump->setParentBlock(bb.get());
-                    }
-                }
-            }
-        }
-
         for (auto& bb : function.getBasicBlocks()) {
             bb->clearPredecessors();
             bb->clearSuccessors();
         }
 
         for (auto& bb : function.getBasicBlocks()) {
-            auto& instructions = bb->getInstructions();
-            if (!instructions.empty()) {
-                auto& lastInstr = instructions.back();
-                lastInstr->updateCFG();
+            if (Instruction* terminator = bb->getTerminator()) {
+                terminator->updateCFG();
             }
         }
     }
 
+    // The trees and the control-dependence graph describe the current edges;
+    // run buildCFG() first if terminators have changed.
+    static DominatorTree computeDominatorTree(Function& function) {
+        return DominatorTree(function);
+    }
 
-    static std::unordered_map<BasicBlock*, std::unordered_set<BasicBlock*>>
-    computeDominators(Function& function) {
-        std::unordered_map<BasicBlock*, std::unordered_set<BasicBlock*>> dominators;
-        auto& basicBlocks = function.getBasicBlocks();
+    static PostDominatorTree computePostDominatorTree(Function& function) {
+        return PostDominatorTree(function);
+    }
 
-        if (basicBlocks.empty()) return dominators;
+    static ControlDependenceGraph computeControlDependence(Function& function) {
+        return ControlDependenceGraph(function, PostDominatorTree(function));
+    }
 
-        BasicBlock* entry = basicBlocks[0].get();
+    // Full dominator sets, materialized from the dominator tree. Meant for
+    // dumps and tests; passes should query a DominatorTree directly.
+    static BlockMap<BlockSet> computeDominators(Function& function) {
+        const size_t numBlocks = function.getNumBlockIds();
+        BlockMap<BlockSet> dominators(numBlocks);
+        DominatorTree domTree(function);
 
-        for (auto& bb : basicBlocks) {
-            if (bb.get() == entry) {
-                dominators[entry] = {entry};
-            } else {
-                std::unordered_set<BasicBlock*> allBlocks;
-                for (auto& b : basicBlocks) {
-                    allBlocks.insert(b.get());
-                }
-                dominators[bb.get()] = allBlocks;
+        for (auto& bb : function.getBasicBlocks()) {
+            if (!domTree.isReachable(bb)) {
+                // Unreachable blocks are dominated by everything.
+                dominators[bb] = BlockSet(numBlocks, true);
+                continue;
+            }
+            BlockSet doms(numBlocks);
+            for (BasicBlock* dom = bb; dom; dom = domTree.getIDom(dom)) {
+                doms.insert(dom);
             }
+            dominators[bb] = std::move(doms);
         }
 
-        bool changed;
-        do {
-            changed = false;
-            for (auto& bb : basicBlocks) {
-                if (bb.get() == entry) continue;
-
-                auto& preds = bb->getPredecessors();
-                if (preds.empty()) continue;
+        return dominators;
+    }
 
-                // Start with the first predecessor's dominators
-                auto firstPred = *preds.begin();
-                std::unordered_set<BasicBlock*> newDoms = dominators[firstPred];
+    // Drops every block the entry cannot reach and rebuilds the edges. Phis
+    // in the surviving blocks forget the removed predecessors, and the dead
+    // instructions let go of their operands so no use list points into them.
+    static bool removeUnreachableBlocks(Function& function) {
+        auto& blocks = function.getBasicBlocks();
+        if (blocks.empty()) {
+            return false;
+        }
 
-                // Intersect with all other predecessors
-                for (auto pred : preds) {
-                    if (pred == firstPred) continue;
+        buildCFG(function);
+        BlockSet reachable(function.getNumBlockIds());
+        for (BasicBlock* block : preOrder(function)) {
+            reachable.insert(block);
+        }
+        if (reachable.size() == blocks.size()) {
+            return false;
+        }
 
-                    std::unordered_set<BasicBlock*> temp;
-                    for (auto dom : newDoms) {
-                        if (dominators[pred].count(dom)) {
-                            temp.insert(dom);
-                        }
-                    }
-                    newDoms = std::move(temp);
+        for (BasicBlock* block : blocks) {
+            if (reachable.count(block)) {
+                continue;
+            }
+            for (BasicBlock* successor : block->getSuccessors()) {
+                if (!reachable.count(successor)) {
+                    continue;
                 }
-
-                // Add the block itself
-                newDoms.insert(bb.get());
-
-                if (newDoms != dominators[bb.get()]) {
-                    dominators[bb.get()] = newDoms;
-                    changed = true;
+                for (auto& instr : successor->getInstructions()) {
+                    auto* phi = dyn_cast<Phi>(&instr);
+                    if (!phi) {
+                        break;
+                    }
+                    phi->removeIncomingBlock(block);
                 }
             }
-        } while (changed);
+            for (auto& instr : block->getInstructions()) {
+                instr.dropAllOperands();
+            }
+        }
 
-        return dominators;
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                    [&](BasicBlock* block) {
+                                        return !reachable.count(block);
+                                    }),
+                     blocks.end());
+        buildCFG(function);
+        return true;
     }
 
+    // Appends the blocks reachable from start that are not in visited yet,
+    // in pre-order, and marks them visited. Walks with an explicit stack, like
+    // preOrder() in cfg_traversal.h, which needs no set of its own.
     static void dfsTraversal(BasicBlock* start,
                             std::unordered_set<BasicBlock*>& visited,
                             std::vector<BasicBlock*>& order) {
-        if (!start || visited.count(start)) return;
+        if (!start || !visited.insert(start).second) return;
 
-        visited.insert(start);
         order.push_back(start);
-
-        for (auto succ : start->getSuccessors()) {
-            dfsTraversal(succ, visited, order);
-        }
-    }
-private:
-    static BasicBlock* findBlockByName(Function& function, const std::string& name) {
-        for (auto& bb : function.getBasicBlocks()) {
-            if (bb->getName() == name) {
-                return bb.get();
+        std::vector<std::pair<BasicBlock*, size_t>> stack{{start, 0}};
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            const auto& successors = top.first->getSuccessors();
+            if (top.second == successors.size()) {
+                stack.pop_back();
+                continue;
+            }
+            BasicBlock* succ = successors[top.second++];
+            if (visited.insert(succ).second) {
+                order.push_back(succ);
+                stack.emplace_back(succ, 0);
             }
         }
-        return nullptr;
     }
 };
\ No newline at end of file
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "basic_block.h"
+#include "dense_map.h"
+#include "function.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Depth-first walk over successor edges, yielding each block reachable from
+// the start once, either when it is first reached (pre-order) or once all
+// of its successors are done (post-order). Successors are taken in edge
+// order, so pre-order matches the classic recursive formulation. The walk
+// keeps its own stack, so a chain of a million blocks costs a million stack
+// entries on the heap rather than a million call frames.
+//
+// The range is single-pass: it is the walk itself, and iterating it again
+// continues where the last loop stopped.
+template<bool PostOrder>
+class DepthFirstRange {
+public:
+    class iterator {
+        DepthFirstRange* range = nullptr;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = BasicBlock*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = BasicBlock* const*;
+        using reference = BasicBlock* const&;
+
+        iterator() = default;
+        explicit iterator(DepthFirstRange* r) : range(r) {}
+
+        reference operator*() const { return range->current; }
+        iterator& operator++() {
+            range->advance();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return atEnd() == other.atEnd(); }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+    private:
+        bool atEnd() const { return !range || !range->current; }
+    };
+
+    DepthFirstRange(BasicBlock* start, size_t numBlockIds) : visited(numBlockIds) {
+        if (!start) {
+            return;
+        }
+        visited.insert(start);
+        stack.emplace_back(start, 0);
+        if (PostOrder) {
+            advance();
+        } else {
+            current = start;
+        }
+    }
+
+    DepthFirstRange(const DepthFirstRange&) = delete;
+    DepthFirstRange& operator=(const DepthFirstRange&) = delete;
+    DepthFirstRange(DepthFirstRange&&) = default;
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+    // Whether the walk has reached bb so far.
+    bool isVisited(const BasicBlock* bb) const { return visited.count(bb); }
+
+private:
+    BlockSet visited;
+    // Each entry is a block and the index of its next successor to try.
+    std::vector<std::pair<BasicBlock*, size_t>> stack;
+    BasicBlock* current = nullptr;
+
+    void advance() {
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            const auto& successors = top.first->getSuccessors();
+            if (top.second < successors.size()) {
+                BasicBlock* succ = successors[top.second++];
+                if (visited.count(succ)) {
+                    continue;
+                }
+                visited.insert(succ);
+                stack.emplace_back(succ, 0);
+                if (!PostOrder) {
+                    current = succ;
+                    return;
+                }
+            } else {
+                BasicBlock* done = top.first;
+                stack.pop_back();
+                if (PostOrder) {
+                    current = done;
+                    return;
+                }
+            }
+        }
+        current = nullptr;
+    }
+};
+
+using PreOrderRange = DepthFirstRange<false>;
+using PostOrderRange = DepthFirstRange<true>;
+
+// The walks start at the entry block; the CFG edges must be current.
+inline PreOrderRange preOrder(Function& function) {
+    BasicBlock* entry = function.getBasicBlocks().empty() ? nullptr : function.getBasicBlocks().front();
+    return PreOrderRange(entry, function.getNumBlockIds());
+}
+
+inline PostOrderRange postOrder(Function& function) {
+    BasicBlock* entry = function.getBasicBlocks().empty() ? nullptr : function.getBasicBlocks().front();
+    return PostOrderRange(entry, function.getNumBlockIds());
+}
+
+inline PreOrderRange preOrder(BasicBlock* start) {
+    return PreOrderRange(start, start->getParent()->getNumBlockIds());
+}
+
+inline PostOrderRange postOrder(BasicBlock* start) {
+    return PostOrderRange(start, start->getParent()->getNumBlockIds());
+}
+
+// The blocks reachable from the entry in reverse post-order, so every block
+// comes before its successors except along back edges, with each block's
+// position available in O(1). Computed once; passes that need the order
+// take it from FunctionAnalysisManager instead of deriving their own.
+class ReversePostOrder {
+public:
+    static constexpr unsigned NotReached = ~0u;
+
+    ReversePostOrder() = default;
+    explicit ReversePostOrder(Function& function) { recalculate(function); }
+
+    void recalculate(Function& function) {
+        blocks.clear();
+        for (BasicBlock* bb : postOrder(function)) {
+            blocks.push_back(bb);
+        }
+        std::reverse(blocks.begin(), blocks.end());
+        numbers.reset(function.getNumBlockIds(), NotReached);
+        for (unsigned i = 0; i < blocks.size(); ++i) {
+            numbers[blocks[i]] = i;
+        }
+    }
+
+    const std::vector<BasicBlock*>& getBlocks() const { return blocks; }
+    std::vector<BasicBlock*>::const_iterator begin() const { return blocks.begin(); }
+    std::vector<BasicBlock*>::const_iterator end() const { return blocks.end(); }
+    size_t size() const { return blocks.size(); }
+
+    // Position in the order, or NotReached for unreachable blocks.
+    unsigned getNumber(const BasicBlock* bb) const { return numbers.lookup(bb); }
+    bool isReachable(const BasicBlock* bb) const { return getNumber(bb) != NotReached; }
+
+private:
+    std::vector<BasicBlock*> blocks;
+    BlockMap<unsigned> numbers;
+};
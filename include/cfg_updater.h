@@ -0,0 +1,304 @@
+#pragma once
+
+#include "basic_block.h"
+#include "cfg.h"
+#include "control_flow.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
+#include "function.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Applies CFG edits to the edge lists, to the phis and, when one is given,
+// to a dominator tree in one step, so a transformation does not have to run
+// buildCFG() and recompute dominators after every change.
+//
+// Terminators stay the caller's business: rewrite the terminator first,
+// then report the edges it added or dropped here. splitBlock() and
+// mergeBlockIntoPredecessor() are the exception and rewrite everything.
+class CFGUpdater {
+public:
+    explicit CFGUpdater(Function& fn, DominatorTree* tree = nullptr) : function(fn), domTree(tree) {}
+
+    DominatorTree* getDominatorTree() const { return domTree; }
+
+    void insertEdge(BasicBlock* from, BasicBlock* to) {
+        from->addSuccessor(to);
+        to->addPredecessor(from);
+        if (domTree) {
+            domTree->insertEdge(from, to);
+        }
+    }
+
+    // Also drops the phi entries of to that came from from. Blocks left
+    // unreachable stay in the function until removeDeadBlocks().
+    void deleteEdge(BasicBlock* from, BasicBlock* to) {
+        removePhiEntries(to, from);
+        from->removeSuccessor(to);
+        to->removePredecessor(from);
+        if (domTree) {
+            domTree->deleteEdge(from, to, &deadBlocks);
+        } else {
+            mayHaveDeadBlocks = true;
+        }
+    }
+
+    // Moves the instructions from pos to the end of bb into a new block,
+    // which takes over bb's successors, and ends bb with a jump to it.
+    BasicBlock* splitBlock(BasicBlock* bb, InstructionList::iterator pos, const std::string& name) {
+        BasicBlock* tail = function.createBasicBlock(name);
+        auto& instructions = bb->getInstructions();
+        tail->getInstructions().splice(tail->getInstructions().end(), instructions, pos, instructions.end());
+
+        for (BasicBlock* succ : bb->getSuccessors()) {
+            replacePhiBlocks(succ, bb, tail);
+            succ->removePredecessor(bb);
+            succ->addPredecessor(tail);
+            tail->addSuccessor(succ);
+        }
+        bb->clearSuccessors();
+        bb->createInstr<Jump>(tail);
+        bb->addSuccessor(tail);
+        tail->addPredecessor(bb);
+        if (domTree) {
+            domTree->splitBlock(bb, tail);
+        }
+        return tail;
+    }
+
+    // Routes the edges from preds into bb through a new block that jumps to
+    // bb, e.g. to give a loop a preheader. Entries of bb's phis for preds
+    // move to the new block, merged by a phi there when there are several.
+    BasicBlock* splitPredecessors(BasicBlock* bb, const std::vector<BasicBlock*>& preds,
+                                  const std::string& name) {
+        BasicBlock* split = function.createBasicBlock(name);
+        auto& instructions = bb->getInstructions();
+        for (auto it = instructions.begin(); it != instructions.end(); ) {
+            auto* phi = dyn_cast<Phi>(&*it);
+            if (!phi) {
+                break;
+            }
+            ++it;
+            Phi* merged = nullptr;
+            Value* single = nullptr;
+            for (BasicBlock* pred : preds) {
+                Value* value = phi->getIncomingValueForBlock(pred);
+                if (!merged && (!single || single == value)) {
+                    single = value;
+                    continue;
+                }
+                if (!merged) {
+                    merged = split->getArena().create<Phi>();
+                    split->getInstructions().push_back(merged);
+                    for (size_t i = 0; i < preds.size() && preds[i] != pred; ++i) {
+                        merged->addIncoming(preds[i], single);
+                    }
+                }
+                merged->addIncoming(pred, value);
+            }
+            // The first entry stays in place for split; the rest go.
+            for (size_t i = 1; i < preds.size(); ++i) {
+                phi->removeIncomingBlock(preds[i]);
+            }
+            for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                if (phi->getIncomingBlock(i) == preds[0]) {
+                    phi->setOperand(i, merged ? merged : single);
+                }
+            }
+            phi->replaceIncomingBlock(preds[0], split);
+        }
+        split->createInstr<Jump>(bb);
+
+        for (BasicBlock* pred : preds) {
+            retarget(pred->getTerminator(), bb, split);
+            pred->removeSuccessor(bb);
+            pred->addSuccessor(split);
+            split->addPredecessor(pred);
+            bb->removePredecessor(pred);
+        }
+        bb->addPredecessor(split);
+        split->addSuccessor(bb);
+
+        if (domTree) {
+            updateDominatorsAfterSplit(bb, split, preds);
+        }
+        return split;
+    }
+
+    // Folds bb into its predecessor when that is the only edge into bb and
+    // the only edge out of the predecessor. Returns the predecessor, or null
+    // if the blocks could not be merged.
+    BasicBlock* mergeBlockIntoPredecessor(BasicBlock* bb) {
+        BasicBlock* pred = mergeIntoPredecessor(bb);
+        if (pred) {
+            function.removeBasicBlock(bb);
+        }
+        return pred;
+    }
+
+    // mergeBlockIntoPredecessor() for each of blocks in turn, with the
+    // merged blocks taken out of the function in one sweep at the end
+    // instead of one at a time. Returns how many were merged.
+    size_t mergeBlocksIntoPredecessors(const std::vector<BasicBlock*>& blocks) {
+        BlockSet merged(function.getNumBlockIds());
+        for (BasicBlock* bb : blocks) {
+            if (mergeIntoPredecessor(bb)) {
+                merged.insert(bb);
+            }
+        }
+        if (merged.size() != 0) {
+            auto& all = function.getBasicBlocks();
+            all.erase(std::remove_if(all.begin(), all.end(), [&](BasicBlock* bb) { return merged.count(bb); }),
+                      all.end());
+        }
+        return merged.size();
+    }
+
+    // Deletes the blocks that deleteEdge() cut off from the entry. Without
+    // a dominator tree this falls back to a reachability search.
+    bool removeDeadBlocks() {
+        if (!domTree) {
+            bool hadDeadBlocks = mayHaveDeadBlocks;
+            mayHaveDeadBlocks = false;
+            return hadDeadBlocks && CFGAnalysis::removeUnreachableBlocks(function);
+        }
+        if (deadBlocks.empty()) {
+            return false;
+        }
+
+        BlockSet dead(function.getNumBlockIds());
+        for (BasicBlock* block : deadBlocks) {
+            dead.insert(block);
+        }
+        for (BasicBlock* block : deadBlocks) {
+            for (BasicBlock* succ : block->getSuccessors()) {
+                if (!dead.count(succ)) {
+                    removePhiEntries(succ, block);
+                    succ->removePredecessor(block);
+                }
+            }
+            for (auto& instr : block->getInstructions()) {
+                instr.dropAllOperands();
+            }
+        }
+
+        auto& blocks = function.getBasicBlocks();
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                    [&](BasicBlock* block) { return dead.count(block); }),
+                     blocks.end());
+        deadBlocks.clear();
+        return true;
+    }
+
+    // Points the edges of terminator that lead to from at to instead. The
+    // edge lists are left alone.
+    static void retarget(Instruction* terminator, BasicBlock* from, BasicBlock* to) {
+        if (auto* jump = dyn_cast_or_null<Jump>(terminator)) {
+            if (jump->getTarget() == from) {
+                jump->setTarget(to);
+            }
+        } else if (auto* branch = dyn_cast_or_null<CondJump>(terminator)) {
+            if (branch->getTrueTarget() == from) {
+                branch->setTrueTarget(to);
+            }
+            if (branch->getFalseTarget() == from) {
+                branch->setFalseTarget(to);
+            }
+        }
+    }
+
+    // Entries of bb's phis from oldPred now arrive from newPred.
+    static void replacePhiBlocks(BasicBlock* bb, BasicBlock* oldPred, BasicBlock* newPred) {
+        for (auto& instr : bb->getInstructions()) {
+            auto* phi = dyn_cast<Phi>(&instr);
+            if (!phi) {
+                break;
+            }
+            phi->replaceIncomingBlock(oldPred, newPred);
+        }
+    }
+
+private:
+    Function& function;
+    DominatorTree* domTree;
+    std::vector<BasicBlock*> deadBlocks;
+    bool mayHaveDeadBlocks = false;
+
+    // Everything mergeBlockIntoPredecessor() does but removing bb from the
+    // function's block list.
+    BasicBlock* mergeIntoPredecessor(BasicBlock* bb) {
+        if (bb->getPredecessors().size() != 1 || bb == function.getBasicBlocks().front()) {
+            return nullptr;
+        }
+        BasicBlock* pred = bb->getPredecessors().front();
+        if (pred == bb || pred->getSuccessors().size() != 1) {
+            return nullptr;
+        }
+
+        // With a single predecessor every phi has a single incoming value.
+        auto& instructions = bb->getInstructions();
+        while (!instructions.empty()) {
+            auto* phi = dyn_cast<Phi>(&instructions.front());
+            if (!phi) {
+                break;
+            }
+            if (phi->getNumIncoming() != 0) {
+                phi->replaceAllUsesWith(phi->getIncomingValue(0));
+            }
+            phi->eraseFromParent();
+        }
+        pred->getTerminator()->eraseFromParent();
+        auto& predInstructions = pred->getInstructions();
+        predInstructions.splice(predInstructions.end(), instructions, instructions.begin(), instructions.end());
+
+        pred->clearSuccessors();
+        for (BasicBlock* succ : bb->getSuccessors()) {
+            replacePhiBlocks(succ, bb, pred);
+            succ->removePredecessor(bb);
+            succ->addPredecessor(pred);
+            pred->addSuccessor(succ);
+        }
+        bb->clearPredecessors();
+        bb->clearSuccessors();
+        if (domTree) {
+            domTree->mergeBlocks(pred, bb);
+        }
+        return pred;
+    }
+
+
+
+    // split is dominated by the common dominator of the predecessors it
+    // took over, and becomes bb's immediate dominator when every other
+    // edge into bb is a back edge.
+    void updateDominatorsAfterSplit(BasicBlock* bb, BasicBlock* split,
+                                    const std::vector<BasicBlock*>& preds) {
+        BasicBlock* idom = nullptr;
+        for (BasicBlock* pred : preds) {
+            if (domTree->isReachable(pred)) {
+                idom = idom ? domTree->findNearestCommonDominator(idom, pred) : pred;
+            }
+        }
+        if (!idom) {
+            return;
+        }
+        domTree->addNewBlock(split, idom);
+        for (BasicBlock* pred : bb->getPredecessors()) {
+            if (pred != split && domTree->isReachable(pred) && !domTree->dominates(bb, pred)) {
+                return;
+            }
+        }
+        domTree->changeImmediateDominator(bb, split);
+    }
+
+    static void removePhiEntries(BasicBlock* bb, BasicBlock* pred) {
+        for (auto& instr : bb->getInstructions()) {
+            auto* phi = dyn_cast<Phi>(&instr);
+            if (!phi) {
+                break;
+            }
+            phi->removeIncomingBlock(pred);
+        }
+    }
+};
@@ -7,7 +7,7 @@ class NullCheck : public Instruction {
 public:
     explicit NullCheck(Value* object) : Instruction(InstrKind::NullCheck, {object}) {}
 
-    Value* getObject() const { return operands[0]; }
+    Value* getObject() const { return getOperand(0); }
 
     std::string str(NameContext& ctx) const override {
         return "nullcheck " + ctx.getValueName(getObject());
@@ -18,14 +18,16 @@ public:
     void print(std::ostream& os) const override {
         os << "nullcheck " << getObject();
     }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::NullCheck); }
 };
 
 class BoundsCheck : public Instruction {
 public:
     BoundsCheck(Value* object, Value* index) : Instruction(InstrKind::BoundsCheck, {object, index}) {}
 
-    Value* getObject() const { return operands[0]; }
-    Value* getIndex() const { return operands[1]; }
+    Value* getObject() const { return getOperand(0); }
+    Value* getIndex() const { return getOperand(1); }
 
     std::string str(NameContext& ctx) const override {
         return "boundscheck " + ctx.getValueName(getObject()) + ", " + ctx.getValueName(getIndex());
@@ -36,4 +38,32 @@ public:
     void print(std::ostream& os) const override {
         os << "boundscheck " << getObject() << ", " << getIndex();
     }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::BoundsCheck); }
+};
+
+// Checks every index from first to last, both included, against the bounds
+// of object at once. An empty range, first > last, always passes, so a
+// loop that may run zero times can check its whole index range up front.
+class RangeCheck : public Instruction {
+public:
+    RangeCheck(Value* object, Value* first, Value* last)
+        : Instruction(InstrKind::RangeCheck, {object, first, last}) {}
+
+    Value* getObject() const { return getOperand(0); }
+    Value* getFirst() const { return getOperand(1); }
+    Value* getLast() const { return getOperand(2); }
+
+    std::string str(NameContext& ctx) const override {
+        return "rangecheck " + ctx.getValueName(getObject()) + ", " + ctx.getValueName(getFirst()) + ", " +
+               ctx.getValueName(getLast());
+    }
+
+    void updateCFG() override {}
+
+    void print(std::ostream& os) const override {
+        os << "rangecheck " << getObject() << ", " << getFirst() << ", " << getLast();
+    }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::RangeCheck); }
 };
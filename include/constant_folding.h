@@ -1,5 +1,6 @@
 #pragma once
 
+#include "analysis_manager.h"
 #include "instruction.h"
 #include "basic_block.h"
 #include "bin_ops.h"
@@ -15,21 +16,22 @@ public:
         auto& instructions = bb.getInstructions();
 
         for (auto it = instructions.begin(); it != instructions.end(); ) {
-            auto& instr = *it;
+            Instruction* instr = &*it;
 
-            if (auto binaryOp = dynamic_cast<BinaryOp*>(instr.get())) {
-                if (binaryOp->getKind() == InstrKind::Mul ||
+            if (auto binaryOp = dyn_cast<BinaryOp>(instr)) {
+                if (binaryOp->getKind() == InstrKind::Add ||
+                    binaryOp->getKind() == InstrKind::Sub ||
+                    binaryOp->getKind() == InstrKind::Mul ||
                     binaryOp->getKind() == InstrKind::Shr ||
                     binaryOp->getKind() == InstrKind::Shl ||
                     binaryOp->getKind() == InstrKind::And) {
                     std::optional<int> folded = tryFoldBinaryOp(binaryOp);
                     if (folded.has_value()) {
-                        auto foldedInstr = std::make_unique<ConstantInstruction>(*folded);
-                        ConstantInstruction* replacement = foldedInstr.get();
-                        replaceAllUsesWith(binaryOp, replacement, bb);
+                        auto* replacement = bb.getArena().create<ConstantInstruction>(bb.getParent()->getConstant(*folded));
+                        binaryOp->replaceAllUsesWith(replacement);
 
                         binaryOp->dropAllOperands();
-                        *it = std::move(foldedInstr);
+                        it = instructions.replace(it, replacement);
                         changed = true;
                     }
                 }
@@ -43,8 +45,8 @@ public:
 
 private:
     static std::optional<int> tryFoldBinaryOp(BinaryOp* op) {
-        auto lhs = dynamic_cast<Constant*>(op->getOperands()[0]);
-        auto rhs = dynamic_cast<Constant*>(op->getOperands()[1]);
+        auto lhs = asConstant(op->getOperand(0));
+        auto rhs = asConstant(op->getOperand(1));
 
         if (!lhs || !rhs) {
             return std::nullopt;
@@ -55,8 +57,14 @@ private:
         int result;
 
         switch (op->getKind()) {
+            case InstrKind::Add:
+                result = static_cast<int>(static_cast<unsigned int>(lhsVal) + static_cast<unsigned int>(rhsVal));
+                break;
+            case InstrKind::Sub:
+                result = static_cast<int>(static_cast<unsigned int>(lhsVal) - static_cast<unsigned int>(rhsVal));
+                break;
             case InstrKind::Mul:
-                result = lhsVal * rhsVal;
+                result = static_cast<int>(static_cast<unsigned int>(lhsVal) * static_cast<unsigned int>(rhsVal));
                 break;
             case InstrKind::Shr:
                 if (rhsVal < 0 || rhsVal >= 32) {
@@ -68,7 +76,7 @@ private:
                 if (rhsVal < 0 || rhsVal >= 32) {
                     return std::nullopt;
                 }
-                result = lhsVal << rhsVal;
+                result = static_cast<int>(static_cast<unsigned int>(lhsVal) << rhsVal);
                 break;
             case InstrKind::And:
                 result = lhsVal & rhsVal;
@@ -79,22 +87,6 @@ private:
 
         return result;
     }
-
-    static void replaceAllUsesWith(Instruction* oldInstr, Value* newVal, BasicBlock& bb) {
-        auto& instructions = bb.getInstructions();
-
-        bool foundOld = false;
-        for (auto& instr : instructions) {
-            if (instr.get() == oldInstr) {
-                foundOld = true;
-                continue;
-            }
-
-            if (foundOld) {
-                instr->replaceOperand(oldInstr, newVal);
-            }
-        }
-    }
 };
 
 class ConstantFoldingPass {
@@ -110,4 +102,13 @@ public:
 
         return changed;
     }
+
+    // Folds binary operations only, so the CFG survives.
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        bool changed = runOnFunction(function);
+        if (changed) {
+            analyses.invalidate(PreservedAnalyses::cfgShape());
+        }
+        return changed;
+    }
 };
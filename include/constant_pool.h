@@ -0,0 +1,46 @@
+#pragma once
+
+#include "instruction.h"
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Interns the integer constants of one function: each value maps to a single
+// Constant, so equal constants are shared and comparing Constant pointers
+// compares values. The Constants themselves live in the function's arena;
+// the pool only indexes them.
+class ConstantPool {
+    std::unordered_map<int, Constant*> byValue;
+    std::vector<Constant*> constants;
+
+public:
+    Constant* lookup(int value) const {
+        auto it = byValue.find(value);
+        return it == byValue.end() ? nullptr : it->second;
+    }
+
+    void insert(Constant* constant) {
+        if (byValue.emplace(constant->getValue(), constant).second) {
+            constants.push_back(constant);
+        }
+    }
+
+    // Constants in creation order.
+    const std::vector<Constant*>& getConstants() const { return constants; }
+    size_t size() const { return constants.size(); }
+
+    void clear() {
+        byValue.clear();
+        constants.clear();
+    }
+
+    // Approximate bytes held by the pooled Constants and the index.
+    size_t getMemoryUsage() const {
+        using Node = std::pair<const int, Constant*>;
+        return constants.size() * sizeof(Constant) +
+               constants.capacity() * sizeof(Constant*) +
+               byValue.bucket_count() * sizeof(void*) +
+               byValue.size() * (sizeof(Node) + sizeof(void*));
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "basic_block.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
+#include "function.h"
+#include <vector>
+
+// Control-dependence graph built from the post-dominator tree (Ferrante,
+// Ottenstein and Warren): block B is control dependent on A when A has a
+// successor that B post-dominates, but B does not post-dominate A itself.
+// In other words, the branch at the end of A decides whether B runs.
+//
+// For every CFG edge A -> S where S does not post-dominate A, the blocks on
+// the post-dominator tree path from S up to, but excluding, ipdom(A) are the
+// ones that depend on A. Total work is linear in the size of the result.
+class ControlDependenceGraph {
+public:
+    ControlDependenceGraph() = default;
+    ControlDependenceGraph(Function& function, const PostDominatorTree& postDomTree) {
+        recalculate(function, postDomTree);
+    }
+
+    void recalculate(Function& function, const PostDominatorTree& postDomTree) {
+        dependences.reset(function.getNumBlockIds());
+        dependents.reset(function.getNumBlockIds());
+
+        for (auto& block : function.getBasicBlocks()) {
+            BasicBlock* ipdom = postDomTree.getIDom(block);
+            for (BasicBlock* succ : block->getSuccessors()) {
+                if (postDomTree.properlyDominates(succ, block)) {
+                    continue;
+                }
+                for (BasicBlock* runner = succ; runner && runner != ipdom;
+                     runner = postDomTree.getIDom(runner)) {
+                    addDependence(runner, block);
+                }
+            }
+        }
+    }
+
+    // Blocks whose terminator decides whether bb executes.
+    const std::vector<BasicBlock*>& getControllingBlocks(const BasicBlock* bb) const {
+        return dependences.lookup(bb);
+    }
+
+    // Blocks whose execution the terminator of bb decides.
+    const std::vector<BasicBlock*>& getDependentBlocks(const BasicBlock* bb) const {
+        return dependents.lookup(bb);
+    }
+
+    bool isControlDependent(const BasicBlock* bb, const BasicBlock* on) const {
+        for (BasicBlock* controller : getControllingBlocks(bb)) {
+            if (controller == on) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    BlockMap<std::vector<BasicBlock*>> dependences;
+    BlockMap<std::vector<BasicBlock*>> dependents;
+
+    // Both successors of a branch may reach the same dependent block.
+    void addDependence(BasicBlock* bb, BasicBlock* on) {
+        auto& controllers = dependences[bb];
+        if (!controllers.empty() && controllers.back() == on) {
+            return;
+        }
+        controllers.push_back(on);
+        dependents[on].push_back(bb);
+    }
+};
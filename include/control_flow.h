@@ -4,13 +4,21 @@
 #include "basic_block.h"
 #include "context.h"
 
-class Return : public Instruction {
-    Value* retVal;
+// Branches link their targets by pointer; names are only used for printing.
+inline std::string blockName(const BasicBlock* block) {
+    return block ? block->getName() : "<null>";
+}
 
+class Return : public Instruction {
 public:
-    Return(Value* val = nullptr) : Instruction(InstrKind::Return, val ? std::vector<Value*>{val} : std::vector<Value*>{}), retVal(val) {}
+    Return(Value* val = nullptr) : Instruction(InstrKind::Return, {}) {
+        if (val) {
+            addOperand(val);
+        }
+    }
 
     std::string str(NameContext& ctx) const override {
+        Value* retVal = getReturnValue();
         return retVal ? "return " + ctx.getValueName(retVal) : "return";
     }
 
@@ -19,48 +27,36 @@ public:
     }
 
     void print(std::ostream& os) const override {
-        if (retVal) {
+        if (Value* retVal = getReturnValue()) {
             os << "return " << retVal;
         } else {
             os << "return";
         }
     }
 
-    Value* getReturnValue() const { return retVal; }
+    Value* getReturnValue() const { return getNumOperands() ? getOperand(0) : nullptr; }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Return); }
 };
 
 class Jump : public Instruction {
 private:
-    std::string targetName;
     BasicBlock* targetBlock;
-    BasicBlock* parentBlock;
 
 public:
-    Jump(const std::string& target)
-        : Instruction(InstrKind::Jump, {}), targetName(target),
-          targetBlock(nullptr), parentBlock(nullptr) {}
-
-    void setParentBlock(BasicBlock* parent) {
-        parentBlock = parent;
-    }
-
-    void setTargetBlock(BasicBlock* target) {
-        targetBlock = target;
-    }
-
-    const std::string& getTargetName() const {
-        return targetName;
-    }
+    explicit Jump(BasicBlock* target)
+        : Instruction(InstrKind::Jump, {}), targetBlock(target) {}
 
     BasicBlock* getTarget() const {
         return targetBlock;
     }
 
-    void setTargetName(const std::string& target) {
-        targetName = target;
+    void setTarget(BasicBlock* target) {
+        targetBlock = target;
     }
 
     void updateCFG() override {
+        BasicBlock* parentBlock = getParent();
         if (!parentBlock || !targetBlock) {
             return;
         }
@@ -71,49 +67,29 @@ public:
     }
 
     void print(std::ostream& os) const override {
-        os << "jump " << targetName;
+        os << "jump " << blockName(targetBlock);
     }
 
     std::string str(NameContext& /*ctx*/) const override {
-        return "jump " + targetName;
+        return "jump " + blockName(targetBlock);
     }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Jump); }
 };
 
 class CondJump : public Instruction {
 private:
-    std::string condition;
-    std::string trueTargetName;
-    std::string falseTargetName;
     BasicBlock* trueTargetBlock;
     BasicBlock* falseTargetBlock;
-    BasicBlock* parentBlock;
 
 public:
-    CondJump(const std::string& cond, const std::string& trueTarget, const std::string& falseTarget)
-        : Instruction(InstrKind::CondJump, {}),
-          condition(cond), trueTargetName(trueTarget), falseTargetName(falseTarget),
-          trueTargetBlock(nullptr), falseTargetBlock(nullptr), parentBlock(nullptr) {}
-
-    void setParentBlock(BasicBlock* parent) {
-        parentBlock = parent;
-    }
-
-    void setTrueTargetBlock(BasicBlock* target) {
-        trueTargetBlock = target;
-    }
+    // The condition is operand 0; any non-zero value takes the true edge.
+    CondJump(Value* cond, BasicBlock* trueTarget, BasicBlock* falseTarget)
+        : Instruction(InstrKind::CondJump, {cond}),
+          trueTargetBlock(trueTarget), falseTargetBlock(falseTarget) {}
 
-    void setFalseTargetBlock(BasicBlock* target) {
-        falseTargetBlock = target;
-    }
-
-    const std::string& getCondition() const { return condition; }
-    const std::string& getTrueTargetName() const { return trueTargetName; }
-    const std::string& getFalseTargetName() const { return falseTargetName; }
-
-    void setTargetNames(const std::string& trueTarget, const std::string& falseTarget) {
-        trueTargetName = trueTarget;
-        falseTargetName = falseTarget;
-    }
+    Value* getCondition() const { return getOperand(0); }
+    void setCondition(Value* cond) { setOperand(0, cond); }
 
     BasicBlock* getTrueTarget() const {
         return trueTargetBlock;
@@ -123,7 +99,16 @@ public:
         return falseTargetBlock;
     }
 
+    void setTrueTarget(BasicBlock* target) {
+        trueTargetBlock = target;
+    }
+
+    void setFalseTarget(BasicBlock* target) {
+        falseTargetBlock = target;
+    }
+
     void updateCFG() override {
+        BasicBlock* parentBlock = getParent();
         if (!parentBlock) return;
 
         parentBlock->clearSuccessors();
@@ -140,49 +125,80 @@ public:
     }
 
     void print(std::ostream& os) const override {
-        os << "if (" << condition << ") ( jump " << trueTargetName
-           << " ) else ( jump " << falseTargetName << " )\n";
+        os << "if (" << getCondition() << ") ( jump " << blockName(trueTargetBlock)
+           << " ) else ( jump " << blockName(falseTargetBlock) << " )\n";
     }
 
-    std::string str(NameContext& /*ctx*/) const override {
-        return "if (" + condition + ") ( jump " + trueTargetName
-           + " ) else ( jump " + falseTargetName + " )";
+    std::string str(NameContext& ctx) const override {
+        return "if (" + ctx.getValueName(getCondition()) + ") ( jump " + blockName(trueTargetBlock)
+           + " ) else ( jump " + blockName(falseTargetBlock) + " )";
     }
-};
 
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::CondJump); }
+};
 
 class Phi : public Instruction {
-    std::vector<std::pair<BasicBlock*, Value*>> incoming;
+    // Incoming values are the operands; blocks[i] is the predecessor that
+    // supplies operand i. Keeping the values as operands lets use-list
+    // rewrites update phis like any other user.
+    SmallVector<BasicBlock*, 2> blocks;
 
 public:
     Phi() : Instruction(InstrKind::Phi, {}) {}
 
     void addIncoming(BasicBlock* pred, Value* val) {
-        incoming.emplace_back(pred, val);
+        blocks.push_back(pred);
         addOperand(val);
     }
 
     void replaceIncomingValue(Value* oldValue, Value* newValue) {
-        for (auto& [pred, val] : incoming) {
-            (void)pred;
-            if (val == oldValue) {
-                val = newValue;
+        replaceOperand(oldValue, newValue);
+    }
+
+    // Forgets every entry coming from pred, e.g. once the edge is gone.
+    void removeIncomingBlock(BasicBlock* pred) {
+        for (size_t i = blocks.size(); i > 0; --i) {
+            if (blocks[i - 1] == pred) {
+                blocks.erase(blocks.begin() + (i - 1));
+                removeOperand(i - 1);
             }
         }
-        replaceOperand(oldValue, newValue);
+    }
+
+    // Entries from oldPred now arrive from newPred, e.g. after a split.
+    void replaceIncomingBlock(BasicBlock* oldPred, BasicBlock* newPred) {
+        for (auto& block : blocks) {
+            if (block == oldPred) {
+                block = newPred;
+            }
+        }
+    }
+
+    size_t getNumIncoming() const { return blocks.size(); }
+    BasicBlock* getIncomingBlock(size_t i) const { return blocks[i]; }
+    Value* getIncomingValue(size_t i) const { return getOperand(i); }
+
+    // The value arriving from pred, or null if pred supplies none.
+    Value* getIncomingValueForBlock(const BasicBlock* pred) const {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            if (blocks[i] == pred) {
+                return getOperand(i);
+            }
+        }
+        return nullptr;
     }
 
     std::string str(NameContext& ctx) const override {
         std::string s = ctx.getValueName(this) + " = phi ";
-        bool first = true;
-        for (const auto& [pred, val] : incoming) {
-            if (!first) s += ", ";
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            if (i != 0) s += ", ";
+            BasicBlock* pred = blocks[i];
+            Value* val = getOperand(i);
             if (!pred || !val) {
                 s += "[INVALID]";
             } else {
                 s += "[" + ctx.getValueName(val) + ", " + pred->getName() + "]";
             }
-            first = false;
         }
         return s;
     }
@@ -192,13 +208,21 @@ public:
 
     void print(std::ostream& os) const override {
         os << "phi ";
-        bool first = true;
-        for (const auto& [pred, val] : incoming) {
-            if (!first) os << ", ";
-            os << "[" << (val ? "value" : "null") << ", " << (pred ? pred->getName() : "null") << "]";
-            first = false;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            if (i != 0) os << ", ";
+            BasicBlock* pred = blocks[i];
+            os << "[" << (getOperand(i) ? "value" : "null") << ", " << (pred ? pred->getName() : "null") << "]";
+        }
+    }
+
+    std::vector<std::pair<BasicBlock*, Value*>> getIncoming() const {
+        std::vector<std::pair<BasicBlock*, Value*>> incoming;
+        incoming.reserve(blocks.size());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            incoming.emplace_back(blocks[i], getOperand(i));
         }
+        return incoming;
     }
 
-    const std::vector<std::pair<BasicBlock*, Value*>>& getIncoming() const { return incoming; }
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Phi); }
 };
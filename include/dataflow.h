@@ -0,0 +1,186 @@
+#pragma once
+
+#include "basic_block.h"
+#include "bit_vector.h"
+#include "cfg_traversal.h"
+#include "dense_map.h"
+#include "function.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+enum class DataflowDirection { Forward, Backward };
+
+// How the facts of several neighbours combine: Union for "on some path"
+// problems (liveness, reaching definitions), Intersection for "on every
+// path" ones (available expressions or checks).
+enum class DataflowMeet { Union, Intersection };
+
+// Work done by one solve.
+struct DataflowStats {
+    // Passes over the block order until nothing was pending.
+    size_t sweeps = 0;
+    // Transfer functions evaluated.
+    size_t blockVisits = 0;
+    // Visits whose result changed and requeued the neighbours.
+    size_t changes = 0;
+    // 64-bit words processed by meets and transfers.
+    size_t wordOps = 0;
+};
+
+// Iterative solver for gen/kill problems over dense bit sets, where every
+// bit stands for one fact (a value id, a definition, a check...). Each
+// block transfers as
+//
+//     result = gen | (input & ~kill)
+//
+// where, going forward, input is the meet of the predecessors' out sets and
+// the result is the block's out set; going backward, input is the meet of
+// the successors' in sets and the result is the in set.
+//
+// Blocks are processed in reverse post-order (post-order when going
+// backward) from a worklist of order positions, so within one sweep every
+// block sees its forward-edge inputs already updated and only loops cause
+// extra sweeps. Blocks the entry does not reach are not solved and keep
+// their initial sets.
+class BitVectorDataflow {
+public:
+    BitVectorDataflow(Function& fn, DataflowDirection dir, DataflowMeet m, size_t bits)
+        : function(fn), direction(dir), meet(m), numBits(bits), boundary(bits) {
+        const size_t numBlocks = function.getNumBlockIds();
+        gen.reset(numBlocks, BitVector(numBits));
+        kill.reset(numBlocks, BitVector(numBits));
+    }
+
+    // The local facts of bb. Write them before solve().
+    BitVector& getGen(const BasicBlock* bb) { return gen[bb]; }
+    BitVector& getKill(const BasicBlock* bb) { return kill[bb]; }
+
+    // What holds on entry to the function (forward) or on exit from blocks
+    // without successors (backward). Empty unless set.
+    void setBoundary(const BitVector& facts) { boundary = facts; }
+
+    void solve(const ReversePostOrder& rpo) {
+        const size_t numBlocks = function.getNumBlockIds();
+        // Interior sets start at the identity of the meet so the iteration
+        // only ever shrinks (Intersection) or grows (Union) them.
+        const BitVector initial(numBits, meet == DataflowMeet::Intersection);
+        in.reset(numBlocks, initial);
+        out.reset(numBlocks, initial);
+        stats = DataflowStats();
+
+        const std::vector<BasicBlock*>& blocks = rpo.getBlocks();
+        const size_t numPositions = blocks.size();
+        auto blockAt = [&](size_t position) {
+            return direction == DataflowDirection::Forward ? blocks[position]
+                                                           : blocks[numPositions - 1 - position];
+        };
+        auto positionOf = [&](const BasicBlock* bb) {
+            unsigned number = rpo.getNumber(bb);
+            return direction == DataflowDirection::Forward ? number : numPositions - 1 - number;
+        };
+
+        BitVector pending(numPositions, true);
+        BitVector input(numBits);
+        while (pending.any()) {
+            ++stats.sweeps;
+            for (size_t position = 0; position < numPositions; ++position) {
+                if (!pending.test(position)) {
+                    continue;
+                }
+                pending.reset(position);
+                BasicBlock* bb = blockAt(position);
+                ++stats.blockVisits;
+
+                bool changed;
+                if (direction == DataflowDirection::Forward) {
+                    computeInput(bb, bb->getPredecessors(), out, rpo, input);
+                    in[bb] = input;
+                    changed = out[bb].assignTransfer(gen[bb], input, kill[bb]);
+                } else {
+                    computeInput(bb, bb->getSuccessors(), in, rpo, input);
+                    out[bb] = input;
+                    changed = in[bb].assignTransfer(gen[bb], input, kill[bb]);
+                }
+                stats.wordOps += input.numWords();
+                if (!changed) {
+                    continue;
+                }
+                ++stats.changes;
+                const auto& dependents = direction == DataflowDirection::Forward ? bb->getSuccessors()
+                                                                                 : bb->getPredecessors();
+                for (BasicBlock* dependent : dependents) {
+                    if (rpo.isReachable(dependent)) {
+                        pending.set(positionOf(dependent));
+                    }
+                }
+            }
+        }
+    }
+
+    // Facts at the top and at the bottom of bb, whatever the direction.
+    const BitVector& getIn(const BasicBlock* bb) const { return in.lookup(bb); }
+    const BitVector& getOut(const BasicBlock* bb) const { return out.lookup(bb); }
+
+    // Moves the solved sets of bb out of the solver, which leaves them
+    // empty, so a client keeping them does not hold a second copy.
+    BitVector takeIn(const BasicBlock* bb) { return std::move(in[bb]); }
+    BitVector takeOut(const BasicBlock* bb) { return std::move(out[bb]); }
+
+    // Frees the gen and kill sets once solve() no longer needs them.
+    void releaseLocalSets() {
+        gen.clear();
+        kill.clear();
+    }
+
+    const DataflowStats& getStats() const { return stats; }
+    size_t getNumBits() const { return numBits; }
+
+private:
+    Function& function;
+    DataflowDirection direction;
+    DataflowMeet meet;
+    size_t numBits;
+    BitVector boundary;
+    BlockMap<BitVector> gen;
+    BlockMap<BitVector> kill;
+    BlockMap<BitVector> in;
+    BlockMap<BitVector> out;
+    DataflowStats stats;
+
+    // Meets the sets of bb's reachable neighbours into input. The entry
+    // (forward) or a block without successors (backward) also takes the
+    // boundary.
+    void computeInput(const BasicBlock* bb,
+                      const BasicBlock::EdgeList& neighbours,
+                      const BlockMap<BitVector>& sets,
+                      const ReversePostOrder& rpo,
+                      BitVector& input) {
+        bool first = true;
+        auto combine = [&](const BitVector& facts) {
+            if (first) {
+                input = facts;
+                first = false;
+            } else if (meet == DataflowMeet::Union) {
+                input.unionWith(facts);
+            } else {
+                input.intersectWith(facts);
+            }
+            stats.wordOps += facts.numWords();
+        };
+
+        const bool atBoundary = direction == DataflowDirection::Forward ? rpo.getNumber(bb) == 0
+                                                                        : neighbours.empty();
+        if (atBoundary) {
+            combine(boundary);
+        }
+        for (const BasicBlock* neighbour : neighbours) {
+            if (rpo.isReachable(neighbour)) {
+                combine(sets.lookup(neighbour));
+            }
+        }
+        if (first) {
+            input = BitVector(numBits, meet == DataflowMeet::Intersection);
+        }
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "basic_block.h"
+#include "bit_vector.h"
+#include "instruction.h"
+#include <cassert>
+#include <vector>
+
+// Side table indexed by the dense per-function id of a BasicBlock or Value.
+// Size it with Function::getNumBlockIds()/getNumValueIds(); it also grows on
+// demand when an id assigned later is written.
+template<typename KeyT, typename T>
+class DenseIdMap {
+    std::vector<T> data;
+    T defaultValue{};
+
+public:
+    DenseIdMap() = default;
+    explicit DenseIdMap(size_t size, const T& init = T()) : data(size, init), defaultValue(init) {}
+
+    void reset(size_t size, const T& init = T()) {
+        data.assign(size, init);
+        defaultValue = init;
+    }
+
+    T& operator[](const KeyT* key) {
+        unsigned id = key->getId();
+        assert(id != KeyT::NoId && "key has not been numbered by its function");
+        if (id >= data.size()) {
+            data.resize(id + 1, defaultValue);
+        }
+        return data[id];
+    }
+
+    // Read-only access; keys never written yield the default value.
+    const T& lookup(const KeyT* key) const {
+        unsigned id = key->getId();
+        return id < data.size() ? data[id] : defaultValue;
+    }
+
+    size_t size() const { return data.size(); }
+    void clear() { data.clear(); }
+};
+
+template<typename T>
+using BlockMap = DenseIdMap<BasicBlock, T>;
+
+template<typename T>
+using ValueMap = DenseIdMap<Value, T>;
+
+// Set of blocks of one function, stored as a bit per block id.
+class BlockSet {
+    BitVector bits;
+
+public:
+    BlockSet() = default;
+    explicit BlockSet(size_t numBlockIds, bool full = false) : bits(numBlockIds, full) {}
+
+    bool count(const BasicBlock* bb) const {
+        unsigned id = bb->getId();
+        return id < bits.size() && bits.test(id);
+    }
+    void insert(const BasicBlock* bb) {
+        if (bb->getId() >= bits.size()) {
+            bits.resize(bb->getId() + 1);
+        }
+        bits.set(bb->getId());
+    }
+    void erase(const BasicBlock* bb) {
+        if (bb->getId() < bits.size()) {
+            bits.reset(bb->getId());
+        }
+    }
+    size_t size() const { return bits.count(); }
+    bool empty() const { return !bits.any(); }
+
+    void intersectWith(const BlockSet& other) { bits.intersectWith(other.bits); }
+    bool operator==(const BlockSet& other) const { return bits == other.bits; }
+    bool operator!=(const BlockSet& other) const { return bits != other.bits; }
+    const BitVector& getBits() const { return bits; }
+};
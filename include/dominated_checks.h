@@ -1,58 +1,70 @@
 #pragma once
 
+#include "analysis_manager.h"
 #include "basic_block.h"
 #include "cfg.h"
 #include "checks.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
 #include "function.h"
 #include <algorithm>
 #include <cstddef>
 #include <memory>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 class DominatedCheckEliminationPass {
 public:
     static bool runOnFunction(Function& function) {
-        CFGAnalysis::buildCFG(function);
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses);
+    }
 
-        auto dominators = CFGAnalysis::computeDominators(function);
+    // Only erases checks, so the CFG and everything derived from it survive.
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        const DominatorTree& domTree = analyses.getDominatorTree();
         PositionMap positions = buildPositionMap(function);
-        std::vector<BasicBlock*> order = computeRPO(function);
+        std::vector<BasicBlock*> order = domTree.getReversePostOrder();
         appendUnvisitedBlocks(function, order);
 
         bool changed = false;
         for (BasicBlock* block : order) {
             auto& instructions = block->getInstructions();
-            for (size_t i = 0; i < instructions.size(); ++i) {
-                Instruction* check = instructions[i].get();
+            for (auto it = instructions.begin(); it != instructions.end(); ) {
+                Instruction* check = &*it;
+                ++it;
                 if (!isCheck(check)) {
                     continue;
                 }
-                if (hasDominatingEquivalentCheck(check, positions, dominators)) {
-                    check->dropAllOperands();
-                    instructions.erase(instructions.begin() + static_cast<std::ptrdiff_t>(i));
-                    positions = buildPositionMap(function);
+                // Erasing leaves a gap in the numbering but keeps the relative
+                // order of the remaining instructions, so positions stay valid.
+                if (hasDominatingEquivalentCheck(check, positions, domTree)) {
+                    positions[check] = InstrPosition();
+                    check->eraseFromParent();
                     changed = true;
-                    --i;
                 }
             }
         }
 
+        if (changed) {
+            analyses.invalidate(PreservedAnalyses::cfgShape());
+        }
         return changed;
     }
 
 private:
     struct InstrPosition {
-        BasicBlock* block;
-        size_t index;
+        BasicBlock* block = nullptr;
+        size_t index = 0;
     };
 
-    using PositionMap = std::unordered_map<const Instruction*, InstrPosition>;
+    // Indexed by value id; a null block marks values that are not numbered
+    // instructions (parameters, constants, erased checks).
+    using PositionMap = ValueMap<InstrPosition>;
 
     static bool isCheck(const Instruction* instr) {
         return instr && (instr->getKind() == InstrKind::NullCheck ||
-                         instr->getKind() == InstrKind::BoundsCheck);
+                         instr->getKind() == InstrKind::BoundsCheck ||
+                         instr->getKind() == InstrKind::RangeCheck);
     }
 
     static Value* checkedObject(Instruction* check) {
@@ -73,11 +85,11 @@ private:
     }
 
     static PositionMap buildPositionMap(Function& function) {
-        PositionMap positions;
+        PositionMap positions(function.getNumValueIds());
         for (auto& block : function.getBasicBlocks()) {
-            auto& instructions = block->getInstructions();
-            for (size_t i = 0; i < instructions.size(); ++i) {
-                positions[instructions[i].get()] = {block.get(), i};
+            size_t index = 0;
+            for (auto& instr : block->getInstructions()) {
+                positions[&instr] = {block, index++};
             }
         }
         return positions;
@@ -86,71 +98,51 @@ private:
     static bool dominates(const Instruction* candidate,
                           const Instruction* target,
                           const PositionMap& positions,
-                          const std::unordered_map<BasicBlock*, std::unordered_set<BasicBlock*>>& dominators) {
-        auto candidateIt = positions.find(candidate);
-        auto targetIt = positions.find(target);
-        if (candidateIt == positions.end() || targetIt == positions.end()) {
+                          const DominatorTree& domTree) {
+        const InstrPosition& candidatePos = positions.lookup(candidate);
+        const InstrPosition& targetPos = positions.lookup(target);
+        if (!candidatePos.block || !targetPos.block) {
             return false;
         }
 
-        BasicBlock* candidateBlock = candidateIt->second.block;
-        BasicBlock* targetBlock = targetIt->second.block;
-        if (candidateBlock == targetBlock) {
-            return candidateIt->second.index < targetIt->second.index;
+        if (candidatePos.block == targetPos.block) {
+            return candidatePos.index < targetPos.index;
         }
 
-        auto domIt = dominators.find(targetBlock);
-        return domIt != dominators.end() && domIt->second.count(candidateBlock) != 0;
+        return domTree.dominates(candidatePos.block, targetPos.block);
     }
 
     static bool hasDominatingEquivalentCheck(
         Instruction* check,
         const PositionMap& positions,
-        const std::unordered_map<BasicBlock*, std::unordered_set<BasicBlock*>>& dominators) {
+        const DominatorTree& domTree) {
         Value* object = checkedObject(check);
         if (!object) {
             return false;
         }
 
-        std::vector<Instruction*> users = object->getUsers();
-        for (Instruction* user : users) {
-            if (user == check || !sameCheck(user, check)) {
+        for (Instruction* user : object->getUsers()) {
+            // Ids are per function, so users elsewhere must not be looked up.
+            if (user == check || !sameCheck(user, check) || !user->getParent() ||
+                user->getParent()->getParent() != check->getParent()->getParent()) {
                 continue;
             }
-            if (dominates(user, check, positions, dominators)) {
+            if (dominates(user, check, positions, domTree)) {
                 return true;
             }
         }
         return false;
     }
 
-    static std::vector<BasicBlock*> computeRPO(Function& function) {
-        std::vector<BasicBlock*> postOrder;
-        std::unordered_set<BasicBlock*> visited;
-        if (!function.getBasicBlocks().empty()) {
-            dfsPostOrder(function.getBasicBlocks().front().get(), visited, postOrder);
-        }
-        std::reverse(postOrder.begin(), postOrder.end());
-        return postOrder;
-    }
-
-    static void dfsPostOrder(BasicBlock* block,
-                             std::unordered_set<BasicBlock*>& visited,
-                             std::vector<BasicBlock*>& postOrder) {
-        if (!block || !visited.insert(block).second) {
-            return;
-        }
-        for (BasicBlock* succ : block->getSuccessors()) {
-            dfsPostOrder(succ, visited, postOrder);
-        }
-        postOrder.push_back(block);
-    }
-
     static void appendUnvisitedBlocks(Function& function, std::vector<BasicBlock*>& order) {
-        std::unordered_set<BasicBlock*> seen(order.begin(), order.end());
+        BlockSet seen(function.getNumBlockIds());
+        for (BasicBlock* block : order) {
+            seen.insert(block);
+        }
         for (auto& block : function.getBasicBlocks()) {
-            if (seen.insert(block.get()).second) {
-                order.push_back(block.get());
+            if (!seen.count(block)) {
+                seen.insert(block);
+                order.push_back(block);
             }
         }
     }
@@ -0,0 +1,663 @@
+#pragma once
+
+#include "basic_block.h"
+#include "cfg_traversal.h"
+#include "dense_map.h"
+#include "function.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Immediate-dominator tree of a function, computed with the iterative
+// algorithm of Cooper, Harvey and Kennedy over a reverse post-order
+// numbering of the blocks. Each tree node also gets DFS entry/exit numbers,
+// so dominates() is two comparisons instead of a walk up the tree.
+//
+// IsPostDom runs the same algorithm on the reversed CFG. Its root is a
+// virtual exit that is not a block: every block without successors (the
+// Return blocks) hangs below it, and so does one block of every region that
+// never reaches a Return, such as an infinite loop, so each block ends up in
+// the tree. A null block stands for the virtual exit in the results.
+//
+// The tree describes the CFG edges at the time it was built. A dominator
+// tree can follow later edits through the update functions below (see also
+// CFGUpdater); otherwise call recalculate(). Blocks the entry cannot reach
+// are not part of a dominator tree and, as in the set formulation,
+// everything dominates them.
+template<bool IsPostDom>
+class DominatorTreeBase {
+public:
+    static constexpr unsigned NotReached = ~0u;
+
+    DominatorTreeBase() = default;
+    explicit DominatorTreeBase(Function& function) { recalculate(function); }
+
+    void recalculate(Function& function) {
+        numbers.reset(function.getNumBlockIds(), NotReached);
+        blocks.clear();
+        idoms.clear();
+        children.clear();
+        roots.clear();
+        marks.clear();
+        rpo.clear();
+        entry = nullptr;
+        if (function.getBasicBlocks().empty()) {
+            return;
+        }
+        entry = function.getBasicBlocks().front();
+        computeReversePostOrder(function);
+        computeIDoms();
+        // Freshly built nodes are numbered in reverse post-order.
+        rpo.assign(blocks.begin(), blocks.end());
+        rpoValid = true;
+        numberTree();
+    }
+
+    // The entry block, or null (the virtual exit) for post-dominators.
+    BasicBlock* getRoot() const { return blocks.empty() ? nullptr : blocks.front(); }
+
+    // Blocks directly below the virtual exit; just the entry for dominators.
+    const std::vector<BasicBlock*>& getRoots() const { return roots; }
+
+    // Tree nodes in reverse post-order of the (reversed) CFG, root first.
+    // After incremental updates the order is recomputed on first use.
+    const std::vector<BasicBlock*>& getReversePostOrder() const {
+        if (!rpoValid) {
+            recomputeReversePostOrder();
+        }
+        return rpo;
+    }
+
+    bool isReachable(const BasicBlock* bb) const { return nodeOf(bb) != NotReached; }
+
+    // Null for the root, for unreachable blocks and for blocks right below
+    // the virtual exit.
+    BasicBlock* getIDom(const BasicBlock* bb) const {
+        unsigned n = nodeOf(bb);
+        return n == NotReached || idoms[n] == NotReached ? nullptr : blocks[idoms[n]];
+    }
+    const std::vector<BasicBlock*>& getChildren(const BasicBlock* bb) const {
+        static const std::vector<BasicBlock*> none;
+        unsigned n = nodeOf(bb);
+        return n == NotReached ? none : children[n];
+    }
+    unsigned getDFSIn(const BasicBlock* bb) const {
+        unsigned n = nodeOf(bb);
+        ensureDFSNumbers();
+        return n == NotReached ? 0 : dfsIn[n];
+    }
+    unsigned getDFSOut(const BasicBlock* bb) const {
+        unsigned n = nodeOf(bb);
+        ensureDFSNumbers();
+        return n == NotReached ? 0 : dfsOut[n];
+    }
+
+    bool dominates(const BasicBlock* a, const BasicBlock* b) const {
+        unsigned nb = nodeOf(b);
+        if (nb == NotReached) {
+            return true;
+        }
+        unsigned na = nodeOf(a);
+        if (na == NotReached) {
+            return false;
+        }
+        return dominatesNode(na, nb);
+    }
+
+    bool properlyDominates(const BasicBlock* a, const BasicBlock* b) const {
+        return a != b && dominates(a, b);
+    }
+
+    // Deepest node dominating both. Null if either block is unreachable or,
+    // for post-dominators, if only the virtual exit is common.
+    BasicBlock* findNearestCommonDominator(const BasicBlock* a, const BasicBlock* b) const {
+        unsigned na = nodeOf(a);
+        unsigned nb = nodeOf(b);
+        if (na == NotReached || nb == NotReached) {
+            return nullptr;
+        }
+        return blocks[commonDominator(na, nb)];
+    }
+
+    // ----- Incremental updates (dominator trees only) -----
+    //
+    // Each function takes the CFG edges as already changed. Queries stay
+    // exact in between; DFS numbers are rebuilt lazily, so until then
+    // dominates() walks the tree.
+
+    // bb is new and its only path from the entry goes through idom.
+    void addNewBlock(BasicBlock* bb, BasicBlock* idom) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned parent = nodeOf(idom);
+        if (parent == NotReached) {
+            return;
+        }
+        unsigned n = createNode(bb);
+        idoms[n] = parent;
+        children[parent].push_back(bb);
+        invalidateNumbering();
+    }
+
+    void changeImmediateDominator(BasicBlock* bb, BasicBlock* newIDom) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned n = nodeOf(bb);
+        unsigned parent = nodeOf(newIDom);
+        if (n == NotReached || parent == NotReached || idoms[n] == parent) {
+            return;
+        }
+        detachFromParent(n);
+        idoms[n] = parent;
+        children[parent].push_back(bb);
+        invalidateNumbering();
+    }
+
+    // The block must no longer be reachable and must not dominate anything.
+    void eraseBlock(BasicBlock* bb) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned n = nodeOf(bb);
+        if (n == NotReached) {
+            return;
+        }
+        detachFromParent(n);
+        numbers[bb] = NotReached;
+        invalidateNumbering();
+    }
+
+    // tail has taken over every successor of bb, and bb now only jumps to
+    // tail: tail inherits all of bb's children.
+    void splitBlock(BasicBlock* bb, BasicBlock* tail) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned n = nodeOf(bb);
+        if (n == NotReached) {
+            return;
+        }
+        unsigned t = createNode(tail);
+        for (BasicBlock* child : children[n]) {
+            idoms[nodeOf(child)] = t;
+        }
+        children[t] = std::move(children[n]);
+        children[n].assign(1, tail);
+        idoms[t] = n;
+        invalidateNumbering();
+    }
+
+    // absorbed had bb as its only predecessor and was bb's only successor;
+    // its instructions and successors now belong to bb.
+    void mergeBlocks(BasicBlock* bb, BasicBlock* absorbed) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned n = nodeOf(bb);
+        unsigned a = nodeOf(absorbed);
+        if (n == NotReached || a == NotReached) {
+            return;
+        }
+        detachFromParent(a);
+        for (BasicBlock* child : children[a]) {
+            idoms[nodeOf(child)] = n;
+            children[n].push_back(child);
+        }
+        children[a].clear();
+        numbers[absorbed] = NotReached;
+        invalidateNumbering();
+    }
+
+    // from -> to was added. Blocks that only now become reachable get their
+    // dominators computed as a region below from; otherwise only the
+    // subtree of the nearest common dominator of from and to can change.
+    void insertEdge(BasicBlock* from, BasicBlock* to) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned f = nodeOf(from);
+        if (f == NotReached) {
+            return;
+        }
+        unsigned t = nodeOf(to);
+        if (t == NotReached) {
+            attachRegion(f, to);
+            return;
+        }
+        unsigned common = commonDominator(f, t);
+        if (common == t || common == idoms[t]) {
+            return;
+        }
+        recalculateSubtree(common);
+    }
+
+    // from -> to was removed. Every node whose dominators change lies below
+    // the old idom of to (or of a block the dead part branched to), so only
+    // that subtree is recomputed. Blocks that became unreachable are
+    // dropped from the tree and appended to unreachable if given.
+    void deleteEdge(BasicBlock* from, BasicBlock* to, std::vector<BasicBlock*>* unreachable = nullptr) {
+        static_assert(!IsPostDom, "post-dominator trees are recalculated");
+        unsigned f = nodeOf(from);
+        unsigned t = nodeOf(to);
+        if (f == NotReached || t == NotReached || dominatesNode(t, f)) {
+            return;
+        }
+
+        for (BasicBlock* pred : to->getPredecessors()) {
+            unsigned p = nodeOf(pred);
+            if (p != NotReached && !dominatesNode(t, p)) {
+                recalculateSubtree(idoms[t], unreachable);
+                return;
+            }
+        }
+
+        // Nothing outside its subtree reaches to any more, so the whole
+        // subtree is dead; blocks it branched to may lose dominators.
+        std::vector<unsigned> dead = collectSubtree(t);
+        std::vector<unsigned> exits;
+        const unsigned isDead = nextEpoch();
+        for (unsigned d : dead) {
+            marks[d] = isDead;
+        }
+        for (unsigned d : dead) {
+            for (BasicBlock* succ : blocks[d]->getSuccessors()) {
+                unsigned s = nodeOf(succ);
+                if (s != NotReached && marks[s] != isDead) {
+                    exits.push_back(s);
+                }
+            }
+        }
+        unsigned top = idoms[t];
+        for (unsigned s : exits) {
+            top = commonDominator(top, idoms[s]);
+        }
+        detachFromParent(t);
+        for (unsigned d : dead) {
+            numbers[blocks[d]] = NotReached;
+            children[d].clear();
+            if (unreachable) {
+                unreachable->push_back(blocks[d]);
+            }
+        }
+        invalidateNumbering();
+        if (!exits.empty()) {
+            recalculateSubtree(top, unreachable);
+        }
+    }
+
+    // Compares against a tree built from scratch; meant for tests.
+    bool verify(Function& function) const {
+        DominatorTreeBase fresh(function);
+        for (BasicBlock* bb : function.getBasicBlocks()) {
+            if (isReachable(bb) != fresh.isReachable(bb) || getIDom(bb) != fresh.getIDom(bb)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // After this many tree walks the DFS numbers are rebuilt.
+    static constexpr unsigned SlowQueryLimit = 32;
+
+    BasicBlock* entry = nullptr;
+    BlockMap<unsigned> numbers;
+    // Indexed by node. A fresh tree numbers its nodes in reverse post-order
+    // and, for post-dominators, node 0 is the virtual exit with a null
+    // block. Nodes added by updates go at the end; removed ones are left
+    // unused.
+    std::vector<BasicBlock*> blocks;
+    std::vector<unsigned> idoms;
+    std::vector<std::vector<BasicBlock*>> children;
+    std::vector<BasicBlock*> roots;
+
+    mutable std::vector<unsigned> dfsIn;
+    mutable std::vector<unsigned> dfsOut;
+    mutable bool dfsValid = false;
+    mutable unsigned slowQueries = 0;
+    mutable std::vector<BasicBlock*> rpo;
+    mutable bool rpoValid = false;
+    // Scratch marks for walks; a slot is set when it equals the epoch.
+    mutable std::vector<unsigned> marks;
+    mutable unsigned epoch = 0;
+
+    unsigned nodeOf(const BasicBlock* bb) const { return numbers.lookup(bb); }
+
+    static const BasicBlock::EdgeList& forwardEdges(const BasicBlock* bb) {
+        return IsPostDom ? bb->getPredecessors() : bb->getSuccessors();
+    }
+    static const BasicBlock::EdgeList& backwardEdges(const BasicBlock* bb) {
+        return IsPostDom ? bb->getSuccessors() : bb->getPredecessors();
+    }
+
+    unsigned createNode(BasicBlock* bb) {
+        unsigned n = static_cast<unsigned>(blocks.size());
+        blocks.push_back(bb);
+        idoms.push_back(NotReached);
+        children.emplace_back();
+        numbers[bb] = n;
+        return n;
+    }
+
+    void detachFromParent(unsigned n) {
+        if (idoms[n] == NotReached) {
+            return;
+        }
+        auto& siblings = children[idoms[n]];
+        siblings.erase(std::find(siblings.begin(), siblings.end(), blocks[n]));
+    }
+
+    void invalidateNumbering() {
+        dfsValid = false;
+        rpoValid = false;
+        slowQueries = 0;
+    }
+
+    unsigned nextEpoch() const {
+        marks.resize(blocks.size(), 0);
+        return ++epoch;
+    }
+
+    bool dominatesNode(unsigned a, unsigned b) const {
+        if (dfsValid) {
+            return dfsIn[a] <= dfsIn[b] && dfsOut[b] <= dfsOut[a];
+        }
+        if (++slowQueries > SlowQueryLimit) {
+            ensureDFSNumbers();
+            return dominatesNode(a, b);
+        }
+        for (unsigned n = b; n != NotReached; n = idoms[n]) {
+            if (n == a) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Walks up from both nodes in turn, so the cost is bounded by their
+    // distance to the common dominator rather than by the tree depth.
+    unsigned commonDominator(unsigned a, unsigned b) const {
+        const unsigned epochMark = nextEpoch();
+        while (true) {
+            if (a != NotReached) {
+                if (marks[a] == epochMark) {
+                    return a;
+                }
+                marks[a] = epochMark;
+                a = idoms[a];
+            }
+            if (b != NotReached) {
+                if (marks[b] == epochMark) {
+                    return b;
+                }
+                marks[b] = epochMark;
+                b = idoms[b];
+            }
+        }
+    }
+
+    std::vector<unsigned> collectSubtree(unsigned root) const {
+        std::vector<unsigned> nodes{root};
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (BasicBlock* child : children[nodes[i]]) {
+                nodes.push_back(nodeOf(child));
+            }
+        }
+        return nodes;
+    }
+
+    // Explicit stack so long block chains cannot overflow the call stack.
+    // Only blocks accepted by inRegion are entered; visit() marks them.
+    template<typename InRegion, typename Visit>
+    static void appendPostOrder(BasicBlock* start, std::vector<BasicBlock*>& postOrder,
+                                InRegion&& inRegion, Visit&& visit) {
+        std::vector<std::pair<BasicBlock*, size_t>> stack;
+        visit(start);
+        stack.emplace_back(start, 0);
+        while (!stack.empty()) {
+            BasicBlock* bb = stack.back().first;
+            size_t next = stack.back().second;
+            const auto& edges = forwardEdges(bb);
+            if (next < edges.size()) {
+                ++stack.back().second;
+                BasicBlock* succ = edges[next];
+                if (inRegion(succ)) {
+                    visit(succ);
+                    stack.emplace_back(succ, 0);
+                }
+            } else {
+                postOrder.push_back(bb);
+                stack.pop_back();
+            }
+        }
+    }
+
+    // While searching, a number of 0 only marks a block as visited.
+    void computeReversePostOrder(Function& function) {
+        auto& functionBlocks = function.getBasicBlocks();
+        std::vector<BasicBlock*> postOrder;
+        auto unvisited = [this](BasicBlock* bb) { return numbers.lookup(bb) == NotReached; };
+        auto visit = [this](BasicBlock* bb) { numbers[bb] = 0; };
+        if (!IsPostDom) {
+            roots.push_back(entry);
+            appendPostOrder(entry, postOrder, unvisited, visit);
+        } else {
+            for (BasicBlock* bb : functionBlocks) {
+                if (bb->getSuccessors().empty()) {
+                    roots.push_back(bb);
+                    appendPostOrder(bb, postOrder, unvisited, visit);
+                }
+            }
+            // Regions that never reach an exit get an extra root each.
+            for (auto it = functionBlocks.rbegin(); it != functionBlocks.rend(); ++it) {
+                if (numbers.lookup(*it) == NotReached) {
+                    roots.push_back(*it);
+                    appendPostOrder(*it, postOrder, unvisited, visit);
+                }
+            }
+            blocks.push_back(nullptr);
+        }
+        blocks.insert(blocks.end(), postOrder.rbegin(), postOrder.rend());
+        for (unsigned i = IsPostDom ? 1 : 0; i < blocks.size(); ++i) {
+            numbers[blocks[i]] = i;
+        }
+        idoms.assign(blocks.size(), NotReached);
+        children.assign(blocks.size(), {});
+    }
+
+    // A dominator always has a smaller RPO number than the nodes it
+    // dominates, which is what intersect() walks by.
+    void computeIDoms() {
+        std::vector<bool> belowVirtualExit(blocks.size(), false);
+        if (IsPostDom) {
+            for (BasicBlock* root : roots) {
+                belowVirtualExit[numbers[root]] = true;
+            }
+        }
+        std::vector<unsigned> doms =
+            solveIDoms(blocks, [&](unsigned i) { return belowVirtualExit[i]; },
+                       [this](BasicBlock* bb) { return numbers.lookup(bb); });
+        for (unsigned i = 1; i < blocks.size(); ++i) {
+            idoms[i] = doms[i];
+            children[doms[i]].push_back(blocks[i]);
+        }
+    }
+
+    // The Cooper-Harvey-Kennedy iteration over order, a reverse post-order
+    // rooted at order[0]. index() maps a block to its position in order or
+    // NotReached; seeded(i) says order[i] hangs directly below the root.
+    template<typename Seeded, typename Index>
+    static std::vector<unsigned> solveIDoms(const std::vector<BasicBlock*>& order,
+                                            Seeded&& seeded, Index&& index) {
+        std::vector<unsigned> doms(order.size(), NotReached);
+        doms[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (unsigned i = 1; i < order.size(); ++i) {
+                unsigned newIDom = seeded(i) ? 0 : NotReached;
+                for (BasicBlock* pred : backwardEdges(order[i])) {
+                    unsigned p = index(pred);
+                    if (p == NotReached || doms[p] == NotReached) {
+                        continue;
+                    }
+                    newIDom = newIDom == NotReached ? p : intersect(doms, p, newIDom);
+                }
+                if (doms[i] != newIDom) {
+                    doms[i] = newIDom;
+                    changed = true;
+                }
+            }
+        }
+        return doms;
+    }
+
+    static unsigned intersect(const std::vector<unsigned>& doms, unsigned a, unsigned b) {
+        while (a != b) {
+            while (a > b) {
+                a = doms[a];
+            }
+            while (b > a) {
+                b = doms[b];
+            }
+        }
+        return a;
+    }
+
+    // Recomputes the dominators below root from the current edges. All
+    // paths into the subtree pass through root, so the rest of the tree is
+    // unaffected; subtree nodes root no longer reaches are removed.
+    void recalculateSubtree(unsigned root, std::vector<BasicBlock*>* unreachable = nullptr) {
+        std::vector<unsigned> subtree = collectSubtree(root);
+        const unsigned inSubtree = nextEpoch();
+        for (unsigned n : subtree) {
+            marks[n] = inSubtree;
+        }
+
+        // Local RPO positions are kept in the idom slots while solving.
+        const unsigned rootIDom = idoms[root];
+        for (unsigned n : subtree) {
+            idoms[n] = NotReached;
+        }
+        std::vector<BasicBlock*> postOrder;
+        appendPostOrder(
+            blocks[root], postOrder,
+            [&](BasicBlock* bb) {
+                unsigned n = nodeOf(bb);
+                return n != NotReached && marks[n] == inSubtree && idoms[n] == NotReached && n != root;
+            },
+            [&](BasicBlock* bb) { idoms[nodeOf(bb)] = 0; });
+        std::vector<BasicBlock*> order(postOrder.rbegin(), postOrder.rend());
+        for (unsigned i = 0; i < order.size(); ++i) {
+            idoms[nodeOf(order[i])] = i;
+        }
+        auto localIndex = [&](BasicBlock* bb) {
+            unsigned n = nodeOf(bb);
+            return n != NotReached && marks[n] == inSubtree && idoms[n] != NotReached ? idoms[n] : NotReached;
+        };
+        std::vector<unsigned> doms = solveIDoms(order, [](unsigned) { return false; }, localIndex);
+
+        // Nodes the search did not reach still have no idom slot.
+        for (unsigned n : subtree) {
+            children[n].clear();
+            if (n != root && idoms[n] == NotReached) {
+                numbers[blocks[n]] = NotReached;
+                if (unreachable) {
+                    unreachable->push_back(blocks[n]);
+                }
+            }
+        }
+        idoms[root] = rootIDom;
+        for (unsigned i = 1; i < order.size(); ++i) {
+            unsigned parent = nodeOf(order[doms[i]]);
+            idoms[nodeOf(order[i])] = parent;
+            children[parent].push_back(order[i]);
+        }
+        invalidateNumbering();
+    }
+
+    // from -> start made start reachable, along with every not yet
+    // reachable block it leads to. The new region is entered only through
+    // start, so its dominators are solved on their own and hung below from;
+    // edges leaving it are then inserted one by one.
+    void attachRegion(unsigned from, BasicBlock* start) {
+        std::vector<BasicBlock*> postOrder;
+        const unsigned visited = nextEpoch();
+        auto isNew = [&](BasicBlock* bb) { return nodeOf(bb) == NotReached; };
+        // New blocks get their node right away, which also marks them as
+        // visited; the epoch tells the region apart from the rest.
+        auto visit = [&](BasicBlock* bb) {
+            unsigned n = createNode(bb);
+            marks.resize(blocks.size(), 0);
+            marks[n] = visited;
+        };
+        appendPostOrder(start, postOrder, isNew, visit);
+
+        std::vector<BasicBlock*> order(postOrder.rbegin(), postOrder.rend());
+        for (unsigned i = 0; i < order.size(); ++i) {
+            idoms[nodeOf(order[i])] = i;
+        }
+        auto localIndex = [&](BasicBlock* bb) {
+            unsigned n = nodeOf(bb);
+            return n != NotReached && marks[n] == visited ? idoms[n] : NotReached;
+        };
+        std::vector<unsigned> doms = solveIDoms(order, [](unsigned) { return false; }, localIndex);
+
+        std::vector<std::pair<BasicBlock*, BasicBlock*>> exits;
+        for (BasicBlock* bb : order) {
+            for (BasicBlock* succ : bb->getSuccessors()) {
+                if (localIndex(succ) == NotReached) {
+                    exits.emplace_back(bb, succ);
+                }
+            }
+        }
+        for (unsigned i = 1; i < order.size(); ++i) {
+            unsigned parent = nodeOf(order[doms[i]]);
+            idoms[nodeOf(order[i])] = parent;
+            children[parent].push_back(order[i]);
+        }
+        unsigned s = nodeOf(start);
+        idoms[s] = from;
+        children[from].push_back(start);
+        invalidateNumbering();
+
+        for (auto& edge : exits) {
+            insertEdge(edge.first, edge.second);
+        }
+    }
+
+    void ensureDFSNumbers() const {
+        if (dfsValid || blocks.empty()) {
+            return;
+        }
+        dfsIn.assign(blocks.size(), 0);
+        dfsOut.assign(blocks.size(), 0);
+        unsigned counter = 0;
+        std::vector<std::pair<unsigned, size_t>> stack;
+        dfsIn[0] = counter++;
+        stack.emplace_back(0, 0);
+        while (!stack.empty()) {
+            unsigned node = stack.back().first;
+            if (stack.back().second < children[node].size()) {
+                unsigned child = nodeOf(children[node][stack.back().second++]);
+                dfsIn[child] = counter++;
+                stack.emplace_back(child, 0);
+            } else {
+                dfsOut[node] = counter++;
+                stack.pop_back();
+            }
+        }
+        dfsValid = true;
+        slowQueries = 0;
+    }
+
+    void numberTree() {
+        dfsValid = false;
+        ensureDFSNumbers();
+    }
+
+    // Only dominator trees are updated in place, so this is a forward walk.
+    void recomputeReversePostOrder() const {
+        rpo.clear();
+        if (entry) {
+            for (BasicBlock* bb : postOrder(entry)) {
+                rpo.push_back(bb);
+            }
+            std::reverse(rpo.begin(), rpo.end());
+        }
+        rpoValid = true;
+    }
+};
+
+using DominatorTree = DominatorTreeBase<false>;
+using PostDominatorTree = DominatorTreeBase<true>;
@@ -5,14 +5,21 @@
 #include <algorithm>
 
 
+#include "arena.h"
+#include "constant_pool.h"
 #include "instruction.h"
 #include "basic_block.h"
 
 class Function {
+    // Owns every Parameter, Constant, BasicBlock and Instruction of the
+    // function; declared first so it is destroyed after the lists below.
+    Arena arena;
     std::string name;
-    std::vector<std::unique_ptr<Parameter>> parameters;
-    std::vector<std::unique_ptr<Constant>> constants;
-    std::vector<std::unique_ptr<BasicBlock>> basicBlocks;
+    std::vector<Parameter*> parameters;
+    ConstantPool constants;
+    std::vector<BasicBlock*> basicBlocks;
+    unsigned numValueIds = 0;
+    unsigned numBlockIds = 0;
     bool native = false;
     bool external = false;
     bool inlineBlacklisted = false;
@@ -21,25 +28,80 @@ public:
     Function(const std::string& nm) : name(nm) {}
 
     Parameter* createParam(const std::string& nm) {
-        parameters.push_back(std::make_unique<Parameter>(nm));
-        return parameters.back().get();
+        parameters.push_back(arena.create<Parameter>(nm));
+        assignId(parameters.back());
+        return parameters.back();
     }
 
     BasicBlock* createBasicBlock(const std::string& nm) {
-        basicBlocks.push_back(std::make_unique<BasicBlock>(nm));
-        return basicBlocks.back().get();
+        basicBlocks.push_back(arena.create<BasicBlock>(nm, this, arena));
+        basicBlocks.back()->id = numBlockIds++;
+        return basicBlocks.back();
     }
 
+    // Returns the function's unique Constant for value, creating it on first
+    // use. The name only matters for that first request.
     Constant* createConstant(int value, const std::string& nm) {
-        constants.push_back(std::make_unique<Constant>(value, nm));
-        return constants.back().get();
+        if (Constant* existing = constants.lookup(value)) {
+            return existing;
+        }
+        Constant* constant = arena.create<Constant>(value, nm);
+        assignId(constant);
+        constants.insert(constant);
+        return constant;
     }
 
+    Constant* getConstant(int value) { return createConstant(value, std::to_string(value)); }
+
     const std::string& getName() const { return name; }
-    const std::vector<std::unique_ptr<Parameter>>& getParams() const { return parameters; }
-    const std::vector<std::unique_ptr<BasicBlock>>& getBasicBlocks() const { return basicBlocks; }
-    std::vector<std::unique_ptr<BasicBlock>>& getBasicBlocks() { return basicBlocks; }
-    const std::vector<std::unique_ptr<Constant>>& getConstants() const { return constants; }
+    const std::vector<Parameter*>& getParams() const { return parameters; }
+    const std::vector<BasicBlock*>& getBasicBlocks() const { return basicBlocks; }
+    std::vector<BasicBlock*>& getBasicBlocks() { return basicBlocks; }
+    const std::vector<Constant*>& getConstants() const { return constants.getConstants(); }
+    const ConstantPool& getConstantPool() const { return constants; }
+    Arena& getArena() { return arena; }
+
+    // Upper bounds (exclusive) of the value and block ids handed out so far;
+    // size BlockMap/ValueMap side tables with these.
+    unsigned getNumValueIds() const { return numValueIds; }
+    unsigned getNumBlockIds() const { return numBlockIds; }
+
+    void assignId(Value* value) {
+        if (value->id == Value::NoId) {
+            value->id = numValueIds++;
+        }
+    }
+
+    // Compacts ids after deletions: parameters, constants, then instructions
+    // in block order, and blocks in list order. Instructions that are not in
+    // any block keep stale ids and must not be reinserted afterwards.
+    void renumber() {
+        numValueIds = 0;
+        numBlockIds = 0;
+        for (Parameter* param : parameters) {
+            param->id = numValueIds++;
+        }
+        for (Constant* constant : constants.getConstants()) {
+            constant->id = numValueIds++;
+        }
+        for (BasicBlock* block : basicBlocks) {
+            block->id = numBlockIds++;
+            for (Value& instr : block->getInstructions()) {
+                instr.id = numValueIds++;
+            }
+        }
+    }
+
+    // Drops the whole body and rewinds the arena so the function can be
+    // rebuilt (e.g. recompiled) without going back to the system allocator.
+    void clear() {
+        basicBlocks.clear();
+        constants.clear();
+        parameters.clear();
+        arena.reset();
+        numValueIds = 0;
+        numBlockIds = 0;
+    }
 
     void setNative(bool value) { native = value; }
     void setExternal(bool value) { external = value; }
@@ -49,8 +111,7 @@ public:
     bool isInlineBlacklisted() const { return inlineBlacklisted; }
 
     void removeBasicBlock(BasicBlock* block) {
-        basicBlocks.erase(std::remove_if(basicBlocks.begin(), basicBlocks.end(),
-                                         [block](const auto& bb) { return bb.get() == block; }),
+        basicBlocks.erase(std::remove(basicBlocks.begin(), basicBlocks.end(), block),
                           basicBlocks.end());
     }
 };
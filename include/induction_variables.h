@@ -0,0 +1,442 @@
+#pragma once
+
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "control_flow.h"
+#include "dense_map.h"
+#include "function.h"
+#include "instruction.h"
+#include "loop_analysis.h"
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+// A value that changes by the same amount on every iteration of a loop.
+//
+// A basic induction variable is a header phi that enters the loop as start
+// and comes back from the latches as update = phi + step. A derived one is
+// computed inside the loop from a basic one as basis * scale + offset (or
+// - offset), with scale a constant and offset invariant in the loop.
+// Arithmetic wraps at 32 bits, which keeps this algebra exact.
+struct InductionVariable {
+    enum class Kind { Basic, Derived };
+
+    Kind kind = Kind::Basic;
+    Value* value = nullptr;
+    const Loop* loop = nullptr;
+    // Change per iteration; for a derived variable, scale times the step of
+    // its basis.
+    int step = 0;
+
+    // Basic only: the value on entry and the phi's incoming value from the
+    // latches.
+    Value* start = nullptr;
+    Instruction* update = nullptr;
+
+    // Derived only.
+    Phi* basis = nullptr;
+    int scale = 1;
+    // Null when there is none.
+    Value* offset = nullptr;
+    bool subtractsOffset = false;
+
+    bool isBasic() const { return kind == Kind::Basic; }
+};
+
+// The exit test of a loop driven by a basic induction variable. The loop
+// goes on while "tested op bound" holds, where tested is the variable's
+// phi or, when testsUpdate is set, its update; op is turned around as
+// needed to read that way.
+struct LoopBound {
+    const InductionVariable* iv = nullptr;
+    // The loop's only exiting block: its header or its latch.
+    BasicBlock* exiting = nullptr;
+    bool testsUpdate = false;
+    CmpOp op = CmpOp::Lt;
+    Value* bound = nullptr;
+};
+
+// Finds the induction variables of every loop of a LoopInfo and, where the
+// exit test allows, the bound of the loop and its trip count.
+class InductionVariableAnalysis {
+public:
+    InductionVariableAnalysis() = default;
+    InductionVariableAnalysis(Function& function, const LoopInfo& loopInfo) { recalculate(function, loopInfo); }
+
+    // Variables and bounds point into the analysis.
+    InductionVariableAnalysis(const InductionVariableAnalysis&) = delete;
+    InductionVariableAnalysis& operator=(const InductionVariableAnalysis&) = delete;
+
+    void recalculate(Function& function, const LoopInfo& loopInfo) {
+        perLoop.clear();
+        perLoop.reserve(loopInfo.size());
+        loopIndex.reset(function.getNumBlockIds(), -1);
+        byValue.reset(function.getNumValueIds(), nullptr);
+        localIndex.reset(function.getNumValueIds(), -1);
+
+        for (Loop* loop : loopInfo) {
+            loopIndex[loop->header] = static_cast<int>(perLoop.size());
+            perLoop.emplace_back();
+            LoopVariables& info = perLoop.back();
+            findBasic(loop, info.variables);
+            findDerived(loop, info.variables);
+            for (const InductionVariable& iv : info.variables) {
+                byValue[iv.value] = &iv;
+            }
+            info.bound = findBound(loop);
+            if (info.bound) {
+                info.tripCount = computeTripCount(loop, *info.bound);
+            }
+        }
+    }
+
+    // Basic variables first, in header order, then derived ones in the
+    // order of the loop's blocks.
+    const std::vector<InductionVariable>& getInductionVariables(const Loop* loop) const {
+        static const std::vector<InductionVariable> none;
+        const LoopVariables* info = lookup(loop);
+        return info ? info->variables : none;
+    }
+
+    const InductionVariable* getInductionVariable(const Value* value) const { return byValue.lookup(value); }
+
+    const LoopBound* getLoopBound(const Loop* loop) const {
+        const LoopVariables* info = lookup(loop);
+        return info && info->bound ? &*info->bound : nullptr;
+    }
+
+    // How many times the latch runs, when start and bound are constants.
+    std::optional<int64_t> getTripCount(const Loop* loop) const {
+        const LoopVariables* info = lookup(loop);
+        return info ? info->tripCount : std::nullopt;
+    }
+
+    // The number of k >= 0 for which "first + k * step op bound" holds
+    // before it first fails, or nothing if it never fails or the values
+    // leave the 32-bit range on the way.
+    static std::optional<int64_t> countIterations(int64_t first, int64_t step, CmpOp op, int64_t bound) {
+        int64_t count = 0;
+        switch (op) {
+            case CmpOp::Lt:
+            case CmpOp::Le: {
+                int64_t limit = op == CmpOp::Lt ? bound : bound + 1;
+                if (first >= limit) {
+                    return 0;
+                }
+                if (step <= 0) {
+                    return std::nullopt;
+                }
+                count = (limit - first + step - 1) / step;
+                break;
+            }
+            case CmpOp::Gt:
+            case CmpOp::Ge: {
+                int64_t limit = op == CmpOp::Gt ? bound : bound - 1;
+                if (first <= limit) {
+                    return 0;
+                }
+                if (step >= 0) {
+                    return std::nullopt;
+                }
+                count = (first - limit - step - 1) / -step;
+                break;
+            }
+            case CmpOp::Ne:
+                if (first == bound) {
+                    return 0;
+                }
+                if (step == 0 || (bound - first) % step != 0 || (bound - first) / step < 0) {
+                    return std::nullopt;
+                }
+                count = (bound - first) / step;
+                break;
+            case CmpOp::Eq:
+                if (first != bound) {
+                    return 0;
+                }
+                if (step == 0) {
+                    return std::nullopt;
+                }
+                count = 1;
+                break;
+        }
+        int64_t failing = first + count * step;
+        if (failing < std::numeric_limits<int32_t>::min() || failing > std::numeric_limits<int32_t>::max()) {
+            return std::nullopt;
+        }
+        return count;
+    }
+
+    static CmpOp swapped(CmpOp op) {
+        switch (op) {
+            case CmpOp::Lt: return CmpOp::Gt;
+            case CmpOp::Le: return CmpOp::Ge;
+            case CmpOp::Gt: return CmpOp::Lt;
+            case CmpOp::Ge: return CmpOp::Le;
+            default: return op;
+        }
+    }
+
+    static CmpOp inverted(CmpOp op) {
+        switch (op) {
+            case CmpOp::Eq: return CmpOp::Ne;
+            case CmpOp::Ne: return CmpOp::Eq;
+            case CmpOp::Lt: return CmpOp::Ge;
+            case CmpOp::Le: return CmpOp::Gt;
+            case CmpOp::Gt: return CmpOp::Le;
+            case CmpOp::Ge: return CmpOp::Lt;
+        }
+        return op;
+    }
+
+private:
+    struct LoopVariables {
+        std::vector<InductionVariable> variables;
+        std::optional<LoopBound> bound;
+        std::optional<int64_t> tripCount;
+    };
+
+    std::vector<LoopVariables> perLoop;
+    BlockMap<int> loopIndex;
+    ValueMap<const InductionVariable*> byValue;
+    // Index into the variables of the loop being scanned; -1 between loops.
+    ValueMap<int> localIndex;
+
+    const LoopVariables* lookup(const Loop* loop) const {
+        int index = loop ? loopIndex.lookup(loop->header) : -1;
+        return index < 0 ? nullptr : &perLoop[index];
+    }
+
+    static bool isInvariant(Value* value, const Loop* loop) {
+        auto* def = dyn_cast_or_null<Instruction>(value);
+        return value && (!def || !loop->contains(def->getParent()));
+    }
+
+    // A header phi with one value from outside the loop and, from every
+    // latch, the same phi plus or minus a constant.
+    static void findBasic(const Loop* loop, std::vector<InductionVariable>& variables) {
+        for (Instruction& instr : loop->header->getInstructions()) {
+            auto* phi = dyn_cast<Phi>(&instr);
+            if (!phi) {
+                break;
+            }
+            Value* start = nullptr;
+            Value* update = nullptr;
+            bool matches = true;
+            for (size_t i = 0; i < phi->getNumIncoming() && matches; ++i) {
+                Value* incoming = phi->getIncomingValue(i);
+                Value*& slot = loop->contains(phi->getIncomingBlock(i)) ? update : start;
+                matches = incoming && (!slot || slot == incoming);
+                slot = incoming;
+            }
+            if (!matches || !start || !update || !isInvariant(start, loop)) {
+                continue;
+            }
+            auto* updateInstr = dyn_cast<BinaryOp>(update);
+            std::optional<int> step = updateInstr ? getStep(phi, updateInstr) : std::nullopt;
+            if (!step) {
+                continue;
+            }
+            InductionVariable iv;
+            iv.kind = InductionVariable::Kind::Basic;
+            iv.value = phi;
+            iv.loop = loop;
+            iv.step = *step;
+            iv.start = start;
+            iv.update = updateInstr;
+            variables.push_back(iv);
+        }
+    }
+
+    // The constant update adds to phi, if update is phi + c, c + phi or
+    // phi - c.
+    static std::optional<int> getStep(const Phi* phi, const BinaryOp* update) {
+        Value* lhs = update->getOperand(0);
+        Value* rhs = update->getOperand(1);
+        if (update->getKind() == InstrKind::Add) {
+            if (lhs != phi) {
+                std::swap(lhs, rhs);
+            }
+            Constant* amount = asConstant(rhs);
+            if (lhs == phi && amount) {
+                return amount->getValue();
+            }
+        } else if (update->getKind() == InstrKind::Sub && lhs == phi) {
+            if (Constant* amount = asConstant(rhs)) {
+                return wrap(-static_cast<int64_t>(amount->getValue()));
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Visits the blocks in reverse post-order, so the variable an
+    // instruction derives from has been seen.
+    void findDerived(const Loop* loop, std::vector<InductionVariable>& variables) {
+        // Lookups go through indices: the vector grows while it is scanned.
+        for (size_t i = 0; i < variables.size(); ++i) {
+            localIndex[variables[i].value] = static_cast<int>(i);
+        }
+        for (BasicBlock* bb : loop->blocks) {
+            for (Instruction& instr : bb->getInstructions()) {
+                auto* binary = dyn_cast<BinaryOp>(&instr);
+                if (!binary) {
+                    continue;
+                }
+                std::optional<InductionVariable> derived = matchDerived(binary, loop, variables, localIndex);
+                if (derived) {
+                    localIndex[binary] = static_cast<int>(variables.size());
+                    variables.push_back(*derived);
+                }
+            }
+        }
+        for (const InductionVariable& iv : variables) {
+            localIndex[iv.value] = -1;
+        }
+    }
+
+    static std::optional<InductionVariable> matchDerived(BinaryOp* instr, const Loop* loop,
+                                                         const std::vector<InductionVariable>& variables,
+                                                         const ValueMap<int>& local) {
+        Value* lhs = instr->getOperand(0);
+        Value* rhs = instr->getOperand(1);
+        int lhsIndex = local.lookup(lhs);
+        int rhsIndex = local.lookup(rhs);
+        InstrKind kind = instr->getKind();
+        bool commutes = kind == InstrKind::Add || kind == InstrKind::Mul;
+        if (lhsIndex < 0 && commutes) {
+            std::swap(lhs, rhs);
+            std::swap(lhsIndex, rhsIndex);
+        }
+        bool reversedSub = false;
+        if (lhsIndex < 0 && kind == InstrKind::Sub) {
+            // invariant - iv
+            std::swap(lhs, rhs);
+            std::swap(lhsIndex, rhsIndex);
+            reversedSub = true;
+        }
+        if (lhsIndex < 0 || rhsIndex >= 0 || !isInvariant(rhs, loop)) {
+            return std::nullopt;
+        }
+
+        const InductionVariable& from = variables[lhsIndex];
+        InductionVariable iv;
+        iv.kind = InductionVariable::Kind::Derived;
+        iv.value = instr;
+        iv.loop = loop;
+        iv.basis = from.isBasic() ? cast<Phi>(from.value) : from.basis;
+        iv.scale = from.isBasic() ? 1 : from.scale;
+        iv.offset = from.isBasic() ? nullptr : from.offset;
+        iv.subtractsOffset = from.isBasic() ? false : from.subtractsOffset;
+
+        // Building on a variable that already has an offset would need a
+        // new value for the combined offset.
+        if (iv.offset) {
+            return std::nullopt;
+        }
+        Constant* constant = asConstant(rhs);
+        switch (kind) {
+            case InstrKind::Add:
+                iv.offset = rhs;
+                break;
+            case InstrKind::Sub:
+                iv.offset = rhs;
+                if (reversedSub) {
+                    iv.scale = wrap(-static_cast<int64_t>(iv.scale));
+                } else {
+                    iv.subtractsOffset = true;
+                }
+                break;
+            case InstrKind::Mul:
+                if (!constant) {
+                    return std::nullopt;
+                }
+                iv.scale = wrap(static_cast<int64_t>(iv.scale) * constant->getValue());
+                break;
+            case InstrKind::Shl:
+                if (!constant || constant->getValue() < 0 || constant->getValue() > 30) {
+                    return std::nullopt;
+                }
+                iv.scale = wrap(static_cast<int64_t>(iv.scale) * (int64_t{1} << constant->getValue()));
+                break;
+            default:
+                return std::nullopt;
+        }
+        int basisStep = variables[local.lookup(iv.basis)].step;
+        iv.step = wrap(static_cast<int64_t>(iv.scale) * basisStep);
+        return iv;
+    }
+
+    // The loop must leave from one block, its header or its latch, on a
+    // comparison of a basic variable against an invariant bound.
+    std::optional<LoopBound> findBound(const Loop* loop) const {
+        BasicBlock* latch = loop->getLatch();
+        if (!latch || loop->exits.size() != 1) {
+            return std::nullopt;
+        }
+        BasicBlock* exiting = loop->exits[0];
+        if (exiting != loop->header && exiting != latch) {
+            return std::nullopt;
+        }
+        auto* branch = dyn_cast_or_null<CondJump>(exiting->getTerminator());
+        auto* test = branch ? dyn_cast_or_null<Cmp>(branch->getCondition()) : nullptr;
+        if (!test || test->getParent() != exiting) {
+            return std::nullopt;
+        }
+        bool continueOnTrue = loop->contains(branch->getTrueTarget());
+        if (continueOnTrue == loop->contains(branch->getFalseTarget())) {
+            return std::nullopt;
+        }
+
+        for (size_t side = 0; side < 2; ++side) {
+            Value* tested = test->getOperand(side);
+            Value* bound = test->getOperand(1 - side);
+            const InductionVariable* iv = getInductionVariable(tested);
+            bool testsUpdate = false;
+            if (!iv || !iv->isBasic()) {
+                // The update is recorded as derived; find the variable it
+                // updates.
+                iv = iv && !iv->isBasic() ? getInductionVariable(iv->basis) : nullptr;
+                testsUpdate = iv && iv->update == tested;
+            }
+            if (!iv || !iv->isBasic() || iv->loop != loop || (!testsUpdate && iv->value != tested) ||
+                !isInvariant(bound, loop)) {
+                continue;
+            }
+            LoopBound result;
+            result.iv = iv;
+            result.exiting = exiting;
+            result.testsUpdate = testsUpdate;
+            result.op = side == 0 ? test->getCmpOp() : swapped(test->getCmpOp());
+            if (!continueOnTrue) {
+                result.op = inverted(result.op);
+            }
+            result.bound = bound;
+            return result;
+        }
+        return std::nullopt;
+    }
+
+    // Iteration k tests start + (k + testsUpdate) * step. Leaving from the
+    // header skips the latch on the last test; leaving from the latch does
+    // not.
+    static std::optional<int64_t> computeTripCount(const Loop* loop, const LoopBound& bound) {
+        Constant* start = asConstant(bound.iv->start);
+        Constant* limit = asConstant(bound.bound);
+        if (!start || !limit) {
+            return std::nullopt;
+        }
+        int64_t step = bound.iv->step;
+        int64_t first = start->getValue() + (bound.testsUpdate ? step : 0);
+        if (first < std::numeric_limits<int32_t>::min() || first > std::numeric_limits<int32_t>::max()) {
+            return std::nullopt;
+        }
+        std::optional<int64_t> passes = countIterations(first, step, bound.op, limit->getValue());
+        if (!passes) {
+            return std::nullopt;
+        }
+        return bound.exiting == loop->getLatch() ? *passes + 1 : *passes;
+    }
+
+    static int wrap(int64_t value) { return static_cast<int>(static_cast<uint32_t>(value)); }
+};
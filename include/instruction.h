@@ -3,6 +3,13 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+
+#include "casting.h"
+#include "small_vector.h"
 
 class BasicBlock;
 class NameContext;
@@ -24,20 +31,139 @@ enum class InstrKind {
     Call,
     Constant,
     NullCheck,
-    BoundsCheck
+    BoundsCheck,
+    RangeCheck,
+    Spill,
+    Reload,
+    Move
+};
+
+class Value;
+
+// One operand slot of an Instruction. Every Use is threaded onto the use
+// list of the value it refers to, so adding, dropping or retargeting an
+// operand is O(1) no matter how many other uses the value has.
+class Use {
+    friend class Value;
+
+    Value* val = nullptr;
+    Instruction* user = nullptr;
+    Use* prev = nullptr;
+    Use* next = nullptr;
+
+    void link();
+    void unlink();
+
+public:
+    Use(Value* v, Instruction* u) : user(u) { set(v); }
+    // Moving takes over the other Use's place in the use list, so operand
+    // storage may relocate its elements freely.
+    Use(Use&& other) noexcept;
+    Use& operator=(Use&& other) noexcept;
+    Use(const Use&) = delete;
+    Use& operator=(const Use&) = delete;
+    ~Use() { unlink(); }
+
+    Value* get() const { return val; }
+    Instruction* getUser() const { return user; }
+    Use* getNext() const { return next; }
+    void set(Value* v);
+
+    operator Value*() const { return val; }
+};
+
+template<typename It>
+class IteratorRange {
+    It first;
+    It last;
+    size_t count;
+
+public:
+    IteratorRange(It b, It e, size_t n) : first(b), last(e), count(n) {}
+    It begin() const { return first; }
+    It end() const { return last; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
 };
 
 class Value {
-    std::vector<Instruction*> users;
+    friend class Use;
+    friend class Function;
 
 public:
     enum class ValueKind { Parameter, Constant, Instruction };
+    static constexpr unsigned NoId = ~0u;
+
+private:
+    Use* useList = nullptr;
+    size_t numUses = 0;
+    // Dense index within the owning function, assigned by Function.
+    unsigned id = NoId;
+    // Fixed at construction; drives classof() and so isa/cast/dyn_cast.
+    const ValueKind valueKind;
+
+public:
+
+    // Walks a value's use list; Deref picks what each step yields.
+    template<typename Deref>
+    class UseListIterator {
+        Use* use;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = decltype(Deref()(std::declval<Use*>()));
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        explicit UseListIterator(Use* u = nullptr) : use(u) {}
+        value_type operator*() const { return Deref()(use); }
+        UseListIterator& operator++() {
+            use = use->getNext();
+            return *this;
+        }
+        UseListIterator operator++(int) {
+            UseListIterator old = *this;
+            use = use->getNext();
+            return old;
+        }
+        bool operator==(const UseListIterator& other) const { return use == other.use; }
+        bool operator!=(const UseListIterator& other) const { return use != other.use; }
+    };
+
+    struct UseDeref {
+        Use* operator()(Use* u) const { return u; }
+    };
+    struct UserDeref {
+        Instruction* operator()(Use* u) const { return u->getUser(); }
+    };
+
+    using use_iterator = UseListIterator<UseDeref>;
+    using user_iterator = UseListIterator<UserDeref>;
+
+    explicit Value(ValueKind k) : valueKind(k) {}
+    Value(const Value&) = delete;
+    Value& operator=(const Value&) = delete;
+
     virtual std::string str(NameContext& ctx) const = 0;
-    virtual ValueKind getValueKind() const = 0;
-    void addUser(Instruction* user);
-    void removeUser(Instruction* user);
-    const std::vector<Instruction*>& getUsers() const;
-    virtual ~Value() = default;
+    ValueKind getValueKind() const { return valueKind; }
+    static bool classof(const Value*) { return true; }
+
+    IteratorRange<use_iterator> getUses() const {
+        return {use_iterator(useList), use_iterator(), numUses};
+    }
+    // One entry per use: an instruction using the value twice is listed twice.
+    IteratorRange<user_iterator> getUsers() const {
+        return {user_iterator(useList), user_iterator(), numUses};
+    }
+    unsigned getId() const { return id; }
+    size_t getNumUses() const { return numUses; }
+    bool hasUses() const { return numUses != 0; }
+
+    // Points every use of this value at newValue in O(number of uses).
+    void replaceAllUsesWith(Value* newValue);
+
+    virtual ~Value();
 };
 
 class Parameter : public Value {
@@ -48,7 +174,8 @@ public:
     std::string str(NameContext& ctx) const override;
     std::string getName() const;
     virtual ~Parameter() = default;
-    ValueKind getValueKind() const override;
+
+    static bool classof(const Value* v) { return v->getValueKind() == ValueKind::Parameter; }
 };
 
 class Constant : public Value {
@@ -57,27 +184,91 @@ class Constant : public Value {
 
 public:
     Constant(int v, const std::string& n);
-    ValueKind getValueKind() const override;
     std::string str(NameContext& ctx) const override;
     int getValue() const;
     std::string getName() const;
+
+    static bool classof(const Value* v) { return v->getValueKind() == ValueKind::Constant; }
 };
 
 class Instruction : public Value {
+    friend class InstructionList;
+
+    // Intrusive links into the parent block's instruction list.
+    Instruction* prev = nullptr;
+    Instruction* next = nullptr;
+    BasicBlock* parent = nullptr;
+
+public:
+    // Most instructions have at most two operands; those stay inline.
+    using OperandList = SmallVector<Use, 2>;
+
 protected:
     InstrKind kind;
-    std::vector<Value*> operands;
+    OperandList operands;
     void addOperand(Value* operand);
+    void removeOperand(size_t i) { operands.erase(operands.begin() + i); }
 
 public:
+    // Read-only view of the operand values.
+    class OperandRange {
+        const OperandList* uses;
+
+    public:
+        class iterator {
+            OperandList::const_iterator it;
+
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value*;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = Value*;
+
+            explicit iterator(OperandList::const_iterator i) : it(i) {}
+            Value* operator*() const { return it->get(); }
+            iterator& operator++() { ++it; return *this; }
+            iterator operator++(int) { iterator old = *this; ++it; return old; }
+            iterator& operator--() { --it; return *this; }
+            iterator operator+(difference_type n) const { return iterator(it + n); }
+            difference_type operator-(const iterator& other) const { return it - other.it; }
+            bool operator==(const iterator& other) const { return it == other.it; }
+            bool operator!=(const iterator& other) const { return it != other.it; }
+        };
+
+        explicit OperandRange(const OperandList& u) : uses(&u) {}
+        iterator begin() const { return iterator(uses->begin()); }
+        iterator end() const { return iterator(uses->end()); }
+        size_t size() const { return uses->size(); }
+        bool empty() const { return uses->empty(); }
+        Value* operator[](size_t i) const { return (*uses)[i].get(); }
+    };
+
+    Instruction(InstrKind k, std::initializer_list<Value*> ops);
     Instruction(InstrKind k, const std::vector<Value*>& ops);
-    virtual InstrKind getKind() const;
-    virtual const std::vector<Value*>& getOperands() const;
-    virtual std::vector<Value*>& getOperands();
+    InstrKind getKind() const { return kind; }
+    OperandRange getOperands() const { return OperandRange(operands); }
+    Value* getOperand(size_t i) const { return operands[i].get(); }
+    void setOperand(size_t i, Value* value) { operands[i].set(value); }
+    size_t getNumOperands() const { return operands.size(); }
+    const OperandList& getOperandUses() const { return operands; }
     void replaceOperand(Value* oldValue, Value* newValue);
     void dropAllOperands();
+
+    BasicBlock* getParent() const { return parent; }
+    Instruction* getPrev() const { return prev; }
+    Instruction* getNext() const { return next; }
+    // Unlinks the instruction from its block; the arena keeps the memory.
+    void removeFromParent();
+    // Unlinks the instruction and drops its operands.
+    void eraseFromParent();
     virtual ~Instruction();
-    ValueKind getValueKind() const override;
+
+    static bool classof(const Value* v) { return v->getValueKind() == ValueKind::Instruction; }
+    // Shared by the classof() of the instruction subclasses.
+    static bool hasKind(const Value* v, InstrKind k) {
+        return classof(v) && static_cast<const Instruction*>(v)->getKind() == k;
+    }
 
     virtual void updateCFG() = 0;
     virtual void print(std::ostream& os) const = 0;
@@ -88,19 +279,31 @@ public:
     }
 };
 
+// Materializes a pooled Constant of the parent function as an instruction.
 class ConstantInstruction : public Instruction {
-    std::unique_ptr<Constant> constant;
+    Constant* constant;
 
 public:
-    ConstantInstruction(int value, const std::string& name)
-        : Instruction(InstrKind::Constant, {}), constant(std::make_unique<Constant>(value, name)) {}
-
-    explicit ConstantInstruction(int value) : ConstantInstruction(value, std::to_string(value)) {}
+    explicit ConstantInstruction(Constant* c) : Instruction(InstrKind::Constant, {}), constant(c) {}
 
-    const Constant* getConstant() const { return constant.get(); }
-    Constant* getConstant() { return constant.get(); }
+    const Constant* getConstant() const { return constant; }
+    Constant* getConstant() { return constant; }
 
     std::string str(NameContext& ctx) const override;
     void updateCFG() override {}
     void print(std::ostream& os) const override;
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Constant); }
 };
+
+// Returns the constant a value is known to hold: either a Constant itself or
+// the Constant materialized by a ConstantInstruction.
+inline Constant* asConstant(Value* value) {
+    if (auto* constant = dyn_cast_or_null<Constant>(value)) {
+        return constant;
+    }
+    if (auto* constInstr = dyn_cast_or_null<ConstantInstruction>(value)) {
+        return constInstr->getConstant();
+    }
+    return nullptr;
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "dense_map.h"
+#include "function.h"
+#include "instruction.h"
+#include "liveness_analysis.h"
+#include "register_allocator.h"
+#include "spill_ops.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Runs a function on integer arguments and counts the work done, so a
+// transformation can be measured by the instructions it saves rather than
+// by reading the IR. Values are 32-bit integers with wrap-around
+// arithmetic; Shr is a logical shift, and a shift by an amount outside
+// 0..31 yields 0, as PeepholeOptimizer assumes. There is no
+// memory: an object is its length, so a NullCheck on zero traps and a
+// BoundsCheck traps unless 0 <= index < object. A RangeCheck traps when a
+// non-empty range is not inside [0, object). Spill and Reload move values
+// through a frame of stack slots per call; a reload overwrites the value
+// with what its slot holds, so a slot shared by mistake shows up in the
+// result.
+//
+// Given a register allocation, the function it was computed for runs on
+// the machine instead: every value is read from and written to the
+// register or slot it has at that position, and phis do nothing, so the
+// Moves of PhiEliminationPass must carry their inputs. Run that way after
+// SpillCodePass and PhiEliminationPass, a wrong spill, reload or move
+// order changes the result. Functions it calls run on values.
+class Interpreter {
+public:
+    enum class Status { Returned, Trapped, StepLimit, BadCall };
+
+    struct Result {
+        Status status = Status::Returned;
+        // The returned value, 0 for a plain return.
+        int value = 0;
+        // Instructions executed, phis and terminators included, over every
+        // call made.
+        size_t instructions = 0;
+        size_t blocks = 0;
+        size_t calls = 0;
+        size_t checks = 0;
+        size_t spills = 0;
+        size_t reloads = 0;
+        size_t moves = 0;
+
+        bool ok() const { return status == Status::Returned; }
+    };
+
+    // Stops with StepLimit after maxInstructions so a miscompiled loop
+    // cannot hang a test.
+    static Result run(Function& function, const std::vector<int>& args,
+                      size_t maxInstructions = 100000000) {
+        Result result;
+        Interpreter interpreter(result, maxInstructions);
+        result.value = interpreter.call(function, args, 0);
+        return result;
+    }
+
+    // liveness is the one the allocation was computed on; its numbering
+    // tells where each original instruction reads and writes.
+    static Result run(Function& function, const std::vector<int>& args, const RegisterAllocator& allocator,
+                      const LivenessAnalysis& liveness, size_t maxInstructions = 100000000) {
+        Result result;
+        Interpreter interpreter(result, maxInstructions);
+        interpreter.machine = {&function, &allocator, &liveness};
+        result.value = interpreter.call(function, args, 0);
+        return result;
+    }
+
+private:
+    static constexpr int MaxCallDepth = 1000;
+
+    struct Machine {
+        Function* function = nullptr;
+        const RegisterAllocator* allocator = nullptr;
+        const LivenessAnalysis* liveness = nullptr;
+    };
+
+    // One call. On the machine, values holds only the constants.
+    struct Frame {
+        ValueMap<int> values;
+        bool onMachine = false;
+        std::vector<int> registers;
+        std::vector<int> slots;
+    };
+
+    Result& result;
+    size_t limit;
+    Machine machine;
+
+    Interpreter(Result& r, size_t maxInstructions) : result(r), limit(maxInstructions) {}
+
+    bool stopped() const { return result.status != Status::Returned; }
+
+    bool step() {
+        if (++result.instructions > limit) {
+            result.status = Status::StepLimit;
+            return false;
+        }
+        return true;
+    }
+
+    int call(Function& function, const std::vector<int>& args, int depth) {
+        ++result.calls;
+        const auto& params = function.getParams();
+        if (depth > MaxCallDepth || function.getBasicBlocks().empty() || args.size() != params.size()) {
+            result.status = Status::BadCall;
+            return 0;
+        }
+
+        Frame frame{ValueMap<int>(function.getNumValueIds(), 0), &function == machine.function, {}, {}};
+        if (frame.onMachine) {
+            frame.registers.assign(machine.allocator->getNumRegisters() + 1, 0);
+            for (size_t i = 0; i < params.size(); ++i) {
+                store(frame, machine.allocator->getLocation(params[i]), args[i]);
+            }
+        } else {
+            for (size_t i = 0; i < params.size(); ++i) {
+                frame.values[params[i]] = args[i];
+            }
+        }
+        for (Constant* constant : function.getConstants()) {
+            frame.values[constant] = constant->getValue();
+        }
+
+        BasicBlock* pred = nullptr;
+        BasicBlock* bb = function.getBasicBlocks().front();
+        std::vector<int> incoming;
+        while (!stopped()) {
+            ++result.blocks;
+            auto& instructions = bb->getInstructions();
+            auto it = instructions.begin();
+
+            // Phis read their inputs on the edge, all at once.
+            incoming.clear();
+            for (auto phiIt = it; phiIt != instructions.end(); ++phiIt) {
+                auto* phi = dyn_cast<Phi>(&*phiIt);
+                if (!phi) {
+                    break;
+                }
+                incoming.push_back(frame.onMachine ? 0 : incomingValue(phi, pred, frame.values));
+            }
+            for (int value : incoming) {
+                if (!step()) {
+                    return 0;
+                }
+                if (!frame.onMachine) {
+                    frame.values[&*it] = value;
+                }
+                ++it;
+            }
+
+            BasicBlock* next = nullptr;
+            for (; it != instructions.end(); ++it) {
+                Instruction* instr = &*it;
+                if (!step()) {
+                    return 0;
+                }
+                switch (instr->getKind()) {
+                    case InstrKind::Jump:
+                        next = cast<Jump>(instr)->getTarget();
+                        break;
+                    case InstrKind::CondJump: {
+                        auto* branch = cast<CondJump>(instr);
+                        next = read(frame, branch->getCondition(), instr) ? branch->getTrueTarget()
+                                                                         : branch->getFalseTarget();
+                        break;
+                    }
+                    case InstrKind::Return: {
+                        Value* retVal = cast<Return>(instr)->getReturnValue();
+                        return retVal ? read(frame, retVal, instr) : 0;
+                    }
+                    case InstrKind::Call: {
+                        auto* callInstr = cast<Call>(instr);
+                        std::vector<int> callArgs;
+                        for (Value* arg : callInstr->getOperands()) {
+                            callArgs.push_back(read(frame, arg, instr));
+                        }
+                        if (!callInstr->getCallee()) {
+                            result.status = Status::BadCall;
+                            return 0;
+                        }
+                        int value = call(*callInstr->getCallee(), callArgs, depth + 1);
+                        if (stopped()) {
+                            return 0;
+                        }
+                        write(frame, instr, value);
+                        break;
+                    }
+                    case InstrKind::NullCheck:
+                        ++result.checks;
+                        if (read(frame, instr->getOperand(0), instr) == 0) {
+                            result.status = Status::Trapped;
+                            return 0;
+                        }
+                        break;
+                    case InstrKind::BoundsCheck:
+                    case InstrKind::RangeCheck:
+                        ++result.checks;
+                        if (!inBounds(frame, instr)) {
+                            result.status = Status::Trapped;
+                            return 0;
+                        }
+                        break;
+                    case InstrKind::Spill: {
+                        ++result.spills;
+                        auto* spill = cast<Spill>(instr);
+                        Value* v = spill->getSpilledValue();
+                        slot(frame, spill->getSlot()) =
+                            frame.onMachine ? load(frame, machine.allocator->getLocation(v)) : frame.values.lookup(v);
+                        break;
+                    }
+                    case InstrKind::Reload: {
+                        ++result.reloads;
+                        auto* reload = cast<Reload>(instr);
+                        if (!frame.onMachine) {
+                            frame.values[reload->getReloadedValue()] = slot(frame, reload->getSlot());
+                        } else if (reload->getRegister() >= 0) {
+                            // A reload into the scratch register only marks
+                            // a read from the stack, which reads the slot.
+                            frame.registers[reload->getRegister()] = slot(frame, reload->getSlot());
+                        }
+                        break;
+                    }
+                    case InstrKind::Move: {
+                        // Off the machine the phis carry the values.
+                        ++result.moves;
+                        auto* move = cast<Move>(instr);
+                        if (frame.onMachine) {
+                            int value = move->getFrom().isNone() ? frame.values.lookup(move->getMovedValue())
+                                                                 : load(frame, move->getFrom());
+                            store(frame, move->getTo(), value);
+                        }
+                        break;
+                    }
+                    case InstrKind::Constant:
+                        write(frame, instr, cast<ConstantInstruction>(instr)->getConstant()->getValue());
+                        break;
+                    case InstrKind::Cmp:
+                        write(frame, instr,
+                              compare(cast<Cmp>(instr)->getCmpOp(), read(frame, instr->getOperand(0), instr),
+                                      read(frame, instr->getOperand(1), instr)));
+                        break;
+                    default:
+                        write(frame, instr,
+                              arithmetic(instr->getKind(), read(frame, instr->getOperand(0), instr),
+                                         read(frame, instr->getOperand(1), instr)));
+                        break;
+                }
+                if (next) {
+                    break;
+                }
+            }
+            if (!next) {
+                // Fell off a block without a terminator.
+                result.status = Status::BadCall;
+                return 0;
+            }
+            pred = bb;
+            bb = next;
+        }
+        return 0;
+    }
+
+    // The value of v as instr reads it.
+    int read(Frame& frame, Value* v, Instruction* instr) const {
+        if (!frame.onMachine || isa<Constant>(v)) {
+            return frame.values.lookup(v);
+        }
+        return load(frame, machine.allocator->getLocationAt(v, machine.liveness->getInstructionId(instr)));
+    }
+
+    void write(Frame& frame, Instruction* instr, int value) const {
+        if (!frame.onMachine) {
+            frame.values[instr] = value;
+            return;
+        }
+        store(frame, machine.allocator->getLocationAt(instr, machine.liveness->getInstructionId(instr)), value);
+    }
+
+    static int load(Frame& frame, const ValueLocation& location) {
+        if (location.isRegister()) {
+            return frame.registers[location.reg];
+        }
+        return location.isSpilled() ? slot(frame, location.spillSlot) : 0;
+    }
+
+    // A value nothing reads has no location and goes nowhere.
+    static void store(Frame& frame, const ValueLocation& location, int value) {
+        if (location.isRegister()) {
+            frame.registers[location.reg] = value;
+        } else if (location.isSpilled()) {
+            slot(frame, location.spillSlot) = value;
+        }
+    }
+
+    static int& slot(Frame& frame, int index) {
+        size_t i = static_cast<size_t>(index);
+        if (i >= frame.slots.size()) {
+            frame.slots.resize(i + 1, 0);
+        }
+        return frame.slots[i];
+    }
+
+    static int incomingValue(Phi* phi, BasicBlock* pred, const ValueMap<int>& values) {
+        Value* input = phi->getIncomingValueForBlock(pred);
+        return input ? values.lookup(input) : 0;
+    }
+
+    bool inBounds(Frame& frame, Instruction* check) const {
+        int length = read(frame, check->getOperand(0), check);
+        int first = read(frame, check->getOperand(1), check);
+        int last = isa<RangeCheck>(check) ? read(frame, check->getOperand(2), check) : first;
+        return first > last || (first >= 0 && last < length);
+    }
+
+    static int compare(CmpOp op, int lhs, int rhs) {
+        switch (op) {
+            case CmpOp::Eq: return lhs == rhs;
+            case CmpOp::Ne: return lhs != rhs;
+            case CmpOp::Lt: return lhs < rhs;
+            case CmpOp::Le: return lhs <= rhs;
+            case CmpOp::Gt: return lhs > rhs;
+            case CmpOp::Ge: return lhs >= rhs;
+        }
+        return 0;
+    }
+
+    static int arithmetic(InstrKind kind, int lhs, int rhs) {
+        uint32_t a = static_cast<uint32_t>(lhs);
+        uint32_t b = static_cast<uint32_t>(rhs);
+        switch (kind) {
+            case InstrKind::Add: return static_cast<int>(a + b);
+            case InstrKind::Sub: return static_cast<int>(a - b);
+            case InstrKind::Mul: return static_cast<int>(a * b);
+            case InstrKind::And: return static_cast<int>(a & b);
+            case InstrKind::Shl: return b < 32 ? static_cast<int>(a << b) : 0;
+            case InstrKind::Shr: return b < 32 ? static_cast<int>(a >> b) : 0;
+            default: return 0;
+        }
+    }
+};
@@ -1,57 +1,42 @@
 #pragma once
 
 #include "basic_block.h"
+#include "dense_map.h"
 #include "function.h"
 #include "loop_analysis.h"
 #include <algorithm>
-#include <set>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 class LinearOrder {
   public:
     static std::vector<BasicBlock *> compute(Function &function) {
+        return compute(function, LoopInfo(function));
+    }
+
+    // Uses loops found beforehand, e.g. cached by a FunctionAnalysisManager.
+    static std::vector<BasicBlock *> compute(Function &function,
+                                             const LoopInfo &loopInfo) {
         auto &basicBlocks = function.getBasicBlocks();
         if (basicBlocks.empty())
             return {};
 
-        // find all natural loops
-        auto loops = LoopAnalysis::findLoops(function);
-
-        // collect all back edges
-        std::set<std::pair<BasicBlock *, BasicBlock *>> backEdges;
-        for (auto *loop : loops) {
-            if (loop->latch && loop->header)
-                backEdges.insert({loop->latch, loop->header});
-        }
-
-        // map each block to its smallest containing loop
-        std::sort(loops.begin(), loops.end(),
-                  [](LoopAnalysis::Loop *a, LoopAnalysis::Loop *b) {
-                      return a->blocks.size() > b->blocks.size();
-                  });
-        std::unordered_map<BasicBlock *, LoopAnalysis::Loop *> blockToLoop;
-        for (auto *loop : loops) {
-            blockToLoop[loop->header] = loop;
-            for (auto *bb : loop->blocks)
-                blockToLoop[bb] = loop;
-        }
+        const size_t numBlocks = function.getNumBlockIds();
+        auto isBackEdge = [&](BasicBlock *from, BasicBlock *to) {
+            return loopInfo.isBackEdge(from, to);
+        };
 
         // Kahn's topological sort
-        std::unordered_map<BasicBlock *, int> predCount;
-        for (auto &bb : basicBlocks)
-            predCount[bb.get()] = 0;
+        BlockMap<int> predCount(numBlocks, 0);
         for (auto &bb : basicBlocks) {
             for (auto *succ : bb->getSuccessors()) {
-                if (!backEdges.count({bb.get(), succ}))
+                if (!isBackEdge(bb, succ))
                     predCount[succ]++;
             }
         }
 
         std::vector<BasicBlock *> worklist;
-        std::unordered_set<BasicBlock *> inWorklist;
-        BasicBlock *entry = basicBlocks[0].get();
+        BlockSet inWorklist(numBlocks);
+        BasicBlock *entry = basicBlocks[0];
         worklist.push_back(entry);
         inWorklist.insert(entry);
 
@@ -59,24 +44,25 @@ class LinearOrder {
         order.reserve(basicBlocks.size());
 
         while (!worklist.empty()) {
-            LoopAnalysis::Loop *currentLoop = nullptr;
-            if (!order.empty()) {
-                auto it = blockToLoop.find(order.back());
-                if (it != blockToLoop.end())
-                    currentLoop = it->second;
-            }
+            Loop *currentLoop = nullptr;
+            if (!order.empty())
+                currentLoop = loopInfo.getLoopFor(order.back());
 
-            int selectedIdx = static_cast<int>(worklist.size()) - 1;
-            if (currentLoop) {
+            // Stay inside the innermost loop that still has ready blocks,
+            // nested loops included, so every loop is laid out contiguously.
+            int selectedIdx = -1;
+            for (auto *loop = currentLoop; loop && selectedIdx < 0;
+                 loop = loop->parent) {
                 for (int i = static_cast<int>(worklist.size()) - 1; i >= 0;
                      --i) {
-                    auto it = blockToLoop.find(worklist[i]);
-                    if (it != blockToLoop.end() && it->second == currentLoop) {
+                    if (loop->contains(worklist[i])) {
                         selectedIdx = i;
                         break;
                     }
                 }
             }
+            if (selectedIdx < 0)
+                selectedIdx = static_cast<int>(worklist.size()) - 1;
 
             BasicBlock *selected = worklist[selectedIdx];
             worklist.erase(worklist.begin() + selectedIdx);
@@ -84,7 +70,7 @@ class LinearOrder {
             order.push_back(selected);
 
             for (auto *succ : selected->getSuccessors()) {
-                if (backEdges.count({selected, succ}))
+                if (isBackEdge(selected, succ))
                     continue;
                 if (--predCount[succ] == 0 && !inWorklist.count(succ)) {
                     worklist.push_back(succ);
@@ -93,8 +79,6 @@ class LinearOrder {
             }
         }
 
-        for (auto *loop : loops)
-            delete loop;
         return order;
     }
 };
@@ -1,15 +1,19 @@
 #pragma once
 
 #include "basic_block.h"
+#include "bit_vector.h"
+#include "cfg_traversal.h"
 #include "control_flow.h"
+#include "dataflow.h"
+#include "dense_map.h"
 #include "function.h"
 #include "instruction.h"
 #include "linear_order.h"
 #include "loop_analysis.h"
 #include <algorithm>
 #include <cassert>
-#include <unordered_map>
-#include <unordered_set>
+#include <climits>
+#include <iterator>
 #include <vector>
 
 struct LiveRange {
@@ -20,82 +24,187 @@ struct LiveRange {
     }
 };
 
-struct LifetimeInterval {
+// A position that reads the value. Ordinary operands need the value in a
+// register; a value passed to a phi is read by a move at the end of the
+// predecessor, which can take it from a stack slot as well.
+struct UsePosition {
+    int pos;
+    bool requiresRegister;
+    bool operator==(const UsePosition &o) const {
+        return pos == o.pos && requiresRegister == o.requiresRegister;
+    }
+};
+
+// The ranges a value is live in, disjoint and ascending, with the holes
+// between them, and the positions that read it.
+//
+// LivenessAnalysis builds intervals in one backward pass over the linear
+// order, so every range it adds starts no later than the ones before it
+// and every use is no later than the previous one. Both lists are kept
+// back to front while building, where prepending and merging with the
+// first range are a push_back or an update of the last element, and are
+// reversed once when the pass is done. Queries binary-search the result.
+class LifetimeInterval {
+  public:
     Value *value = nullptr;
-    std::vector<LiveRange> ranges;
 
-    void addRange(int from, int to) {
-        if (from >= to)
-            return;
-        ranges.push_back({from, to});
-        mergeRanges();
+    bool isLiveAt(int pos) const {
+        auto it = std::upper_bound(
+            ranges_.begin(), ranges_.end(), pos,
+            [](int p, const LiveRange &r) { return p < r.from; });
+        return it != ranges_.begin() && pos < std::prev(it)->to;
     }
 
-    void setFrom(int newFrom) {
-        if (ranges.empty()) {
-            ranges.push_back({newFrom, newFrom + 2});
-            return;
+    const std::vector<LiveRange> &getLiveRanges() const { return ranges_; }
+    const std::vector<UsePosition> &getUsePositions() const { return uses_; }
+
+    // Where the first range starts and the last one ends; -1 when empty.
+    int getStart() const { return ranges_.empty() ? -1 : ranges_.front().from; }
+    int getEnd() const { return ranges_.empty() ? -1 : ranges_.back().to; }
+
+    // The first use at or after pos, or INT_MAX if there is none. With
+    // requiresRegister, uses that could read a stack slot are skipped.
+    int nextUseAfter(int pos, bool requiresRegister = false) const {
+        auto it = std::lower_bound(
+            uses_.begin(), uses_.end(), pos,
+            [](const UsePosition &u, int p) { return u.pos < p; });
+        if (requiresRegister) {
+            while (it != uses_.end() && !it->requiresRegister)
+                ++it;
         }
-        ranges[0].from = newFrom;
-        mergeRanges();
+        return it == uses_.end() ? INT_MAX : it->pos;
     }
 
-    bool isLiveAt(int pos) const {
-        for (const auto &r : ranges) {
-            if (pos >= r.from && pos < r.to)
-                return true;
-            if (pos < r.from)
-                break;
+    // The last use before pos, or -1 if there is none.
+    int lastUseBefore(int pos) const {
+        auto it = std::lower_bound(
+            uses_.begin(), uses_.end(), pos,
+            [](const UsePosition &u, int p) { return u.pos < p; });
+        return it == uses_.begin() ? -1 : std::prev(it)->pos;
+    }
+
+    // The first position both intervals cover, or -1 if they never do.
+    // Walks the ranges of the interval with fewer of them and searches the
+    // other one for each.
+    int firstIntersection(const LifetimeInterval &other) const {
+        if (ranges_.size() > other.ranges_.size())
+            return other.firstIntersection(*this);
+        if (ranges_.empty() || other.ranges_.empty() ||
+            getEnd() <= other.getStart() || other.getEnd() <= getStart())
+            return -1;
+        auto it = other.ranges_.begin();
+        for (const LiveRange &r : ranges_) {
+            it = std::upper_bound(
+                it, other.ranges_.end(), r.from,
+                [](int p, const LiveRange &o) { return p < o.to; });
+            if (it == other.ranges_.end())
+                return -1;
+            if (it->from < r.to)
+                return std::max(r.from, it->from);
         }
-        return false;
+        return -1;
     }
 
-    const std::vector<LiveRange> &getLiveRanges() const { return ranges; }
+    bool intersects(const LifetimeInterval &other) const {
+        return firstIntersection(other) >= 0;
+    }
+
+    // Cuts the interval at pos: this keeps what lies before pos and the
+    // returned interval takes the rest, uses at pos included.
+    LifetimeInterval splitAt(int pos) {
+        LifetimeInterval rest;
+        rest.value = value;
+        auto range = std::upper_bound(
+            ranges_.begin(), ranges_.end(), pos,
+            [](int p, const LiveRange &r) { return p < r.to; });
+        if (range != ranges_.end() && range->from < pos) {
+            rest.ranges_.push_back({pos, range->to});
+            range->to = pos;
+            ++range;
+        }
+        rest.ranges_.insert(rest.ranges_.end(), range, ranges_.end());
+        ranges_.erase(range, ranges_.end());
+
+        auto use = std::lower_bound(
+            uses_.begin(), uses_.end(), pos,
+            [](const UsePosition &u, int p) { return u.pos < p; });
+        rest.uses_.assign(use, uses_.end());
+        uses_.erase(use, uses_.end());
+        return rest;
+    }
 
   private:
-    void mergeRanges() {
-        if (ranges.empty())
+    friend class LivenessAnalysis;
+
+    std::vector<LiveRange> ranges_;
+    std::vector<UsePosition> uses_;
+
+    // Prepends [from, to), merging it into the first range if they touch.
+    void addRange(int from, int to) {
+        if (from >= to)
+            return;
+        if (!ranges_.empty() && to >= ranges_.back().from) {
+            assert(from <= ranges_.back().from);
+            LiveRange &first = ranges_.back();
+            first.from = from;
+            first.to = std::max(first.to, to);
             return;
-        std::sort(ranges.begin(), ranges.end(),
-                  [](const LiveRange &a, const LiveRange &b) {
-                      return a.from < b.from;
-                  });
-        std::vector<LiveRange> merged;
-        merged.push_back(ranges[0]);
-        for (size_t i = 1; i < ranges.size(); ++i) {
-            auto &last = merged.back();
-            if (ranges[i].from <= last.to) {
-                last.to = std::max(last.to, ranges[i].to);
-            } else {
-                merged.push_back(ranges[i]);
-            }
         }
-        ranges = std::move(merged);
+        ranges_.push_back({from, to});
+    }
+
+    // Starts the first range at the definition. A value nothing reads
+    // lives just for its defining instruction.
+    void setFrom(int from) {
+        if (ranges_.empty()) {
+            ranges_.push_back({from, from + 2});
+            return;
+        }
+        ranges_.back().from = from;
+    }
+
+    void addUse(int pos, bool requiresRegister) {
+        if (!uses_.empty() && uses_.back().pos == pos) {
+            uses_.back().requiresRegister |= requiresRegister;
+            return;
+        }
+        assert(uses_.empty() || pos < uses_.back().pos);
+        uses_.push_back({pos, requiresRegister});
+    }
+
+    void finish() {
+        std::reverse(ranges_.begin(), ranges_.end());
+        std::reverse(uses_.begin(), uses_.end());
     }
 };
 
 class LivenessAnalysis {
   public:
     void build(Function &function) {
-        intervals_.clear();
-        instrToId_.clear();
-        blockFrom_.clear();
-        blockTo_.clear();
-        liveIn_.clear();
+        build(function, LinearOrder::compute(function),
+              ReversePostOrder(function));
+    }
 
-        linearOrder_ = LinearOrder::compute(function);
+    // Builds from a linear order and a reverse post-order computed
+    // beforehand, e.g. cached by a FunctionAnalysisManager. The live sets
+    // come from a backward dataflow solve; the intervals are then laid out
+    // along the linear order.
+    void build(Function &function, const std::vector<BasicBlock *> &linearOrder,
+               const ReversePostOrder &rpo) {
+        const size_t numValues = function.getNumValueIds();
+        const size_t numBlocks = function.getNumBlockIds();
+        intervals_.reset(numValues);
+        instrToId_.reset(numValues, -1);
+        blockFrom_.reset(numBlocks, -1);
+        blockTo_.reset(numBlocks, -1);
+        indexValues(function);
+        indexLiveAcross(function);
+
+        linearOrder_ = linearOrder;
         numberInstructions();
 
-        auto loops = LoopAnalysis::findLoops(function);
-        std::unordered_map<BasicBlock *, LoopAnalysis::Loop *> headerToLoop;
-        for (auto *loop : loops) {
-            headerToLoop[loop->header] = loop;
-        }
-
-        buildIntervals(headerToLoop);
-
-        for (auto *loop : loops)
-            delete loop;
+        computeLiveSets(function, rpo);
+        buildIntervals();
     }
 
     const std::vector<BasicBlock *> &getLinearOrder() const {
@@ -103,53 +212,124 @@ class LivenessAnalysis {
     }
 
     const LifetimeInterval *getInterval(Value *v) const {
-        auto it = intervals_.find(v);
-        return (it != intervals_.end()) ? &it->second : nullptr;
+        const auto &iv = intervals_.lookup(v);
+        return iv.value ? &iv : nullptr;
     }
 
     std::vector<LiveRange> getLiveRanges(Value *v) const {
-        auto it = intervals_.find(v);
-        if (it == intervals_.end())
-            return {};
-        return it->second.getLiveRanges();
+        return intervals_.lookup(v).getLiveRanges();
     }
 
     bool isLiveAt(Value *v, int pos) const {
-        auto it = intervals_.find(v);
-        if (it == intervals_.end())
-            return false;
-        return it->second.isLiveAt(pos);
+        return intervals_.lookup(v).isLiveAt(pos);
     }
 
     int getInstructionId(Instruction *instr) const {
-        auto it = instrToId_.find(instr);
-        return (it != instrToId_.end()) ? it->second : -1;
+        return instrToId_.lookup(instr);
     }
 
-    int getBlockFrom(BasicBlock *bb) const {
-        auto it = blockFrom_.find(bb);
-        return (it != blockFrom_.end()) ? it->second : -1;
+    int getBlockFrom(BasicBlock *bb) const { return blockFrom_.lookup(bb); }
+
+    int getBlockTo(BasicBlock *bb) const { return blockTo_.lookup(bb); }
+
+    // Values live on entry to and on exit from bb. Only values read in a
+    // block other than their defining one can be live there, so the bits
+    // index getLiveAcrossValues() rather than value ids. Phi operands count
+    // as used on the edge, so they are in neither set unless live for
+    // another reason.
+    const BitVector &getLiveIn(const BasicBlock *bb) const {
+        return liveIn_.lookup(bb);
+    }
+    const BitVector &getLiveOut(const BasicBlock *bb) const {
+        return liveOut_.lookup(bb);
     }
 
-    int getBlockTo(BasicBlock *bb) const {
-        auto it = blockTo_.find(bb);
-        return (it != blockTo_.end()) ? it->second : -1;
+    bool isLiveIn(const BasicBlock *bb, const Value *v) const {
+        int bit = getLiveAcrossIndex(v);
+        return bit >= 0 && liveIn_.lookup(bb).test(bit);
+    }
+    bool isLiveOut(const BasicBlock *bb, const Value *v) const {
+        int bit = getLiveAcrossIndex(v);
+        return bit >= 0 && liveOut_.lookup(bb).test(bit);
     }
 
+    // The values of the live-set bits, in value id order, and the bit of v;
+    // -1 when v never crosses a block boundary.
+    const std::vector<Value *> &getLiveAcrossValues() const {
+        return liveAcross_;
+    }
+    int getLiveAcrossIndex(const Value *v) const {
+        return liveAcrossIndex_.lookup(v);
+    }
+
+    const DataflowStats &getDataflowStats() const { return dataflowStats_; }
+
   private:
     std::vector<BasicBlock *> linearOrder_;
-    std::unordered_map<Value *, LifetimeInterval> intervals_;
-    std::unordered_map<Instruction *, int> instrToId_;
-    std::unordered_map<BasicBlock *, int> blockFrom_;
-    std::unordered_map<BasicBlock *, int> blockTo_;
-    std::unordered_map<BasicBlock *, std::unordered_set<Value *>> liveIn_;
+    // All side tables are indexed by the function's dense value/block ids;
+    // an interval with a null value has never been created.
+    ValueMap<LifetimeInterval> intervals_;
+    ValueMap<int> instrToId_;
+    BlockMap<int> blockFrom_;
+    BlockMap<int> blockTo_;
+    BlockMap<BitVector> liveIn_;
+    BlockMap<BitVector> liveOut_;
+    DataflowStats dataflowStats_;
+    std::vector<Value *> valueById_;
+    std::vector<Value *> liveAcross_;
+    ValueMap<int> liveAcrossIndex_;
+
+    void indexValues(Function &function) {
+        valueById_.assign(function.getNumValueIds(), nullptr);
+        for (auto *param : function.getParams())
+            valueById_[param->getId()] = param;
+        for (auto *bb : function.getBasicBlocks()) {
+            for (auto &instr : bb->getInstructions())
+                valueById_[instr.getId()] = &instr;
+        }
+    }
+
+    // A value is read across blocks when an instruction outside its
+    // defining block uses it, or it is passed to a phi along an edge from
+    // another block. Parameters have no defining block.
+    void indexLiveAcross(Function &function) {
+        std::vector<bool> across(valueById_.size(), false);
+        auto markUse = [&](Value *v, const BasicBlock *useBlock) {
+            if (!v || !isTracked(v))
+                return;
+            auto *def = dyn_cast<Instruction>(v);
+            if (!def || def->getParent() != useBlock)
+                across[v->getId()] = true;
+        };
+        for (auto *bb : function.getBasicBlocks()) {
+            for (auto &instr : bb->getInstructions()) {
+                if (auto *phi = dyn_cast<Phi>(&instr)) {
+                    for (size_t i = 0; i < phi->getNumIncoming(); ++i)
+                        markUse(phi->getIncomingValue(i),
+                                phi->getIncomingBlock(i));
+                    continue;
+                }
+                for (auto *opd : instr.getOperands())
+                    markUse(opd, bb);
+            }
+        }
+        liveAcross_.clear();
+        liveAcrossIndex_.reset(valueById_.size(), -1);
+        for (size_t id = 0; id < valueById_.size(); ++id) {
+            if (across[id] && valueById_[id]) {
+                liveAcrossIndex_[valueById_[id]] =
+                    static_cast<int>(liveAcross_.size());
+                liveAcross_.push_back(valueById_[id]);
+            }
+        }
+    }
 
     void numberInstructions() {
         int idx = 0;
         for (auto *bb : linearOrder_) {
             blockFrom_[bb] = 2 * idx;
-            for (auto &instrPtr : bb->getInstructions()) {
-                instrToId_[instrPtr.get()] = 2 * idx;
+            for (auto &instr : bb->getInstructions()) {
+                instrToId_[&instr] = 2 * idx;
                 ++idx;
             }
             blockTo_[bb] = 2 * idx;
@@ -172,80 +352,126 @@ class LivenessAnalysis {
         return v->getValueKind() != Value::ValueKind::Constant;
     }
 
-    void
-    buildIntervals(const std::unordered_map<BasicBlock *, LoopAnalysis::Loop *>
-                       &headerToLoop) {
-        for (int bi = static_cast<int>(linearOrder_.size()) - 1; bi >= 0;
-             --bi) {
-            BasicBlock *b = linearOrder_[bi];
-            int bFrom = blockFrom_[b];
-            int bTo = blockTo_[b];
-
-            std::unordered_set<Value *> live;
-
-            for (auto *succ : b->getSuccessors()) {
-                auto it = liveIn_.find(succ);
-                if (it != liveIn_.end()) {
-                    live.insert(it->second.begin(), it->second.end());
+    // Calls fn on every value b passes to phis of its successors.
+    template <typename Fn> static void forEachPhiUse(BasicBlock *b, Fn &&fn) {
+        // Phis lead their block, so each scan stops at the first non-phi
+        // instruction.
+        for (auto *succ : b->getSuccessors()) {
+            for (auto &instr : succ->getInstructions()) {
+                auto *phi = dyn_cast<Phi>(&instr);
+                if (!phi)
+                    break;
+                for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                    Value *val = phi->getIncomingValue(i);
+                    if (phi->getIncomingBlock(i) == b && val && isTracked(val))
+                        fn(val);
                 }
             }
+        }
+    }
 
-            for (auto *succ : b->getSuccessors()) {
-                for (auto &instrPtr : succ->getInstructions()) {
-                    if (auto *phi = dynamic_cast<Phi *>(instrPtr.get())) {
-                        for (auto &[pred, val] : phi->getIncoming()) {
-                            if (pred == b && val && isTracked(val)) {
-                                live.insert(val);
-                            }
-                        }
-                    }
+    // gen is what b reads before defining it, counting the operands it
+    // passes to successor phis as read at its end; kill is everything b
+    // defines, its own phis included. Both only cover values read across
+    // blocks: the others are never live on a block boundary.
+    void computeLiveSets(Function &function, const ReversePostOrder &rpo) {
+        BitVectorDataflow dataflow(function, DataflowDirection::Backward,
+                                   DataflowMeet::Union, liveAcross_.size());
+        for (auto *b : rpo) {
+            BitVector &gen = dataflow.getGen(b);
+            BitVector &kill = dataflow.getKill(b);
+            forEachPhiUse(b, [&](Value *val) {
+                int bit = liveAcrossIndex_.lookup(val);
+                if (bit >= 0)
+                    gen.set(bit);
+            });
+            auto &instrs = b->getInstructions();
+            for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+                Instruction *op = &*it;
+                int bit = liveAcrossIndex_.lookup(op);
+                if (bit >= 0 &&
+                    (op->getKind() == InstrKind::Phi || producesValue(op))) {
+                    gen.reset(bit);
+                    kill.set(bit);
+                }
+                if (op->getKind() == InstrKind::Phi)
+                    continue;
+                for (auto *opd : op->getOperands()) {
+                    if (!opd || !isTracked(opd))
+                        continue;
+                    int opdBit = liveAcrossIndex_.lookup(opd);
+                    if (opdBit >= 0)
+                        gen.set(opdBit);
                 }
             }
+        }
+        dataflow.solve(rpo);
+        dataflow.releaseLocalSets();
+
+        const size_t numBlocks = function.getNumBlockIds();
+        liveIn_.reset(numBlocks);
+        liveOut_.reset(numBlocks);
+        for (auto *b : rpo) {
+            liveIn_[b] = dataflow.takeIn(b);
+            liveOut_[b] = dataflow.takeOut(b);
+        }
+        dataflowStats_ = dataflow.getStats();
+    }
 
-            for (auto *opd : live) {
-                getOrCreate(opd).addRange(bFrom, bTo);
-            }
+    // With exact live-out sets every block is handled on its own: values
+    // live out span the whole block, then a backward scan shortens them to
+    // their definitions and extends operands to their uses. Blocks and
+    // instructions are visited back to front, which is the order
+    // LifetimeInterval expects ranges and uses in.
+    void buildIntervals() {
+        for (int bi = static_cast<int>(linearOrder_.size()) - 1; bi >= 0;
+             --bi) {
+            BasicBlock *b = linearOrder_[bi];
+            int bFrom = blockFrom_[b];
+            int bTo = blockTo_[b];
+
+            // A phi operand b defines itself is live from its definition
+            // to the end of b without being in any live set.
+            BitVector live = liveOut_.lookup(b);
+            if (live.size() != liveAcross_.size())
+                live = BitVector(liveAcross_.size());
+            forEachPhiUse(b, [&](Value *val) {
+                LifetimeInterval &interval = getOrCreate(val);
+                int bit = liveAcrossIndex_.lookup(val);
+                if (bit >= 0)
+                    live.set(bit);
+                else
+                    interval.addRange(bFrom, bTo);
+                interval.addUse(bTo - 2, false);
+            });
+
+            live.forEach([&](size_t bit) {
+                getOrCreate(liveAcross_[bit]).addRange(bFrom, bTo);
+            });
 
             auto &instrs = b->getInstructions();
-            for (int ii = static_cast<int>(instrs.size()) - 1; ii >= 0; --ii) {
-                Instruction *op = instrs[ii].get();
+            for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+                Instruction *op = &*it;
                 if (op->getKind() == InstrKind::Phi)
                     continue;
 
                 int opId = instrToId_[op];
 
-                if (producesValue(op)) {
+                if (producesValue(op))
                     getOrCreate(op).setFrom(opId);
-                    live.erase(op);
-                }
 
                 for (auto *opd : op->getOperands()) {
                     if (!opd || !isTracked(opd))
                         continue;
-                    getOrCreate(opd).addRange(bFrom, opId + 1);
-                    live.insert(opd);
-                }
-            }
-
-            for (auto &instrPtr : b->getInstructions()) {
-                if (auto *phi = dynamic_cast<Phi *>(instrPtr.get())) {
-                    live.erase(phi);
+                    LifetimeInterval &interval = getOrCreate(opd);
+                    interval.addRange(bFrom, opId + 1);
+                    interval.addUse(opId, true);
                 }
             }
-
-            auto loopIt = headerToLoop.find(b);
-            if (loopIt != headerToLoop.end()) {
-                LoopAnalysis::Loop *loop = loopIt->second;
-                BasicBlock *latchBlock = loop->latch;
-                if (latchBlock) {
-                    int loopEndTo = blockTo_[latchBlock];
-                    for (auto *opd : live) {
-                        getOrCreate(opd).addRange(bFrom, loopEndTo);
-                    }
-                }
-            }
-
-            liveIn_[b] = std::move(live);
+        }
+        for (Value *v : valueById_) {
+            if (v && intervals_[v].value)
+                intervals_[v].finish();
         }
     }
 };
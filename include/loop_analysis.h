@@ -2,161 +2,280 @@
 
 #include "basic_block.h"
 #include "cfg.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
 #include <unordered_set>
-#include <unordered_map>
 #include <vector>
-#include <stack>
-#include <algorithm>
 
-class LoopAnalysis {
+class LoopInfo;
+
+// A natural loop: the header and every block that reaches one of the back
+// edges into it without passing through the header. All back edges into a
+// header belong to the same loop.
+class Loop {
 public:
-    struct Loop {
-        BasicBlock* header;
-        BasicBlock* latch;
-        std::unordered_set<BasicBlock*> blocks;
-        std::unordered_set<BasicBlock*> exits;
-        std::vector<Loop*> subLoops;
-        Loop* parent;
-
-        Loop(BasicBlock* hdr, BasicBlock* lch = nullptr, Loop* p = nullptr)
-            : header(hdr), latch(lch), parent(p) {}
-
-        void addBlock(BasicBlock* bb) { blocks.insert(bb); }
-        void addExit(BasicBlock* bb) { exits.insert(bb); }
-        void addSubLoop(Loop* loop) { subLoops.push_back(loop); }
-
-        bool contains(BasicBlock* bb) const {
-            return blocks.count(bb) || bb == header;
-        }
-
-        int getDepth() const {
-            int depth = 0;
-            Loop* current = parent;
-            while (current) {
-                depth++;
-                current = current->parent;
-            }
-            return depth;
-        }
-    };
-
-    static std::vector<Loop*> findLoops(Function& function) {
-        std::vector<Loop*> loops;
-        auto dominators = CFGAnalysis::computeDominators(function);
-        auto& basicBlocks = function.getBasicBlocks();
-
-        for (auto& bb : basicBlocks) {
-            for (auto succ : bb->getSuccessors()) {
-                if (dominators[bb.get()].count(succ)) {
-                    Loop* loop = discoverLoop(bb.get(), succ, dominators);
-                    if (loop) {
-                        loops.push_back(loop);
-                    }
+    BasicBlock* header;
+    // Sources of the back edges, in the header's predecessor order.
+    std::vector<BasicBlock*> latches;
+    // The single block outside the loop that enters it, if it does nothing
+    // but jump to the header; null otherwise.
+    BasicBlock* preheader = nullptr;
+    // Header first, then the rest in reverse post-order, nested loops
+    // included.
+    std::vector<BasicBlock*> blocks;
+    // Blocks of the loop with a successor outside it.
+    std::vector<BasicBlock*> exits;
+    std::vector<Loop*> subLoops;
+    Loop* parent = nullptr;
+
+    explicit Loop(BasicBlock* hdr) : header(hdr) {}
+
+    // The only latch, or null when there are several.
+    BasicBlock* getLatch() const { return latches.size() == 1 ? latches[0] : nullptr; }
+
+    // O(depth) through the innermost-loop map of the owning LoopInfo.
+    bool contains(const BasicBlock* bb) const;
+
+    bool contains(const Loop* other) const {
+        while (other && other->depth > depth) {
+            other = other->parent;
+        }
+        return other == this;
+    }
+
+    // 0 for an outermost loop.
+    int getDepth() const { return depth; }
+
+    bool isInnermost() const { return subLoops.empty(); }
+
+private:
+    friend class LoopInfo;
+    const LoopInfo* info = nullptr;
+    int depth = 0;
+};
+
+// The loop forest of a function. Owns its loops, which stay valid until the
+// next recalculate(). Every block maps to its innermost loop in O(1).
+//
+// Loops are found bottom-up: headers are visited in post-order so that
+// inner loops exist before the loops around them, and the backward walk
+// from the latches of a header steps over an inner loop by jumping straight
+// to its header. Each block is therefore assigned once, and nesting falls
+// out of the walk rather than from comparing loops pairwise.
+class LoopInfo {
+public:
+    LoopInfo() = default;
+    explicit LoopInfo(Function& function) { recalculate(function, DominatorTree(function)); }
+    LoopInfo(Function& function, const DominatorTree& domTree) { recalculate(function, domTree); }
+
+    // Loops point back at their LoopInfo.
+    LoopInfo(const LoopInfo&) = delete;
+    LoopInfo& operator=(const LoopInfo&) = delete;
+
+    void recalculate(Function& function, const DominatorTree& domTree) {
+        storage.clear();
+        loops.clear();
+        topLevel.clear();
+        innermost.reset(function.getNumBlockIds(), nullptr);
+
+        const std::vector<BasicBlock*>& rpo = domTree.getReversePostOrder();
+        for (auto it = rpo.rbegin(); it != rpo.rend(); ++it) {
+            BasicBlock* header = *it;
+            std::vector<BasicBlock*> latches;
+            for (BasicBlock* pred : header->getPredecessors()) {
+                if (domTree.isReachable(pred) && domTree.dominates(header, pred)) {
+                    latches.push_back(pred);
                 }
             }
+            if (latches.empty()) {
+                continue;
+            }
+            storage.push_back(std::make_unique<Loop>(header));
+            discoverLoop(storage.back().get(), std::move(latches), domTree);
         }
 
-        buildLoopHierarchy(loops);
-        return loops;
+        // In reverse post-order every header comes before the rest of its
+        // loop and before the headers nested in it.
+        for (BasicBlock* bb : rpo) {
+            Loop* loop = innermost[bb];
+            if (!loop) {
+                continue;
+            }
+            if (loop->header == bb) {
+                loop->info = this;
+                loop->depth = loop->parent ? loop->parent->depth + 1 : 0;
+                (loop->parent ? loop->parent->subLoops : topLevel).push_back(loop);
+                loops.push_back(loop);
+            }
+            for (Loop* l = loop; l; l = l->parent) {
+                l->blocks.push_back(bb);
+            }
+        }
+
+        for (Loop* loop : loops) {
+            finishLoop(loop, domTree);
+        }
     }
 
-    static void analyzeLoopNesting(Function& function) {
-        auto loops = findLoops(function);
+    // Every loop, each after the loop around it.
+    const std::vector<Loop*>& getLoops() const { return loops; }
+    const std::vector<Loop*>& getTopLevelLoops() const { return topLevel; }
+    std::vector<Loop*>::const_iterator begin() const { return loops.begin(); }
+    std::vector<Loop*>::const_iterator end() const { return loops.end(); }
+    size_t size() const { return loops.size(); }
+    bool empty() const { return loops.empty(); }
+
+    // The innermost loop containing bb, or null.
+    Loop* getLoopFor(const BasicBlock* bb) const { return innermost.lookup(bb); }
+
+    // Number of loops around bb.
+    int getLoopDepth(const BasicBlock* bb) const {
+        Loop* loop = getLoopFor(bb);
+        return loop ? loop->getDepth() + 1 : 0;
+    }
 
-        std::cout << "Loop Analysis for Function: " << function.getName() << "\n";
-        std::cout << "========================================\n";
+    bool isLoopHeader(const BasicBlock* bb) const {
+        Loop* loop = getLoopFor(bb);
+        return loop && loop->header == bb;
+    }
 
-        if (loops.empty()) {
-            std::cout << "No loops found.\n";
-            return;
-        }
+    // Whether from -> to closes a loop.
+    bool isBackEdge(const BasicBlock* from, const BasicBlock* to) const {
+        Loop* loop = getLoopFor(to);
+        return loop && loop->header == to && loop->contains(from);
+    }
 
-        for (auto loop : loops) {
-            printLoopInfo(loop, 0);
+    // Records a block a pass created inside loop, or outside every loop
+    // when loop is null, so the analysis stays usable without a
+    // recalculate(). The block must not be a header, and its edges must be
+    // in place: it goes right before its single successor in the blocks of
+    // each enclosing loop, which keeps them in reverse post-order, and at
+    // the end when that successor is the header or not in the loop yet.
+    void addBlockToLoop(BasicBlock* bb, Loop* loop) {
+        innermost[bb] = loop;
+        const auto& succs = bb->getSuccessors();
+        BasicBlock* succ = succs.size() == 1 ? succs[0] : nullptr;
+        for (Loop* l = loop; l; l = l->parent) {
+            auto it = succ && succ != l->header ? std::find(l->blocks.begin(), l->blocks.end(), succ)
+                                                : l->blocks.end();
+            l->blocks.insert(it, bb);
         }
+    }
 
-        for (auto loop : loops) {
-            delete loop;
+private:
+    std::vector<std::unique_ptr<Loop>> storage;
+    std::vector<Loop*> loops;
+    std::vector<Loop*> topLevel;
+    BlockMap<Loop*> innermost;
+
+    static Loop* outermost(Loop* loop) {
+        while (loop->parent) {
+            loop = loop->parent;
         }
+        return loop;
     }
 
-    static std::unordered_set<BasicBlock*> getLoopExits(Loop* loop) {
-        std::unordered_set<BasicBlock*> exits;
+    void discoverLoop(Loop* loop, std::vector<BasicBlock*> latches, const DominatorTree& domTree) {
+        innermost[loop->header] = loop;
+        std::vector<BasicBlock*> worklist = latches;
+        while (!worklist.empty()) {
+            BasicBlock* bb = worklist.back();
+            worklist.pop_back();
+            BasicBlock* next = bb;
+            if (Loop* sub = innermost[bb]) {
+                // Already claimed: by this loop, or by an inner loop whose
+                // outermost ancestor so far is now nested in this one.
+                sub = outermost(sub);
+                if (sub == loop) {
+                    continue;
+                }
+                sub->parent = loop;
+                next = sub->header;
+            } else {
+                innermost[bb] = loop;
+            }
+            for (BasicBlock* pred : next->getPredecessors()) {
+                if (domTree.isReachable(pred)) {
+                    worklist.push_back(pred);
+                }
+            }
+        }
+        loop->latches = std::move(latches);
+    }
 
-        for (auto bb : loop->blocks) {
-            for (auto succ : bb->getSuccessors()) {
+    void finishLoop(Loop* loop, const DominatorTree& domTree) {
+        for (BasicBlock* bb : loop->blocks) {
+            for (BasicBlock* succ : bb->getSuccessors()) {
                 if (!loop->contains(succ)) {
-                    exits.insert(bb);
+                    loop->exits.push_back(bb);
+                    break;
                 }
             }
         }
 
-        for (auto succ : loop->header->getSuccessors()) {
-            if (!loop->contains(succ)) {
-                exits.insert(loop->header);
+        BasicBlock* entering = nullptr;
+        for (BasicBlock* pred : loop->header->getPredecessors()) {
+            if (!domTree.isReachable(pred) || loop->contains(pred)) {
+                continue;
+            }
+            if (entering && entering != pred) {
+                return;
             }
+            entering = pred;
+        }
+        if (entering && entering->getSuccessors().size() == 1) {
+            loop->preheader = entering;
         }
-
-        return exits;
-    }
-
-    static bool isInnermostLoop(Loop* loop) {
-        return loop->subLoops.empty();
     }
+};
 
-private:
-    static Loop* discoverLoop(BasicBlock* latch, BasicBlock* header,
-                            const std::unordered_map<BasicBlock*, std::unordered_set<BasicBlock*>>& /* dominators */) {
-        Loop* loop = new Loop(header, latch);
-        loop->addBlock(header);
-
-        std::stack<BasicBlock*> worklist;
-        worklist.push(latch);
+inline bool Loop::contains(const BasicBlock* bb) const {
+    return contains(info->getLoopFor(bb));
+}
 
-        while (!worklist.empty()) {
-            BasicBlock* current = worklist.top();
-            worklist.pop();
-
-            if (loop->blocks.count(current)) {
-                continue;
-            }
+class LoopAnalysis {
+public:
+    static void analyzeLoopNesting(Function& function) {
+        LoopInfo loopInfo(function);
 
-            loop->addBlock(current);
+        std::cout << "Loop Analysis for Function: " << function.getName() << "\n";
+        std::cout << "========================================\n";
 
-            for (auto pred : current->getPredecessors()) {
-                if (!loop->blocks.count(pred)) {
-                    worklist.push(pred);
-                }
-            }
+        if (loopInfo.empty()) {
+            std::cout << "No loops found.\n";
+            return;
         }
 
-        loop->exits = getLoopExits(loop);
-
-        return loop;
+        for (auto loop : loopInfo.getTopLevelLoops()) {
+            printLoopInfo(loop, 0);
+        }
     }
 
-    static void buildLoopHierarchy(std::vector<Loop*>& loops) {
-        std::sort(loops.begin(), loops.end(), [](Loop* a, Loop* b) {
-            return a->blocks.size() > b->blocks.size();
-        });
+    static std::unordered_set<BasicBlock*> getLoopExits(const Loop* loop) {
+        return std::unordered_set<BasicBlock*>(loop->exits.begin(), loop->exits.end());
+    }
 
-        for (size_t i = 0; i < loops.size(); ++i) {
-            for (size_t j = i + 1; j < loops.size(); ++j) {
-                if (loops[i]->contains(loops[j]->header)) {
-                    loops[j]->parent = loops[i];
-                    loops[i]->addSubLoop(loops[j]);
-                }
-            }
-        }
+    static bool isInnermostLoop(const Loop* loop) {
+        return loop->isInnermost();
     }
 
-    static void printLoopInfo(Loop* loop, int indent) {
+private:
+    static void printLoopInfo(const Loop* loop, int indent) {
         std::string indentStr(indent * 2, ' ');
 
         std::cout << indentStr << "Loop (Depth: " << loop->getDepth() << "):\n";
         std::cout << indentStr << "  Header: " << loop->header->getName() << "\n";
-        if (loop->latch) {
-            std::cout << indentStr << "  Latch: " << loop->latch->getName() << "\n";
+        std::cout << indentStr << (loop->latches.size() == 1 ? "  Latch: " : "  Latches: ");
+        for (auto latch : loop->latches) {
+            std::cout << latch->getName() << " ";
+        }
+        std::cout << "\n";
+        if (loop->preheader) {
+            std::cout << indentStr << "  Preheader: " << loop->preheader->getName() << "\n";
         }
 
         std::cout << indentStr << "  Blocks: ";
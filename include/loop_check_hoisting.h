@@ -0,0 +1,347 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "cfg_updater.h"
+#include "checks.h"
+#include "control_flow.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
+#include "function.h"
+#include "induction_variables.h"
+#include "instruction.h"
+#include "loop_analysis.h"
+#include "loop_invariant_code_motion.h"
+#include <vector>
+
+// Takes checks out of loops. DominatedCheckElimination only drops a check
+// that an identical one dominates, so a check in a loop body still runs on
+// every iteration.
+//
+// A check whose operands do not change in the loop runs once before it
+// instead. A BoundsCheck indexed by the loop counter, as found by the
+// InductionVariableAnalysis, becomes one RangeCheck over every value the
+// counter takes.
+//
+// A check may only run before the loop if the loop would have run it. A
+// check in a block that dominates every exit and every latch lies on every
+// path from the header to the first exit or back edge, so it runs on the
+// first iteration and goes to the preheader. Dominating the exits alone
+// only means it runs before the loop leaves, maybe on a later iteration or
+// never. For a loop that leaves only from its header,
+// a check in a block that dominates every latch runs as soon as the first
+// header test passes; it goes to a guard block between the preheader and
+// the loop that repeats that test on the starting values. Range checks
+// always go to the guard, where the loop is known to run and its range is
+// exact.
+//
+// Loops containing calls are skipped: a call may not return, and a check
+// moved above it could trap where the original never ran.
+class LoopCheckHoistingPass {
+public:
+    static bool runOnFunction(Function& function) {
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses);
+    }
+
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        if (analyses.getLoopInfo().empty()) {
+            return false;
+        }
+        bool changed = LoopInvariantCodeMotionPass::insertPreheaders(function, analyses);
+
+        analyses.getLoopInfo();
+        analyses.getDominatorTree();
+        LoopInfo& loopInfo = *analyses.getCachedLoopInfo();
+        CFGUpdater updater(function, analyses.getCachedDominatorTree());
+        ExecutionFacts facts = computeExecutionFacts(function, loopInfo, *updater.getDominatorTree());
+        const InductionVariableAnalysis& ivs = analyses.getInductionVariables();
+        bool hoisted = false;
+        bool guarded = false;
+        const std::vector<Loop*>& loops = loopInfo.getLoops();
+        for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+            hoisted |= hoistChecks(function, *it, loopInfo, updater, facts, ivs, guarded);
+        }
+
+        if (guarded) {
+            analyses.invalidate(PreservedAnalyses()
+                                    .preserve(AnalysisKind::CFG)
+                                    .preserve(AnalysisKind::DominatorTree)
+                                    .preserve(AnalysisKind::Loops));
+        } else if (hoisted) {
+            analyses.invalidate(PreservedAnalyses::cfgShape());
+        }
+        return changed || hoisted;
+    }
+
+    static bool isCheck(const Instruction* instr) {
+        return isa<NullCheck>(instr) || isa<BoundsCheck>(instr) || isa<RangeCheck>(instr);
+    }
+
+private:
+    // Per block, relative to its innermost loop: whether it runs on the
+    // first iteration, dominating every exit and every latch, and whether
+    // it runs on every iteration, dominating every latch. Taken before anything changes;
+    // guards only add blocks on the edge into a loop, which leaves these
+    // facts alone, and blocks they add are in neither set.
+    struct ExecutionFacts {
+        BlockSet runsFirst;
+        BlockSet runsEvery;
+    };
+
+    static ExecutionFacts computeExecutionFacts(Function& function, const LoopInfo& loopInfo,
+                                                const DominatorTree& domTree) {
+        ExecutionFacts facts{BlockSet(function.getNumBlockIds()), BlockSet(function.getNumBlockIds())};
+        for (Loop* loop : loopInfo) {
+            for (BasicBlock* bb : loop->blocks) {
+                if (loopInfo.getLoopFor(bb) != loop) {
+                    continue;
+                }
+                if (!dominatesAll(domTree, bb, loop->latches)) {
+                    continue;
+                }
+                facts.runsEvery.insert(bb);
+                if (!loop->exits.empty() && dominatesAll(domTree, bb, loop->exits)) {
+                    facts.runsFirst.insert(bb);
+                }
+            }
+        }
+        return facts;
+    }
+
+    static bool hoistChecks(Function& function, Loop* loop, LoopInfo& loopInfo, CFGUpdater& updater,
+                            const ExecutionFacts& facts, const InductionVariableAnalysis& ivs, bool& guarded) {
+        BasicBlock* preheader = loop->preheader;
+        if (!preheader || containsCall(loop)) {
+            return false;
+        }
+        const LoopBound* counted = getCountedBound(loop, ivs);
+        bool exitsFromHeader = loop->exits.size() == 1 && loop->exits[0] == loop->header;
+
+        // Checks in nested loops had their turn with the inner loop.
+        std::vector<Instruction*> checks;
+        for (BasicBlock* bb : loop->blocks) {
+            if (loopInfo.getLoopFor(bb) != loop) {
+                continue;
+            }
+            for (Instruction& instr : bb->getInstructions()) {
+                if (isCheck(&instr)) {
+                    checks.push_back(&instr);
+                }
+            }
+        }
+
+        BasicBlock* guard = nullptr;
+        bool triedGuard = false;
+        auto getGuard = [&]() {
+            if (!triedGuard) {
+                triedGuard = true;
+                guard = createGuard(function, loop, loopInfo, updater);
+                guarded |= guard != nullptr;
+            }
+            return guard;
+        };
+
+        bool changed = false;
+        for (Instruction* check : checks) {
+            BasicBlock* bb = check->getParent();
+            bool everyIteration = facts.runsEvery.count(bb);
+            bool guardable = exitsFromHeader && everyIteration;
+
+            if (isAvailable(check, loop)) {
+                BasicBlock* target = nullptr;
+                if (facts.runsFirst.count(bb)) {
+                    target = preheader;
+                } else if (guardable) {
+                    target = getGuard();
+                }
+                if (!target) {
+                    continue;
+                }
+                hoistOperands(check, loop, preheader);
+                check->removeFromParent();
+                target->insertBeforeTerminator(check);
+                changed = true;
+                continue;
+            }
+
+            auto* boundsCheck = dyn_cast<BoundsCheck>(check);
+            if (!boundsCheck || !counted || boundsCheck->getIndex() != counted->iv->value ||
+                bb == loop->header || !everyIteration || !isAvailable(boundsCheck->getObject(), loop) ||
+                !getGuard()) {
+                continue;
+            }
+            hoistOperands(boundsCheck->getObject(), loop, preheader);
+            insertRangeCheck(function, guard, boundsCheck->getObject(), *counted);
+            boundsCheck->eraseFromParent();
+            changed = true;
+        }
+        return changed;
+    }
+
+    // A bound tested in the header on a counter that moves by one towards
+    // it, so the body runs exactly once per value from start up to or down
+    // to the bound.
+    static const LoopBound* getCountedBound(const Loop* loop, const InductionVariableAnalysis& ivs) {
+        const LoopBound* bound = ivs.getLoopBound(loop);
+        if (!bound || bound->exiting != loop->header || bound->testsUpdate) {
+            return nullptr;
+        }
+        int step = bound->iv->step;
+        bool upward = step == 1 && (bound->op == CmpOp::Lt || bound->op == CmpOp::Le);
+        bool downward = step == -1 && (bound->op == CmpOp::Gt || bound->op == CmpOp::Ge);
+        return upward || downward ? bound : nullptr;
+    }
+
+    // Covers first..last of the counter, which the guard knows to be a
+    // non-empty range.
+    static void insertRangeCheck(Function& function, BasicBlock* guard, Value* object, const LoopBound& counted) {
+        Arena& arena = function.getArena();
+        Value* one = function.getConstant(1);
+        Value* first = counted.iv->start;
+        Value* last = counted.iv->start;
+        if (counted.iv->step > 0) {
+            last = counted.bound;
+            if (counted.op == CmpOp::Lt) {
+                last = guard->insertBeforeTerminator(arena.create<BinaryOp>(InstrKind::Sub, counted.bound, one));
+            }
+        } else {
+            first = counted.bound;
+            if (counted.op == CmpOp::Gt) {
+                first = guard->insertBeforeTerminator(arena.create<BinaryOp>(InstrKind::Add, counted.bound, one));
+            }
+        }
+        guard->insertBeforeTerminator(arena.create<RangeCheck>(object, first, last));
+    }
+
+    // Splits the preheader's edge into the loop so that the new guard block
+    // runs only if the first header test passes. The test is repeated in
+    // the preheader on the values the header phis start with; the block
+    // between the guard and the header becomes the new preheader.
+    static BasicBlock* createGuard(Function& function, Loop* loop, LoopInfo& loopInfo, CFGUpdater& updater) {
+        BasicBlock* preheader = loop->preheader;
+        BasicBlock* header = loop->header;
+        bool continueOnTrue = false;
+        Cmp* test = getHeaderTest(loop, continueOnTrue);
+        if (!test) {
+            return nullptr;
+        }
+        Value* operands[2];
+        for (size_t i = 0; i < 2; ++i) {
+            Value* operand = test->getOperand(i);
+            auto* phi = dyn_cast_or_null<Phi>(operand);
+            if (phi && phi->getParent() == header) {
+                operand = phi->getIncomingValueForBlock(preheader);
+            } else if (!isOutside(operand, loop)) {
+                return nullptr;
+            }
+            if (!operand) {
+                return nullptr;
+            }
+            operands[i] = operand;
+        }
+
+        Arena& arena = function.getArena();
+        Instruction* firstTest =
+            preheader->insertBeforeTerminator(arena.create<Cmp>(test->getCmpOp(), operands[0], operands[1]));
+        BasicBlock* entry = updater.splitPredecessors(header, {preheader}, header->getName() + ".entry");
+        BasicBlock* guard = function.createBasicBlock(header->getName() + ".guard");
+        guard->createInstr<Jump>(entry);
+
+        auto& instructions = preheader->getInstructions();
+        instructions.replace(instructions.iteratorTo(preheader->getTerminator()),
+                             arena.create<CondJump>(firstTest, continueOnTrue ? guard : entry,
+                                                    continueOnTrue ? entry : guard));
+        updater.insertEdge(preheader, guard);
+        updater.insertEdge(guard, entry);
+
+        // entry first, so that guard lands in front of it.
+        loopInfo.addBlockToLoop(entry, loop->parent);
+        loopInfo.addBlockToLoop(guard, loop->parent);
+        loop->preheader = entry;
+        return guard;
+    }
+
+    // The comparison the header branches on when exactly one of its targets
+    // stays in the loop; continueOnTrue tells which one.
+    static Cmp* getHeaderTest(const Loop* loop, bool& continueOnTrue) {
+        auto* branch = dyn_cast_or_null<CondJump>(loop->header->getTerminator());
+        if (!branch) {
+            return nullptr;
+        }
+        auto* test = dyn_cast_or_null<Cmp>(branch->getCondition());
+        if (!test || test->getParent() != loop->header) {
+            return nullptr;
+        }
+        continueOnTrue = loop->contains(branch->getTrueTarget());
+        if (continueOnTrue == loop->contains(branch->getFalseTarget())) {
+            return nullptr;
+        }
+        return test;
+    }
+
+    static bool containsCall(const Loop* loop) {
+        for (BasicBlock* bb : loop->blocks) {
+            for (const Instruction& instr : bb->getInstructions()) {
+                if (isa<Call>(&instr)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    static bool dominatesAll(const DominatorTree& domTree, const BasicBlock* bb,
+                             const std::vector<BasicBlock*>& blocks) {
+        for (BasicBlock* other : blocks) {
+            if (!domTree.dominates(bb, other)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool isOutside(Value* value, const Loop* loop) {
+        auto* def = dyn_cast_or_null<Instruction>(value);
+        return !def || !loop->contains(def->getParent());
+    }
+
+    // Whether every operand is defined outside the loop or computed in it by
+    // side-effect-free instructions that hoistOperands() can move out.
+    static bool isAvailable(const Instruction* instr, const Loop* loop) {
+        for (Value* operand : instr->getOperands()) {
+            if (!isAvailable(operand, loop)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool isAvailable(Value* value, const Loop* loop) {
+        if (isOutside(value, loop)) {
+            return true;
+        }
+        auto* def = cast<Instruction>(value);
+        return LoopInvariantCodeMotionPass::isHoistable(def) && isAvailable(def, loop);
+    }
+
+    // Moves what isAvailable() accepted to the end of the preheader, which
+    // dominates both the guard and the loop, operands first.
+    static void hoistOperands(Instruction* instr, const Loop* loop, BasicBlock* preheader) {
+        for (Value* operand : instr->getOperands()) {
+            hoistOperands(operand, loop, preheader);
+        }
+    }
+
+    static void hoistOperands(Value* value, const Loop* loop, BasicBlock* preheader) {
+        if (isOutside(value, loop)) {
+            return;
+        }
+        auto* def = cast<Instruction>(value);
+        hoistOperands(def, loop, preheader);
+        def->removeFromParent();
+        preheader->insertBeforeTerminator(def);
+    }
+};
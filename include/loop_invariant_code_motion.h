@@ -0,0 +1,132 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "cfg_updater.h"
+#include "dominator_tree.h"
+#include "function.h"
+#include "instruction.h"
+#include "loop_analysis.h"
+#include <iterator>
+#include <vector>
+
+// Moves BinaryOp, Cmp and ConstantInstruction whose operands do not change
+// inside a loop to the loop's preheader, so they run once per entry to the
+// loop instead of once per iteration. None of them can trap or has side
+// effects, so they are hoisted from conditionally executed blocks too.
+//
+// Loops without a preheader get one first. Loops are handled innermost
+// first: what leaves an inner loop lands in its preheader, which is part of
+// the outer loop and is looked at again when the outer loop's turn comes.
+class LoopInvariantCodeMotionPass {
+public:
+    static bool runOnFunction(Function& function) {
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses);
+    }
+
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        if (analyses.getLoopInfo().empty()) {
+            return false;
+        }
+        bool changed = insertPreheaders(function, analyses);
+
+        const LoopInfo& loopInfo = analyses.getLoopInfo();
+        const DominatorTree& domTree = analyses.getDominatorTree();
+        bool hoisted = false;
+        const std::vector<Loop*>& loops = loopInfo.getLoops();
+        for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+            hoisted |= hoistInvariants(*it, domTree);
+        }
+
+        if (hoisted) {
+            analyses.invalidate(PreservedAnalyses::cfgShape());
+        }
+        return changed || hoisted;
+    }
+
+    // Gives every loop that can have one a preheader, keeping the edge
+    // lists and a cached dominator tree current. A loop headed by the entry
+    // block has no edge from outside to split and is left alone.
+    static bool insertPreheaders(Function& function, FunctionAnalysisManager& analyses) {
+        const LoopInfo& loopInfo = analyses.getLoopInfo();
+        analyses.getDominatorTree();
+        CFGUpdater updater(function, analyses.getCachedDominatorTree());
+        bool changed = false;
+        for (Loop* loop : loopInfo) {
+            if (loop->preheader) {
+                continue;
+            }
+            std::vector<BasicBlock*> outside;
+            for (BasicBlock* pred : loop->header->getPredecessors()) {
+                if (updater.getDominatorTree()->isReachable(pred) && !loop->contains(pred)) {
+                    outside.push_back(pred);
+                }
+            }
+            if (outside.empty()) {
+                continue;
+            }
+            updater.splitPredecessors(loop->header, outside, loop->header->getName() + ".preheader");
+            changed = true;
+        }
+
+        if (changed) {
+            analyses.invalidate(PreservedAnalyses()
+                                    .preserve(AnalysisKind::CFG)
+                                    .preserve(AnalysisKind::DominatorTree));
+        }
+        return changed;
+    }
+
+    static bool isHoistable(const Instruction* instr) {
+        return isa<BinaryOp>(instr) || isa<Cmp>(instr) || isa<ConstantInstruction>(instr);
+    }
+
+    static bool isInvariant(const Instruction* instr, const Loop* loop) {
+        for (Value* operand : instr->getOperands()) {
+            auto* def = dyn_cast_or_null<Instruction>(operand);
+            if (def && loop->contains(def->getParent())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Walks the loop in dominator-tree order, so an instruction is seen
+    // after everything it uses from the same loop and chains of invariant
+    // computations move together.
+    static bool hoistInvariants(Loop* loop, const DominatorTree& domTree) {
+        BasicBlock* preheader = loop->preheader;
+        if (!preheader) {
+            return false;
+        }
+        auto& target = preheader->getInstructions();
+        auto insertPoint = target.iteratorTo(preheader->getTerminator());
+
+        bool changed = false;
+        std::vector<BasicBlock*> worklist{loop->header};
+        while (!worklist.empty()) {
+            BasicBlock* bb = worklist.back();
+            worklist.pop_back();
+            auto& instructions = bb->getInstructions();
+            for (auto it = instructions.begin(); it != instructions.end(); ) {
+                Instruction* instr = &*it;
+                ++it;
+                if (!isHoistable(instr) || !isInvariant(instr, loop)) {
+                    continue;
+                }
+                instructions.remove(instr);
+                target.insert(insertPoint, instr);
+                changed = true;
+            }
+            for (BasicBlock* child : domTree.getChildren(bb)) {
+                if (loop->contains(child)) {
+                    worklist.push_back(child);
+                }
+            }
+        }
+        return changed;
+    }
+};
@@ -0,0 +1,446 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "call.h"
+#include "cfg.h"
+#include "cfg_updater.h"
+#include "checks.h"
+#include "constant_folding.h"
+#include "control_flow.h"
+#include "function.h"
+#include "induction_variables.h"
+#include "instruction.h"
+#include "loop_analysis.h"
+#include "loop_invariant_code_motion.h"
+#include "peephole_optimizer.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Duplicates the bodies of innermost loops whose exit test
+// InductionVariableAnalysis understands.
+//
+// A loop with a constant trip count within the budget is unrolled fully:
+// it turns into one copy of its blocks per iteration, laid out in a row.
+// Each copy reads the values the previous one computed instead of the
+// header's phis, and its exit test is settled, since it is known how it
+// comes out.
+//
+// A loop tested in its header is otherwise unrolled partially. A new loop
+// in front of it runs factor copies of the body per iteration for as long
+// as that many iterations are certain to remain, and the original loop
+// runs what is left over.
+//
+// The copies are merged into their predecessors where control flows
+// straight through, and ConstantFoldingPass and PeepholePass then fold the
+// arithmetic on induction variables that became constants.
+class LoopUnrollingPass {
+public:
+    struct Config {
+        // Loops with a larger constant trip count are left to partial
+        // unrolling.
+        size_t maxFullTripCount;
+        // Copies per iteration of a partially unrolled loop; less than 2
+        // turns partial unrolling off.
+        size_t unrollFactor;
+        // How many instructions the copies of one loop may add up to.
+        size_t maxUnrolledInstructions;
+        bool runLocalOptimizations;
+
+        Config()
+            : maxFullTripCount(16),
+              unrollFactor(4),
+              maxUnrolledInstructions(256),
+              runLocalOptimizations(true) {}
+    };
+
+    static bool runOnFunction(Function& function, const Config& config = Config()) {
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses, config);
+    }
+
+    // Every loop is planned before the first one changes, so the analyses
+    // are computed once. Unrolling a loop only retargets the edge from its
+    // preheader and the phis of its exit, which leaves the plans of the
+    // other loops intact.
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses,
+                              const Config& config = Config()) {
+        if (analyses.getLoopInfo().empty()) {
+            return false;
+        }
+        bool changed = LoopInvariantCodeMotionPass::insertPreheaders(function, analyses);
+
+        const InductionVariableAnalysis& ivs = analyses.getInductionVariables();
+        std::vector<Plan> plans;
+        for (Loop* loop : analyses.getLoopInfo()) {
+            if (std::optional<Plan> plan = planLoop(loop, ivs, config)) {
+                plans.push_back(*plan);
+            }
+        }
+        if (plans.empty()) {
+            return changed;
+        }
+
+        std::vector<BasicBlock*> copies;
+        for (const Plan& plan : plans) {
+            if (plan.fully) {
+                unrollFully(function, plan, copies);
+            } else {
+                unrollPartially(function, plan, config.unrollFactor, copies);
+            }
+        }
+
+        // The original blocks of fully unrolled loops are no longer
+        // reachable; dropping them rebuilds the edges as well.
+        CFGAnalysis::removeUnreachableBlocks(function);
+        CFGUpdater(function).mergeBlocksIntoPredecessors(copies);
+        analyses.invalidate(PreservedAnalyses::none());
+
+        if (config.runLocalOptimizations) {
+            ConstantFoldingPass::runOnFunction(function, analyses);
+            PeepholePass::runOnFunction(function, analyses);
+        }
+        return true;
+    }
+
+private:
+    struct Plan {
+        Loop* loop = nullptr;
+        LoopBound bound;
+        // The successor of the exiting block outside the loop.
+        BasicBlock* exit = nullptr;
+        bool fully = false;
+        int64_t tripCount = 0;
+        // Partial only: the value the variable is tested against in the
+        // unrolled loop, when the bound is a constant.
+        std::optional<int> limit;
+    };
+
+    // The values and blocks of the loop in one copy.
+    struct Copy {
+        std::unordered_map<const Value*, Value*> values;
+        std::unordered_map<const BasicBlock*, BasicBlock*> blocks;
+
+        Value* map(Value* value) const {
+            auto it = values.find(value);
+            return it == values.end() ? value : it->second;
+        }
+
+        BasicBlock* map(BasicBlock* bb) const {
+            auto it = blocks.find(bb);
+            return it == blocks.end() ? bb : it->second;
+        }
+    };
+
+    static std::optional<Plan> planLoop(Loop* loop, const InductionVariableAnalysis& ivs, const Config& config) {
+        const LoopBound* bound = ivs.getLoopBound(loop);
+        if (!loop->isInnermost() || !loop->preheader || !bound) {
+            return std::nullopt;
+        }
+        size_t size = 0;
+        for (BasicBlock* bb : loop->blocks) {
+            for (const Instruction& instr : bb->getInstructions()) {
+                if (instr.getKind() == InstrKind::Return) {
+                    return std::nullopt;
+                }
+            }
+            size += bb->getInstructions().size();
+        }
+
+        Plan plan;
+        plan.loop = loop;
+        plan.bound = *bound;
+        auto* branch = cast<CondJump>(bound->exiting->getTerminator());
+        plan.exit = loop->contains(branch->getTrueTarget()) ? branch->getFalseTarget() : branch->getTrueTarget();
+
+        std::optional<int64_t> tripCount = ivs.getTripCount(loop);
+        if (tripCount && static_cast<uint64_t>(*tripCount) <= config.maxFullTripCount &&
+            static_cast<uint64_t>(*tripCount) * size <= config.maxUnrolledInstructions) {
+            plan.fully = true;
+            plan.tripCount = *tripCount;
+            return plan;
+        }
+
+        if (config.unrollFactor < 2 || config.unrollFactor * size > config.maxUnrolledInstructions ||
+            bound->exiting != loop->header || bound->exiting == loop->getLatch() || bound->testsUpdate) {
+            return std::nullopt;
+        }
+        int64_t step = bound->iv->step;
+        bool counting = ((bound->op == CmpOp::Lt || bound->op == CmpOp::Le) && step > 0) ||
+                        ((bound->op == CmpOp::Gt || bound->op == CmpOp::Ge) && step < 0);
+        int64_t delta = static_cast<int64_t>(config.unrollFactor - 1) * step;
+        if (!counting || !fitsInt(delta)) {
+            return std::nullopt;
+        }
+        if (Constant* constant = asConstant(bound->bound)) {
+            int64_t limit = constant->getValue() - delta;
+            if (!fitsInt(limit)) {
+                return std::nullopt;
+            }
+            plan.limit = static_cast<int>(limit);
+        }
+        return plan;
+    }
+
+    // Copy k of the blocks reads, for a header phi, its value from the
+    // preheader when k is 0 and what copy k - 1 computed for the latch
+    // otherwise. Copy k jumps to copy k + 1, and the last copy leaves the
+    // loop at the test whose outcome differs. A loop tested in a header
+    // that is not also its latch runs the header once more than the rest,
+    // so the last copy is just the header there.
+    static void unrollFully(Function& function, const Plan& plan, std::vector<BasicBlock*>& copies) {
+        const Loop* loop = plan.loop;
+        BasicBlock* header = loop->header;
+        BasicBlock* latch = loop->getLatch();
+        BasicBlock* exiting = plan.bound.exiting;
+        const bool headerExits = exiting != latch;
+        const int64_t count = plan.tripCount + (headerExits ? 1 : 0);
+        const std::vector<BasicBlock*> headerOnly{header};
+
+        Copy previous;
+        Instruction* entering = loop->preheader->getTerminator();
+        for (int64_t k = 0; k < count; ++k) {
+            const bool last = k + 1 == count;
+            Copy copy;
+            for (Instruction& instr : header->getInstructions()) {
+                auto* phi = dyn_cast<Phi>(&instr);
+                if (!phi) {
+                    break;
+                }
+                copy.values[phi] = k == 0 ? phi->getIncomingValueForBlock(loop->preheader)
+                                          : previous.map(phi->getIncomingValueForBlock(latch));
+            }
+            cloneBlocks(function, loop, last && headerExits ? headerOnly : loop->blocks,
+                        ".unroll" + std::to_string(k), copy, copies);
+            CFGUpdater::retarget(entering, header, copy.blocks.at(header));
+
+            BasicBlock* exitingCopy = copy.blocks.at(exiting);
+            settleExitTest(exitingCopy, last ? plan.exit : nextInLoop(loop, copy, exiting));
+            if (!last) {
+                entering = copy.blocks.at(latch)->getTerminator();
+            }
+            previous = std::move(copy);
+        }
+
+        // Whatever used the loop's values after it reads the last copy's.
+        CFGUpdater::replacePhiBlocks(plan.exit, exiting, previous.blocks.at(exiting));
+        for (BasicBlock* bb : loop->blocks) {
+            for (Instruction& instr : bb->getInstructions()) {
+                auto it = previous.values.find(&instr);
+                if (it != previous.values.end()) {
+                    instr.replaceAllUsesWith(it->second);
+                }
+            }
+        }
+    }
+
+    // preheader -> unrolled: phis, "iv op limit"
+    //   true:  copy 0 -> ... -> copy factor - 1 -> unrolled
+    //   false: the original loop, which starts from the unrolled phis.
+    //
+    // limit is bound - (factor - 1) * step, so iv passes exactly when the
+    // next factor - 1 values of iv would pass the original test. If the
+    // bound is not a constant, the subtraction may wrap; the preheader then
+    // also checks that limit came out on the right side of bound, and the
+    // unrolled loop is skipped when it did not.
+    static void unrollPartially(Function& function, const Plan& plan, size_t factor,
+                                std::vector<BasicBlock*>& copies) {
+        Arena& arena = function.getArena();
+        const Loop* loop = plan.loop;
+        BasicBlock* header = loop->header;
+        BasicBlock* latch = loop->getLatch();
+        BasicBlock* preheader = loop->preheader;
+        const LoopBound& bound = plan.bound;
+
+        Value* limit = nullptr;
+        Value* inRange = nullptr;
+        if (plan.limit) {
+            limit = function.getConstant(*plan.limit);
+        } else {
+            Value* current = currentBound(bound);
+            int delta = static_cast<int>((static_cast<int64_t>(factor) - 1) * bound.iv->step);
+            limit = preheader->insertBeforeTerminator(
+                arena.create<BinaryOp>(InstrKind::Sub, current, function.getConstant(delta)));
+            CmpOp side = delta > 0 ? CmpOp::Lt : CmpOp::Gt;
+            inRange = preheader->insertBeforeTerminator(arena.create<Cmp>(side, limit, current));
+        }
+
+        BasicBlock* unrolled = function.createBasicBlock(header->getName() + ".unrolled");
+        std::vector<std::pair<Phi*, Phi*>> phis;
+        for (Instruction& instr : header->getInstructions()) {
+            auto* phi = dyn_cast<Phi>(&instr);
+            if (!phi) {
+                break;
+            }
+            auto* merged = arena.create<Phi>();
+            unrolled->getInstructions().push_back(merged);
+            phis.emplace_back(phi, merged);
+        }
+        Phi* iv = nullptr;
+        for (const auto& [phi, merged] : phis) {
+            if (phi == bound.iv->value) {
+                iv = merged;
+            }
+        }
+        Value* condition = &unrolled->createInstr<Cmp>(bound.op, iv, limit);
+        if (inRange) {
+            condition = &unrolled->createInstr<BinaryOp>(InstrKind::And, condition, inRange);
+        }
+
+        Copy previous;
+        BasicBlock* first = nullptr;
+        Instruction* backEdge = nullptr;
+        for (size_t k = 0; k < factor; ++k) {
+            Copy copy;
+            for (const auto& [phi, merged] : phis) {
+                copy.values[phi] = k == 0 ? merged : previous.map(phi->getIncomingValueForBlock(latch));
+            }
+            cloneBlocks(function, loop, loop->blocks, ".unroll" + std::to_string(k), copy, copies);
+            BasicBlock* headerCopy = copy.blocks.at(header);
+            if (backEdge) {
+                CFGUpdater::retarget(backEdge, header, headerCopy);
+            } else {
+                first = headerCopy;
+            }
+            settleExitTest(headerCopy, nextInLoop(loop, copy, header));
+            backEdge = copy.blocks.at(latch)->getTerminator();
+            previous = std::move(copy);
+        }
+        CFGUpdater::retarget(backEdge, header, unrolled);
+        unrolled->createInstr<CondJump>(condition, first, header);
+
+        BasicBlock* lastLatch = previous.blocks.at(latch);
+        for (const auto& [phi, merged] : phis) {
+            merged->addIncoming(preheader, phi->getIncomingValueForBlock(preheader));
+            merged->addIncoming(lastLatch, previous.map(phi->getIncomingValueForBlock(latch)));
+            for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                if (phi->getIncomingBlock(i) == preheader) {
+                    phi->setOperand(i, merged);
+                }
+            }
+            phi->replaceIncomingBlock(preheader, unrolled);
+        }
+        CFGUpdater::retarget(preheader->getTerminator(), header, unrolled);
+    }
+
+    // Clones blocks into copy, whose header phis the caller has mapped
+    // already. Jumps back to the header keep pointing at the original for
+    // the caller to redirect.
+    static void cloneBlocks(Function& function, const Loop* loop, const std::vector<BasicBlock*>& blocks,
+                            const std::string& suffix, Copy& copy, std::vector<BasicBlock*>& copies) {
+        for (BasicBlock* bb : blocks) {
+            BasicBlock* clone = function.createBasicBlock(bb->getName() + suffix);
+            copy.blocks[bb] = clone;
+            copies.push_back(clone);
+        }
+
+        // Operands are mapped once every value of the copy exists: phis in
+        // the loop body may read values from blocks cloned after them.
+        std::vector<Instruction*> cloned;
+        for (BasicBlock* bb : blocks) {
+            BasicBlock* clone = copy.blocks.at(bb);
+            for (Instruction& instr : bb->getInstructions()) {
+                if (bb == loop->header && isa<Phi>(&instr)) {
+                    continue;
+                }
+                Instruction* newInstr = cloneInstruction(function, instr, loop, copy);
+                clone->getInstructions().push_back(newInstr);
+                copy.values[&instr] = newInstr;
+                cloned.push_back(newInstr);
+            }
+        }
+        for (Instruction* instr : cloned) {
+            for (size_t i = 0; i < instr->getNumOperands(); ++i) {
+                instr->setOperand(i, copy.map(instr->getOperand(i)));
+            }
+        }
+    }
+
+    static Instruction* cloneInstruction(Function& function, const Instruction& instr, const Loop* loop,
+                                         const Copy& copy) {
+        Arena& arena = function.getArena();
+        auto target = [&](BasicBlock* bb) { return bb == loop->header ? bb : copy.map(bb); };
+        switch (instr.getKind()) {
+            case InstrKind::Add:
+            case InstrKind::Mul:
+            case InstrKind::Sub:
+            case InstrKind::Shr:
+            case InstrKind::And:
+            case InstrKind::Shl:
+                return arena.create<BinaryOp>(instr.getKind(), instr.getOperand(0), instr.getOperand(1));
+            case InstrKind::Cmp:
+                return arena.create<Cmp>(cast<Cmp>(&instr)->getCmpOp(), instr.getOperand(0), instr.getOperand(1));
+            case InstrKind::Constant:
+                return arena.create<ConstantInstruction>(
+                    function.getConstant(cast<ConstantInstruction>(&instr)->getConstant()->getValue()));
+            case InstrKind::NullCheck:
+                return arena.create<NullCheck>(instr.getOperand(0));
+            case InstrKind::BoundsCheck:
+                return arena.create<BoundsCheck>(instr.getOperand(0), instr.getOperand(1));
+            case InstrKind::RangeCheck:
+                return arena.create<RangeCheck>(instr.getOperand(0), instr.getOperand(1), instr.getOperand(2));
+            case InstrKind::Call: {
+                auto* call = cast<Call>(&instr);
+                std::vector<Value*> arguments(call->getOperands().begin(), call->getOperands().end());
+                return arena.create<Call>(call->getCallee(), arguments);
+            }
+            case InstrKind::Jump:
+                return arena.create<Jump>(target(cast<Jump>(&instr)->getTarget()));
+            case InstrKind::CondJump: {
+                auto* branch = cast<CondJump>(&instr);
+                return arena.create<CondJump>(branch->getCondition(), target(branch->getTrueTarget()),
+                                              target(branch->getFalseTarget()));
+            }
+            case InstrKind::Phi: {
+                auto* phi = cast<Phi>(&instr);
+                auto* newPhi = arena.create<Phi>();
+                for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                    newPhi->addIncoming(copy.map(phi->getIncomingBlock(i)), phi->getIncomingValue(i));
+                }
+                return newPhi;
+            }
+            default:
+                // Returns never sit in a loop; planLoop() checks.
+                return nullptr;
+        }
+    }
+
+    // Replaces the exit test at the end of bb, whose outcome is known, by
+    // a jump to target. The comparison goes too unless something else
+    // reads it.
+    static void settleExitTest(BasicBlock* bb, BasicBlock* target) {
+        auto* branch = cast<CondJump>(bb->getTerminator());
+        auto* test = dyn_cast_or_null<Instruction>(branch->getCondition());
+        branch->eraseFromParent();
+        bb->createInstr<Jump>(target);
+        if (test && test->getParent() == bb && !test->hasUses()) {
+            test->eraseFromParent();
+        }
+    }
+
+    // Where the copy of the exiting block bb goes when the loop carries
+    // on. A branch back to the header is left for the caller to redirect.
+    static BasicBlock* nextInLoop(const Loop* loop, const Copy& copy, BasicBlock* bb) {
+        auto* branch = cast<CondJump>(bb->getTerminator());
+        BasicBlock* next = loop->contains(branch->getTrueTarget()) ? branch->getTrueTarget() : branch->getFalseTarget();
+        return next == loop->header ? next : copy.map(next);
+    }
+
+    // The bound as the exit test reads it now: unrolling an earlier loop
+    // may have replaced the value the analysis recorded.
+    static Value* currentBound(const LoopBound& bound) {
+        auto* branch = cast<CondJump>(bound.exiting->getTerminator());
+        auto* test = cast<Cmp>(branch->getCondition());
+        return test->getOperand(0) == bound.iv->value ? test->getOperand(1) : test->getOperand(0);
+    }
+
+    static bool fitsInt(int64_t value) {
+        return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "instruction.h"
+#include "value_location.h"
+#include <cstddef>
+#include <vector>
+
+// Copies between locations that take effect all at once, like the inputs
+// of the phis of a block arriving over one edge.
+//
+// sequentialize() orders them so that no copy overwrites a location a
+// later one still reads. What is left once nothing more can go is a set
+// of disjoint cycles; each is broken by saving one location in a
+// temporary and reading it from there. A cycle is done before the next is
+// broken, so a single temporary serves all of them, and none is used
+// without a cycle. A copy onto its own source, a phi that got the
+// location of its input, is dropped when added.
+class ParallelCopy {
+public:
+    struct Copy {
+        Value* value;
+        // None when value is a constant.
+        ValueLocation from;
+        ValueLocation to;
+    };
+
+    // Each location may be the target of one copy only.
+    void add(Value* value, ValueLocation from, ValueLocation to) {
+        if (from == to) {
+            ++coalesced;
+            return;
+        }
+        copies.push_back({value, from, to});
+    }
+
+    bool empty() const { return copies.empty(); }
+    size_t size() const { return copies.size(); }
+    size_t getNumCoalesced() const { return coalesced; }
+
+    // The copies in an order that is safe one at a time, with a copy into
+    // temp added in front of each cycle. temp must not be read or written
+    // by any of them.
+    std::vector<Copy> sequentialize(ValueLocation temp) const {
+        std::vector<Copy> pending = copies;
+        std::vector<Copy> order;
+        order.reserve(pending.size() + 1);
+
+        // readers[i]: copies not yet made that read what copy i overwrites.
+        std::vector<size_t> readers(pending.size(), 0);
+        std::vector<bool> done(pending.size(), false);
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            for (const Copy& other : pending) {
+                readers[i] += other.from == pending[i].to;
+            }
+            if (readers[i] == 0) {
+                ready.push_back(i);
+            }
+        }
+
+        size_t remaining = pending.size();
+        size_t next = 0;
+        while (remaining > 0) {
+            while (!ready.empty()) {
+                size_t i = ready.back();
+                ready.pop_back();
+                order.push_back(pending[i]);
+                done[i] = true;
+                --remaining;
+                // The location copy i read may now be overwritten.
+                for (size_t k = 0; k < pending.size(); ++k) {
+                    if (!done[k] && pending[k].to == pending[i].from && --readers[k] == 0) {
+                        ready.push_back(k);
+                    }
+                }
+            }
+            if (remaining == 0) {
+                break;
+            }
+            // Only cycles are left, where every location has one reader.
+            // Save the target of one copy so that it can go.
+            while (done[next]) {
+                ++next;
+            }
+            for (size_t k = 0; k < pending.size(); ++k) {
+                if (!done[k] && pending[k].from == pending[next].to) {
+                    order.push_back({pending[k].value, pending[k].from, temp});
+                    pending[k].from = temp;
+                }
+            }
+            readers[next] = 0;
+            ready.push_back(next);
+        }
+        return order;
+    }
+
+private:
+    std::vector<Copy> copies;
+    size_t coalesced = 0;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "cfg_updater.h"
+#include "control_flow.h"
+#include "function.h"
+#include "instruction.h"
+#include "liveness_analysis.h"
+#include "parallel_copy.h"
+#include "register_allocator.h"
+#include "spill_ops.h"
+#include <cstddef>
+#include <vector>
+
+// Takes a function out of SSA form once registers are assigned: the
+// inputs of the phis of a block become Moves on each incoming edge, from
+// where the input is at the end of the predecessor to where the phi lives.
+//
+// The phis of a block take their inputs at once, so the moves of an edge
+// are a ParallelCopy, ordered with the scratch register breaking cycles.
+// A phi the allocator put where its input already is costs nothing. The
+// moves go where SpillCodePass puts the reloads of the same edge, and
+// ahead of them: at the end of the predecessor if it has no other
+// successor, at the top of the block if it has no other predecessor, and
+// otherwise into a new block on the edge, unless SpillCodePass made one
+// already. Only critical edges that carry a move are split.
+//
+// Afterwards a phi has no inputs and only stands for the value its users
+// read; a phi nothing reads is erased. Runs after SpillCodePass, on the
+// liveness the allocation was computed on.
+class PhiEliminationPass {
+public:
+    struct Stats {
+        size_t moves = 0;
+        size_t coalesced = 0;
+        size_t temporaries = 0;
+        size_t splitEdges = 0;
+    };
+
+    // The liveness of analyses must still be the one the allocation was
+    // computed on. Phis lose their inputs even where nothing moves, so
+    // the instruction-level analyses are always dropped.
+    static Stats runOnFunction(Function& function, FunctionAnalysisManager& analyses,
+                               const RegisterAllocator& allocator) {
+        Stats stats = runOnFunction(function, analyses.getLiveness(), allocator);
+        analyses.invalidate(stats.splitEdges ? PreservedAnalyses::none() : PreservedAnalyses::cfgShape());
+        return stats;
+    }
+
+    static Stats runOnFunction(Function& function, const LivenessAnalysis& liveness,
+                               const RegisterAllocator& allocator) {
+        Stats stats;
+        const ValueLocation temp{allocator.getScratchRegister(), -1};
+
+        struct EdgeMoves {
+            BasicBlock* pred;
+            BasicBlock* succ;
+            std::vector<ParallelCopy::Copy> moves;
+        };
+        std::vector<EdgeMoves> edges;
+        std::vector<Phi*> phis;
+        for (BasicBlock* succ : liveness.getLinearOrder()) {
+            size_t first = phis.size();
+            for (auto& instr : succ->getInstructions()) {
+                auto* phi = dyn_cast<Phi>(&instr);
+                if (!phi) {
+                    break;
+                }
+                phis.push_back(phi);
+            }
+            if (phis.size() == first) {
+                continue;
+            }
+            for (BasicBlock* pred : succ->getPredecessors()) {
+                // The values leave the block the edge came from before
+                // SpillCodePass split it.
+                BasicBlock* from = pred;
+                if (liveness.getBlockFrom(from) < 0 && from->getPredecessors().size() == 1) {
+                    from = from->getPredecessors()[0];
+                }
+                if (liveness.getBlockFrom(from) < 0) {
+                    continue;
+                }
+                int end = liveness.getBlockTo(from) - 1;
+                ParallelCopy copy;
+                for (size_t i = first; i < phis.size(); ++i) {
+                    Phi* phi = phis[i];
+                    Value* input = phi->getIncomingValueForBlock(pred);
+                    if (!input || allocator.getIntervals(phi).empty()) {
+                        continue;
+                    }
+                    ValueLocation source = isa<Constant>(input) ? ValueLocation() : allocator.getLocationAt(input, end);
+                    copy.add(input, source, allocator.getLocation(phi));
+                }
+                stats.coalesced += copy.getNumCoalesced();
+                if (!copy.empty()) {
+                    edges.push_back({pred, succ, copy.sequentialize(temp)});
+                }
+            }
+        }
+
+        Arena& arena = function.getArena();
+        for (EdgeMoves& edge : edges) {
+            Instruction* anchor = nullptr;
+            if (liveness.getBlockFrom(edge.pred) < 0) {
+                // An edge block of SpillCodePass holds nothing but its reloads.
+                anchor = &edge.pred->getInstructions().front();
+            } else if (edge.pred->getSuccessors().size() == 1) {
+                anchor = firstEdgeReload(edge.pred, liveness, allocator);
+            } else if (edge.succ->getPredecessors().size() == 1) {
+                anchor = firstNonPhi(edge.succ);
+            } else {
+                BasicBlock* bb = CFGUpdater(function).splitPredecessors(
+                    edge.succ, {edge.pred}, edge.pred->getName() + "." + edge.succ->getName());
+                anchor = bb->getTerminator();
+                ++stats.splitEdges;
+            }
+            auto& instructions = anchor->getParent()->getInstructions();
+            for (const ParallelCopy::Copy& move : edge.moves) {
+                instructions.insert(instructions.iteratorTo(anchor), arena.create<Move>(move.value, move.from, move.to));
+                stats.temporaries += move.to == temp;
+            }
+            stats.moves += edge.moves.size();
+        }
+
+        for (Phi* phi : phis) {
+            while (phi->getNumIncoming() > 0) {
+                phi->removeIncomingBlock(phi->getIncomingBlock(0));
+            }
+        }
+        for (Phi* phi : phis) {
+            if (!phi->hasUses()) {
+                phi->eraseFromParent();
+            }
+        }
+        return stats;
+    }
+
+private:
+    static Instruction* firstNonPhi(BasicBlock* bb) {
+        for (auto& instr : bb->getInstructions()) {
+            if (!isa<Phi>(&instr)) {
+                return &instr;
+            }
+        }
+        return nullptr;
+    }
+
+    // The reloads SpillCodePass put on the way out of bb, which has a
+    // single successor, sit right before its terminator. Each changes the
+    // register its value leaves bb in; a reload into that register belongs
+    // to bb itself, whether it fills a piece of an interval or starts the
+    // block, and has to run before the moves read it.
+    static Instruction* firstEdgeReload(BasicBlock* bb, const LivenessAnalysis& liveness,
+                                        const RegisterAllocator& allocator) {
+        int end = liveness.getBlockTo(bb) - 1;
+        Instruction* anchor = bb->getTerminator();
+        while (auto* reload = dyn_cast_or_null<Reload>(anchor->getPrev())) {
+            if (reload->getRegister() < 0 ||
+                allocator.getLocationAt(reload->getReloadedValue(), end).reg == reload->getRegister()) {
+                break;
+            }
+            anchor = reload;
+        }
+        return anchor;
+    }
+};
@@ -4,15 +4,22 @@
 #include <memory>
 #include <unordered_map>
 #include "context.h"
+#include "analysis_manager.h"
 #include "cfg.h"
+#include "branch_folding.h"
 #include "loop_analysis.h"
 #include "function.h"
 #include "constant_folding.h"
 #include "peephole_optimizer.h"
 #include "dominated_checks.h"
+#include "loop_invariant_code_motion.h"
+#include "loop_unrolling.h"
+#include "loop_check_hoisting.h"
+#include "strength_reduction.h"
 
 class Program {
     std::vector<std::unique_ptr<Function>> functions;
+    AnalysisStats analysisStats;
 
 public:
     Function& createFunction(const std::string& name) {
@@ -25,7 +32,7 @@ public:
         int instr_count = 0;
         for (const auto& instr : bb.getInstructions()) {
             try {
-                std::cout << "  " << instr->str(ctx) << "\n";
+                std::cout << "  " << instr.str(ctx) << "\n";
             } catch (...) {
                 std::cout << "  [CRASHED on instruction " << instr_count << "]\n";
             }
@@ -92,23 +99,80 @@ public:
         }
     }
 
+    void runBranchFolding() {
+        for (auto& func : functions) {
+            BranchFoldingPass::runOnFunction(*func);
+        }
+    }
+
+    void runLoopInvariantCodeMotion() {
+        for (auto& func : functions) {
+            LoopInvariantCodeMotionPass::runOnFunction(*func);
+        }
+    }
+
+    void runLoopUnrolling(const LoopUnrollingPass::Config& config = LoopUnrollingPass::Config()) {
+        for (auto& func : functions) {
+            LoopUnrollingPass::runOnFunction(*func, config);
+        }
+    }
+
+    void runStrengthReduction() {
+        for (auto& func : functions) {
+            StrengthReductionPass::runOnFunction(*func);
+        }
+    }
+
+    void runLoopCheckHoisting() {
+        for (auto& func : functions) {
+            LoopCheckHoistingPass::runOnFunction(*func);
+        }
+    }
+
     void runDominatedCheckElimination() {
         for (auto& func : functions) {
             DominatedCheckEliminationPass::runOnFunction(*func);
         }
     }
 
+    // The passes share one analysis cache per function; getAnalysisStats()
+    // reports what it computed and what it could hand out again.
     void runOptimizations() {
         for (auto& func : functions) {
-            PeepholePass::runOnFunction(*func);
-            ConstantFoldingPass::runOnFunction(*func);
-            DominatedCheckEliminationPass::runOnFunction(*func);
+            FunctionAnalysisManager analyses(*func);
+            PeepholePass::runOnFunction(*func, analyses);
+            ConstantFoldingPass::runOnFunction(*func, analyses);
+            BranchFoldingPass::runOnFunction(*func, analyses);
+            LoopInvariantCodeMotionPass::runOnFunction(*func, analyses);
+            StrengthReductionPass::runOnFunction(*func, analyses);
+            LoopCheckHoistingPass::runOnFunction(*func, analyses);
+            DominatedCheckEliminationPass::runOnFunction(*func, analyses);
+            analysisStats += analyses.getStats();
         }
     }
 
+    const AnalysisStats& getAnalysisStats() const { return analysisStats; }
+
     std::vector<std::unique_ptr<Function>> &getFunctions() {
         return functions;
     }
+
+    // Constant-pool totals over all functions of the program.
+    size_t getNumConstants() const {
+        size_t total = 0;
+        for (const auto& func : functions) {
+            total += func->getConstantPool().size();
+        }
+        return total;
+    }
+
+    size_t getConstantPoolMemoryUsage() const {
+        size_t total = 0;
+        for (const auto& func : functions) {
+            total += func->getConstantPool().getMemoryUsage();
+        }
+        return total;
+    }
 };
 
 class ProgramWithLoopAnalysis : public Program {
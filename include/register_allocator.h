@@ -0,0 +1,526 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "context.h"
+#include "dense_map.h"
+#include "function.h"
+#include "instruction.h"
+#include "liveness_analysis.h"
+#include "loop_analysis.h"
+#include "value_location.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <ostream>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// A piece of a value's lifetime interval with one location. Splitting cuts
+// a value's interval wherever its location changes; a value that was never
+// split has a single piece covering all of it.
+struct AllocatedInterval {
+    LifetimeInterval interval;
+    ValueLocation location;
+};
+
+// Linear-scan register allocation after Wimmer and Franz, "Linear Scan
+// Register Allocation on SSA Form", on the intervals of a
+// LivenessAnalysis, with the interval splitting of Wimmer and
+// Mössenböck, "Optimized Interval Splitting in a Linear Scan Register
+// Allocator".
+//
+// Intervals are handled by increasing start position. Those covering the
+// current position are active; those that began earlier but are in a
+// lifetime hole there are inactive, and their register is free until they
+// resume. A register is free for the new interval if no active interval
+// holds it and no inactive one holding it resumes before the new interval
+// ends; a register free for only part of it is taken for that part.
+// When none is free, the register whose holders are next read furthest
+// away is taken, unless the new interval's own next read is further
+// still; whichever side loses goes to the stack from there. Inside a loop,
+// a value the loop reads counts as read again at the loop end.
+//
+// A part moved to the stack is split again before its next use that needs
+// a register, and that part waits for a register like any other interval,
+// preferring the one the value had before. Phis and their inputs prefer
+// each other's registers, so that SSA deconstruction has no move to make
+// for them. Splits prefer the end of a block with a smaller loop depth,
+// so a value the loop does not read leaves its register in front of the
+// loop and comes back after it.
+//
+// A spilled value is stored once, right after its definition, which keeps
+// its slot valid wherever it is live; values whose lifetimes do not
+// intersect share a slot.
+//
+// Only values something reads get a location; constants are immediates.
+class RegisterAllocator {
+  public:
+    struct Config {
+        // Off, a value that does not fit keeps a stack slot for its whole
+        // lifetime and is reloaded for every read, as without splitting.
+        bool splitIntervals;
+
+        Config() : splitIntervals(true) {}
+    };
+
+    explicit RegisterAllocator(int numRegisters,
+                               const Config &config = Config())
+        : numRegisters_(std::max(numRegisters, 0)), config_(config) {}
+
+    void allocate(Function &function) {
+        FunctionAnalysisManager analyses(function);
+        allocate(function, analyses);
+    }
+
+    void allocate(Function &function, FunctionAnalysisManager &analyses) {
+        allocate(function, analyses.getLiveness(), analyses.getLoopInfo());
+    }
+
+    void allocate(Function &function, const LivenessAnalysis &liveness) {
+        LoopInfo loops(function);
+        allocate(function, liveness, loops);
+    }
+
+    void allocate(Function &function, const LivenessAnalysis &liveness,
+                  const LoopInfo &loops) {
+        const size_t numValues = function.getNumValueIds();
+        liveness_ = &liveness;
+        loops_ = &loops;
+        intervals_.clear();
+        pieces_.reset(numValues);
+        spillSlots_.reset(numValues, -1);
+        slotOwners_.clear();
+        allocated_.clear();
+        active_.clear();
+        inactive_.clear();
+        unhandled_ = Unhandled();
+        sequence_ = 0;
+        computeLoopRanges();
+
+        auto consider = [&](Value *v) {
+            const LifetimeInterval *interval = liveness.getInterval(v);
+            if (!interval || interval->getLiveRanges().empty() || !v->hasUses())
+                return;
+            intervals_.push_back({*interval, {}});
+            pieces_[v].push_back(&intervals_.back());
+            allocated_.push_back(v);
+            enqueue(&intervals_.back());
+        };
+        for (auto *param : function.getParams())
+            consider(param);
+        for (auto *bb : liveness.getLinearOrder()) {
+            for (auto &instr : bb->getInstructions())
+                consider(&instr);
+        }
+
+        while (!unhandled_.empty()) {
+            AllocatedInterval *current = std::get<2>(unhandled_.top());
+            unhandled_.pop();
+            advanceTo(current->interval.getStart());
+            if (!tryAllocateFreeRegister(current))
+                allocateBlockedRegister(current);
+        }
+    }
+
+    int getNumRegisters() const { return numRegisters_; }
+    // The register past the allocatable ones, free for moves to break
+    // cycles through.
+    int getScratchRegister() const { return numRegisters_; }
+
+    // The location of a value where it is defined: a default location,
+    // with neither register nor slot, for values that did not need one.
+    const ValueLocation &getLocation(const Value *v) const {
+        static const ValueLocation none;
+        const auto &pieces = pieces_.lookup(v);
+        return pieces.empty() ? none : pieces.front()->location;
+    }
+
+    // The location of the piece of v's interval that position falls in.
+    ValueLocation getLocationAt(const Value *v, int position) const {
+        const auto &pieces = pieces_.lookup(v);
+        auto it = std::upper_bound(
+            pieces.begin(), pieces.end(), position,
+            [](int pos, const AllocatedInterval *piece) {
+                return pos < piece->interval.getStart();
+            });
+        return it == pieces.begin() ? ValueLocation()
+                                    : (*std::prev(it))->location;
+    }
+
+    // The pieces of v's interval in order, empty if v got no location.
+    const std::vector<AllocatedInterval *> &getIntervals(const Value *v) const {
+        return pieces_.lookup(v);
+    }
+
+    int getRegister(const Value *v) const { return getLocation(v).reg; }
+    // A value spends part of its lifetime on the stack if it has a slot.
+    int getSpillSlot(const Value *v) const { return spillSlots_.lookup(v); }
+    bool isSpilled(const Value *v) const { return getSpillSlot(v) >= 0; }
+    int getNumSpillSlots() const {
+        return static_cast<int>(slotOwners_.size());
+    }
+
+    // The values that got a location, in the order they were handled.
+    const std::vector<Value *> &getAllocatedValues() const {
+        return allocated_;
+    }
+
+    // One line per value, with the position each later piece starts at:
+    // "%v3 -> r1" or "%v4 -> r0, stack 0 from 12, r2 from 20".
+    void print(std::ostream &os, NameContext &ctx) const {
+        for (Value *v : allocated_) {
+            os << ctx.getValueName(v) << " -> ";
+            const auto &pieces = pieces_.lookup(v);
+            for (size_t i = 0; i < pieces.size(); ++i) {
+                if (i > 0)
+                    os << ", ";
+                os << pieces[i]->location.str();
+                if (i > 0)
+                    os << " from " << pieces[i]->interval.getStart();
+            }
+            os << "\n";
+        }
+    }
+
+  private:
+    // Ordered by start position, then by the order pieces were queued in,
+    // so that equal starts are handled deterministically.
+    using Entry = std::tuple<int, size_t, AllocatedInterval *>;
+    using Unhandled =
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>;
+
+    int numRegisters_;
+    Config config_;
+    const LivenessAnalysis *liveness_ = nullptr;
+    const LoopInfo *loops_ = nullptr;
+    // Owns the pieces; a deque keeps them in place as it grows.
+    std::deque<AllocatedInterval> intervals_;
+    ValueMap<std::vector<AllocatedInterval *>> pieces_;
+    ValueMap<int> spillSlots_;
+    // The whole intervals of the values sharing each slot.
+    std::vector<std::vector<const LifetimeInterval *>> slotOwners_;
+    std::vector<Value *> allocated_;
+    std::vector<AllocatedInterval *> active_;
+    std::vector<AllocatedInterval *> inactive_;
+    Unhandled unhandled_;
+    size_t sequence_ = 0;
+    // The positions of the innermost loop around each block of the linear
+    // order, empty outside loops.
+    std::vector<LiveRange> loopRanges_;
+
+    void enqueue(AllocatedInterval *piece) {
+        unhandled_.push({piece->interval.getStart(), sequence_++, piece});
+    }
+
+    // The next read at or after position that needs the value in a
+    // register; reads by phi moves can come from a stack slot.
+    static int nextUseAfter(const AllocatedInterval *piece, int position) {
+        return piece->interval.nextUseAfter(position, true);
+    }
+
+    // The next use as eviction weighs it. Reads by phi moves count too: a
+    // value that reaches its phi in a register saves the store after its
+    // definition. In a loop, a value read in the loop and still live where
+    // it jumps back is read again on the next iteration, so it counts as
+    // read at the loop end rather than at its next read after the loop.
+    int nextUseInLoop(const AllocatedInterval *piece, int position) const {
+        int next = piece->interval.nextUseAfter(position);
+        const LiveRange &loop = loopRanges_[blockIndexAt(position)];
+        if (next < loop.to || !piece->interval.isLiveAt(loop.to - 1))
+            return next;
+        const LifetimeInterval *whole =
+            liveness_->getInterval(piece->interval.value);
+        return whole->nextUseAfter(loop.from) < loop.to ? loop.to : next;
+    }
+
+    void computeLoopRanges() {
+        const auto &order = liveness_->getLinearOrder();
+        std::vector<std::pair<const Loop *, LiveRange>> cache;
+        loopRanges_.assign(order.size(), LiveRange{0, 0});
+        for (size_t i = 0; i < order.size(); ++i) {
+            const Loop *loop = loops_->getLoopFor(order[i]);
+            if (!loop)
+                continue;
+            auto cached = std::find_if(
+                cache.begin(), cache.end(),
+                [&](const auto &entry) { return entry.first == loop; });
+            if (cached == cache.end()) {
+                LiveRange range{INT_MAX, 0};
+                for (BasicBlock *bb : loop->blocks) {
+                    int from = liveness_->getBlockFrom(bb);
+                    if (from < 0)
+                        continue;
+                    range.from = std::min(range.from, from);
+                    range.to = std::max(range.to, liveness_->getBlockTo(bb));
+                }
+                cache.push_back({loop, range});
+                cached = std::prev(cache.end());
+            }
+            loopRanges_[i] = cached->second;
+        }
+    }
+
+    // Retires intervals that ended before position and moves the others
+    // between active and inactive as position enters or leaves their holes.
+    void advanceTo(int position) {
+        std::vector<AllocatedInterval *> stillActive;
+        std::vector<AllocatedInterval *> stillInactive;
+        for (auto *pieces : {&active_, &inactive_}) {
+            for (AllocatedInterval *piece : *pieces) {
+                if (piece->interval.getEnd() <= position)
+                    continue;
+                (piece->interval.isLiveAt(position) ? stillActive
+                                                    : stillInactive)
+                    .push_back(piece);
+            }
+        }
+        active_ = std::move(stillActive);
+        inactive_ = std::move(stillInactive);
+    }
+
+    // Takes the register that stays free longest. If it is not free for
+    // the whole of current, current keeps it up to a split position before
+    // it is needed elsewhere and goes to the stack from there.
+    bool tryAllocateFreeRegister(AllocatedInterval *current) {
+        if (numRegisters_ == 0)
+            return false;
+        const LifetimeInterval &interval = current->interval;
+        std::vector<int> freeUntil(numRegisters_, INT_MAX);
+        for (AllocatedInterval *piece : active_)
+            freeUntil[piece->location.reg] = 0;
+        for (AllocatedInterval *piece : inactive_) {
+            int overlap = piece->interval.firstIntersection(interval);
+            int &until = freeUntil[piece->location.reg];
+            if (overlap >= 0)
+                until = std::min(until, overlap);
+        }
+        int reg = static_cast<int>(
+            std::max_element(freeUntil.begin(), freeUntil.end()) -
+            freeUntil.begin());
+        int hint = hintedRegister(current);
+        if (hint >= 0 && freeUntil[hint] >= interval.getEnd())
+            reg = hint;
+        int until = freeUntil[reg];
+        if (until >= interval.getEnd()) {
+            assign(current, reg);
+            return true;
+        }
+        if (!config_.splitIntervals || until <= interval.getStart())
+            return false;
+        int split = splitPosition(interval.getStart() + 1, until);
+        assign(current, reg);
+        spillFrom(current, split, split);
+        return true;
+    }
+
+    void allocateBlockedRegister(AllocatedInterval *current) {
+        const int position = current->interval.getStart();
+        if (numRegisters_ == 0) {
+            spillFrom(current, position, position);
+            return;
+        }
+        std::vector<int> nextUse(numRegisters_, INT_MAX);
+        for (AllocatedInterval *piece : active_) {
+            int &next = nextUse[piece->location.reg];
+            next = std::min(next, nextUseInLoop(piece, position));
+        }
+        for (AllocatedInterval *piece : inactive_) {
+            if (!piece->interval.intersects(current->interval))
+                continue;
+            int &next = nextUse[piece->location.reg];
+            next = std::min(next, nextUseInLoop(piece, position));
+        }
+        int reg = static_cast<int>(
+            std::max_element(nextUse.begin(), nextUse.end()) -
+            nextUse.begin());
+        // A register every holder needs right here cannot be had at all;
+        // current's reads here then go through a scratch register.
+        if (nextUse[reg] <= position ||
+            nextUseInLoop(current, position) > nextUse[reg]) {
+            spillFrom(current, position, position + 1);
+            return;
+        }
+
+        // Every holder of reg that overlaps current gives it up from here,
+        // or from an earlier loop entry after its last read, so the loop
+        // does not reload it on every iteration.
+        auto evict = [&](std::vector<AllocatedInterval *> &pieces) {
+            auto kept = std::remove_if(
+                pieces.begin(), pieces.end(), [&](AllocatedInterval *piece) {
+                    if (piece->location.reg != reg ||
+                        !piece->interval.intersects(current->interval))
+                        return false;
+                    const LifetimeInterval &interval = piece->interval;
+                    int from = std::max(interval.getStart(),
+                                        interval.lastUseBefore(position)) + 1;
+                    int split = from < position
+                                    ? splitPosition(from, position)
+                                    : position;
+                    spillFrom(piece, split, position);
+                    return true;
+                });
+            pieces.erase(kept, pieces.end());
+        };
+        evict(active_);
+        evict(inactive_);
+        assign(current, reg);
+    }
+
+    void assign(AllocatedInterval *piece, int reg) {
+        piece->location = {reg, -1};
+        active_.push_back(piece);
+    }
+
+    // Moves piece to the stack from position on. With splitting, the part
+    // before position keeps its register and the part from the first use
+    // at or after reloadFrom that needs one waits for a register again;
+    // without, the whole value stays on the stack.
+    void spillFrom(AllocatedInterval *piece, int position, int reloadFrom) {
+        const int slot = spillSlot(piece->interval.value);
+        if (!config_.splitIntervals) {
+            piece->location = {-1, slot};
+            return;
+        }
+        AllocatedInterval *rest = position <= piece->interval.getStart()
+                                      ? piece
+                                      : splitAt(piece, position);
+        rest->location = {-1, slot};
+        if (numRegisters_ == 0)
+            return;
+        const int start = rest->interval.getStart();
+        const int next = nextUseAfter(rest, std::max(start, reloadFrom));
+        if (next == INT_MAX)
+            return;
+        if (next <= start) {
+            // Needed in a register right away: nothing to keep on the
+            // stack.
+            rest->location = {};
+            enqueue(rest);
+            return;
+        }
+        enqueue(splitAt(
+            rest, splitPosition(std::max(start + 1, reloadFrom), next)));
+    }
+
+    AllocatedInterval *splitAt(AllocatedInterval *piece, int position) {
+        intervals_.push_back({piece->interval.splitAt(position), {}});
+        AllocatedInterval *rest = &intervals_.back();
+        auto &pieces = pieces_[piece->interval.value];
+        pieces.insert(std::find(pieces.begin(), pieces.end(), piece) + 1, rest);
+        return rest;
+    }
+
+    // The register piece would rather have, or -1. A piece coming back
+    // from the stack prefers the register the value had before, so the
+    // edges into it need no move. A phi prefers the register an input
+    // leaves its predecessor in, and a value a phi reads prefers the
+    // phi's register, so the move on that edge is coalesced away.
+    int hintedRegister(AllocatedInterval *piece) const {
+        int reg = previousRegister(piece);
+        if (reg >= 0)
+            return reg;
+        Value *v = piece->interval.value;
+        auto *phi = dyn_cast<Phi>(v);
+        if (phi && piece == getIntervals(v).front()) {
+            for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                int end = edgeEnd(phi->getIncomingBlock(i));
+                Value *input = phi->getIncomingValue(i);
+                if (end >= 0 && !isa<Constant>(input) &&
+                    getLocationAt(input, end).isRegister())
+                    return getLocationAt(input, end).reg;
+            }
+        }
+        for (Instruction *user : v->getUsers()) {
+            auto *reader = dyn_cast<Phi>(user);
+            if (!reader || !getLocation(reader).isRegister())
+                continue;
+            for (size_t i = 0; i < reader->getNumIncoming(); ++i) {
+                int end = edgeEnd(reader->getIncomingBlock(i));
+                if (reader->getIncomingValue(i) == v && end >= 0 &&
+                    piece->interval.isLiveAt(end - 1))
+                    return getLocation(reader).reg;
+            }
+        }
+        return -1;
+    }
+
+    // The position past the terminator of pred, where the inputs of the
+    // phis of its successor are read; -1 if pred is not numbered.
+    int edgeEnd(BasicBlock *pred) const {
+        return liveness_->getBlockFrom(pred) < 0
+                   ? -1
+                   : liveness_->getBlockTo(pred) - 1;
+    }
+
+    // The register of the last piece of the same value before piece, or -1.
+    int previousRegister(AllocatedInterval *piece) const {
+        const auto &pieces = getIntervals(piece->interval.value);
+        auto it = std::find(pieces.begin(), pieces.end(), piece);
+        while (it != pieces.begin()) {
+            --it;
+            if ((*it)->location.isRegister())
+                return (*it)->location.reg;
+        }
+        return -1;
+    }
+
+    // The index in the linear order of the block holding pos.
+    size_t blockIndexAt(int pos) const {
+        const auto &order = liveness_->getLinearOrder();
+        auto it = std::upper_bound(
+            order.begin(), order.end(), pos, [&](int p, BasicBlock *bb) {
+                return p < liveness_->getBlockFrom(bb);
+            });
+        return static_cast<size_t>(it - order.begin()) - 1;
+    }
+
+    // Where to split in [minPos, maxPos]: maxPos, unless a block ending in
+    // that range has a smaller loop depth than the block of maxPos; then
+    // the end of the shallowest such block, the latest one on a tie.
+    int splitPosition(int minPos, int maxPos) const {
+        assert(minPos <= maxPos);
+        const auto &order = liveness_->getLinearOrder();
+        size_t minBlock = blockIndexAt(minPos);
+        size_t maxBlock = blockIndexAt(maxPos);
+        int position = maxPos;
+        int depth = loops_->getLoopDepth(order[maxBlock]);
+        for (size_t i = maxBlock; i-- > minBlock;) {
+            int blockDepth = loops_->getLoopDepth(order[i]);
+            if (blockDepth < depth) {
+                depth = blockDepth;
+                position = liveness_->getBlockTo(order[i]);
+            }
+        }
+        return position;
+    }
+
+    // The first slot whose values are never live together with v, or a
+    // new one.
+    int spillSlot(Value *v) {
+        int &slot = spillSlots_[v];
+        if (slot >= 0)
+            return slot;
+        const LifetimeInterval *interval = liveness_->getInterval(v);
+        for (size_t s = 0; s < slotOwners_.size() && slot < 0; ++s) {
+            bool shared = std::any_of(
+                slotOwners_[s].begin(), slotOwners_[s].end(),
+                [&](const LifetimeInterval *owner) {
+                    return owner->intersects(*interval);
+                });
+            if (!shared)
+                slot = static_cast<int>(s);
+        }
+        if (slot < 0) {
+            slot = static_cast<int>(slotOwners_.size());
+            slotOwners_.emplace_back();
+        }
+        slotOwners_[slot].push_back(interval);
+        return slot;
+    }
+};
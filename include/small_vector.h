@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Vector that keeps its first N elements inline and only goes to the heap
+// when it grows past them. Iterators are plain pointers and, as with
+// std::vector, are invalidated when the vector grows.
+//
+// Elements are moved with their move constructor, so types such as Use that
+// fix up outside links when relocated are safe to store; only trivially
+// copyable elements are copied as bytes.
+template<typename T, unsigned N>
+class SmallVector {
+    static_assert(N > 0, "SmallVector needs at least one inline element");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned element type");
+
+    T* begin_;
+    size_t size_ = 0;
+    size_t capacity_ = N;
+    alignas(T) unsigned char inlineStorage[N * sizeof(T)];
+
+    T* inlineData() { return reinterpret_cast<T*>(inlineStorage); }
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using size_type = size_t;
+
+    SmallVector() : begin_(inlineData()) {}
+
+    SmallVector(std::initializer_list<T> init) : SmallVector() {
+        reserve(init.size());
+        for (const T& value : init) {
+            push_back(value);
+        }
+    }
+
+    SmallVector(const SmallVector& other) : SmallVector() {
+        reserve(other.size());
+        for (const T& value : other) {
+            push_back(value);
+        }
+    }
+
+    SmallVector(SmallVector&& other) noexcept : SmallVector() { takeFrom(std::move(other)); }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this != &other) {
+            clear();
+            reserve(other.size());
+            for (const T& value : other) {
+                push_back(value);
+            }
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept {
+        if (this != &other) {
+            clear();
+            releaseHeap();
+            takeFrom(std::move(other));
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        clear();
+        releaseHeap();
+    }
+
+    iterator begin() { return begin_; }
+    iterator end() { return begin_ + size_; }
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return begin_ + size_; }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    // True while the elements still live in the inline buffer.
+    bool isSmall() const { return begin_ == reinterpret_cast<const T*>(inlineStorage); }
+
+    T* data() { return begin_; }
+    const T* data() const { return begin_; }
+    T& operator[](size_t i) { assert(i < size_); return begin_[i]; }
+    const T& operator[](size_t i) const { assert(i < size_); return begin_[i]; }
+    T& front() { return (*this)[0]; }
+    const T& front() const { return (*this)[0]; }
+    T& back() { return (*this)[size_ - 1]; }
+    const T& back() const { return (*this)[size_ - 1]; }
+
+    void reserve(size_t n) {
+        if (n > capacity_) {
+            grow(n);
+        }
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == capacity_) {
+            grow(capacity_ * 2);
+        }
+        T* slot = new (begin_ + size_) T(std::forward<Args>(args)...);
+        ++size_;
+        return *slot;
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        assert(size_ > 0);
+        begin_[--size_].~T();
+    }
+
+    // Removes the element at pos, shifting the tail down; returns pos.
+    iterator erase(iterator pos) {
+        assert(pos >= begin() && pos < end());
+        std::move(pos + 1, end(), pos);
+        pop_back();
+        return pos;
+    }
+
+    void clear() {
+        for (size_t i = size_; i > 0; --i) {
+            begin_[i - 1].~T();
+        }
+        size_ = 0;
+    }
+
+private:
+    void grow(size_t minCapacity) {
+        size_t newCapacity = std::max(minCapacity, capacity_ * 2);
+        T* newData = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+        T* old = begin_;
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (size_ > 0) {
+                std::memcpy(static_cast<void*>(newData), static_cast<const void*>(old), size_ * sizeof(T));
+            }
+        } else {
+            std::uninitialized_move(old, old + size_, newData);
+            std::destroy(old, old + size_);
+        }
+        releaseHeap();
+        begin_ = newData;
+        capacity_ = newCapacity;
+    }
+
+    void releaseHeap() {
+        if (!isSmall()) {
+            ::operator delete(begin_);
+            begin_ = inlineData();
+            capacity_ = N;
+        }
+    }
+
+    // Expects this to be empty and inline.
+    void takeFrom(SmallVector&& other) {
+        if (!other.isSmall()) {
+            // Heap buffers change owner without moving any element.
+            begin_ = other.begin_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.begin_ = other.inlineData();
+            other.size_ = 0;
+            other.capacity_ = N;
+            return;
+        }
+        for (T& value : other) {
+            emplace_back(std::move(value));
+        }
+        other.clear();
+    }
+};
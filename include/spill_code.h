@@ -0,0 +1,210 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "cfg_updater.h"
+#include "control_flow.h"
+#include "function.h"
+#include "instruction.h"
+#include "liveness_analysis.h"
+#include "register_allocator.h"
+#include "spill_ops.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Inserts the Spill and Reload instructions a register allocation implies.
+//
+// A value with a stack slot is stored once, right after its definition:
+// after the phis for a phi, at the top of the entry block for a parameter.
+// A piece of its interval that starts in a register inside a block is
+// reloaded just before it starts. A read that needs a register while the
+// value is on the stack, which only happens without splitting or without
+// registers, reloads into a scratch register right before the reader.
+//
+// On a control-flow edge, a value live into the successor whose location
+// there is a register other than the one it leaves the predecessor in is
+// reloaded on the edge. The slot is valid on every edge since the store
+// follows the definition, so a change of register is a reload too, and the
+// reloads on an edge never depend on each other. They go at the end of the
+// predecessor if it has no other successor, at the top of the successor if
+// it has no other predecessor, and into a new block splitting the edge
+// otherwise. Phis are left alone; PhiEliminationPass moves their
+// operands.
+//
+// The liveness must be the one the allocation was computed on. Numbering
+// and intervals refer to the instructions before the pass, so both are out
+// of date afterwards.
+class SpillCodePass {
+public:
+    struct Stats {
+        size_t spills = 0;
+        size_t reloads = 0;
+        size_t splitEdges = 0;
+    };
+
+    static Stats runOnFunction(Function& function, FunctionAnalysisManager& analyses,
+                               const RegisterAllocator& allocator) {
+        Stats stats = runOnFunction(function, analyses.getLiveness(), allocator);
+        if (stats.spills || stats.reloads) {
+            analyses.invalidate(stats.splitEdges ? PreservedAnalyses::none() : PreservedAnalyses::cfgShape());
+        }
+        return stats;
+    }
+
+    static Stats runOnFunction(Function& function, const LivenessAnalysis& liveness,
+                               const RegisterAllocator& allocator) {
+        Stats stats;
+        const std::vector<BasicBlock*>& order = liveness.getLinearOrder();
+        if (order.empty()) {
+            return stats;
+        }
+        Arena& arena = function.getArena();
+
+        // Instructions by position, so a split position maps to the
+        // instruction it precedes.
+        std::vector<Instruction*> byPosition;
+        for (BasicBlock* bb : order) {
+            for (auto& instr : bb->getInstructions()) {
+                byPosition.push_back(&instr);
+            }
+        }
+
+        std::vector<std::pair<Instruction*, Instruction*>> insertions;
+        auto insertBefore = [&](Instruction* anchor, Instruction* instr) {
+            insertions.push_back({anchor, instr});
+            if (isa<Spill>(instr)) {
+                ++stats.spills;
+            } else {
+                ++stats.reloads;
+            }
+        };
+
+        for (Value* v : allocator.getAllocatedValues()) {
+            int slot = allocator.getSpillSlot(v);
+            if (slot < 0) {
+                continue;
+            }
+            insertBefore(afterDefinition(v, order.front()), arena.create<Spill>(v, slot));
+
+            const auto& pieces = allocator.getIntervals(v);
+            for (size_t i = 1; i < pieces.size(); ++i) {
+                const ValueLocation& location = pieces[i]->location;
+                int start = pieces[i]->interval.getStart();
+                Instruction* at = byPosition[start / 2];
+                bool atBlockStart = liveness.getBlockFrom(at->getParent()) == start;
+                if (location.isRegister() && !atBlockStart && pieces[i - 1]->location.reg != location.reg) {
+                    insertBefore(at, arena.create<Reload>(v, slot, location.reg));
+                }
+            }
+        }
+
+        for (BasicBlock* bb : order) {
+            for (auto& instr : bb->getInstructions()) {
+                if (isa<Phi>(&instr)) {
+                    continue;
+                }
+                int position = liveness.getInstructionId(&instr);
+                std::vector<Value*> reloaded;
+                for (Value* operand : instr.getOperands()) {
+                    int slot = operand ? allocator.getSpillSlot(operand) : -1;
+                    if (slot < 0 || allocator.getLocationAt(operand, position).isRegister() ||
+                        std::find(reloaded.begin(), reloaded.end(), operand) != reloaded.end()) {
+                        continue;
+                    }
+                    reloaded.push_back(operand);
+                    insertBefore(&instr, arena.create<Reload>(operand, slot, -1));
+                }
+            }
+        }
+
+        struct EdgeReloads {
+            BasicBlock* pred;
+            BasicBlock* succ;
+            std::vector<Instruction*> reloads;
+        };
+        std::vector<Value*> byId(function.getNumValueIds(), nullptr);
+        for (Value* v : allocator.getAllocatedValues()) {
+            byId[v->getId()] = v;
+        }
+        std::vector<EdgeReloads> edges;
+        for (BasicBlock* succ : order) {
+            int from = liveness.getBlockFrom(succ);
+            for (BasicBlock* pred : succ->getPredecessors()) {
+                if (liveness.getBlockFrom(pred) < 0) {
+                    continue;
+                }
+                int to = liveness.getBlockTo(pred) - 1;
+                EdgeReloads edge{pred, succ, {}};
+                liveness.getLiveIn(succ).forEach([&](size_t bit) {
+                    Value* v = byId[liveness.getLiveAcrossValues()[bit]->getId()];
+                    if (!v) {
+                        return;
+                    }
+                    ValueLocation there = allocator.getLocationAt(v, from);
+                    if (there.isRegister() && allocator.getLocationAt(v, to).reg != there.reg) {
+                        assert(allocator.getSpillSlot(v) >= 0);
+                        edge.reloads.push_back(arena.create<Reload>(v, allocator.getSpillSlot(v), there.reg));
+                    }
+                });
+                if (!edge.reloads.empty()) {
+                    stats.reloads += edge.reloads.size();
+                    edges.push_back(std::move(edge));
+                }
+            }
+        }
+
+        // Before the same instruction, a store saves a value defined right
+        // above it while a reload may be filling that value's register for
+        // another, so the stores go first.
+        std::stable_partition(insertions.begin(), insertions.end(),
+                              [](const auto& insertion) { return isa<Spill>(insertion.second); });
+        for (auto& [anchor, instr] : insertions) {
+            auto& instructions = anchor->getParent()->getInstructions();
+            instructions.insert(instructions.iteratorTo(anchor), instr);
+        }
+        for (EdgeReloads& edge : edges) {
+            BasicBlock* bb = nullptr;
+            if (edge.pred->getSuccessors().size() == 1) {
+                bb = edge.pred;
+            } else if (edge.succ->getPredecessors().size() == 1) {
+                bb = edge.succ;
+            } else {
+                bb = CFGUpdater(function).splitPredecessors(edge.succ, {edge.pred},
+                                                            edge.pred->getName() + "." + edge.succ->getName());
+                ++stats.splitEdges;
+            }
+            Instruction* anchor = bb == edge.succ ? firstNonPhi(bb) : bb->getTerminator();
+            auto& instructions = bb->getInstructions();
+            for (Instruction* reload : edge.reloads) {
+                instructions.insert(instructions.iteratorTo(anchor), reload);
+            }
+        }
+        return stats;
+    }
+
+private:
+    static Instruction* firstNonPhi(BasicBlock* bb) {
+        for (auto& instr : bb->getInstructions()) {
+            if (!isa<Phi>(&instr)) {
+                return &instr;
+            }
+        }
+        return nullptr;
+    }
+
+    // The instruction a store right after v's definition goes before.
+    static Instruction* afterDefinition(Value* v, BasicBlock* entry) {
+        auto* instr = dyn_cast<Instruction>(v);
+        if (!instr) {
+            return firstNonPhi(entry);
+        }
+        if (isa<Phi>(instr)) {
+            return firstNonPhi(instr->getParent());
+        }
+        return instr->getNext();
+    }
+};
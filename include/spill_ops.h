@@ -0,0 +1,97 @@
+#pragma once
+
+#include "context.h"
+#include "instruction.h"
+#include "value_location.h"
+#include <string>
+
+// Data movement made explicit after register allocation: stack traffic by
+// SpillCodePass, phi moves by PhiEliminationPass. None defines a value: a
+// value keeps its SSA identity, and later instructions go on reading it
+// wherever the allocator put it.
+
+// Stores value to its stack slot.
+class Spill : public Instruction {
+    int slot;
+
+public:
+    Spill(Value* value, int stackSlot) : Instruction(InstrKind::Spill, {value}), slot(stackSlot) {}
+
+    Value* getSpilledValue() const { return getOperand(0); }
+    int getSlot() const { return slot; }
+
+    std::string str(NameContext& ctx) const override {
+        return "spill " + ctx.getValueName(getSpilledValue()) + ", stack " + std::to_string(slot);
+    }
+
+    void updateCFG() override {}
+
+    void print(std::ostream& os) const override {
+        os << "spill " << getSpilledValue() << ", stack " << slot;
+    }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Spill); }
+};
+
+// Loads value from its stack slot into a register, or into a scratch
+// register for a single read when reg is -1.
+class Reload : public Instruction {
+    int slot;
+    int reg;
+
+public:
+    Reload(Value* value, int stackSlot, int targetReg)
+        : Instruction(InstrKind::Reload, {value}), slot(stackSlot), reg(targetReg) {}
+
+    Value* getReloadedValue() const { return getOperand(0); }
+    int getSlot() const { return slot; }
+    int getRegister() const { return reg; }
+
+    std::string str(NameContext& ctx) const override {
+        return "reload " + ctx.getValueName(getReloadedValue()) + ", stack " + std::to_string(slot) +
+               (reg >= 0 ? " -> r" + std::to_string(reg) : "");
+    }
+
+    void updateCFG() override {}
+
+    void print(std::ostream& os) const override {
+        os << "reload " << getReloadedValue() << ", stack " << slot;
+        if (reg >= 0) {
+            os << " -> r" << reg;
+        }
+    }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Reload); }
+};
+
+// Copies value from one location to another, or materializes it there
+// when it is a constant and from is none.
+class Move : public Instruction {
+    ValueLocation from;
+    ValueLocation to;
+
+public:
+    Move(Value* value, ValueLocation source, ValueLocation target)
+        : Instruction(InstrKind::Move, {value}), from(source), to(target) {}
+
+    Value* getMovedValue() const { return getOperand(0); }
+    const ValueLocation& getFrom() const { return from; }
+    const ValueLocation& getTo() const { return to; }
+
+    std::string str(NameContext& ctx) const override {
+        return "move " + ctx.getValueName(getMovedValue()) + (from.isNone() ? "" : ", " + from.str()) + " -> " +
+               to.str();
+    }
+
+    void updateCFG() override {}
+
+    void print(std::ostream& os) const override {
+        os << "move " << getMovedValue();
+        if (!from.isNone()) {
+            os << ", " << from.str();
+        }
+        os << " -> " << to.str();
+    }
+
+    static bool classof(const Value* v) { return hasKind(v, InstrKind::Move); }
+};
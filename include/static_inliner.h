@@ -1,8 +1,11 @@
 #pragma once
 
+#include "analysis_manager.h"
 #include "bin_ops.h"
+#include "branch_folding.h"
 #include "call.h"
 #include "cfg.h"
+#include "cfg_updater.h"
 #include "checks.h"
 #include "constant_folding.h"
 #include "control_flow.h"
@@ -39,35 +42,72 @@ public:
         return changed;
     }
 
+    // Inlined bodies and continuations are appended to the block list, so a
+    // single pass over it also reaches the calls they contain. The CFG and
+    // the dominator tree are kept current through a CFGUpdater instead of
+    // being rebuilt after every call site.
     static bool runOnFunction(Function& caller, const Config& config = Config()) {
+        if (caller.getBasicBlocks().empty()) {
+            return false;
+        }
+        FunctionAnalysisManager analyses(caller);
+        analyses.getDominatorTree();
+        DominatorTree* domTree = analyses.getCachedDominatorTree();
+        CFGUpdater updater(caller, domTree);
+        size_t callerInstructions = countInstructions(caller);
         bool changed = false;
-        bool inlinedOne = false;
-        do {
-            inlinedOne = false;
-            for (auto& block : caller.getBasicBlocks()) {
-                auto& instructions = block->getInstructions();
-                for (size_t i = 0; i < instructions.size(); ++i) {
-                    auto* call = dynamic_cast<Call*>(instructions[i].get());
-                    if (!call) {
-                        continue;
-                    }
-                    if (!canInline(caller, *call, config)) {
-                        continue;
-                    }
-                    inlineCall(caller, *block, i, *call, config);
-                    changed = true;
-                    inlinedOne = true;
-                    break;
+
+        auto& blocks = caller.getBasicBlocks();
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            BasicBlock* block = blocks[i];
+            if (!domTree->isReachable(block)) {
+                continue;
+            }
+            for (auto& instr : block->getInstructions()) {
+                auto* call = dyn_cast<Call>(&instr);
+                if (!call || !canInline(caller, *call, callerInstructions, config)) {
+                    continue;
                 }
-                if (inlinedOne) {
-                    break;
+                const size_t firstNewBlock = blocks.size();
+                const size_t before = block->getInstructions().size();
+                inlineCall(caller, *call, config, updater);
+                callerInstructions += block->getInstructions().size() - before;
+                for (size_t j = firstNewBlock; j < blocks.size(); ++j) {
+                    callerInstructions += blocks[j]->getInstructions().size();
                 }
+                if (updater.removeDeadBlocks()) {
+                    i = std::find(blocks.begin(), blocks.end(), block) - blocks.begin();
+                    callerInstructions = countInstructions(caller);
+                }
+                changed = true;
+                // The rest of the block moved into the continuation.
+                break;
             }
-        } while (inlinedOne);
+        }
+
+        if (changed && config.runLocalOptimizations) {
+            PeepholePass::runOnFunction(caller, analyses);
+            ConstantFoldingPass::runOnFunction(caller, analyses);
+            BranchFoldingPass::runOnFunction(caller, analyses);
+            DominatedCheckEliminationPass::runOnFunction(caller, analyses);
+        }
         return changed;
     }
 
     static bool canInline(const Function& caller, const Call& call, const Config& config = Config()) {
+        return canInline(caller, call, countInstructions(caller), config);
+    }
+
+private:
+    struct CloneState {
+        std::unordered_map<const BasicBlock*, BasicBlock*> blocks;
+        std::unordered_map<const Value*, Value*> values;
+        std::vector<std::pair<BasicBlock*, Value*>> returns;
+        // Cloned blocks that jump to the continuation, one per Return.
+        std::vector<BasicBlock*> exits;
+    };
+
+    static bool canInline(const Function& caller, const Call& call, size_t callerInstructions, const Config& config) {
         Function* callee = call.getCallee();
         if (!callee || callee == &caller || callee->isNative() || callee->isInlineBlacklisted()) {
             return false;
@@ -84,7 +124,7 @@ public:
             return false;
         }
 
-        const size_t projected = countInstructions(caller) + calleeInstructionCount;
+        const size_t projected = callerInstructions + calleeInstructionCount;
         if (projected > config.maxTotalInstructions && !isSmallException(calleeInstructionCount, config)) {
             return false;
         }
@@ -92,14 +132,6 @@ public:
         return true;
     }
 
-private:
-    struct CloneState {
-        std::unordered_map<const BasicBlock*, BasicBlock*> blocks;
-        std::unordered_map<std::string, std::string> blockNames;
-        std::unordered_map<const Value*, Value*> values;
-        std::vector<std::pair<BasicBlock*, Value*>> returns;
-    };
-
     static size_t& inlineCounter() {
         static size_t counter = 0;
         return counter;
@@ -121,57 +153,70 @@ private:
         return countInstructions(callee) <= 4;
     }
 
-    static void inlineCall(Function& caller,
-                           BasicBlock& callBlock,
-                           size_t callIndex,
-                           Call& call,
-                           const Config& config) {
+    // Splits the call block, clones the callee between the two halves and
+    // hooks the clone into the CFG and the dominator tree of updater.
+    static void inlineCall(Function& caller, Call& call, const Config& config, CFGUpdater& updater) {
         Function& callee = *call.getCallee();
+        BasicBlock& callBlock = *call.getParent();
         Value* oldCallValue = &call;
-        std::vector<Value*> arguments = call.getOperands();
+        std::vector<Value*> arguments(call.getOperands().begin(), call.getOperands().end());
         const std::string prefix = "__inline" + std::to_string(++inlineCounter()) + "_" + callee.getName() + "_";
-        BasicBlock* continuation = splitCallBlock(caller, callBlock, callIndex, prefix + "cont");
+        auto& callInstructions = callBlock.getInstructions();
+        BasicBlock* continuation =
+            updater.splitBlock(&callBlock, std::next(callInstructions.iteratorTo(&call)), prefix + "cont");
 
         CloneState state;
+        std::vector<const BasicBlock*> calleeBlocks = reachableBlocks(callee);
         mapParametersAndConstants(caller, callee, arguments, state);
-        cloneBlocks(caller, callee, prefix, state);
-        cloneInstructions(caller, callee, continuation, state);
+        cloneBlocks(caller, calleeBlocks, prefix, state);
+        cloneInstructions(caller, calleeBlocks, continuation, state);
         Value* replacement = buildReturnValue(continuation, state);
-        replaceAllUses(caller, oldCallValue, replacement);
-        removeCallInstruction(callBlock, callIndex);
-        wireCallBlock(callBlock, callee, state);
-        removeUnreachableBlocks(caller);
-        CFGAnalysis::buildCFG(caller);
+        replaceAllUses(oldCallValue, replacement);
+        call.eraseFromParent();
+        wireCallBlock(callBlock, calleeBlocks, continuation, state, updater);
 
         if (config.runLocalOptimizations) {
-            PeepholePass::runOnFunction(caller);
-            ConstantFoldingPass::runOnFunction(caller);
-            DominatedCheckEliminationPass::runOnFunction(caller);
+            for (const BasicBlock* block : calleeBlocks) {
+                BasicBlock* cloned = state.blocks.at(block);
+                PeepholeOptimizer::optimizeBlock(*cloned);
+                ConstantFolding::foldConstants(*cloned);
+                BranchFolding::foldBranch(*cloned, updater);
+            }
+            PeepholeOptimizer::optimizeBlock(*continuation);
+            ConstantFolding::foldConstants(*continuation);
         }
     }
 
-    static BasicBlock* splitCallBlock(Function& caller,
-                                      BasicBlock& callBlock,
-                                      size_t callIndex,
-                                      const std::string& continuationName) {
-        BasicBlock* continuation = caller.createBasicBlock(continuationName);
-        auto& callInstructions = callBlock.getInstructions();
-        auto& continuationInstructions = continuation->getInstructions();
-
-        for (size_t i = callIndex + 1; i < callInstructions.size(); ++i) {
-            continuationInstructions.push_back(std::move(callInstructions[i]));
+    // Callee blocks its entry reaches, in callee order. Follows the
+    // terminators, since the callee's edge lists need not be current.
+    static std::vector<const BasicBlock*> reachableBlocks(const Function& callee) {
+        std::unordered_set<const BasicBlock*> reachable;
+        std::vector<const BasicBlock*> stack;
+        if (!callee.getBasicBlocks().empty()) {
+            stack.push_back(callee.getBasicBlocks().front());
+        }
+        while (!stack.empty()) {
+            const BasicBlock* block = stack.back();
+            stack.pop_back();
+            if (!reachable.insert(block).second || block->getInstructions().empty()) {
+                continue;
+            }
+            const Instruction* terminator = &block->getInstructions().back();
+            if (auto* jump = dyn_cast<Jump>(terminator)) {
+                stack.push_back(jump->getTarget());
+            } else if (auto* condJump = dyn_cast<CondJump>(terminator)) {
+                stack.push_back(condJump->getTrueTarget());
+                stack.push_back(condJump->getFalseTarget());
+            }
         }
-        callInstructions.erase(callInstructions.begin() + static_cast<std::ptrdiff_t>(callIndex + 1),
-                               callInstructions.end());
-        return continuation;
-    }
 
-    static void removeCallInstruction(BasicBlock& callBlock, size_t callIndex) {
-        auto& callInstructions = callBlock.getInstructions();
-        if (callIndex < callInstructions.size()) {
-            callInstructions[callIndex]->dropAllOperands();
-            callInstructions.erase(callInstructions.begin() + static_cast<std::ptrdiff_t>(callIndex));
+        std::vector<const BasicBlock*> blocks;
+        for (const auto& block : callee.getBasicBlocks()) {
+            if (reachable.count(block)) {
+                blocks.push_back(block);
+            }
         }
+        return blocks;
     }
 
     static void mapParametersAndConstants(Function& caller,
@@ -179,86 +224,109 @@ private:
                                           const std::vector<Value*>& arguments,
                                           CloneState& state) {
         for (size_t i = 0; i < callee.getParams().size(); ++i) {
-            state.values[callee.getParams()[i].get()] = arguments[i];
+            state.values[callee.getParams()[i]] = arguments[i];
         }
         for (const auto& constant : callee.getConstants()) {
-            state.values[constant.get()] = caller.createConstant(constant->getValue(), constant->getName());
+            state.values[constant] = caller.createConstant(constant->getValue(), constant->getName());
         }
     }
 
     static void cloneBlocks(Function& caller,
-                            const Function& callee,
+                            const std::vector<const BasicBlock*>& calleeBlocks,
                             const std::string& prefix,
                             CloneState& state) {
-        for (const auto& block : callee.getBasicBlocks()) {
+        for (const BasicBlock* block : calleeBlocks) {
             BasicBlock* cloned = caller.createBasicBlock(prefix + block->getName());
-            state.blocks[block.get()] = cloned;
-            state.blockNames[block->getName()] = cloned->getName();
+            state.blocks[block] = cloned;
         }
     }
 
+    // Operands are mapped once every instruction of the clone exists: a
+    // loop-header phi reads its back-edge value from a block cloned after
+    // it, and callee blocks need not be in dominance order.
     static void cloneInstructions(Function& caller,
-                                  const Function& callee,
+                                  const std::vector<const BasicBlock*>& calleeBlocks,
                                   BasicBlock* continuation,
                                   CloneState& state) {
-        for (const auto& oldBlock : callee.getBasicBlocks()) {
-            BasicBlock* newBlock = state.blocks[oldBlock.get()];
+        std::vector<Instruction*> cloned;
+        for (const BasicBlock* oldBlock : calleeBlocks) {
+            BasicBlock* newBlock = state.blocks.at(oldBlock);
             for (const auto& oldInstr : oldBlock->getInstructions()) {
-                if (auto* ret = dynamic_cast<Return*>(oldInstr.get())) {
+                if (auto* ret = dyn_cast<Return>(&oldInstr)) {
                     if (ret->getReturnValue()) {
-                        state.returns.emplace_back(newBlock, mapValue(caller, ret->getReturnValue(), state));
+                        state.returns.emplace_back(newBlock, ret->getReturnValue());
                     }
-                    newBlock->createInstr<Jump>(continuation->getName());
+                    newBlock->createInstr<Jump>(continuation);
+                    state.exits.push_back(newBlock);
                     continue;
                 }
-                Instruction* cloned = cloneInstruction(caller, *oldInstr, state);
-                if (cloned) {
-                    newBlock->getInstructions().push_back(std::unique_ptr<Instruction>(cloned));
-                    state.values[oldInstr.get()] = cloned;
+                Instruction* newInstr = cloneInstruction(caller, oldInstr, state);
+                if (newInstr) {
+                    newBlock->getInstructions().push_back(newInstr);
+                    state.values[&oldInstr] = newInstr;
+                    cloned.push_back(newInstr);
                 }
             }
         }
+        for (Instruction* instr : cloned) {
+            for (size_t i = 0; i < instr->getNumOperands(); ++i) {
+                instr->setOperand(i, mapValue(caller, instr->getOperand(i), state));
+            }
+        }
+        for (auto& ret : state.returns) {
+            ret.second = mapValue(caller, ret.second, state);
+        }
     }
 
+    // Clones oldInstr with the callee's operands; cloneInstructions maps
+    // them afterwards.
     static Instruction* cloneInstruction(Function& caller, const Instruction& oldInstr, CloneState& state) {
-        if (auto* binary = dynamic_cast<const BinaryOp*>(&oldInstr)) {
-            return new BinaryOp(binary->getKind(),
-                                mapValue(caller, binary->getOperands()[0], state),
-                                mapValue(caller, binary->getOperands()[1], state));
-        }
-        if (auto* cmp = dynamic_cast<const Cmp*>(&oldInstr)) {
-            return new Cmp(cmp->getCmpOp(),
-                           mapValue(caller, cmp->getOperands()[0], state),
-                           mapValue(caller, cmp->getOperands()[1], state));
-        }
-        if (auto* constant = dynamic_cast<const ConstantInstruction*>(&oldInstr)) {
-            return new ConstantInstruction(constant->getConstant()->getValue(),
-                                           constant->getConstant()->getName());
-        }
-        if (auto* nullCheck = dynamic_cast<const NullCheck*>(&oldInstr)) {
-            return new NullCheck(mapValue(caller, nullCheck->getObject(), state));
-        }
-        if (auto* boundsCheck = dynamic_cast<const BoundsCheck*>(&oldInstr)) {
-            return new BoundsCheck(mapValue(caller, boundsCheck->getObject(), state),
-                                   mapValue(caller, boundsCheck->getIndex(), state));
-        }
-        if (auto* jump = dynamic_cast<const Jump*>(&oldInstr)) {
-            return new Jump(mappedBlockName(jump->getTargetName(), state));
-        }
-        if (auto* condJump = dynamic_cast<const CondJump*>(&oldInstr)) {
-            return new CondJump(condJump->getCondition(),
-                                mappedBlockName(condJump->getTrueTargetName(), state),
-                                mappedBlockName(condJump->getFalseTargetName(), state));
-        }
-        if (auto* phi = dynamic_cast<const Phi*>(&oldInstr)) {
-            auto* clonedPhi = new Phi();
-            state.values[&oldInstr] = clonedPhi;
-            for (const auto& incoming : phi->getIncoming()) {
-                clonedPhi->addIncoming(state.blocks[incoming.first], mapValue(caller, incoming.second, state));
+        Arena& arena = caller.getArena();
+        switch (oldInstr.getKind()) {
+            case InstrKind::Add:
+            case InstrKind::Mul:
+            case InstrKind::Sub:
+            case InstrKind::Shr:
+            case InstrKind::And:
+            case InstrKind::Shl:
+                return arena.create<BinaryOp>(oldInstr.getKind(), oldInstr.getOperand(0), oldInstr.getOperand(1));
+            case InstrKind::Cmp:
+                return arena.create<Cmp>(cast<Cmp>(&oldInstr)->getCmpOp(), oldInstr.getOperand(0),
+                                         oldInstr.getOperand(1));
+            case InstrKind::Constant: {
+                const Constant* pooled = cast<ConstantInstruction>(&oldInstr)->getConstant();
+                return arena.create<ConstantInstruction>(caller.createConstant(pooled->getValue(), pooled->getName()));
+            }
+            case InstrKind::NullCheck:
+                return arena.create<NullCheck>(oldInstr.getOperand(0));
+            case InstrKind::BoundsCheck:
+                return arena.create<BoundsCheck>(oldInstr.getOperand(0), oldInstr.getOperand(1));
+            case InstrKind::RangeCheck:
+                return arena.create<RangeCheck>(oldInstr.getOperand(0), oldInstr.getOperand(1),
+                                                oldInstr.getOperand(2));
+            case InstrKind::Jump:
+                return arena.create<Jump>(mappedBlock(cast<Jump>(&oldInstr)->getTarget(), state));
+            case InstrKind::CondJump: {
+                auto* condJump = cast<CondJump>(&oldInstr);
+                return arena.create<CondJump>(condJump->getCondition(),
+                                              mappedBlock(condJump->getTrueTarget(), state),
+                                              mappedBlock(condJump->getFalseTarget(), state));
+            }
+            case InstrKind::Phi: {
+                auto* phi = cast<Phi>(&oldInstr);
+                auto* clonedPhi = arena.create<Phi>();
+                for (size_t i = 0; i < phi->getNumIncoming(); ++i) {
+                    // Entries from callee blocks that were not cloned are dead.
+                    auto pred = state.blocks.find(phi->getIncomingBlock(i));
+                    if (pred != state.blocks.end()) {
+                        clonedPhi->addIncoming(pred->second, phi->getIncomingValue(i));
+                    }
+                }
+                return clonedPhi;
             }
-            return clonedPhi;
+            default:
+                return nullptr;
         }
-        return nullptr;
     }
 
     static Value* mapValue(Function& caller, Value* oldValue, CloneState& state) {
@@ -266,7 +334,7 @@ private:
         if (it != state.values.end()) {
             return it->second;
         }
-        if (auto* constant = dynamic_cast<Constant*>(oldValue)) {
+        if (auto* constant = dyn_cast_or_null<Constant>(oldValue)) {
             Value* cloned = caller.createConstant(constant->getValue(), constant->getName());
             state.values[oldValue] = cloned;
             return cloned;
@@ -274,17 +342,48 @@ private:
         return oldValue;
     }
 
-    static std::string mappedBlockName(const std::string& oldBlockName, const CloneState& state) {
-        auto it = state.blockNames.find(oldBlockName);
-        return it == state.blockNames.end() ? oldBlockName : it->second;
+    static BasicBlock* mappedBlock(BasicBlock* oldBlock, const CloneState& state) {
+        auto it = state.blocks.find(oldBlock);
+        return it == state.blocks.end() ? oldBlock : it->second;
     }
 
-    static void wireCallBlock(BasicBlock& callBlock, const Function& callee, const CloneState& state) {
-        if (callee.getBasicBlocks().empty()) {
+    // Redirects the call block from the continuation to the cloned entry.
+    // The clone is not reachable until then, so its own edges need no tree
+    // updates; once it is attached below the call block, the continuation
+    // is entered only through the returns and its idom is their common
+    // dominator. Nothing else changes: every other block the call block
+    // dominated is still reached only through the continuation.
+    static void wireCallBlock(BasicBlock& callBlock,
+                              const std::vector<const BasicBlock*>& calleeBlocks,
+                              BasicBlock* continuation,
+                              const CloneState& state,
+                              CFGUpdater& updater) {
+        if (calleeBlocks.empty()) {
             return;
         }
-        const BasicBlock* calleeEntry = callee.getBasicBlocks().front().get();
-        callBlock.createInstr<Jump>(state.blocks.at(calleeEntry)->getName());
+        for (const BasicBlock* block : calleeBlocks) {
+            if (Instruction* terminator = state.blocks.at(block)->getTerminator()) {
+                terminator->updateCFG();
+            }
+        }
+
+        BasicBlock* clonedEntry = state.blocks.at(calleeBlocks.front());
+        auto& instructions = callBlock.getInstructions();
+        instructions.replace(std::prev(instructions.end()), callBlock.getArena().create<Jump>(clonedEntry));
+        updater.insertEdge(&callBlock, clonedEntry);
+        if (state.exits.empty()) {
+            updater.deleteEdge(&callBlock, continuation);
+            return;
+        }
+        callBlock.removeSuccessor(continuation);
+        continuation->removePredecessor(&callBlock);
+        if (DominatorTree* domTree = updater.getDominatorTree()) {
+            BasicBlock* idom = state.exits.front();
+            for (BasicBlock* exit : state.exits) {
+                idom = domTree->findNearestCommonDominator(idom, exit);
+            }
+            domTree->changeImmediateDominator(continuation, idom);
+        }
     }
 
     static Value* buildReturnValue(BasicBlock* continuation, CloneState& state) {
@@ -295,53 +394,18 @@ private:
             return state.returns.front().second;
         }
 
-        auto phi = std::make_unique<Phi>();
-        Phi* phiPtr = phi.get();
+        auto* phi = continuation->getArena().create<Phi>();
         for (auto& ret : state.returns) {
-            phiPtr->addIncoming(ret.first, ret.second);
+            phi->addIncoming(ret.first, ret.second);
         }
-        continuation->getInstructions().insert(continuation->getInstructions().begin(), std::move(phi));
-        return phiPtr;
+        continuation->getInstructions().push_front(phi);
+        return phi;
     }
 
-    static void replaceAllUses(Function& function, Value* oldValue, Value* newValue) {
+    static void replaceAllUses(Value* oldValue, Value* newValue) {
         if (!newValue) {
             return;
         }
-        for (auto& block : function.getBasicBlocks()) {
-            for (auto& instr : block->getInstructions()) {
-                instr->replaceOperand(oldValue, newValue);
-                if (auto* phi = dynamic_cast<Phi*>(instr.get())) {
-                    phi->replaceIncomingValue(oldValue, newValue);
-                }
-            }
-        }
-    }
-
-    static void removeUnreachableBlocks(Function& function) {
-        if (function.getBasicBlocks().empty()) {
-            return;
-        }
-
-        CFGAnalysis::buildCFG(function);
-        std::unordered_set<BasicBlock*> reachable;
-        std::vector<BasicBlock*> stack{function.getBasicBlocks().front().get()};
-        while (!stack.empty()) {
-            BasicBlock* current = stack.back();
-            stack.pop_back();
-            if (!reachable.insert(current).second) {
-                continue;
-            }
-            for (BasicBlock* successor : current->getSuccessors()) {
-                stack.push_back(successor);
-            }
-        }
-
-        auto& blocks = function.getBasicBlocks();
-        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
-                                    [&](const auto& block) {
-                                        return reachable.count(block.get()) == 0;
-                                    }),
-                     blocks.end());
+        oldValue->replaceAllUsesWith(newValue);
     }
 };
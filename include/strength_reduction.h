@@ -0,0 +1,177 @@
+#pragma once
+
+#include "analysis_manager.h"
+#include "basic_block.h"
+#include "bin_ops.h"
+#include "control_flow.h"
+#include "function.h"
+#include "induction_variables.h"
+#include "instruction.h"
+#include "loop_analysis.h"
+#include "loop_invariant_code_motion.h"
+#include <cstdint>
+#include <vector>
+
+// Rewrites induction variables into cheaper ones. A multiplication or left
+// shift of an induction variable by a constant becomes a phi of its own
+// that starts at the scaled start value and adds the scaled step on every
+// iteration. Products with the same scale of basic variables that start
+// and step alike share one phi.
+//
+// Afterwards, a basic variable with the same start and step as an earlier
+// one in the same header is replaced by it, and a basic variable used by
+// nothing but its own update is removed with the update.
+class StrengthReductionPass {
+public:
+    static bool runOnFunction(Function& function) {
+        FunctionAnalysisManager analyses(function);
+        return runOnFunction(function, analyses);
+    }
+
+    static bool runOnFunction(Function& function, FunctionAnalysisManager& analyses) {
+        if (analyses.getLoopInfo().empty()) {
+            return false;
+        }
+        bool changed = LoopInvariantCodeMotionPass::insertPreheaders(function, analyses);
+
+        const LoopInfo& loopInfo = analyses.getLoopInfo();
+        const InductionVariableAnalysis& ivs = analyses.getInductionVariables();
+        bool rewritten = false;
+        for (Loop* loop : loopInfo) {
+            if (!loop->preheader || !loop->getLatch()) {
+                continue;
+            }
+            rewritten |= reduceProducts(function, loop, ivs);
+            rewritten |= mergeDuplicates(loop, ivs);
+            rewritten |= removeUnused(loop, ivs);
+        }
+
+        if (rewritten) {
+            analyses.invalidate(PreservedAnalyses::cfgShape());
+        }
+        return changed || rewritten;
+    }
+
+private:
+    static bool isProduct(const InductionVariable& iv) {
+        auto* instr = cast<Instruction>(iv.value);
+        return !iv.isBasic() && (instr->getKind() == InstrKind::Mul || instr->getKind() == InstrKind::Shl);
+    }
+
+    static bool reduceProducts(Function& function, const Loop* loop, const InductionVariableAnalysis& ivs) {
+        struct Reduced {
+            const InductionVariable* basis;
+            int scale;
+            Value* replacement;
+        };
+        std::vector<Reduced> reduced;
+        bool changed = false;
+        for (const InductionVariable& iv : ivs.getInductionVariables(loop)) {
+            if (!isProduct(iv)) {
+                continue;
+            }
+            const InductionVariable* basis = ivs.getInductionVariable(iv.basis);
+            Value* replacement = nullptr;
+            for (const Reduced& r : reduced) {
+                if (r.basis->start == basis->start && r.basis->step == basis->step && r.scale == iv.scale) {
+                    replacement = r.replacement;
+                    break;
+                }
+            }
+            if (!replacement) {
+                replacement = iv.scale == 1 ? iv.basis : createScaledPhi(function, loop, *basis, iv.scale);
+                reduced.push_back({basis, iv.scale, replacement});
+            }
+            auto* product = cast<Instruction>(iv.value);
+            product->replaceAllUsesWith(replacement);
+            product->eraseFromParent();
+            changed = true;
+        }
+        return changed;
+    }
+
+    // A phi that equals basis * scale on every iteration: it starts at
+    // start * scale, computed in the preheader or folded when start is a
+    // constant, and adds step * scale in the latch.
+    static Phi* createScaledPhi(Function& function, const Loop* loop, const InductionVariable& basis, int scale) {
+        Arena& arena = function.getArena();
+        BasicBlock* preheader = loop->preheader;
+        BasicBlock* latch = loop->getLatch();
+
+        Value* start = nullptr;
+        if (Constant* constant = asConstant(basis.start)) {
+            start = function.getConstant(multiply(constant->getValue(), scale));
+        } else {
+            start = preheader->insertBeforeTerminator(
+                arena.create<BinaryOp>(InstrKind::Mul, basis.start, function.getConstant(scale)));
+        }
+
+        auto* phi = arena.create<Phi>();
+        auto& header = loop->header->getInstructions();
+        auto pos = header.begin();
+        while (pos != header.end() && isa<Phi>(&*pos)) {
+            ++pos;
+        }
+        header.insert(pos, phi);
+        Instruction* next = latch->insertBeforeTerminator(
+            arena.create<BinaryOp>(InstrKind::Add, phi, function.getConstant(multiply(basis.step, scale))));
+        phi->addIncoming(preheader, start);
+        phi->addIncoming(latch, next);
+        return phi;
+    }
+
+    // The uses of a duplicate go to the earlier phi. Its update is left to
+    // recompute the same value from that phi, since the earlier update need
+    // not dominate its uses; it goes away with the phi if nothing else
+    // reads it.
+    static bool mergeDuplicates(const Loop* loop, const InductionVariableAnalysis& ivs) {
+        std::vector<const InductionVariable*> kept;
+        bool changed = false;
+        for (const InductionVariable& iv : ivs.getInductionVariables(loop)) {
+            if (!iv.isBasic()) {
+                break;
+            }
+            const InductionVariable* same = nullptr;
+            for (const InductionVariable* other : kept) {
+                if (other->start == iv.start && other->step == iv.step) {
+                    same = other;
+                    break;
+                }
+            }
+            if (!same) {
+                kept.push_back(&iv);
+                continue;
+            }
+            auto* phi = cast<Phi>(iv.value);
+            phi->replaceAllUsesWith(same->value);
+            phi->eraseFromParent();
+            if (!iv.update->hasUses()) {
+                iv.update->eraseFromParent();
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    static bool removeUnused(const Loop* loop, const InductionVariableAnalysis& ivs) {
+        bool changed = false;
+        for (const InductionVariable& iv : ivs.getInductionVariables(loop)) {
+            if (!iv.isBasic()) {
+                break;
+            }
+            auto* phi = cast<Phi>(iv.value);
+            if (!phi->getParent() || phi->getNumUses() != 1 || *phi->getUsers().begin() != iv.update ||
+                iv.update->getNumUses() != 1 || *iv.update->getUsers().begin() != phi) {
+                continue;
+            }
+            phi->eraseFromParent();
+            iv.update->eraseFromParent();
+            changed = true;
+        }
+        return changed;
+    }
+
+    static int multiply(int a, int b) {
+        return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+// Where a value lives once registers are assigned.
+struct ValueLocation {
+    // In [0, numRegisters), or -1. Register numRegisters is the scratch
+    // register, which only moves and reloads outside the allocation use.
+    int reg = -1;
+    // The stack slot of a spilled value, or -1.
+    int spillSlot = -1;
+
+    bool isRegister() const { return reg >= 0; }
+    bool isSpilled() const { return spillSlot >= 0; }
+    bool isNone() const { return !isRegister() && !isSpilled(); }
+
+    bool operator==(const ValueLocation &other) const {
+        return reg == other.reg && spillSlot == other.spillSlot;
+    }
+    bool operator!=(const ValueLocation &other) const {
+        return !(*this == other);
+    }
+
+    std::string str() const {
+        if (isRegister())
+            return "r" + std::to_string(reg);
+        if (isSpilled())
+            return "stack " + std::to_string(spillSlot);
+        return "none";
+    }
+};
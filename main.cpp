@@ -17,20 +17,18 @@ void createCompleteFactorial(Program& program) {
     Constant* one = fact.createConstant(1, "one");
     [[maybe_unused]] Constant* zero = fact.createConstant(0, "zero");
 
-    entry->createInstr<Jump>("check");
+    entry->createInstr<Jump>(check);
 
     auto& cmp = check->createInstr<Cmp>(CmpOp::Le, n, one);
-    NameContext ctx;
-    std::string condStr = cmp.str(ctx);
-    check->createInstr<CondJump>(condStr, "base_case", "recursive");
+    check->createInstr<CondJump>(&cmp, base_case, recursive);
 
     base_case->createInstr<Return>(one);
 
     auto& n_minus_one = recursive->createInstr<BinaryOp>(InstrKind::Sub, n, one);
-    recursive->createInstr<Jump>("compute");
+    recursive->createInstr<Jump>(compute);
 
     auto& computed_result = compute->createInstr<BinaryOp>(InstrKind::Mul, n, &n_minus_one);
-    compute->createInstr<Jump>("exit");
+    compute->createInstr<Jump>(exit);
 
     exit->createInstr<Return>(&computed_result);
 }
@@ -47,20 +45,23 @@ void createIterativeFactorial(Program& program) {
     Constant* one = fact.createConstant(1, "one");
     Constant* zero = fact.createConstant(0, "zero");
 
-    auto& result = entry->createInstr<BinaryOp>(InstrKind::Add, one, zero);
-    auto& i = entry->createInstr<BinaryOp>(InstrKind::Add, n, zero);
-    entry->createInstr<Jump>("loop_check");
+    entry->createInstr<Jump>(loop_check);
 
+    auto& result = loop_check->createInstr<Phi>();
+    auto& i = loop_check->createInstr<Phi>();
     auto& cmp = loop_check->createInstr<Cmp>(CmpOp::Gt, &i, zero);
-    NameContext ctx;
-    std::string condStr = cmp.str(ctx);
-    loop_check->createInstr<CondJump>(condStr, "loop_body", "exit");
+    loop_check->createInstr<CondJump>(&cmp, loop_body, exit);
 
     auto& new_result = loop_body->createInstr<BinaryOp>(InstrKind::Mul, &result, &i);
-    [[maybe_unused]] auto& new_i = loop_body->createInstr<BinaryOp>(InstrKind::Sub, &i, one);
-    loop_body->createInstr<Jump>("loop_check");
+    auto& new_i = loop_body->createInstr<BinaryOp>(InstrKind::Sub, &i, one);
+    loop_body->createInstr<Jump>(loop_check);
 
-    exit->createInstr<Return>(&new_result);
+    result.addIncoming(entry, one);
+    result.addIncoming(loop_body, &new_result);
+    i.addIncoming(entry, n);
+    i.addIncoming(loop_body, &new_i);
+
+    exit->createInstr<Return>(&result);
 }
 
 void createSimpleFactorial(Program& program) {
@@ -87,12 +88,10 @@ void createConditionalFactorial(Program& program) {
     Constant* one = fact.createConstant(1, "one");
     [[maybe_unused]] Constant* zero = fact.createConstant(0, "zero");
 
-    entry->createInstr<Jump>("check");
+    entry->createInstr<Jump>(check);
 
     auto& cmp = check->createInstr<Cmp>(CmpOp::Le, n, one);
-    NameContext ctx;
-    std::string condStr = cmp.str(ctx);
-    check->createInstr<CondJump>(condStr, "base", "recurse");
+    check->createInstr<CondJump>(&cmp, base, recurse);
 
     base->createInstr<Return>(one);
 
@@ -1,26 +1,98 @@
 #include "instruction.h"
+#include "basic_block.h"
+#include "function.h"
 #include "context.h"
 #include <algorithm>
 #include <iostream>
 
-void Value::addUser(Instruction* user) {
-    if (!user) {
+void Use::link() {
+    prev = nullptr;
+    next = val->useList;
+    if (next) {
+        next->prev = this;
+    }
+    val->useList = this;
+    ++val->numUses;
+}
+
+void Use::unlink() {
+    if (!val) {
         return;
     }
-    if (std::find(users.begin(), users.end(), user) == users.end()) {
-        users.push_back(user);
+    (prev ? prev->next : val->useList) = next;
+    if (next) {
+        next->prev = prev;
+    }
+    prev = nullptr;
+    next = nullptr;
+    --val->numUses;
+}
+
+void Use::set(Value* v) {
+    unlink();
+    val = v;
+    if (val) {
+        link();
+    }
+}
+
+Use::Use(Use&& other) noexcept
+    : val(other.val), user(other.user), prev(other.prev), next(other.next) {
+    if (val) {
+        (prev ? prev->next : val->useList) = this;
+        if (next) {
+            next->prev = this;
+        }
+    }
+    other.val = nullptr;
+    other.prev = nullptr;
+    other.next = nullptr;
+}
+
+Use& Use::operator=(Use&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    unlink();
+    val = other.val;
+    user = other.user;
+    prev = other.prev;
+    next = other.next;
+    if (val) {
+        (prev ? prev->next : val->useList) = this;
+        if (next) {
+            next->prev = this;
+        }
     }
+    other.val = nullptr;
+    other.prev = nullptr;
+    other.next = nullptr;
+    return *this;
 }
 
-void Value::removeUser(Instruction* user) {
-    users.erase(std::remove(users.begin(), users.end(), user), users.end());
+void Value::replaceAllUsesWith(Value* newValue) {
+    if (newValue == this) {
+        return;
+    }
+    while (useList) {
+        useList->set(newValue);
+    }
 }
 
-const std::vector<Instruction*>& Value::getUsers() const {
-    return users;
+Value::~Value() {
+    // Objects die in bulk when their arena is reset, so users may outlive
+    // the value by a moment. Detach them so their own destruction does not
+    // touch this value again.
+    for (Use* use = useList; use;) {
+        Use* nextUse = use->next;
+        use->val = nullptr;
+        use->prev = nullptr;
+        use->next = nullptr;
+        use = nextUse;
+    }
 }
 
-Parameter::Parameter(const std::string& n) : name(n) {}
+Parameter::Parameter(const std::string& n) : Value(ValueKind::Parameter), name(n) {}
 
 std::string Parameter::str(NameContext& /*ctx*/) const {
     return name;
@@ -30,15 +102,7 @@ std::string Parameter::getName() const {
     return name;
 }
 
-Value::ValueKind Parameter::getValueKind() const {
-    return Value::ValueKind::Parameter;
-}
-
-Constant::Constant(int v, const std::string& n) : value(v), name(n) {}
-
-Value::ValueKind Constant::getValueKind() const {
-    return Value::ValueKind::Constant;
-}
+Constant::Constant(int v, const std::string& n) : Value(ValueKind::Constant), value(v), name(n) {}
 
 std::string Constant::str(NameContext& /*ctx*/) const {
     return name;
@@ -48,52 +112,51 @@ int Constant::getValue() const { return value; }
 
 std::string Constant::getName() const { return name; }
 
-Instruction::Instruction(InstrKind k, const std::vector<Value*>& ops) : kind(k) {
+Instruction::Instruction(InstrKind k, std::initializer_list<Value*> ops) : Value(ValueKind::Instruction), kind(k) {
+    operands.reserve(ops.size());
     for (Value* operand : ops) {
         addOperand(operand);
     }
 }
 
-Instruction::~Instruction() = default;
-
-InstrKind Instruction::getKind() const { return kind; }
-
-const std::vector<Value*>& Instruction::getOperands() const { return operands; }
+Instruction::Instruction(InstrKind k, const std::vector<Value*>& ops) : Value(ValueKind::Instruction), kind(k) {
+    operands.reserve(ops.size());
+    for (Value* operand : ops) {
+        addOperand(operand);
+    }
+}
 
-std::vector<Value*>& Instruction::getOperands() { return operands; }
+Instruction::~Instruction() = default;
 
 void Instruction::addOperand(Value* operand) {
-    operands.push_back(operand);
-    if (operand) {
-        operand->addUser(this);
-    }
+    operands.emplace_back(operand, this);
 }
 
 void Instruction::replaceOperand(Value* oldValue, Value* newValue) {
     for (auto& operand : operands) {
-        if (operand == oldValue) {
-            if (oldValue) {
-                oldValue->removeUser(this);
-            }
-            operand = newValue;
-            if (newValue) {
-                newValue->addUser(this);
-            }
+        if (operand.get() == oldValue) {
+            operand.set(newValue);
         }
     }
 }
 
 void Instruction::dropAllOperands() {
-    for (Value* operand : operands) {
-        if (operand) {
-            operand->removeUser(this);
-        }
-    }
     operands.clear();
 }
 
-Value::ValueKind Instruction::getValueKind() const {
-    return Value::ValueKind::Instruction;
+void BasicBlock::adopt(Instruction* instr) {
+    parent->assignId(instr);
+}
+
+void Instruction::removeFromParent() {
+    if (parent) {
+        parent->getInstructions().remove(this);
+    }
+}
+
+void Instruction::eraseFromParent() {
+    dropAllOperands();
+    removeFromParent();
 }
 
 std::string ConstantInstruction::str(NameContext& ctx) const {
@@ -6,6 +6,7 @@ class GraphExamples {
 public:
     static void createExample1(Program& program) {
         Function& func = program.createFunction("example1");
+        Parameter* condition = func.createParam("condition");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -27,25 +28,26 @@ public:
         // F: E, G
         // G: D
 
-        A->createInstr<Jump>("B");
+        A->createInstr<Jump>(B);
 
-        B->createInstr<CondJump>("condition", "C", "F");
+        B->createInstr<CondJump>(condition, C, F);
 
-        C->createInstr<Jump>("D");
+        C->createInstr<Jump>(D);
 
         D->createInstr<Return>();
 
-        E->createInstr<Jump>("D");
+        E->createInstr<Jump>(D);
 
-        F->createInstr<CondJump>("condition", "E", "G");
+        F->createInstr<CondJump>(condition, E, G);
 
-        G->createInstr<Jump>("D");
+        G->createInstr<Jump>(D);
 
         CFGAnalysis::buildCFG(func);
     }
 
     static void createExample2(Program& program) {
         Function& func = program.createFunction("example2");
+        Parameter* condition = func.createParam("condition");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -72,16 +74,16 @@ public:
         // J: C
         // K:
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("condition", "C", "J");
-        C->createInstr<Jump>("D");
-        D->createInstr<CondJump>("condition", "E", "C");
-        E->createInstr<Jump>("F");
-        F->createInstr<CondJump>("condition", "G", "E");
-        G->createInstr<CondJump>("condition", "H", "I");
-        H->createInstr<Jump>("B");
-        I->createInstr<Jump>("K");
-        J->createInstr<Jump>("C");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(condition, C, J);
+        C->createInstr<Jump>(D);
+        D->createInstr<CondJump>(condition, E, C);
+        E->createInstr<Jump>(F);
+        F->createInstr<CondJump>(condition, G, E);
+        G->createInstr<CondJump>(condition, H, I);
+        H->createInstr<Jump>(B);
+        I->createInstr<Jump>(K);
+        J->createInstr<Jump>(C);
         K->createInstr<Return>();
 
         CFGAnalysis::buildCFG(func);
@@ -89,6 +91,7 @@ public:
 
     static void createExample3(Program& program) {
         Function& func = program.createFunction("example3");
+        Parameter* condition = func.createParam("condition");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -111,14 +114,14 @@ public:
         // H: G, I
         // I:
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("condition", "C", "E");
-        C->createInstr<Jump>("D");
-        D->createInstr<Jump>("G");
-        E->createInstr<CondJump>("condition", "D", "F");
-        F->createInstr<CondJump>("condition", "H", "B");
-        G->createInstr<CondJump>("condition", "I", "C");
-        H->createInstr<CondJump>("condition", "G", "I");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(condition, C, E);
+        C->createInstr<Jump>(D);
+        D->createInstr<Jump>(G);
+        E->createInstr<CondJump>(condition, D, F);
+        F->createInstr<CondJump>(condition, H, B);
+        G->createInstr<CondJump>(condition, I, C);
+        H->createInstr<CondJump>(condition, G, I);
         I->createInstr<Return>();
 
         CFGAnalysis::buildCFG(func);
@@ -136,10 +139,12 @@ int main() {
         auto dominators = CFGAnalysis::computeDominators(*func_ptr);
 
         std::cout << "\nDominators for " << func_ptr->getName() << ":" << std::endl;
-        for (auto& [bb, dom_set] : dominators) {
+        for (auto* bb : func_ptr->getBasicBlocks()) {
             std::cout << bb->getName() << ": ";
-            for (auto dom : dom_set) {
-                std::cout << dom->getName() << " ";
+            for (auto* dom : func_ptr->getBasicBlocks()) {
+                if (dominators.lookup(bb).count(dom)) {
+                    std::cout << dom->getName() << " ";
+                }
             }
             std::cout << std::endl;
         }
@@ -22,6 +22,7 @@ private:
 
         Program program;
         Function& func = program.createFunction("test1");
+        Parameter* cond = func.createParam("cond");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -29,21 +30,22 @@ private:
         BasicBlock* D = func.createBasicBlock("D");
         BasicBlock* E = func.createBasicBlock("E");
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("cond", "C", "D");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(cond, C, D);
         C->createInstr<Return>();
-        D->createInstr<Jump>("E");
-        E->createInstr<Jump>("B");
+        D->createInstr<Jump>(E);
+        E->createInstr<Jump>(B);
 
         CFGAnalysis::buildCFG(func);
 
-        auto loops = LoopAnalysis::findLoops(func);
+        LoopInfo loopInfo(func);
+        const auto& loops = loopInfo.getLoops();
 
         assert(loops.size() == 1);
 
         auto* loop = loops[0];
         assert(loop->header->getName() == "B");
-        assert(loop->latch->getName() == "E");
+        assert(loop->getLatch()->getName() == "E");
         assert(loop->blocks.size() == 3);
         assert(loop->contains(B));
         assert(loop->contains(D));
@@ -58,7 +60,6 @@ private:
         std::cout << "Test 1 passed: Found loop B->D->E->B\n\n";
         LoopAnalysis::analyzeLoopNesting(func);
 
-        for (auto l : loops) delete l;
     }
 
     static void testGraph2() {
@@ -67,6 +68,8 @@ private:
 
         Program program;
         Function& func = program.createFunction("test2");
+        Parameter* cond1 = func.createParam("cond1");
+        Parameter* cond2 = func.createParam("cond2");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -75,22 +78,23 @@ private:
         BasicBlock* E = func.createBasicBlock("E");
         BasicBlock* F = func.createBasicBlock("F");
 
-        A->createInstr<Jump>("B");
-        B->createInstr<Jump>("C");
-        C->createInstr<CondJump>("cond1", "D", "F");
-        D->createInstr<CondJump>("cond2", "E", "F");
-        E->createInstr<Jump>("B");
+        A->createInstr<Jump>(B);
+        B->createInstr<Jump>(C);
+        C->createInstr<CondJump>(cond1, D, F);
+        D->createInstr<CondJump>(cond2, E, F);
+        E->createInstr<Jump>(B);
         F->createInstr<Return>();
 
         CFGAnalysis::buildCFG(func);
 
-        auto loops = LoopAnalysis::findLoops(func);
+        LoopInfo loopInfo(func);
+        const auto& loops = loopInfo.getLoops();
 
         assert(loops.size() == 1 && "Should find exactly one loop");
 
         auto* loop = loops[0];
         assert(loop->header->getName() == "B");
-        assert(loop->latch->getName() == "E");
+        assert(loop->getLatch()->getName() == "E");
 
         assert(loop->blocks.size() == 4);
         assert(loop->contains(B));
@@ -108,7 +112,6 @@ private:
         std::cout << "Test 2 passed: Found loop B->C->D->E->B\n\n";
         LoopAnalysis::analyzeLoopNesting(func);
 
-        for (auto l : loops) delete l;
     }
 
     static void testGraph3() {
@@ -117,6 +120,9 @@ private:
 
         Program program;
         Function& func = program.createFunction("test3");
+        Parameter* cond1 = func.createParam("cond1");
+        Parameter* cond2 = func.createParam("cond2");
+        Parameter* cond3 = func.createParam("cond3");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -127,22 +133,23 @@ private:
         BasicBlock* G = func.createBasicBlock("G");
         BasicBlock* H = func.createBasicBlock("H");
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("cond1", "C", "D");
-        C->createInstr<CondJump>("cond2", "E", "F");
-        D->createInstr<Jump>("F");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(cond1, C, D);
+        C->createInstr<CondJump>(cond2, E, F);
+        D->createInstr<Jump>(F);
         E->createInstr<Return>();
-        F->createInstr<Jump>("G");
-        G->createInstr<CondJump>("cond3", "B", "H");
-        H->createInstr<Jump>("A");
+        F->createInstr<Jump>(G);
+        G->createInstr<CondJump>(cond3, B, H);
+        H->createInstr<Jump>(A);
 
         CFGAnalysis::buildCFG(func);
 
-        auto loops = LoopAnalysis::findLoops(func);
+        LoopInfo loopInfo(func);
+        const auto& loops = loopInfo.getLoops();
 
         assert(loops.size() >= 1);
 
-        LoopAnalysis::Loop* outerLoop = nullptr;
+        Loop* outerLoop = nullptr;
         for (auto loop : loops) {
             if (loop->header->getName() == "A") {
                 outerLoop = loop;
@@ -151,7 +158,7 @@ private:
         }
 
         assert(outerLoop != nullptr);
-        assert(outerLoop->latch->getName() == "H");
+        assert(outerLoop->getLatch()->getName() == "H");
 
         assert(outerLoop->contains(A));
         assert(outerLoop->contains(B));
@@ -162,7 +169,7 @@ private:
         assert(outerLoop->contains(H));
         assert(!outerLoop->contains(E));
 
-        LoopAnalysis::Loop* innerLoop = nullptr;
+        Loop* innerLoop = nullptr;
         for (auto loop : loops) {
             if (loop->header->getName() == "B" && loop != outerLoop) {
                 innerLoop = loop;
@@ -171,7 +178,7 @@ private:
         }
 
         assert(outerLoop != nullptr);
-        assert(innerLoop->latch->getName() == "G");
+        assert(innerLoop->getLatch()->getName() == "G");
 
         assert(innerLoop->contains(B));
         assert(innerLoop->contains(C));
@@ -193,7 +200,6 @@ private:
         // }
         std::cout << "\n";
 
-        for (auto l : loops) delete l;
     }
 
     static void testGraph4() {
@@ -202,6 +208,8 @@ private:
 
         Program program;
         Function& func = program.createFunction("test4");
+        Parameter* cond1 = func.createParam("cond1");
+        Parameter* cond2 = func.createParam("cond2");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -211,24 +219,24 @@ private:
         BasicBlock* F = func.createBasicBlock("F");
         BasicBlock* G = func.createBasicBlock("G");
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("cond1", "C", "F");
-        C->createInstr<Jump>("D");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(cond1, C, F);
+        C->createInstr<Jump>(D);
         D->createInstr<Return>();
-        E->createInstr<Jump>("D");
-        F->createInstr<CondJump>("cond2", "E", "G");
-        G->createInstr<Jump>("D");
+        E->createInstr<Jump>(D);
+        F->createInstr<CondJump>(cond2, E, G);
+        G->createInstr<Jump>(D);
 
         CFGAnalysis::buildCFG(func);
 
-        auto loops = LoopAnalysis::findLoops(func);
+        LoopInfo loopInfo(func);
+        const auto& loops = loopInfo.getLoops();
 
         assert(loops.size() == 0);
 
         std::cout << "Test 4 passed\n";
         LoopAnalysis::analyzeLoopNesting(func);
 
-        for (auto l : loops) delete l;
     }
 
     static void testGraph5() {
@@ -237,6 +245,10 @@ private:
 
         Program program;
         Function& func = program.createFunction("test5");
+        Parameter* cond1 = func.createParam("cond1");
+        Parameter* cond2 = func.createParam("cond2");
+        Parameter* cond3 = func.createParam("cond3");
+        Parameter* cond4 = func.createParam("cond4");
 
         BasicBlock* A = func.createBasicBlock("A");
         BasicBlock* B = func.createBasicBlock("B");
@@ -250,25 +262,26 @@ private:
         BasicBlock* J = func.createBasicBlock("J");
         BasicBlock* K = func.createBasicBlock("K");
 
-        A->createInstr<Jump>("B");
-        B->createInstr<CondJump>("cond1", "C", "J");
-        C->createInstr<Jump>("D");
-        D->createInstr<CondJump>("cond2", "E", "C");
-        E->createInstr<Jump>("F");
-        F->createInstr<CondJump>("cond3", "E", "G");
-        G->createInstr<CondJump>("cond4", "H", "I");
-        H->createInstr<Jump>("B");
-        I->createInstr<Jump>("K");
-        J->createInstr<Jump>("C");
+        A->createInstr<Jump>(B);
+        B->createInstr<CondJump>(cond1, C, J);
+        C->createInstr<Jump>(D);
+        D->createInstr<CondJump>(cond2, E, C);
+        E->createInstr<Jump>(F);
+        F->createInstr<CondJump>(cond3, E, G);
+        G->createInstr<CondJump>(cond4, H, I);
+        H->createInstr<Jump>(B);
+        I->createInstr<Jump>(K);
+        J->createInstr<Jump>(C);
         K->createInstr<Return>();
 
         CFGAnalysis::buildCFG(func);
 
-        auto loops = LoopAnalysis::findLoops(func);
+        LoopInfo loopInfo(func);
+        const auto& loops = loopInfo.getLoops();
 
         assert(loops.size() >= 2);
 
-        LoopAnalysis::Loop* outerLoop = nullptr;
+        Loop* outerLoop = nullptr;
         for (auto loop : loops) {
             if (loop->header->getName() == "B") {
                 outerLoop = loop;
@@ -277,7 +290,7 @@ private:
         }
 
         assert(outerLoop != nullptr);
-        assert(outerLoop->latch->getName() == "H");
+        assert(outerLoop->getLatch()->getName() == "H");
 
         assert(outerLoop->contains(B));
         assert(outerLoop->contains(C));
@@ -288,7 +301,7 @@ private:
         assert(outerLoop->contains(H));
         assert(outerLoop->contains(J));
 
-        LoopAnalysis::Loop* innerLoopCD = nullptr;
+        Loop* innerLoopCD = nullptr;
         for (auto loop : loops) {
             if (loop->header->getName() == "C" && loop != outerLoop) {
                 innerLoopCD = loop;
@@ -297,14 +310,14 @@ private:
         }
 
         if (innerLoopCD != nullptr) {
-            assert(innerLoopCD->latch->getName() == "D");
+            assert(innerLoopCD->getLatch()->getName() == "D");
             assert(innerLoopCD->contains(C));
             assert(innerLoopCD->contains(D));
             assert(innerLoopCD->parent == outerLoop);
         }
-        LoopAnalysis::Loop* selfLoopEF = nullptr;
+        Loop* selfLoopEF = nullptr;
         for (auto loop : loops) {
-            if (loop->header->getName() == "E" && loop->latch->getName() == "F") {
+            if (loop->header->getName() == "E" && loop->getLatch()->getName() == "F") {
                 selfLoopEF = loop;
                 break;
             }
@@ -330,7 +343,6 @@ private:
         // LoopAnalysis::printLoopInfo(selfLoopEF, 1);
         std::cout << "\n";
 
-        for (auto l : loops) delete l;
     }
 
 };
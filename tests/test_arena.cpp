@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include "arena.h"
+#include "program.h"
+#include "bin_ops.h"
+#include "control_flow.h"
+#include <cstdint>
+
+namespace {
+
+struct Tracked {
+    int* destroyed;
+    explicit Tracked(int* counter) : destroyed(counter) {}
+    ~Tracked() { ++*destroyed; }
+};
+
+struct alignas(32) Overaligned {
+    char payload[3];
+};
+
+} // namespace
+
+TEST(ArenaTest, AllocationsRespectAlignment) {
+    Arena arena(64);
+    for (int i = 0; i < 100; ++i) {
+        arena.create<char>('x');
+        auto* wide = arena.create<Overaligned>();
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(wide) % alignof(Overaligned), 0U);
+    }
+}
+
+TEST(ArenaTest, ResetRunsDestructorsAndReusesSlabs) {
+    Arena arena(128);
+    int destroyed = 0;
+    for (int i = 0; i < 1000; ++i) {
+        arena.create<Tracked>(&destroyed);
+    }
+    size_t slabs = arena.getSlabCount();
+    EXPECT_GT(slabs, 1U);
+    EXPECT_EQ(arena.getObjectCount(), 1000U);
+
+    arena.reset();
+    EXPECT_EQ(destroyed, 1000);
+    EXPECT_EQ(arena.getObjectCount(), 0U);
+
+    for (int i = 0; i < 1000; ++i) {
+        arena.create<Tracked>(&destroyed);
+    }
+    EXPECT_EQ(arena.getSlabCount(), slabs);
+}
+
+TEST(ArenaTest, OversizedObjectsGetTheirOwnSlab) {
+    Arena arena(64);
+    auto* big = static_cast<char*>(arena.allocate(4096, 8));
+    big[4095] = 1;
+    EXPECT_GE(arena.getBytesReserved(), 4096U);
+}
+
+TEST(ArenaTest, FunctionClearReleasesBodyInBulk) {
+    Program program;
+    Function& func = program.createFunction("rebuild");
+    for (int round = 0; round < 2; ++round) {
+        Parameter* x = func.createParam("x");
+        Constant* one = func.createConstant(1, "1");
+        BasicBlock* entry = func.createBasicBlock("entry");
+        auto& sum = entry->createInstr<BinaryOp>(InstrKind::Add, x, one);
+        entry->createInstr<Return>(&sum);
+
+        EXPECT_EQ(func.getBasicBlocks().size(), 1U);
+        EXPECT_EQ(func.getConstants().size(), 1U);
+        EXPECT_EQ(x->getUsers().size(), 1U);
+        EXPECT_GT(func.getArena().getObjectCount(), 0U);
+        func.clear();
+    }
+    EXPECT_TRUE(func.getBasicBlocks().empty());
+    EXPECT_EQ(func.getArena().getObjectCount(), 0U);
+}
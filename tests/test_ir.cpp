@@ -0,0 +1,973 @@
+#include <gtest/gtest.h>
+#include "program.h"
+#include "bin_ops.h"
+#include "block_name_index.h"
+#include "call.h"
+#include "cfg.h"
+#include "cfg_traversal.h"
+#include "cfg_updater.h"
+#include "checks.h"
+#include "control_dependence.h"
+#include "control_flow.h"
+#include "dense_map.h"
+#include "dominator_tree.h"
+#include "induction_variables.h"
+#include "loop_analysis.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static std::vector<Instruction*> collect(BasicBlock& bb) {
+    std::vector<Instruction*> out;
+    for (auto& instr : bb.getInstructions()) {
+        out.push_back(&instr);
+    }
+    return out;
+}
+
+TEST(InstructionListTest, InsertAndEraseKeepOtherIteratorsValid) {
+    Program program;
+    Function& func = program.createFunction("ilist");
+    Parameter* x = func.createParam("x");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* bb = func.createBasicBlock("entry");
+
+    auto& a = bb->createInstr<BinaryOp>(InstrKind::Add, x, one);
+    auto& b = bb->createInstr<BinaryOp>(InstrKind::Sub, x, one);
+    auto& c = bb->createInstr<BinaryOp>(InstrKind::Mul, x, one);
+
+    auto& list = bb->getInstructions();
+    auto itC = list.iteratorTo(&c);
+
+    auto* inserted = func.getArena().create<BinaryOp>(InstrKind::And, x, one);
+    list.insert(list.iteratorTo(&b), inserted);
+    EXPECT_EQ(collect(*bb), (std::vector<Instruction*>{&a, inserted, &b, &c}));
+    EXPECT_EQ(inserted->getParent(), bb);
+
+    b.eraseFromParent();
+    EXPECT_EQ(b.getParent(), nullptr);
+    EXPECT_EQ(&*itC, &c);
+    EXPECT_EQ(&*std::prev(itC), inserted);
+    EXPECT_EQ(list.size(), 3U);
+    EXPECT_EQ(&list.back(), &c);
+    EXPECT_EQ(&*list.rbegin(), &c);
+}
+
+TEST(InstructionListTest, SpliceMovesTailAndUpdatesParents) {
+    Program program;
+    Function& func = program.createFunction("splice");
+    Parameter* x = func.createParam("x");
+    BasicBlock* from = func.createBasicBlock("from");
+    BasicBlock* to = func.createBasicBlock("to");
+
+    auto& a = from->createInstr<BinaryOp>(InstrKind::Add, x, x);
+    auto& b = from->createInstr<BinaryOp>(InstrKind::Sub, x, x);
+    auto& c = from->createInstr<BinaryOp>(InstrKind::Mul, x, x);
+    auto& ret = to->createInstr<Return>(x);
+
+    auto& fromList = from->getInstructions();
+    auto& toList = to->getInstructions();
+    toList.splice(toList.begin(), fromList, fromList.iteratorTo(&b), fromList.end());
+
+    EXPECT_EQ(collect(*from), (std::vector<Instruction*>{&a}));
+    EXPECT_EQ(collect(*to), (std::vector<Instruction*>{&b, &c, &ret}));
+    EXPECT_EQ(fromList.size(), 1U);
+    EXPECT_EQ(toList.size(), 3U);
+    EXPECT_EQ(b.getParent(), to);
+    EXPECT_EQ(c.getParent(), to);
+    EXPECT_EQ(a.getNext(), nullptr);
+}
+
+TEST(UseListTest, ReplaceAllUsesWithRewritesEveryUse) {
+    Program program;
+    Function& func = program.createFunction("rauw");
+    Parameter* x = func.createParam("x");
+    Parameter* y = func.createParam("y");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* next = func.createBasicBlock("next");
+
+    auto& square = entry->createInstr<BinaryOp>(InstrKind::Mul, x, x);
+    auto& phi = next->createInstr<Phi>();
+    phi.addIncoming(entry, x);
+    next->createInstr<Return>(x);
+
+    EXPECT_EQ(x->getNumUses(), 4U);
+    x->replaceAllUsesWith(y);
+
+    EXPECT_FALSE(x->hasUses());
+    EXPECT_EQ(y->getNumUses(), 4U);
+    EXPECT_EQ(square.getOperand(0), y);
+    EXPECT_EQ(square.getOperand(1), y);
+    EXPECT_EQ(phi.getIncomingValue(0), y);
+    EXPECT_EQ(phi.getIncoming()[0].second, y);
+    EXPECT_EQ(static_cast<Return&>(next->getInstructions().back()).getReturnValue(), y);
+}
+
+TEST(UseListTest, OperandStorageGrowthKeepsUseListsConsistent) {
+    Program program;
+    Function& func = program.createFunction("grow");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    std::vector<Parameter*> params;
+    for (int i = 0; i < 64; ++i) {
+        params.push_back(func.createParam("p" + std::to_string(i)));
+    }
+
+    auto& phi = entry->createInstr<Phi>();
+    for (Parameter* p : params) {
+        phi.addIncoming(entry, p);
+        phi.addIncoming(entry, params.front());
+    }
+
+    EXPECT_EQ(params.front()->getNumUses(), 65U);
+    for (Use* use : params.front()->getUses()) {
+        EXPECT_EQ(use->getUser(), &phi);
+        EXPECT_EQ(use->get(), params.front());
+    }
+
+    phi.dropAllOperands();
+    for (Parameter* p : params) {
+        EXPECT_FALSE(p->hasUses());
+    }
+}
+
+TEST(DenseIdTest, ValuesAndBlocksGetDenseIds) {
+    Program program;
+    Function& func = program.createFunction("ids");
+    Parameter* x = func.createParam("x");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* exit = func.createBasicBlock("exit");
+
+    auto& add = entry->createInstr<BinaryOp>(InstrKind::Add, x, one);
+    auto* detached = func.getArena().create<BinaryOp>(InstrKind::Sub, x, one);
+    EXPECT_EQ(detached->getId(), Value::NoId);
+    exit->getInstructions().push_back(detached);
+
+    EXPECT_EQ(x->getId(), 0U);
+    EXPECT_EQ(one->getId(), 1U);
+    EXPECT_EQ(add.getId(), 2U);
+    EXPECT_EQ(detached->getId(), 3U);
+    EXPECT_EQ(func.getNumValueIds(), 4U);
+    EXPECT_EQ(entry->getId(), 0U);
+    EXPECT_EQ(exit->getId(), 1U);
+    EXPECT_EQ(func.getNumBlockIds(), 2U);
+
+    // Moving an instruction between blocks keeps its id.
+    exit->getInstructions().remove(detached);
+    entry->getInstructions().push_back(detached);
+    EXPECT_EQ(detached->getId(), 3U);
+}
+
+TEST(DenseIdTest, RenumberCompactsAfterRemoval) {
+    Program program;
+    Function& func = program.createFunction("renumber");
+    Parameter* x = func.createParam("x");
+    BasicBlock* dead = func.createBasicBlock("dead");
+    BasicBlock* live = func.createBasicBlock("live");
+
+    auto& a = dead->createInstr<BinaryOp>(InstrKind::Add, x, x);
+    auto& b = live->createInstr<BinaryOp>(InstrKind::Mul, x, x);
+    a.eraseFromParent();
+    func.removeBasicBlock(dead);
+    func.renumber();
+
+    EXPECT_EQ(live->getId(), 0U);
+    EXPECT_EQ(func.getNumBlockIds(), 1U);
+    EXPECT_EQ(b.getId(), 1U);
+    EXPECT_EQ(func.getNumValueIds(), 2U);
+}
+
+TEST(DenseIdTest, SideTablesIndexById) {
+    Program program;
+    Function& func = program.createFunction("maps");
+    std::vector<BasicBlock*> blocks;
+    for (int i = 0; i < 100; ++i) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(i)));
+    }
+
+    BlockMap<int> order(func.getNumBlockIds(), -1);
+    BlockSet even(func.getNumBlockIds());
+    for (int i = 0; i < 100; ++i) {
+        order[blocks[i]] = 99 - i;
+        if (i % 2 == 0) {
+            even.insert(blocks[i]);
+        }
+    }
+
+    EXPECT_EQ(order.lookup(blocks[0]), 99);
+    EXPECT_EQ(order.lookup(blocks[99]), 0);
+    EXPECT_EQ(even.size(), 50U);
+    EXPECT_TRUE(even.count(blocks[64]));
+    EXPECT_FALSE(even.count(blocks[65]));
+
+    // Blocks created after the table was sized read as the default and
+    // grow the table when written.
+    BasicBlock* late = func.createBasicBlock("late");
+    EXPECT_EQ(order.lookup(late), -1);
+    order[late] = 7;
+    EXPECT_EQ(order.lookup(late), 7);
+    EXPECT_FALSE(even.count(late));
+}
+
+TEST(CastingTest, KindBasedCastsFollowTheHierarchy) {
+    Program program;
+    Function& func = program.createFunction("casts");
+    Parameter* x = func.createParam("x");
+    Constant* two = func.createConstant(2, "2");
+    BasicBlock* bb = func.createBasicBlock("entry");
+    auto& shl = bb->createInstr<BinaryOp>(InstrKind::Shl, x, two);
+    auto& cmp = bb->createInstr<Cmp>(CmpOp::Lt, &shl, x);
+    auto& check = bb->createInstr<NullCheck>(x);
+    auto& ret = bb->createInstr<Return>(&shl);
+
+    EXPECT_TRUE(isa<Parameter>(x));
+    EXPECT_FALSE(isa<Instruction>(x));
+    EXPECT_TRUE(isa<Constant>(two));
+    EXPECT_TRUE(isa<Instruction>(static_cast<Value*>(&shl)));
+    EXPECT_TRUE(isa<BinaryOp>(&shl));
+    EXPECT_FALSE(isa<BinaryOp>(&cmp));
+    EXPECT_TRUE(isa<Cmp>(&cmp));
+    EXPECT_TRUE(isa<NullCheck>(&check));
+    EXPECT_FALSE(isa<BoundsCheck>(&check));
+    EXPECT_TRUE(isa<Return>(&ret));
+
+    Value* value = &shl;
+    EXPECT_EQ(dyn_cast<BinaryOp>(value), &shl);
+    EXPECT_EQ(dyn_cast<Phi>(value), nullptr);
+    EXPECT_EQ(cast<Instruction>(value)->getKind(), InstrKind::Shl);
+    EXPECT_EQ(dyn_cast_or_null<Constant>(static_cast<Value*>(nullptr)), nullptr);
+
+    const Instruction& constRef = bb->getInstructions().front();
+    const BinaryOp* constOp = dyn_cast<BinaryOp>(&constRef);
+    EXPECT_EQ(constOp, &shl);
+}
+
+TEST(SmallVectorTest, SpillsToHeapAndKeepsUsesLinked) {
+    SmallVector<int, 2> ints;
+    ints.push_back(1);
+    ints.push_back(2);
+    EXPECT_TRUE(ints.isSmall());
+    ints.push_back(3);
+    EXPECT_FALSE(ints.isSmall());
+    EXPECT_EQ(ints.size(), 3U);
+    EXPECT_EQ(ints[2], 3);
+    ints.erase(ints.begin());
+    EXPECT_EQ(ints.front(), 2);
+    EXPECT_EQ(ints.back(), 3);
+
+    SmallVector<int, 2> moved(std::move(ints));
+    EXPECT_EQ(moved.size(), 2U);
+    EXPECT_TRUE(ints.empty());
+
+    // Uses relink themselves when the operand list outgrows its inline slots.
+    Program program;
+    Function& func = program.createFunction("operands");
+    Parameter* x = func.createParam("x");
+    BasicBlock* bb = func.createBasicBlock("entry");
+    auto& call = bb->createInstr<Call>(&func, std::vector<Value*>{x, x, x, x, x});
+    EXPECT_FALSE(call.getOperandUses().isSmall());
+    EXPECT_EQ(x->getNumUses(), 5U);
+    for (Use* use : x->getUses()) {
+        EXPECT_EQ(use->getUser(), &call);
+    }
+    auto& add = bb->createInstr<BinaryOp>(InstrKind::Add, x, x);
+    EXPECT_TRUE(add.getOperandUses().isSmall());
+}
+
+TEST(SmallVectorTest, BlockEdgesAreUniqueAndOrdered) {
+    Program program;
+    Function& func = program.createFunction("edges");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* left = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    BasicBlock* join = func.createBasicBlock("join");
+    entry->createInstr<CondJump>(c, right, left);
+    left->createInstr<Jump>(join);
+    right->createInstr<Jump>(join);
+    join->createInstr<Return>(nullptr);
+
+    CFGAnalysis::buildCFG(func);
+    CFGAnalysis::buildCFG(func);
+
+    ASSERT_EQ(entry->getSuccessors().size(), 2U);
+    EXPECT_EQ(entry->getSuccessors()[0], right);
+    EXPECT_EQ(entry->getSuccessors()[1], left);
+    ASSERT_EQ(join->getPredecessors().size(), 2U);
+    EXPECT_EQ(join->getPredecessors()[0], left);
+    EXPECT_EQ(join->getPredecessors()[1], right);
+
+    join->removePredecessor(left);
+    ASSERT_EQ(join->getPredecessors().size(), 1U);
+    EXPECT_EQ(join->getPredecessors()[0], right);
+}
+
+TEST(BranchTargetTest, BranchesLinkBlocksByPointer) {
+    Program program;
+    Function& func = program.createFunction("targets");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    auto& br = entry->createInstr<CondJump>(c, body, exit);
+    auto& back = body->createInstr<Jump>(entry);
+    exit->createInstr<Return>();
+
+    CFGAnalysis::buildCFG(func);
+    EXPECT_EQ(br.getTrueTarget(), body);
+    EXPECT_EQ(back.getTarget(), entry);
+    ASSERT_EQ(entry->getPredecessors().size(), 1U);
+    EXPECT_EQ(entry->getPredecessors()[0], body);
+
+    // Retargeting is a pointer store; the printed form follows the block.
+    back.setTarget(exit);
+    CFGAnalysis::buildCFG(func);
+    EXPECT_TRUE(entry->getPredecessors().empty());
+    NameContext ctx;
+    EXPECT_EQ(back.str(ctx), "jump exit");
+
+    BlockNameIndex index(func);
+    EXPECT_EQ(index.size(), 3U);
+    EXPECT_EQ(index.lookup("body"), body);
+    EXPECT_EQ(index.lookup("missing"), nullptr);
+}
+
+TEST(DominatorTreeTest, DiamondInsideLoop) {
+    Program program;
+    Function& func = program.createFunction("dominators");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* left = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    BasicBlock* join = func.createBasicBlock("join");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    BasicBlock* dead = func.createBasicBlock("dead");
+    entry->createInstr<Jump>(header);
+    header->createInstr<CondJump>(c, left, right);
+    left->createInstr<Jump>(join);
+    right->createInstr<Jump>(join);
+    join->createInstr<CondJump>(c, header, exit);
+    exit->createInstr<Return>();
+    dead->createInstr<Jump>(join);
+    CFGAnalysis::buildCFG(func);
+
+    DominatorTree domTree(func);
+    EXPECT_EQ(domTree.getRoot(), entry);
+    EXPECT_EQ(domTree.getIDom(entry), nullptr);
+    EXPECT_EQ(domTree.getIDom(header), entry);
+    EXPECT_EQ(domTree.getIDom(left), header);
+    EXPECT_EQ(domTree.getIDom(join), header);
+    EXPECT_EQ(domTree.getIDom(exit), join);
+    EXPECT_EQ(domTree.getChildren(header).size(), 3U);
+
+    EXPECT_TRUE(domTree.dominates(header, exit));
+    EXPECT_TRUE(domTree.dominates(join, join));
+    EXPECT_FALSE(domTree.properlyDominates(join, join));
+    EXPECT_FALSE(domTree.dominates(left, join));
+    EXPECT_FALSE(domTree.dominates(join, header));
+    EXPECT_EQ(domTree.findNearestCommonDominator(left, right), header);
+    EXPECT_EQ(domTree.findNearestCommonDominator(left, exit), header);
+
+    // The dead predecessor of join does not disturb the reachable part.
+    EXPECT_FALSE(domTree.isReachable(dead));
+    EXPECT_TRUE(domTree.dominates(exit, dead));
+    EXPECT_FALSE(domTree.dominates(dead, exit));
+    EXPECT_EQ(domTree.getReversePostOrder().size(), 6U);
+    EXPECT_EQ(domTree.getReversePostOrder().front(), entry);
+}
+
+TEST(DominatorTreeTest, AgreesWithReachabilityDefinition) {
+    Program program;
+    Function& func = program.createFunction("random_cfg");
+    Parameter* c = func.createParam("c");
+    std::vector<BasicBlock*> blocks;
+    for (int i = 0; i < 60; ++i) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(i)));
+    }
+    unsigned seed = 12345;
+    auto next = [&seed] {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % 60;
+    };
+    for (BasicBlock* bb : blocks) {
+        bb->createInstr<CondJump>(c, blocks[next()], blocks[next()]);
+    }
+    CFGAnalysis::buildCFG(func);
+    DominatorTree domTree(func);
+
+    // a dominates b iff b cannot be reached from the entry avoiding a.
+    auto reachableAvoiding = [&](BasicBlock* avoided) {
+        BlockSet seen(func.getNumBlockIds());
+        std::vector<BasicBlock*> stack;
+        if (blocks[0] != avoided) {
+            stack.push_back(blocks[0]);
+        }
+        while (!stack.empty()) {
+            BasicBlock* bb = stack.back();
+            stack.pop_back();
+            if (seen.count(bb)) {
+                continue;
+            }
+            seen.insert(bb);
+            for (BasicBlock* succ : bb->getSuccessors()) {
+                if (succ != avoided) {
+                    stack.push_back(succ);
+                }
+            }
+        }
+        return seen;
+    };
+
+    for (BasicBlock* a : blocks) {
+        BlockSet seen = reachableAvoiding(a);
+        for (BasicBlock* b : blocks) {
+            if (!domTree.isReachable(b)) {
+                continue;
+            }
+            bool expected = a == b || !seen.count(b);
+            EXPECT_EQ(domTree.dominates(a, b), expected) << a->getName() << " / " << b->getName();
+        }
+    }
+}
+
+TEST(DominatorTreeTest, PostDominatorsUseVirtualExit) {
+    Program program;
+    Function& func = program.createFunction("post_dominators");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* check = func.createBasicBlock("check");
+    BasicBlock* early = func.createBasicBlock("early");
+    BasicBlock* work = func.createBasicBlock("work");
+    BasicBlock* done = func.createBasicBlock("done");
+    BasicBlock* spin = func.createBasicBlock("spin");
+    entry->createInstr<CondJump>(c, check, spin);
+    check->createInstr<CondJump>(c, early, work);
+    early->createInstr<Return>();
+    work->createInstr<Jump>(done);
+    done->createInstr<Return>();
+    spin->createInstr<Jump>(spin);
+    CFGAnalysis::buildCFG(func);
+
+    PostDominatorTree postDomTree = CFGAnalysis::computePostDominatorTree(func);
+    EXPECT_EQ(postDomTree.getRoot(), nullptr);
+    ASSERT_EQ(postDomTree.getRoots().size(), 3U);
+    EXPECT_EQ(postDomTree.getRoots()[0], early);
+    EXPECT_EQ(postDomTree.getRoots()[1], done);
+    EXPECT_EQ(postDomTree.getRoots()[2], spin);
+
+    EXPECT_EQ(postDomTree.getIDom(work), done);
+    EXPECT_EQ(postDomTree.getIDom(check), nullptr);
+    EXPECT_EQ(postDomTree.getIDom(early), nullptr);
+    EXPECT_TRUE(postDomTree.dominates(done, work));
+    EXPECT_FALSE(postDomTree.dominates(done, check));
+    EXPECT_FALSE(postDomTree.dominates(spin, entry));
+    EXPECT_EQ(postDomTree.findNearestCommonDominator(work, done), done);
+    EXPECT_EQ(postDomTree.findNearestCommonDominator(early, work), nullptr);
+    for (BasicBlock* bb : func.getBasicBlocks()) {
+        EXPECT_TRUE(postDomTree.isReachable(bb)) << bb->getName();
+    }
+}
+
+TEST(DominatorTreeTest, ControlDependenceOfNestedBranches) {
+    Program program;
+    Function& func = program.createFunction("control_dependence");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* then = func.createBasicBlock("then");
+    BasicBlock* latch = func.createBasicBlock("latch");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    header->createInstr<CondJump>(c, body, exit);
+    body->createInstr<CondJump>(c, then, latch);
+    then->createInstr<Jump>(latch);
+    latch->createInstr<Jump>(header);
+    exit->createInstr<Return>();
+    CFGAnalysis::buildCFG(func);
+
+    ControlDependenceGraph cdg = CFGAnalysis::computeControlDependence(func);
+    EXPECT_TRUE(cdg.getControllingBlocks(entry).empty());
+    EXPECT_TRUE(cdg.getControllingBlocks(exit).empty());
+    EXPECT_TRUE(cdg.isControlDependent(body, header));
+    EXPECT_TRUE(cdg.isControlDependent(latch, header));
+    // The loop header decides whether it runs again.
+    EXPECT_TRUE(cdg.isControlDependent(header, header));
+    ASSERT_EQ(cdg.getControllingBlocks(then).size(), 1U);
+    EXPECT_EQ(cdg.getControllingBlocks(then)[0], body);
+    EXPECT_EQ(cdg.getDependentBlocks(body).size(), 1U);
+    EXPECT_EQ(cdg.getDependentBlocks(header).size(), 3U);
+}
+
+TEST(DominatorTreeTest, IncrementalUpdatesMatchRecalculation) {
+    Program program;
+    Function& func = program.createFunction("edited_cfg");
+    std::vector<BasicBlock*> blocks;
+    for (int i = 0; i < 40; ++i) {
+        blocks.push_back(func.createBasicBlock("bb" + std::to_string(i)));
+    }
+    // Only the edge lists matter to the tree, so the test edits them
+    // directly instead of going through terminators.
+    auto addEdge = [](BasicBlock* from, BasicBlock* to) {
+        from->addSuccessor(to);
+        to->addPredecessor(from);
+    };
+    for (size_t i = 0; i + 1 < blocks.size(); ++i) {
+        addEdge(blocks[i], blocks[i + 1]);
+    }
+    DominatorTree domTree(func);
+
+    unsigned seed = 777;
+    auto next = [&seed] {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % 40;
+    };
+    size_t deadBlocks = 0;
+    for (int step = 0; step < 600; ++step) {
+        BasicBlock* from = blocks[next()];
+        if (step % 3 == 2 && !from->getSuccessors().empty()) {
+            BasicBlock* to = from->getSuccessors()[next() % from->getSuccessors().size()];
+            from->removeSuccessor(to);
+            to->removePredecessor(from);
+            std::vector<BasicBlock*> unreachable;
+            domTree.deleteEdge(from, to, &unreachable);
+            deadBlocks += unreachable.size();
+            for (BasicBlock* bb : unreachable) {
+                EXPECT_FALSE(domTree.isReachable(bb));
+            }
+        } else {
+            BasicBlock* to = blocks[next()];
+            if (to == blocks[0] || std::find(from->getSuccessors().begin(), from->getSuccessors().end(), to) !=
+                                       from->getSuccessors().end()) {
+                continue;
+            }
+            addEdge(from, to);
+            domTree.insertEdge(from, to);
+        }
+        ASSERT_TRUE(domTree.verify(func)) << "after step " << step;
+
+        DominatorTree fresh(func);
+        for (int q = 0; q < 20; ++q) {
+            BasicBlock* a = blocks[next()];
+            BasicBlock* b = blocks[next()];
+            EXPECT_EQ(domTree.dominates(a, b), fresh.dominates(a, b)) << "after step " << step;
+            EXPECT_EQ(domTree.findNearestCommonDominator(a, b), fresh.findNearestCommonDominator(a, b));
+        }
+    }
+    // The walk should have cut off and re-attached regions along the way.
+    EXPECT_GT(deadBlocks, 0U);
+    EXPECT_EQ(domTree.getReversePostOrder(), DominatorTree(func).getReversePostOrder());
+}
+
+TEST(DominatorTreeTest, UpdaterSplitsAndMergesBlocks) {
+    Program program;
+    Function& func = program.createFunction("split_merge");
+    Parameter* c = func.createParam("c");
+    Parameter* p = func.createParam("p");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* left = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    BasicBlock* merge = func.createBasicBlock("merge");
+    auto& sum = entry->createInstr<BinaryOp>(InstrKind::Add, p, p);
+    auto& product = entry->createInstr<BinaryOp>(InstrKind::Mul, &sum, p);
+    entry->createInstr<CondJump>(c, left, right);
+    left->createInstr<Jump>(merge);
+    right->createInstr<Jump>(merge);
+    auto& phi = merge->createInstr<Phi>();
+    phi.addIncoming(left, &product);
+    phi.addIncoming(right, p);
+    merge->createInstr<Return>(&phi);
+    CFGAnalysis::buildCFG(func);
+    DominatorTree domTree(func);
+    CFGUpdater updater(func, &domTree);
+
+    BasicBlock* tail = updater.splitBlock(entry, entry->getInstructions().iteratorTo(&product), "entry.tail");
+    EXPECT_EQ(product.getParent(), tail);
+    EXPECT_EQ(entry->getInstructions().size(), 2U);
+    EXPECT_EQ(domTree.getIDom(left), tail);
+    EXPECT_EQ(domTree.getIDom(merge), tail);
+    EXPECT_EQ(left->getPredecessors()[0], tail);
+    EXPECT_TRUE(domTree.verify(func));
+
+    // left only has the tail as predecessor but the tail branches, so it
+    // cannot be merged; the tail itself can go back into the entry.
+    EXPECT_EQ(updater.mergeBlockIntoPredecessor(left), nullptr);
+    EXPECT_EQ(updater.mergeBlockIntoPredecessor(tail), entry);
+    EXPECT_EQ(product.getParent(), entry);
+    EXPECT_EQ(func.getBasicBlocks().size(), 4U);
+    EXPECT_EQ(domTree.getIDom(merge), entry);
+    EXPECT_TRUE(domTree.verify(func));
+
+    // Cutting entry -> left leaves merge with a single-entry phi.
+    auto* branch = cast<CondJump>(entry->getTerminator());
+    branch->dropAllOperands();
+    entry->getInstructions().replace(entry->getInstructions().iteratorTo(branch),
+                                     func.getArena().create<Jump>(right));
+    updater.deleteEdge(entry, left);
+    EXPECT_TRUE(updater.removeDeadBlocks());
+    EXPECT_EQ(func.getBasicBlocks().size(), 3U);
+    ASSERT_EQ(phi.getNumIncoming(), 1U);
+    EXPECT_EQ(phi.getIncomingBlock(0), right);
+    EXPECT_EQ(merge->getPredecessors().size(), 1U);
+    EXPECT_TRUE(domTree.verify(func));
+
+    ASSERT_EQ(updater.mergeBlockIntoPredecessor(merge), right);
+    EXPECT_EQ(product.getNumUses(), 0U);
+    EXPECT_TRUE(domTree.verify(func));
+    CFGAnalysis::buildCFG(func);
+    EXPECT_TRUE(domTree.verify(func));
+}
+
+TEST(CFGUpdaterTest, MergesChainsOfBlocksInOneSweep) {
+    Program program;
+    Function& func = program.createFunction("chain");
+    Parameter* p = func.createParam("p");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    std::vector<BasicBlock*> chain;
+    Value* value = p;
+    BasicBlock* last = entry;
+    for (int i = 0; i < 4; ++i) {
+        BasicBlock* next = func.createBasicBlock("b" + std::to_string(i));
+        last->createInstr<Jump>(next);
+        value = &next->createInstr<BinaryOp>(InstrKind::Add, value, p);
+        chain.push_back(next);
+        last = next;
+    }
+    last->createInstr<Return>(value);
+    CFGAnalysis::buildCFG(func);
+    DominatorTree domTree(func);
+    CFGUpdater updater(func, &domTree);
+
+    // Merging b0 makes entry the predecessor of b1, and so on down.
+    EXPECT_EQ(updater.mergeBlocksIntoPredecessors(chain), 4U);
+    ASSERT_EQ(func.getBasicBlocks().size(), 1U);
+    EXPECT_EQ(entry->getInstructions().size(), 5U);
+    EXPECT_EQ(cast<Instruction>(value)->getParent(), entry);
+    EXPECT_TRUE(entry->getSuccessors().empty());
+    EXPECT_TRUE(domTree.verify(func));
+}
+
+TEST(TraversalTest, PreOrderPostOrderAndReversePostOrder) {
+    Program program;
+    Function& func = program.createFunction("traversals");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    BasicBlock* dead = func.createBasicBlock("dead");
+    entry->createInstr<Jump>(header);
+    header->createInstr<CondJump>(c, body, exit);
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>();
+    dead->createInstr<Jump>(exit);
+    CFGAnalysis::buildCFG(func);
+
+    std::vector<BasicBlock*> pre;
+    for (BasicBlock* bb : preOrder(func)) {
+        pre.push_back(bb);
+    }
+    EXPECT_EQ(pre, (std::vector<BasicBlock*>{entry, header, body, exit}));
+
+    std::vector<BasicBlock*> post;
+    for (BasicBlock* bb : postOrder(func)) {
+        post.push_back(bb);
+    }
+    EXPECT_EQ(post, (std::vector<BasicBlock*>{body, exit, header, entry}));
+
+    ReversePostOrder rpo(func);
+    EXPECT_EQ(rpo.getBlocks(), (std::vector<BasicBlock*>{entry, header, exit, body}));
+    EXPECT_EQ(rpo.getNumber(entry), 0U);
+    EXPECT_EQ(rpo.getNumber(body), 3U);
+    EXPECT_FALSE(rpo.isReachable(dead));
+
+    std::unordered_set<BasicBlock*> visited{exit};
+    std::vector<BasicBlock*> order;
+    CFGAnalysis::dfsTraversal(entry, visited, order);
+    EXPECT_EQ(order, (std::vector<BasicBlock*>{entry, header, body}));
+}
+
+TEST(TraversalTest, MillionBlockChainDoesNotRecurse) {
+    Program program;
+    Function& func = program.createFunction("chain");
+    const size_t numBlocks = 1000000;
+    std::vector<BasicBlock*> blocks;
+    blocks.reserve(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i) {
+        blocks.push_back(func.createBasicBlock(""));
+    }
+    for (size_t i = 0; i + 1 < numBlocks; ++i) {
+        blocks[i]->createInstr<Jump>(blocks[i + 1]);
+    }
+    blocks.back()->createInstr<Return>();
+    CFGAnalysis::buildCFG(func);
+
+    size_t visited = 0;
+    for (BasicBlock* bb : preOrder(func)) {
+        (void)bb;
+        ++visited;
+    }
+    EXPECT_EQ(visited, numBlocks);
+
+    PostOrderRange post = postOrder(func);
+    EXPECT_EQ(*post.begin(), blocks.back());
+
+    ReversePostOrder rpo(func);
+    EXPECT_EQ(rpo.getNumber(blocks.back()), numBlocks - 1);
+
+    std::unordered_set<BasicBlock*> seen;
+    std::vector<BasicBlock*> order;
+    CFGAnalysis::dfsTraversal(blocks.front(), seen, order);
+    EXPECT_EQ(order.size(), numBlocks);
+
+    EXPECT_FALSE(CFGAnalysis::removeUnreachableBlocks(func));
+    DominatorTree domTree(func);
+    EXPECT_EQ(domTree.getIDom(blocks.back()), blocks[numBlocks - 2]);
+    EXPECT_TRUE(domTree.dominates(blocks[1], blocks.back()));
+}
+
+// Two back edges into one header, a loop nested inside with its own
+// preheader, and a dead block jumping into the loop:
+//
+//   entry -> header
+//   header: c ? pre : exit
+//   pre -> inner
+//   inner: c ? inner : latchA      (self loop)
+//   latchA: c ? header : latchB
+//   latchB -> header
+//   dead -> latchB
+TEST(LoopInfoTest, MergesLatchesAndNestsLoops) {
+    Program program;
+    Function& func = program.createFunction("loops");
+    Parameter* c = func.createParam("c");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* pre = func.createBasicBlock("pre");
+    BasicBlock* inner = func.createBasicBlock("inner");
+    BasicBlock* latchA = func.createBasicBlock("latchA");
+    BasicBlock* latchB = func.createBasicBlock("latchB");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    BasicBlock* dead = func.createBasicBlock("dead");
+    entry->createInstr<Jump>(header);
+    header->createInstr<CondJump>(c, pre, exit);
+    pre->createInstr<Jump>(inner);
+    inner->createInstr<CondJump>(c, inner, latchA);
+    latchA->createInstr<CondJump>(c, header, latchB);
+    latchB->createInstr<Jump>(header);
+    exit->createInstr<Return>();
+    dead->createInstr<Jump>(latchB);
+    CFGAnalysis::buildCFG(func);
+
+    LoopInfo loopInfo(func);
+    ASSERT_EQ(loopInfo.size(), 2U);
+    ASSERT_EQ(loopInfo.getTopLevelLoops().size(), 1U);
+
+    Loop* outer = loopInfo.getTopLevelLoops()[0];
+    EXPECT_EQ(outer->header, header);
+    EXPECT_EQ(outer->latches, (std::vector<BasicBlock*>{latchA, latchB}));
+    EXPECT_EQ(outer->getLatch(), nullptr);
+    EXPECT_EQ(outer->preheader, entry);
+    EXPECT_EQ(outer->blocks.size(), 5U);
+    EXPECT_EQ(outer->blocks.front(), header);
+    EXPECT_EQ(outer->exits, (std::vector<BasicBlock*>{header}));
+    EXPECT_EQ(outer->getDepth(), 0);
+
+    ASSERT_EQ(outer->subLoops.size(), 1U);
+    Loop* self = outer->subLoops[0];
+    EXPECT_EQ(self->header, inner);
+    EXPECT_EQ(self->getLatch(), inner);
+    EXPECT_EQ(self->preheader, pre);
+    EXPECT_EQ(self->parent, outer);
+    EXPECT_EQ(self->blocks, (std::vector<BasicBlock*>{inner}));
+    EXPECT_TRUE(self->isInnermost());
+    EXPECT_TRUE(outer->contains(self));
+    EXPECT_FALSE(self->contains(outer));
+
+    EXPECT_EQ(loopInfo.getLoopFor(inner), self);
+    EXPECT_EQ(loopInfo.getLoopFor(latchB), outer);
+    EXPECT_EQ(loopInfo.getLoopFor(entry), nullptr);
+    EXPECT_EQ(loopInfo.getLoopFor(dead), nullptr);
+    EXPECT_EQ(loopInfo.getLoopDepth(inner), 2);
+    EXPECT_EQ(loopInfo.getLoopDepth(exit), 0);
+    EXPECT_TRUE(outer->contains(inner));
+    EXPECT_FALSE(outer->contains(exit));
+    EXPECT_FALSE(outer->contains(dead));
+    EXPECT_TRUE(loopInfo.isLoopHeader(header));
+    EXPECT_FALSE(loopInfo.isLoopHeader(pre));
+    EXPECT_TRUE(loopInfo.isBackEdge(latchB, header));
+    EXPECT_TRUE(loopInfo.isBackEdge(inner, inner));
+    EXPECT_FALSE(loopInfo.isBackEdge(entry, header));
+}
+
+// A few thousand loops nested in pairs: every block is mapped once and the
+// nesting is found without comparing loops with each other.
+TEST(LoopInfoTest, ManyLoopsMapBlocksToInnermost) {
+    Program program;
+    Function& func = program.createFunction("many_loops");
+    Parameter* c = func.createParam("c");
+    const int numPairs = 5000;
+    BasicBlock* current = func.createBasicBlock("entry");
+    std::vector<BasicBlock*> outerHeaders;
+    std::vector<BasicBlock*> innerHeaders;
+    for (int i = 0; i < numPairs; ++i) {
+        BasicBlock* outer = func.createBasicBlock("");
+        BasicBlock* inner = func.createBasicBlock("");
+        BasicBlock* latch = func.createBasicBlock("");
+        BasicBlock* next = func.createBasicBlock("");
+        current->createInstr<Jump>(outer);
+        outer->createInstr<Jump>(inner);
+        inner->createInstr<CondJump>(c, inner, latch);
+        latch->createInstr<CondJump>(c, outer, next);
+        outerHeaders.push_back(outer);
+        innerHeaders.push_back(inner);
+        current = next;
+    }
+    current->createInstr<Return>();
+    CFGAnalysis::buildCFG(func);
+
+    LoopInfo loopInfo(func);
+    EXPECT_EQ(loopInfo.size(), 2U * numPairs);
+    EXPECT_EQ(loopInfo.getTopLevelLoops().size(), static_cast<size_t>(numPairs));
+    for (int i = 0; i < numPairs; ++i) {
+        Loop* inner = loopInfo.getLoopFor(innerHeaders[i]);
+        ASSERT_NE(inner, nullptr);
+        EXPECT_EQ(inner->header, innerHeaders[i]);
+        EXPECT_EQ(inner->parent, loopInfo.getLoopFor(outerHeaders[i]));
+        EXPECT_EQ(inner->parent->blocks.size(), 3U);
+    }
+}
+
+// for (i = 0; i < 10; i += 2) with a few values computed from i, and a phi
+// that doubles, which is not an induction variable.
+TEST(InductionVariableTest, FindsBasicAndDerivedVariables) {
+    Program program;
+    Function& func = program.createFunction("ivs");
+    Parameter* p = func.createParam("p");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* two = func.createConstant(2, "2");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& k = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Gt, func.getConstant(10), &i);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& times3 = body->createInstr<BinaryOp>(InstrKind::Mul, &i, func.getConstant(3));
+    auto& plusP = body->createInstr<BinaryOp>(InstrKind::Add, p, &times3);
+    auto& sevenMinus = body->createInstr<BinaryOp>(InstrKind::Sub, func.getConstant(7), &i);
+    auto& times4 = body->createInstr<BinaryOp>(InstrKind::Shl, &i, two);
+    auto& timesP = body->createInstr<BinaryOp>(InstrKind::Mul, &times3, p);
+    auto& offsetTwice = body->createInstr<BinaryOp>(InstrKind::Mul, &plusP, two);
+    auto& next = body->createInstr<BinaryOp>(InstrKind::Add, &i, two);
+    auto& nextK = body->createInstr<BinaryOp>(InstrKind::Mul, &k, two);
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&k);
+    i.addIncoming(entry, zero);
+    i.addIncoming(body, &next);
+    k.addIncoming(entry, p);
+    k.addIncoming(body, &nextK);
+    CFGAnalysis::buildCFG(func);
+
+    LoopInfo loopInfo(func);
+    InductionVariableAnalysis ivs(func, loopInfo);
+    Loop* loop = loopInfo.getLoopFor(header);
+
+    const InductionVariable* basic = ivs.getInductionVariable(&i);
+    ASSERT_NE(basic, nullptr);
+    EXPECT_TRUE(basic->isBasic());
+    EXPECT_EQ(basic->loop, loop);
+    EXPECT_EQ(basic->start, zero);
+    EXPECT_EQ(basic->step, 2);
+    EXPECT_EQ(basic->update, &next);
+    EXPECT_EQ(ivs.getInductionVariable(&k), nullptr);
+    EXPECT_EQ(ivs.getInductionVariable(&nextK), nullptr);
+    EXPECT_EQ(ivs.getInductionVariable(&timesP), nullptr);
+    EXPECT_EQ(ivs.getInductionVariable(&offsetTwice), nullptr);
+
+    struct Expected {
+        Value* value;
+        int scale;
+        int step;
+        Value* offset;
+        bool subtracts;
+    };
+    for (const Expected& e : {Expected{&times3, 3, 6, nullptr, false}, Expected{&plusP, 3, 6, p, false},
+                              Expected{&sevenMinus, -1, -2, func.getConstant(7), false},
+                              Expected{&times4, 4, 8, nullptr, false}, Expected{&next, 1, 2, two, false}}) {
+        const InductionVariable* derived = ivs.getInductionVariable(e.value);
+        ASSERT_NE(derived, nullptr);
+        EXPECT_FALSE(derived->isBasic());
+        EXPECT_EQ(derived->basis, &i);
+        EXPECT_EQ(derived->scale, e.scale);
+        EXPECT_EQ(derived->step, e.step);
+        EXPECT_EQ(derived->offset, e.offset);
+        EXPECT_EQ(derived->subtractsOffset, e.subtracts);
+    }
+    EXPECT_EQ(ivs.getInductionVariables(loop).size(), 6U);
+
+    // 10 > i reads as i < 10 with the variable on the left.
+    const LoopBound* bound = ivs.getLoopBound(loop);
+    ASSERT_NE(bound, nullptr);
+    EXPECT_EQ(bound->iv, basic);
+    EXPECT_EQ(bound->exiting, header);
+    EXPECT_FALSE(bound->testsUpdate);
+    EXPECT_EQ(bound->op, CmpOp::Lt);
+    EXPECT_EQ(bound->bound, func.getConstant(10));
+    EXPECT_EQ(ivs.getTripCount(loop), 5);
+}
+
+// A loop tested at the bottom that counts i down from 10, leaving when
+// i - 1 <= 0, and the same shape with an unknown start, like the iterative
+// factorial.
+TEST(InductionVariableTest, CountsLoopsTestedInTheLatch) {
+    for (bool knownStart : {true, false}) {
+        Program program;
+        Function& func = program.createFunction("countdown");
+        Parameter* n = func.createParam("n");
+        Constant* one = func.createConstant(1, "1");
+        BasicBlock* entry = func.createBasicBlock("entry");
+        BasicBlock* loopBlock = func.createBasicBlock("loop");
+        BasicBlock* exit = func.createBasicBlock("exit");
+        entry->createInstr<Jump>(loopBlock);
+        auto& i = loopBlock->createInstr<Phi>();
+        auto& next = loopBlock->createInstr<BinaryOp>(InstrKind::Sub, &i, one);
+        auto& done = loopBlock->createInstr<Cmp>(CmpOp::Le, &next, func.getConstant(0));
+        loopBlock->createInstr<CondJump>(&done, exit, loopBlock);
+        exit->createInstr<Return>(&next);
+        i.addIncoming(entry, knownStart ? static_cast<Value*>(func.getConstant(10)) : n);
+        i.addIncoming(loopBlock, &next);
+        CFGAnalysis::buildCFG(func);
+
+        LoopInfo loopInfo(func);
+        InductionVariableAnalysis ivs(func, loopInfo);
+        Loop* loop = loopInfo.getLoopFor(loopBlock);
+        const LoopBound* bound = ivs.getLoopBound(loop);
+        ASSERT_NE(bound, nullptr);
+        EXPECT_EQ(bound->iv->step, -1);
+        EXPECT_TRUE(bound->testsUpdate);
+        EXPECT_EQ(bound->op, CmpOp::Gt);
+        if (knownStart) {
+            EXPECT_EQ(ivs.getTripCount(loop), 10);
+        } else {
+            EXPECT_FALSE(ivs.getTripCount(loop).has_value());
+        }
+    }
+}
+
+TEST(InductionVariableTest, CountIterationsStaysInRange) {
+    const int32_t max = std::numeric_limits<int32_t>::max();
+    EXPECT_EQ(InductionVariableAnalysis::countIterations(0, 2, CmpOp::Ne, 10), 5);
+    EXPECT_FALSE(InductionVariableAnalysis::countIterations(0, 3, CmpOp::Ne, 10).has_value());
+    EXPECT_EQ(InductionVariableAnalysis::countIterations(5, 1, CmpOp::Lt, 5), 0);
+    EXPECT_EQ(InductionVariableAnalysis::countIterations(0, 1, CmpOp::Lt, max), max);
+    EXPECT_FALSE(InductionVariableAnalysis::countIterations(0, 2, CmpOp::Le, max).has_value());
+    EXPECT_EQ(InductionVariableAnalysis::countIterations(10, -3, CmpOp::Ge, 0), 4);
+    EXPECT_FALSE(InductionVariableAnalysis::countIterations(0, -1, CmpOp::Lt, 10).has_value());
+}
@@ -5,8 +5,12 @@
 #include "liveness_analysis.h"
 #include "bin_ops.h"
 #include "control_flow.h"
+#include "dataflow.h"
+#include "checks.h"
+#include "cfg_traversal.h"
 #include <vector>
 #include <algorithm>
+#include <climits>
 
 // collect block names from an ordered list
 static std::vector<std::string> names(const std::vector<BasicBlock*>& order) {
@@ -31,7 +35,7 @@ static int indexOf(const std::vector<BasicBlock*>& order, const std::string& nam
 //                v1 = add v0, const_1
 //                jump loop_header
 //   loop_header: v2 = phi [v1, entry], [v3, loop_body]
-//                condjump "cond" loop_body exit
+//                condjump cond loop_body exit
 //   loop_body:   v3 = mul v2, v2
 //                jump loop_header           ← back edge
 //   exit:        return v2
@@ -39,6 +43,7 @@ static int indexOf(const std::vector<BasicBlock*>& order, const std::string& nam
 TEST(LinearOrderTest, SimpleLoopLinearOrder) {
     Program prog;
     Function& func = prog.createFunction("simple_loop");
+    Parameter* cond = func.createParam("cond");
 
     BasicBlock* entry       = func.createBasicBlock("entry");
     BasicBlock* loop_header = func.createBasicBlock("loop_header");
@@ -50,15 +55,15 @@ TEST(LinearOrderTest, SimpleLoopLinearOrder) {
 
     // entry
     BinaryOp& v1 = entry->createInstr<BinaryOp>(InstrKind::Add, param_x, const_1);
-    entry->createInstr<Jump>("loop_header");
+    entry->createInstr<Jump>(loop_header);
 
     // loop_header
     Phi& v2 = loop_header->createInstr<Phi>();
-    loop_header->createInstr<CondJump>("cond", "loop_body", "exit");
+    loop_header->createInstr<CondJump>(cond, loop_body, exitBB);
 
     // loop_body
     BinaryOp& v3 = loop_body->createInstr<BinaryOp>(InstrKind::Mul, &v2, &v2);
-    loop_body->createInstr<Jump>("loop_header");
+    loop_body->createInstr<Jump>(loop_header);
 
     // exit
     exitBB->createInstr<Return>(&v2);
@@ -96,6 +101,7 @@ TEST(LinearOrderTest, SimpleLoopLinearOrder) {
 TEST(LivenessAnalysisTest, SimpleLoopLiveness) {
     Program prog;
     Function& func = prog.createFunction("simple_loop_live");
+    Parameter* cond = func.createParam("cond");
 
     BasicBlock* entry       = func.createBasicBlock("entry");
     BasicBlock* loop_header = func.createBasicBlock("loop_header");
@@ -106,13 +112,13 @@ TEST(LivenessAnalysisTest, SimpleLoopLiveness) {
     Constant*  const_1 = func.createConstant(1, "1");
 
     BinaryOp& v1 = entry->createInstr<BinaryOp>(InstrKind::Add, param_x, const_1);
-    entry->createInstr<Jump>("loop_header");
+    entry->createInstr<Jump>(loop_header);
 
     Phi& v2 = loop_header->createInstr<Phi>();
-    loop_header->createInstr<CondJump>("cond", "loop_body", "exit");
+    loop_header->createInstr<CondJump>(cond, loop_body, exitBB);
 
     BinaryOp& v3 = loop_body->createInstr<BinaryOp>(InstrKind::Mul, &v2, &v2);
-    loop_body->createInstr<Jump>("loop_header");
+    loop_body->createInstr<Jump>(loop_header);
 
     exitBB->createInstr<Return>(&v2);
 
@@ -170,9 +176,9 @@ TEST(LivenessAnalysisTest, SimpleLoopLiveness) {
 //   entry:        v0 = param "n"
 //                 jump outer_header
 //   outer_header: v1 = phi [v0, entry], [v4, outer_body]
-//                 condjump "outer_cond" inner_header exit
+//                 condjump outer_cond inner_header exit
 //   inner_header: v2 = phi [v1, outer_header], [v3, inner_body]
-//                 condjump "inner_cond" inner_body outer_body
+//                 condjump inner_cond inner_body outer_body
 //   inner_body:   v3 = add v2, const_1    ← uses v2
 //                 jump inner_header       ← back edge (inner)
 //   outer_body:   v4 = mul v1, v1         ← uses v1
@@ -182,6 +188,8 @@ TEST(LivenessAnalysisTest, SimpleLoopLiveness) {
 TEST(LinearOrderTest, NestedLoopsLinearOrder) {
     Program prog;
     Function& func = prog.createFunction("nested_loops");
+    Parameter* outer_cond = func.createParam("outer_cond");
+    Parameter* inner_cond = func.createParam("inner_cond");
 
     BasicBlock* entry        = func.createBasicBlock("entry");
     BasicBlock* outer_header = func.createBasicBlock("outer_header");
@@ -194,23 +202,23 @@ TEST(LinearOrderTest, NestedLoopsLinearOrder) {
     Constant*  const_1 = func.createConstant(1, "1");
 
     // entry
-    entry->createInstr<Jump>("outer_header");
+    entry->createInstr<Jump>(outer_header);
 
     // outer_header
     Phi& v1 = outer_header->createInstr<Phi>();
-    outer_header->createInstr<CondJump>("outer_cond", "inner_header", "exit");
+    outer_header->createInstr<CondJump>(outer_cond, inner_header, exitBB);
 
     // inner_header
     Phi& v2 = inner_header->createInstr<Phi>();
-    inner_header->createInstr<CondJump>("inner_cond", "inner_body", "outer_body");
+    inner_header->createInstr<CondJump>(inner_cond, inner_body, outer_body);
 
     // inner_body
     BinaryOp& v3 = inner_body->createInstr<BinaryOp>(InstrKind::Add, &v2, const_1);
-    inner_body->createInstr<Jump>("inner_header");
+    inner_body->createInstr<Jump>(inner_header);
 
     // outer_body
     BinaryOp& v4 = outer_body->createInstr<BinaryOp>(InstrKind::Mul, &v1, &v1);
-    outer_body->createInstr<Jump>("outer_header");
+    outer_body->createInstr<Jump>(outer_header);
 
     // exit
     exitBB->createInstr<Return>(&v1);
@@ -263,6 +271,8 @@ TEST(LinearOrderTest, NestedLoopsLinearOrder) {
 TEST(LivenessAnalysisTest, NestedLoopsLiveness) {
     Program prog;
     Function& func = prog.createFunction("nested_loops_live");
+    Parameter* outer_cond = func.createParam("outer_cond");
+    Parameter* inner_cond = func.createParam("inner_cond");
 
     BasicBlock* entry        = func.createBasicBlock("entry");
     BasicBlock* outer_header = func.createBasicBlock("outer_header");
@@ -274,19 +284,19 @@ TEST(LivenessAnalysisTest, NestedLoopsLiveness) {
     Parameter* param_n = func.createParam("n");
     Constant*  const_1 = func.createConstant(1, "1");
 
-    entry->createInstr<Jump>("outer_header");
+    entry->createInstr<Jump>(outer_header);
 
     Phi& v1 = outer_header->createInstr<Phi>();
-    outer_header->createInstr<CondJump>("outer_cond", "inner_header", "exit");
+    outer_header->createInstr<CondJump>(outer_cond, inner_header, exitBB);
 
     Phi& v2 = inner_header->createInstr<Phi>();
-    inner_header->createInstr<CondJump>("inner_cond", "inner_body", "outer_body");
+    inner_header->createInstr<CondJump>(inner_cond, inner_body, outer_body);
 
     BinaryOp& v3 = inner_body->createInstr<BinaryOp>(InstrKind::Add, &v2, const_1);
-    inner_body->createInstr<Jump>("inner_header");
+    inner_body->createInstr<Jump>(inner_header);
 
     BinaryOp& v4 = outer_body->createInstr<BinaryOp>(InstrKind::Mul, &v1, &v1);
-    outer_body->createInstr<Jump>("outer_header");
+    outer_body->createInstr<Jump>(outer_header);
 
     exitBB->createInstr<Return>(&v1);
 
@@ -342,9 +352,9 @@ TEST(LivenessAnalysisTest, NestedLoopsLiveness) {
 //                v1 = param "b"
 //                jump loop_header
 //   loop_header: v_acc = phi [v0, entry], [v_merge, merge]
-//                condjump "loop_cond" if_block exit
+//                condjump loop_cond if_block exit
 //   if_block:    v_cmp = cmp.lt v_acc, const_10
-//                condjump "inner_cond" then_block else_block
+//                condjump inner_cond then_block else_block
 //   then_block:  v_then = add v_acc, v1     ← uses v_acc and v1
 //                jump merge
 //   else_block:  v_else = mul v_acc, const_2  ← uses v_acc, NOT v1
@@ -356,6 +366,8 @@ TEST(LivenessAnalysisTest, NestedLoopsLiveness) {
 TEST(LinearOrderTest, LoopWithConditionalLinearOrder) {
     Program prog;
     Function& func = prog.createFunction("loop_cond");
+    Parameter* loop_cond = func.createParam("loop_cond");
+    Parameter* inner_cond = func.createParam("inner_cond");
 
     BasicBlock* entry       = func.createBasicBlock("entry");
     BasicBlock* loop_header = func.createBasicBlock("loop_header");
@@ -371,27 +383,27 @@ TEST(LinearOrderTest, LoopWithConditionalLinearOrder) {
     Constant*  const_2  = func.createConstant(2, "2");
 
     // entry
-    entry->createInstr<Jump>("loop_header");
+    entry->createInstr<Jump>(loop_header);
 
     // loop_header
     Phi& v_acc = loop_header->createInstr<Phi>();
-    loop_header->createInstr<CondJump>("loop_cond", "if_block", "exit");
+    loop_header->createInstr<CondJump>(loop_cond, if_block, exitBB);
 
     // if_block
     if_block->createInstr<Cmp>(CmpOp::Lt, &v_acc, const_10);
-    if_block->createInstr<CondJump>("inner_cond", "then_block", "else_block");
+    if_block->createInstr<CondJump>(inner_cond, then_block, else_block);
 
     // then_block
     BinaryOp& v_then = then_block->createInstr<BinaryOp>(InstrKind::Add, &v_acc, param_b);
-    then_block->createInstr<Jump>("merge");
+    then_block->createInstr<Jump>(merge);
 
     // else_block
     BinaryOp& v_else = else_block->createInstr<BinaryOp>(InstrKind::Mul, &v_acc, const_2);
-    else_block->createInstr<Jump>("merge");
+    else_block->createInstr<Jump>(merge);
 
     // merge
     Phi& v_merge = merge->createInstr<Phi>();
-    merge->createInstr<Jump>("loop_header");
+    merge->createInstr<Jump>(loop_header);
 
     // exit
     exitBB->createInstr<Return>(&v_acc);
@@ -455,6 +467,8 @@ TEST(LinearOrderTest, LoopWithConditionalLinearOrder) {
 TEST(LivenessAnalysisTest, LoopWithConditionalLiveness) {
     Program prog;
     Function& func = prog.createFunction("loop_cond_live");
+    Parameter* loop_cond = func.createParam("loop_cond");
+    Parameter* inner_cond = func.createParam("inner_cond");
 
     BasicBlock* entry       = func.createBasicBlock("entry");
     BasicBlock* loop_header = func.createBasicBlock("loop_header");
@@ -469,22 +483,22 @@ TEST(LivenessAnalysisTest, LoopWithConditionalLiveness) {
     Constant*  const_10 = func.createConstant(10, "10");
     Constant*  const_2  = func.createConstant(2, "2");
 
-    entry->createInstr<Jump>("loop_header");
+    entry->createInstr<Jump>(loop_header);
 
     Phi& v_acc = loop_header->createInstr<Phi>();
-    loop_header->createInstr<CondJump>("loop_cond", "if_block", "exit");
+    loop_header->createInstr<CondJump>(loop_cond, if_block, exitBB);
 
     Cmp& v_cmp = if_block->createInstr<Cmp>(CmpOp::Lt, &v_acc, const_10);
-    if_block->createInstr<CondJump>("inner_cond", "then_block", "else_block");
+    if_block->createInstr<CondJump>(inner_cond, then_block, else_block);
 
     BinaryOp& v_then = then_block->createInstr<BinaryOp>(InstrKind::Add, &v_acc, param_b);
-    then_block->createInstr<Jump>("merge");
+    then_block->createInstr<Jump>(merge);
 
     BinaryOp& v_else = else_block->createInstr<BinaryOp>(InstrKind::Mul, &v_acc, const_2);
-    else_block->createInstr<Jump>("merge");
+    else_block->createInstr<Jump>(merge);
 
     Phi& v_merge = merge->createInstr<Phi>();
-    merge->createInstr<Jump>("loop_header");
+    merge->createInstr<Jump>(loop_header);
 
     exitBB->createInstr<Return>(&v_acc);
 
@@ -530,7 +544,294 @@ TEST(LivenessAnalysisTest, LoopWithConditionalLiveness) {
     EXPECT_TRUE(la.isLiveAt(&v_merge, merge_from));
 }
 
+// A parameter read after each of two checks that leave the function is
+// dead in the exit blocks, so its interval has holes wherever the linear
+// order places them.
+//
+//   entry: condjump c, pass0, fail0
+//   fail0: return c
+//   pass0: a = add x, c; condjump a, pass1, fail1
+//   fail1: return c
+//   pass1: b = add x, a; return b
+TEST(LivenessAnalysisTest, IntervalsWithHoles) {
+    Program prog;
+    Function& func = prog.createFunction("checks");
+    Parameter* c = func.createParam("c");
+    Parameter* x = func.createParam("x");
+
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* fail0 = func.createBasicBlock("fail0");
+    BasicBlock* pass0 = func.createBasicBlock("pass0");
+    BasicBlock* fail1 = func.createBasicBlock("fail1");
+    BasicBlock* pass1 = func.createBasicBlock("pass1");
+    entry->createInstr<CondJump>(c, pass0, fail0);
+    fail0->createInstr<Return>(c);
+    BinaryOp& a = pass0->createInstr<BinaryOp>(InstrKind::Add, x, c);
+    pass0->createInstr<CondJump>(&a, pass1, fail1);
+    fail1->createInstr<Return>(c);
+    BinaryOp& b = pass1->createInstr<BinaryOp>(InstrKind::Add, x, &a);
+    pass1->createInstr<Return>(&b);
+
+    CFGAnalysis::buildCFG(func);
+    LivenessAnalysis la;
+    la.build(func);
+
+    const LifetimeInterval* xi = la.getInterval(x);
+    ASSERT_NE(xi, nullptr);
+    const auto& ranges = xi->getLiveRanges();
+    ASSERT_FALSE(ranges.empty());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        EXPECT_LT(ranges[i].from, ranges[i].to);
+        if (i > 0) {
+            EXPECT_LT(ranges[i - 1].to, ranges[i].from);
+        }
+    }
+    EXPECT_EQ(xi->getStart(), la.getBlockFrom(entry));
+    EXPECT_EQ(xi->getEnd(), la.getInstructionId(&b) + 1);
+
+    // Every position agrees with the live sets of its block.
+    for (BasicBlock* bb : la.getLinearOrder()) {
+        bool liveIn = la.isLiveIn(bb, x);
+        EXPECT_EQ(xi->isLiveAt(la.getBlockFrom(bb)), liveIn) << bb->getName();
+        EXPECT_EQ(xi->isLiveAt(la.getBlockTo(bb) - 1), la.isLiveOut(bb, x))
+            << bb->getName();
+    }
+    EXPECT_FALSE(la.isLiveAt(x, la.getBlockFrom(fail0)));
+    EXPECT_FALSE(la.isLiveAt(x, la.getBlockFrom(fail1)));
+    EXPECT_TRUE(la.isLiveAt(x, la.getBlockFrom(pass1)));
+    EXPECT_FALSE(xi->isLiveAt(-1));
+    EXPECT_FALSE(xi->isLiveAt(xi->getEnd()));
+
+    std::vector<UsePosition> expected = {{la.getInstructionId(&a), true},
+                                         {la.getInstructionId(&b), true}};
+    EXPECT_EQ(xi->getUsePositions(), expected);
+    EXPECT_EQ(xi->nextUseAfter(0), la.getInstructionId(&a));
+    EXPECT_EQ(xi->nextUseAfter(la.getInstructionId(&a) + 1), la.getInstructionId(&b));
+    EXPECT_EQ(xi->nextUseAfter(la.getInstructionId(&b) + 1), INT_MAX);
+
+    // a is read by the branch and by b, so it overlaps x until b.
+    const LifetimeInterval* ai = la.getInterval(&a);
+    ASSERT_NE(ai, nullptr);
+    EXPECT_EQ(xi->firstIntersection(*ai), la.getInstructionId(&a));
+    EXPECT_EQ(ai->firstIntersection(*xi), la.getInstructionId(&a));
+    EXPECT_TRUE(xi->intersects(*la.getInterval(&b)));
+    EXPECT_EQ(ai->firstIntersection(*la.getInterval(&b)), la.getInstructionId(&b));
+
+    // Splitting inside a range cuts it; splitting in a hole moves the
+    // ranges after it.
+    EXPECT_EQ(xi->lastUseBefore(la.getInstructionId(&b)), la.getInstructionId(&a));
+    EXPECT_EQ(xi->lastUseBefore(la.getInstructionId(&a)), -1);
+    int afterA = la.getInstructionId(&a) + 1;
+    LifetimeInterval head = *xi;
+    LifetimeInterval tail = head.splitAt(afterA);
+    EXPECT_EQ(tail.value, x);
+    EXPECT_EQ(head.getEnd(), afterA);
+    EXPECT_EQ(tail.getStart(), afterA);
+    EXPECT_EQ(tail.getEnd(), xi->getEnd());
+    EXPECT_EQ(head.getUsePositions(), std::vector<UsePosition>(1, expected[0]));
+    EXPECT_EQ(tail.getUsePositions(), std::vector<UsePosition>(1, expected[1]));
+    EXPECT_EQ(head.getLiveRanges().size() + tail.getLiveRanges().size(), ranges.size() + 1);
+
+    head = *xi;
+    tail = head.splitAt(la.getBlockFrom(fail1));
+    EXPECT_EQ(head.getLiveRanges().size() + tail.getLiveRanges().size(), ranges.size());
+    EXPECT_EQ(tail.getStart(), la.getBlockFrom(pass1));
+    EXPECT_EQ(head.getUsePositions().size(), 1U);
+}
+
+// A value passed to a phi is read by the move at the end of the
+// predecessor, which does not need it in a register.
+//
+//   entry:  jump header
+//   header: i = phi [0, entry], [next, body]
+//           more = cmp lt i, n
+//           condjump more, body, exit
+//   body:   next = add i, 1
+//           jump header
+//   exit:   return i
+TEST(LivenessAnalysisTest, PhiOperandUsePositions) {
+    Program prog;
+    Function& func = prog.createFunction("count");
+    Parameter* n = func.createParam("n");
+
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exitBB = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    Phi& i = header->createInstr<Phi>();
+    Cmp& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exitBB);
+    BinaryOp& next = body->createInstr<BinaryOp>(InstrKind::Add, &i, func.getConstant(1));
+    Instruction& backEdge = body->createInstr<Jump>(header);
+    exitBB->createInstr<Return>(&i);
+    i.addIncoming(entry, func.getConstant(0));
+    i.addIncoming(body, &next);
+
+    CFGAnalysis::buildCFG(func);
+    LivenessAnalysis la;
+    la.build(func);
+
+    const LifetimeInterval* nexti = la.getInterval(&next);
+    ASSERT_NE(nexti, nullptr);
+    int jumpId = la.getInstructionId(&backEdge);
+    std::vector<UsePosition> expected = {{jumpId, false}};
+    EXPECT_EQ(nexti->getUsePositions(), expected);
+    EXPECT_EQ(nexti->nextUseAfter(0), jumpId);
+    EXPECT_EQ(nexti->nextUseAfter(0, true), INT_MAX);
+    EXPECT_EQ(nexti->getEnd(), la.getBlockTo(body));
+
+    const LifetimeInterval* ii = la.getInterval(&i);
+    ASSERT_NE(ii, nullptr);
+    EXPECT_EQ(ii->getStart(), la.getBlockFrom(header));
+    EXPECT_EQ(ii->nextUseAfter(0, true), la.getInstructionId(&more));
+    EXPECT_EQ(ii->firstIntersection(*nexti), la.getInstructionId(&next));
+    EXPECT_FALSE(la.getInterval(&more)->intersects(*nexti));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
+
+// The live sets behind the intervals of SimpleLoopLiveness: phi operands
+// are used on their edge and a phi is defined at the top of its block.
+TEST(DataflowTest, LiveSetsAroundLoop) {
+    Program prog;
+    Function& func = prog.createFunction("live_sets");
+    Parameter* cond = func.createParam("cond");
+    Parameter* param_x = func.createParam("x");
+    Constant* const_1 = func.createConstant(1, "1");
+
+    BasicBlock* entry       = func.createBasicBlock("entry");
+    BasicBlock* loop_header = func.createBasicBlock("loop_header");
+    BasicBlock* loop_body   = func.createBasicBlock("loop_body");
+    BasicBlock* exitBB      = func.createBasicBlock("exit");
+
+    BinaryOp& v1 = entry->createInstr<BinaryOp>(InstrKind::Add, param_x, const_1);
+    entry->createInstr<Jump>(loop_header);
+    Phi& v2 = loop_header->createInstr<Phi>();
+    loop_header->createInstr<CondJump>(cond, loop_body, exitBB);
+    BinaryOp& v3 = loop_body->createInstr<BinaryOp>(InstrKind::Mul, &v2, &v2);
+    loop_body->createInstr<Jump>(loop_header);
+    exitBB->createInstr<Return>(&v2);
+    v2.addIncoming(entry, &v1);
+    v2.addIncoming(loop_body, &v3);
+
+    CFGAnalysis::buildCFG(func);
+    LivenessAnalysis la;
+    la.build(func);
+
+    EXPECT_TRUE(la.isLiveIn(entry, param_x));
+    EXPECT_TRUE(la.isLiveIn(entry, cond));
+    EXPECT_EQ(la.getLiveIn(entry).count(), 2U);
+
+    EXPECT_FALSE(la.isLiveIn(loop_header, &v2));
+    EXPECT_TRUE(la.isLiveOut(loop_header, &v2));
+    EXPECT_TRUE(la.isLiveIn(loop_body, &v2));
+    EXPECT_FALSE(la.isLiveOut(loop_body, &v3));
+    EXPECT_FALSE(la.isLiveOut(entry, &v1));
+    EXPECT_TRUE(la.isLiveOut(loop_body, cond));
+    EXPECT_FALSE(la.getLiveOut(exitBB).any());
+
+    // v1 and v3 only reach the phi along their own block's edge, so the
+    // live sets have no bit for them.
+    EXPECT_EQ(la.getLiveAcrossIndex(&v1), -1);
+    EXPECT_EQ(la.getLiveAcrossIndex(&v3), -1);
+    EXPECT_EQ(la.getLiveAcrossValues().size(), 3U);
+
+    // One loop: a sweep to propagate around the back edge and one to see
+    // that nothing changes any more.
+    EXPECT_LE(la.getDataflowStats().sweeps, 3U);
+    EXPECT_GE(la.getDataflowStats().blockVisits, 4U);
+}
+
+// Null checks available on every path, a forward intersection problem:
+//
+//   entry:  nullcheck p           ─→ header
+//   header: condjump c body exit
+//   body:   nullcheck q           ─→ header (back)
+//   exit:   return p
+TEST(DataflowTest, AvailableChecksIntersectOverLoop) {
+    Program prog;
+    Function& func = prog.createFunction("available_checks");
+    Parameter* p = func.createParam("p");
+    Parameter* q = func.createParam("q");
+    Parameter* c = func.createParam("c");
+
+    BasicBlock* entry  = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body   = func.createBasicBlock("body");
+    BasicBlock* exitBB = func.createBasicBlock("exit");
+
+    entry->createInstr<NullCheck>(p);
+    entry->createInstr<Jump>(header);
+    header->createInstr<CondJump>(c, body, exitBB);
+    body->createInstr<NullCheck>(q);
+    body->createInstr<Jump>(header);
+    exitBB->createInstr<Return>(p);
+
+    CFGAnalysis::buildCFG(func);
+    ReversePostOrder rpo(func);
+    BitVectorDataflow dataflow(func, DataflowDirection::Forward, DataflowMeet::Intersection,
+                               func.getNumValueIds());
+    for (BasicBlock* bb : rpo) {
+        for (auto& instr : bb->getInstructions()) {
+            if (auto* check = dyn_cast<NullCheck>(&instr)) {
+                dataflow.getGen(bb).set(check->getObject()->getId());
+            }
+        }
+    }
+    dataflow.solve(rpo);
+
+    EXPECT_FALSE(dataflow.getIn(entry).any());
+    EXPECT_TRUE(dataflow.getIn(header).test(p->getId()));
+    EXPECT_FALSE(dataflow.getIn(header).test(q->getId()));
+    EXPECT_TRUE(dataflow.getOut(body).test(q->getId()));
+    EXPECT_TRUE(dataflow.getIn(exitBB).test(p->getId()));
+    EXPECT_FALSE(dataflow.getIn(exitBB).test(q->getId()));
+}
+
+// Reaching definitions of a variable stored in several places, a forward
+// union problem. Bits are the stores; each store kills the other stores of
+// the same variable.
+//
+//   entry: def0       ─→ left | right
+//   left:  def1       ─→ join
+//   right:            ─→ join
+//   join:  def2 (of a second variable), return
+TEST(DataflowTest, ReachingDefinitionsUnionOverDiamond) {
+    Program prog;
+    Function& func = prog.createFunction("reaching_defs");
+    Parameter* c = func.createParam("c");
+
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* left  = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    BasicBlock* join  = func.createBasicBlock("join");
+    entry->createInstr<CondJump>(c, left, right);
+    left->createInstr<Jump>(join);
+    right->createInstr<Jump>(join);
+    join->createInstr<Return>(c);
+
+    CFGAnalysis::buildCFG(func);
+    ReversePostOrder rpo(func);
+    enum { Def0, Def1, Def2, NumDefs };
+    BitVectorDataflow dataflow(func, DataflowDirection::Forward, DataflowMeet::Union, NumDefs);
+    dataflow.getGen(entry).set(Def0);
+    dataflow.getKill(entry).set(Def1);
+    dataflow.getGen(left).set(Def1);
+    dataflow.getKill(left).set(Def0);
+    dataflow.getGen(join).set(Def2);
+    dataflow.solve(rpo);
+
+    const BitVector& atJoin = dataflow.getIn(join);
+    EXPECT_TRUE(atJoin.test(Def0));
+    EXPECT_TRUE(atJoin.test(Def1));
+    EXPECT_FALSE(atJoin.test(Def2));
+    EXPECT_FALSE(dataflow.getOut(left).test(Def0));
+    EXPECT_EQ(dataflow.getOut(join).count(), 3U);
+    // Without loops every block sees its final inputs in reverse
+    // post-order, so one sweep settles everything.
+    EXPECT_EQ(dataflow.getStats().sweeps, 1U);
+}
@@ -7,6 +7,14 @@
 #include "checks.h"
 #include "dominated_checks.h"
 #include "static_inliner.h"
+#include "interpreter.h"
+#include "loop_invariant_code_motion.h"
+#include "loop_check_hoisting.h"
+#include "loop_unrolling.h"
+#include "strength_reduction.h"
+#include "analysis_manager.h"
+#include <algorithm>
+#include <limits>
 
 class OptimizationsTest : public ::testing::Test {
 protected:
@@ -24,7 +32,7 @@ protected:
         int count = 0;
         for (const auto& bb : func.getBasicBlocks()) {
             for (const auto& instr : bb->getInstructions()) {
-                if (auto binaryOp = dynamic_cast<BinaryOp*>(instr.get())) {
+                if (auto binaryOp = dyn_cast<BinaryOp>(&instr)) {
                     if (binaryOp->getKind() == kind) {
                         count++;
                     }
@@ -36,7 +44,7 @@ protected:
 
     bool containsConstant(const BasicBlock& bb, int value) {
         for (const auto& instr : bb.getInstructions()) {
-            if (auto constant = dynamic_cast<ConstantInstruction*>(instr.get())) {
+            if (auto constant = dyn_cast<ConstantInstruction>(&instr)) {
                 if (constant->getConstant()->getValue() == value) {
                     return true;
                 }
@@ -49,7 +57,7 @@ protected:
         int count = 0;
         for (const auto& bb : func.getBasicBlocks()) {
             for (const auto& instr : bb->getInstructions()) {
-                if (dynamic_cast<Call*>(instr.get())) {
+                if (dyn_cast<Call>(&instr)) {
                     count++;
                 }
             }
@@ -60,7 +68,7 @@ protected:
     BasicBlock* findBlock(Function& func, const std::string& namePart) {
         for (auto& bb : func.getBasicBlocks()) {
             if (bb->getName().find(namePart) != std::string::npos) {
-                return bb.get();
+                return bb;
             }
         }
         return nullptr;
@@ -70,7 +78,7 @@ protected:
         int count = 0;
         for (const auto& bb : func.getBasicBlocks()) {
             for (const auto& instr : bb->getInstructions()) {
-                if (dynamic_cast<Phi*>(instr.get())) {
+                if (dyn_cast<Phi>(&instr)) {
                     count++;
                 }
             }
@@ -78,11 +86,21 @@ protected:
         return count;
     }
 
+    int countChecksIn(const BasicBlock& bb) {
+        int count = 0;
+        for (const auto& instr : bb.getInstructions()) {
+            if (LoopCheckHoistingPass::isCheck(&instr)) {
+                count++;
+            }
+        }
+        return count;
+    }
+
     int countChecks(const Function& func, InstrKind kind) {
         int count = 0;
         for (const auto& bb : func.getBasicBlocks()) {
             for (const auto& instr : bb->getInstructions()) {
-                if (instr->getKind() == kind) {
+                if (instr.getKind() == kind) {
                     count++;
                 }
             }
@@ -107,6 +125,42 @@ TEST_F(OptimizationsTest, ConstantFoldingMulBasic) {
     EXPECT_TRUE(containsConstant(*bb, 15));
 }
 
+TEST_F(OptimizationsTest, ConstantFoldingAddAndSubWrap) {
+    Function& func = program->createFunction("test_add_sub");
+    BasicBlock* bb = func.createBasicBlock("entry");
+
+    Constant* max = func.createConstant(2147483647, "max");
+    Constant* c1 = func.createConstant(1, "1");
+    Constant* c7 = func.createConstant(7, "7");
+    auto& sum = bb->createInstr<BinaryOp>(InstrKind::Add, max, c1);
+    bb->createInstr<BinaryOp>(InstrKind::Sub, c7, &sum);
+
+    ConstantFoldingPass::runOnFunction(func);
+
+    EXPECT_EQ(countInstructions(func, InstrKind::Add), 0);
+    EXPECT_EQ(countInstructions(func, InstrKind::Sub), 0);
+    EXPECT_TRUE(containsConstant(*bb, -2147483647 - 1));
+    EXPECT_TRUE(containsConstant(*bb, -2147483647 + 6));
+}
+
+TEST_F(OptimizationsTest, ConstantFoldingMulAndShlWrap) {
+    Function& func = program->createFunction("test_mul_shl");
+    BasicBlock* bb = func.createBasicBlock("entry");
+
+    Constant* max = func.createConstant(2147483647, "max");
+    Constant* c3 = func.createConstant(3, "3");
+    Constant* c31 = func.createConstant(31, "31");
+    bb->createInstr<BinaryOp>(InstrKind::Mul, max, c3);
+    bb->createInstr<BinaryOp>(InstrKind::Shl, c3, c31);
+
+    ConstantFoldingPass::runOnFunction(func);
+
+    EXPECT_EQ(countInstructions(func, InstrKind::Mul), 0);
+    EXPECT_EQ(countInstructions(func, InstrKind::Shl), 0);
+    EXPECT_TRUE(containsConstant(*bb, 2147483645));
+    EXPECT_TRUE(containsConstant(*bb, -2147483647 - 1));
+}
+
 TEST_F(OptimizationsTest, ConstantFoldingAndBasic) {
     Function& func = program->createFunction("test_and");
     BasicBlock* bb = func.createBasicBlock("entry");
@@ -446,7 +500,7 @@ TEST_F(OptimizationsTest, DominatedNullCheckAcrossBlocksIsRemoved) {
     BasicBlock* body = func.createBasicBlock("body");
 
     entry->createInstr<NullCheck>(object);
-    entry->createInstr<Jump>("body");
+    entry->createInstr<Jump>(body);
     body->createInstr<NullCheck>(object);
 
     CFGAnalysis::buildCFG(func);
@@ -457,16 +511,17 @@ TEST_F(OptimizationsTest, DominatedNullCheckAcrossBlocksIsRemoved) {
 
 TEST_F(OptimizationsTest, NonDominatingNullCheckIsKept) {
     Function& func = program->createFunction("non_dominating_null");
+    Parameter* cond = func.createParam("cond");
     Parameter* object = func.createParam("obj");
     BasicBlock* entry = func.createBasicBlock("entry");
     BasicBlock* left = func.createBasicBlock("left");
     BasicBlock* right = func.createBasicBlock("right");
     BasicBlock* merge = func.createBasicBlock("merge");
 
-    entry->createInstr<CondJump>("cond", "left", "right");
+    entry->createInstr<CondJump>(cond, left, right);
     left->createInstr<NullCheck>(object);
-    left->createInstr<Jump>("merge");
-    right->createInstr<Jump>("merge");
+    left->createInstr<Jump>(merge);
+    right->createInstr<Jump>(merge);
     merge->createInstr<NullCheck>(object);
 
     CFGAnalysis::buildCFG(func);
@@ -518,10 +573,10 @@ TEST_F(OptimizationsTest, StaticInliningSingleReturnReplacesCallUses) {
     BasicBlock* continuation = findBlock(caller, "cont");
     ASSERT_NE(continuation, nullptr);
     ASSERT_FALSE(continuation->getInstructions().empty());
-    auto* mul = dynamic_cast<BinaryOp*>(continuation->getInstructions().front().get());
+    auto* mul = dyn_cast<BinaryOp>(&continuation->getInstructions().front());
     ASSERT_NE(mul, nullptr);
     EXPECT_EQ(mul->getOperands()[0]->getValueKind(), Value::ValueKind::Instruction);
-    EXPECT_EQ(dynamic_cast<Call*>(mul->getOperands()[0]), nullptr) << "call value should have been replaced";
+    EXPECT_EQ(dyn_cast<Call>(mul->getOperands()[0]), nullptr) << "call value should have been replaced";
 }
 
 TEST_F(OptimizationsTest, StaticInliningMultipleReturnsCreatesPhi) {
@@ -534,9 +589,10 @@ TEST_F(OptimizationsTest, StaticInliningMultipleReturnsCreatesPhi) {
     BasicBlock* left = callee.createBasicBlock("left");
     BasicBlock* right = callee.createBasicBlock("right");
 
-    start->createInstr<Jump>("branch");
+    start->createInstr<Jump>(branch);
     branch->createInstr<BinaryOp>(InstrKind::Add, a, one);
-    branch->createInstr<CondJump>("lecture_condition", "left", "right");
+    auto& lessThan = branch->createInstr<Cmp>(CmpOp::Lt, a, b);
+    branch->createInstr<CondJump>(&lessThan, left, right);
     left->createInstr<Return>(a);
     right->createInstr<Return>(b);
 
@@ -560,11 +616,1102 @@ TEST_F(OptimizationsTest, StaticInliningMultipleReturnsCreatesPhi) {
     BasicBlock* continuation = findBlock(caller, "cont");
     ASSERT_NE(continuation, nullptr);
     ASSERT_GE(continuation->getInstructions().size(), 2U);
-    auto* phi = dynamic_cast<Phi*>(continuation->getInstructions()[0].get());
+    auto* phi = dyn_cast<Phi>(&continuation->getInstructions().front());
     ASSERT_NE(phi, nullptr);
     EXPECT_EQ(phi->getIncoming().size(), 2U);
 
-    auto* mul = dynamic_cast<BinaryOp*>(continuation->getInstructions()[1].get());
+    auto* mul = dyn_cast<BinaryOp>(&*std::next(continuation->getInstructions().begin()));
     ASSERT_NE(mul, nullptr);
     EXPECT_EQ(mul->getOperands()[0], phi);
 }
+
+TEST_F(OptimizationsTest, ConstantFoldingUpdatesUsersInOtherBlocks) {
+    Function& func = program->createFunction("fold_across_blocks");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* next = func.createBasicBlock("next");
+
+    Constant* c2 = func.createConstant(2, "2");
+    Constant* c3 = func.createConstant(3, "3");
+    Constant* c4 = func.createConstant(4, "4");
+
+    auto& product = entry->createInstr<BinaryOp>(InstrKind::Mul, c2, c3);
+    entry->createInstr<Jump>(next);
+    auto& phi = next->createInstr<Phi>();
+    phi.addIncoming(entry, &product);
+    auto& scaled = next->createInstr<BinaryOp>(InstrKind::Mul, &product, c4);
+    auto& ret = next->createInstr<Return>(&scaled);
+
+    ConstantFoldingPass::runOnFunction(func);
+
+    EXPECT_FALSE(product.hasUses());
+    EXPECT_FALSE(scaled.hasUses());
+    EXPECT_EQ(countInstructions(func, InstrKind::Mul), 0);
+    EXPECT_TRUE(containsConstant(*entry, 6));
+    EXPECT_TRUE(containsConstant(*next, 24));
+
+    auto* phiInput = dyn_cast<ConstantInstruction>(phi.getIncomingValue(0));
+    ASSERT_NE(phiInput, nullptr);
+    EXPECT_EQ(phiInput->getConstant()->getValue(), 6);
+    auto* returned = dyn_cast<ConstantInstruction>(ret.getReturnValue());
+    ASSERT_NE(returned, nullptr);
+    EXPECT_EQ(returned->getConstant()->getValue(), 24);
+}
+
+TEST_F(OptimizationsTest, PeepholeRewritesUsersInOtherBlocks) {
+    Function& func = program->createFunction("peephole_across_blocks");
+    Parameter* x = func.createParam("x");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* next = func.createBasicBlock("next");
+
+    auto& identity = entry->createInstr<BinaryOp>(InstrKind::Mul, x, one);
+    entry->createInstr<Jump>(next);
+    auto& ret = next->createInstr<Return>(&identity);
+
+    PeepholePass::runOnFunction(func);
+
+    EXPECT_EQ(countInstructions(func, InstrKind::Mul), 0);
+    EXPECT_EQ(ret.getReturnValue(), x);
+}
+
+TEST_F(OptimizationsTest, ConstantPoolSharesEqualConstants) {
+    Function& func = program->createFunction("pool");
+    Constant* one = func.createConstant(1, "1");
+    Constant* two = func.createConstant(2, "2");
+
+    EXPECT_EQ(func.createConstant(1, "one"), one);
+    EXPECT_EQ(func.getConstant(2), two);
+    EXPECT_NE(one, two);
+    EXPECT_EQ(func.getConstants().size(), 2U);
+    EXPECT_EQ(one->getName(), "1");
+}
+
+TEST_F(OptimizationsTest, PeepholeShiftReusesPooledConstant) {
+    Function& func = program->createFunction("mul_to_shift");
+    Parameter* x = func.createParam("x");
+    Parameter* y = func.createParam("y");
+    Constant* eight = func.createConstant(8, "8");
+    Constant* three = func.createConstant(3, "3");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    entry->createInstr<BinaryOp>(InstrKind::Mul, x, eight);
+    entry->createInstr<BinaryOp>(InstrKind::Mul, y, eight);
+
+    PeepholePass::runOnFunction(func);
+
+    EXPECT_EQ(countInstructions(func, InstrKind::Shl), 2);
+    EXPECT_EQ(func.getConstants().size(), 2U);
+    for (auto& instr : entry->getInstructions()) {
+        EXPECT_EQ(instr.getOperand(1), three);
+    }
+}
+
+TEST_F(OptimizationsTest, RepeatedInliningDoesNotGrowCallerConstants) {
+    Function& callee = program->createFunction("scale");
+    Parameter* x = callee.createParam("x");
+    Constant* three = callee.createConstant(3, "3");
+    Constant* seven = callee.createConstant(7, "7");
+    BasicBlock* calleeEntry = callee.createBasicBlock("entry");
+    auto& product = calleeEntry->createInstr<BinaryOp>(InstrKind::Mul, x, three);
+    auto& sum = calleeEntry->createInstr<BinaryOp>(InstrKind::Add, &product, seven);
+    calleeEntry->createInstr<Return>(&sum);
+
+    Function& caller = program->createFunction("caller");
+    Value* value = caller.createParam("y");
+    BasicBlock* entry = caller.createBasicBlock("entry");
+    for (int i = 0; i < 50; ++i) {
+        value = &entry->createInstr<Call>(&callee, std::vector<Value*>{value});
+    }
+    entry->createInstr<Return>(value);
+
+    StaticInlinerPass::Config config;
+    config.runLocalOptimizations = false;
+    config.maxTotalInstructions = 1000;
+    ASSERT_TRUE(StaticInlinerPass::runOnFunction(caller, config));
+
+    EXPECT_EQ(countCalls(caller), 0);
+    EXPECT_EQ(caller.getConstants().size(), 2U);
+    Constant* callerThree = caller.getConstant(3);
+    EXPECT_EQ(callerThree->getNumUses(), 50U);
+    EXPECT_EQ(caller.getConstants().size(), 2U);
+}
+
+TEST_F(OptimizationsTest, BranchFoldingRemovesUntakenArm) {
+    Function& func = program->createFunction("fold_branch");
+    Constant* one = func.createConstant(1, "1");
+    Constant* two = func.createConstant(2, "2");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* thenBlock = func.createBasicBlock("then");
+    BasicBlock* elseBlock = func.createBasicBlock("else");
+    BasicBlock* merge = func.createBasicBlock("merge");
+
+    auto& less = entry->createInstr<Cmp>(CmpOp::Lt, one, two);
+    entry->createInstr<CondJump>(&less, elseBlock, thenBlock);
+    thenBlock->createInstr<Jump>(merge);
+    elseBlock->createInstr<Jump>(merge);
+    auto& phi = merge->createInstr<Phi>();
+    phi.addIncoming(thenBlock, one);
+    phi.addIncoming(elseBlock, two);
+    merge->createInstr<Return>(&phi);
+
+    ASSERT_TRUE(BranchFoldingPass::runOnFunction(func));
+
+    ASSERT_EQ(func.getBasicBlocks().size(), 3U);
+    EXPECT_EQ(findBlock(func, "then"), nullptr);
+    EXPECT_EQ(countChecks(func, InstrKind::Cmp), 0);
+    auto* jump = dyn_cast<Jump>(entry->getTerminator());
+    ASSERT_NE(jump, nullptr);
+    EXPECT_EQ(jump->getTarget(), elseBlock);
+    ASSERT_EQ(phi.getNumIncoming(), 1U);
+    EXPECT_EQ(phi.getIncomingBlock(0), elseBlock);
+    EXPECT_EQ(phi.getIncomingValue(0), two);
+    EXPECT_EQ(one->getNumUses(), 0U);
+    EXPECT_EQ(merge->getPredecessors().size(), 1U);
+}
+
+TEST_F(OptimizationsTest, BranchFoldingKeepsUnknownCondition) {
+    Function& func = program->createFunction("keep_branch");
+    Parameter* x = func.createParam("x");
+    Constant* zero = func.createConstant(0, "0");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* positive = func.createBasicBlock("positive");
+    BasicBlock* other = func.createBasicBlock("other");
+
+    auto& greater = entry->createInstr<Cmp>(CmpOp::Gt, x, zero);
+    entry->createInstr<CondJump>(&greater, positive, other);
+    positive->createInstr<Return>(x);
+    other->createInstr<Return>(zero);
+
+    EXPECT_FALSE(BranchFoldingPass::runOnFunction(func));
+    EXPECT_EQ(func.getBasicBlocks().size(), 3U);
+    EXPECT_NE(dyn_cast<CondJump>(entry->getTerminator()), nullptr);
+}
+
+TEST_F(OptimizationsTest, StaticInliningFoldsConstantGuard) {
+    Function& callee = program->createFunction("clamp_small");
+    Parameter* n = callee.createParam("n");
+    Constant* ten = callee.createConstant(10, "10");
+    BasicBlock* calleeEntry = callee.createBasicBlock("entry");
+    BasicBlock* small = callee.createBasicBlock("small");
+    BasicBlock* large = callee.createBasicBlock("large");
+    auto& less = calleeEntry->createInstr<Cmp>(CmpOp::Lt, n, ten);
+    calleeEntry->createInstr<CondJump>(&less, small, large);
+    small->createInstr<Return>(n);
+    auto& scaled = large->createInstr<BinaryOp>(InstrKind::Mul, n, ten);
+    large->createInstr<Return>(&scaled);
+
+    Function& caller = program->createFunction("caller");
+    Constant* three = caller.createConstant(3, "3");
+    BasicBlock* entry = caller.createBasicBlock("entry");
+    auto& call = entry->createInstr<Call>(&callee, std::vector<Value*>{three});
+    entry->createInstr<Return>(&call);
+
+    ASSERT_TRUE(StaticInlinerPass::runOnFunction(caller));
+
+    EXPECT_EQ(countCalls(caller), 0);
+    EXPECT_EQ(findBlock(caller, "large"), nullptr);
+    EXPECT_NE(findBlock(caller, "small"), nullptr);
+    EXPECT_EQ(countChecks(caller, InstrKind::Cmp), 0);
+    EXPECT_EQ(countInstructions(caller, InstrKind::Mul), 0);
+    for (const auto& bb : caller.getBasicBlocks()) {
+        EXPECT_EQ(dyn_cast<CondJump>(bb->getTerminator()), nullptr);
+    }
+}
+
+TEST_F(OptimizationsTest, StaticInliningRetargetsSuccessorPhis) {
+    Function& callee = program->createFunction("twice");
+    Parameter* x = callee.createParam("x");
+    BasicBlock* calleeEntry = callee.createBasicBlock("entry");
+    BasicBlock* calleeDead = callee.createBasicBlock("never");
+    auto& doubled = calleeEntry->createInstr<BinaryOp>(InstrKind::Add, x, x);
+    calleeEntry->createInstr<Return>(&doubled);
+    calleeDead->createInstr<Return>(x);
+
+    Function& caller = program->createFunction("caller");
+    Parameter* c = caller.createParam("c");
+    Parameter* y = caller.createParam("y");
+    BasicBlock* entry = caller.createBasicBlock("entry");
+    BasicBlock* callSite = caller.createBasicBlock("call_site");
+    BasicBlock* other = caller.createBasicBlock("other");
+    BasicBlock* merge = caller.createBasicBlock("merge");
+    entry->createInstr<CondJump>(c, callSite, other);
+    auto& call = callSite->createInstr<Call>(&callee, std::vector<Value*>{y});
+    callSite->createInstr<Jump>(merge);
+    other->createInstr<Jump>(merge);
+    auto& phi = merge->createInstr<Phi>();
+    phi.addIncoming(callSite, &call);
+    phi.addIncoming(other, y);
+    merge->createInstr<Return>(&phi);
+
+    StaticInlinerPass::Config config;
+    config.runLocalOptimizations = false;
+    ASSERT_TRUE(StaticInlinerPass::runOnFunction(caller, config));
+
+    // The phi now hears from the continuation, which holds the old jump.
+    BasicBlock* continuation = findBlock(caller, "cont");
+    ASSERT_NE(continuation, nullptr);
+    ASSERT_EQ(phi.getNumIncoming(), 2U);
+    EXPECT_EQ(phi.getIncomingBlock(0), continuation);
+    auto* inlinedSum = dyn_cast<BinaryOp>(phi.getIncomingValue(0));
+    ASSERT_NE(inlinedSum, nullptr);
+    EXPECT_NE(inlinedSum, &doubled);
+    EXPECT_EQ(inlinedSum->getParent()->getParent(), &caller);
+    EXPECT_EQ(countInstructions(caller, InstrKind::Add), 1);
+    // Only callee blocks reachable from its entry are cloned.
+    EXPECT_EQ(findBlock(caller, "never"), nullptr);
+
+    // The edges kept up to date during inlining match a rebuild.
+    std::vector<std::vector<BasicBlock*>> successors;
+    for (auto& bb : caller.getBasicBlocks()) {
+        successors.emplace_back(bb->getSuccessors().begin(), bb->getSuccessors().end());
+    }
+    CFGAnalysis::buildCFG(caller);
+    for (size_t i = 0; i < caller.getBasicBlocks().size(); ++i) {
+        const auto& rebuilt = caller.getBasicBlocks()[i]->getSuccessors();
+        EXPECT_EQ(successors[i], std::vector<BasicBlock*>(rebuilt.begin(), rebuilt.end()));
+    }
+}
+
+// The callee's header phis read their back-edge values from a block that
+// is cloned after the header.
+TEST_F(OptimizationsTest, StaticInliningClonesCalleeLoop) {
+    // sum = 0; for (i = 0; i < n; ++i) sum += i; return sum
+    Function& callee = program->createFunction("sum");
+    Parameter* n = callee.createParam("n");
+    Constant* zero = callee.createConstant(0, "0");
+    Constant* one = callee.createConstant(1, "1");
+    BasicBlock* calleeEntry = callee.createBasicBlock("entry");
+    BasicBlock* header = callee.createBasicBlock("header");
+    BasicBlock* exit = callee.createBasicBlock("exit");
+    BasicBlock* body = callee.createBasicBlock("body");
+    calleeEntry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    exit->createInstr<Return>(&sum);
+    auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &i);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    body->createInstr<Jump>(header);
+    i.addIncoming(calleeEntry, zero);
+    i.addIncoming(body, &nextI);
+    sum.addIncoming(calleeEntry, zero);
+    sum.addIncoming(body, &nextSum);
+
+    Function& caller = program->createFunction("caller");
+    Parameter* m = caller.createParam("m");
+    Constant* three = caller.createConstant(3, "3");
+    BasicBlock* entry = caller.createBasicBlock("entry");
+    auto& call = entry->createInstr<Call>(&callee, std::vector<Value*>{m});
+    auto& result = entry->createInstr<BinaryOp>(InstrKind::Mul, &call, three);
+    entry->createInstr<Return>(&result);
+
+    std::vector<int> counts = {0, 1, 10, 100};
+    std::vector<Interpreter::Result> before;
+    for (int count : counts) {
+        before.push_back(Interpreter::run(caller, {count}));
+    }
+
+    ASSERT_TRUE(StaticInlinerPass::runOnFunction(caller));
+    EXPECT_EQ(countCalls(caller), 0);
+    for (auto& bb : caller.getBasicBlocks()) {
+        for (auto& instr : bb->getInstructions()) {
+            for (size_t k = 0; k < instr.getNumOperands(); ++k) {
+                auto* def = dyn_cast<Instruction>(instr.getOperand(k));
+                EXPECT_TRUE(!def || def->getParent()->getParent() == &caller) << "operand from the callee";
+            }
+        }
+    }
+
+    for (size_t c = 0; c < counts.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(caller, {counts[c]});
+        ASSERT_TRUE(after.ok()) << "count " << counts[c];
+        EXPECT_EQ(after.value, before[c].value) << "count " << counts[c];
+        EXPECT_LT(after.calls, before[c].calls);
+    }
+}
+
+TEST_F(OptimizationsTest, AnalysisManagerReusesUntilInvalidated) {
+    Function& func = program->createFunction("cached_loop");
+    Parameter* n = func.createParam("n");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& more = header->createInstr<Cmp>(CmpOp::Gt, n, one);
+    header->createInstr<CondJump>(&more, body, exit);
+    body->createInstr<BinaryOp>(InstrKind::Mul, n, one);
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(n);
+
+    FunctionAnalysisManager analyses(func);
+    const LivenessAnalysis& liveness = analyses.getLiveness();
+    EXPECT_EQ(liveness.getLinearOrder().size(), 4U);
+    const AnalysisStats& stats = analyses.getStats();
+    EXPECT_EQ(stats.getComputed(AnalysisKind::CFG), 1U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::DominatorTree), 1U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::Loops), 1U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::ReversePostOrder), 1U);
+    // Liveness takes the loops and the order from the cache as well.
+    EXPECT_EQ(stats.getReused(AnalysisKind::CFG), 1U);
+    EXPECT_EQ(analyses.getLoopInfo().size(), 1U);
+    EXPECT_GT(liveness.getDataflowStats().blockVisits, 0U);
+
+    // The multiply by one goes away; only liveness has to be redone.
+    ASSERT_TRUE(PeepholePass::runOnFunction(func, analyses));
+    analyses.getLiveness();
+    EXPECT_EQ(stats.getComputed(AnalysisKind::Liveness), 2U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::LinearOrder), 1U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::ReversePostOrder), 1U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::DominatorTree), 1U);
+
+    analyses.invalidateAll();
+    analyses.getDominatorTree();
+    EXPECT_EQ(stats.getComputed(AnalysisKind::CFG), 2U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::DominatorTree), 2U);
+}
+
+TEST_F(OptimizationsTest, StandardPipelineSharesAnalyses) {
+    for (const char* name : {"first", "second"}) {
+        Function& func = program->createFunction(name);
+        Parameter* p = func.createParam("p");
+        Constant* zero = func.createConstant(0, "0");
+        BasicBlock* entry = func.createBasicBlock("entry");
+        BasicBlock* next = func.createBasicBlock("next");
+        entry->createInstr<NullCheck>(p);
+        auto& product = entry->createInstr<BinaryOp>(InstrKind::Mul, p, zero);
+        entry->createInstr<Jump>(next);
+        next->createInstr<NullCheck>(p);
+        next->createInstr<Return>(&product);
+    }
+
+    program->runOptimizations();
+
+    const AnalysisStats& stats = program->getAnalysisStats();
+    EXPECT_EQ(stats.getComputed(AnalysisKind::CFG), 2U);
+    EXPECT_EQ(stats.getReused(AnalysisKind::CFG), 2U);
+    EXPECT_EQ(stats.getComputed(AnalysisKind::DominatorTree), 2U);
+    for (auto& func : program->getFunctions()) {
+        EXPECT_EQ(countChecks(*func, InstrKind::NullCheck), 1);
+    }
+}
+
+TEST_F(OptimizationsTest, InterpreterCountsLoopIterations) {
+    // sum = 0; for (i = 0; i < n; ++i) sum += i; return sum
+    Function& func = program->createFunction("sum");
+    Parameter* n = func.createParam("n");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &i);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    body->createInstr<Jump>(header);
+    exit->createInstr<NullCheck>(n);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, zero);
+    i.addIncoming(body, &nextI);
+    sum.addIncoming(entry, zero);
+    sum.addIncoming(body, &nextSum);
+
+    Interpreter::Result result = Interpreter::run(func, {10});
+    ASSERT_TRUE(result.ok());
+    EXPECT_EQ(result.value, 45);
+    // entry 1, header 4 x 11, body 3 x 10, exit 2
+    EXPECT_EQ(result.instructions, 77U);
+    EXPECT_EQ(result.blocks, 23U);
+    EXPECT_EQ(result.checks, 1U);
+
+    EXPECT_EQ(Interpreter::run(func, {0}).status, Interpreter::Status::Trapped);
+    EXPECT_EQ(Interpreter::run(func, {1000}, 100).status, Interpreter::Status::StepLimit);
+}
+
+TEST_F(OptimizationsTest, InterpreterShiftsOutOfRangeToZero) {
+    // return (x >> n) + (x << n) + (x >> 32)
+    Function& func = program->createFunction("shifts");
+    Parameter* x = func.createParam("x");
+    Parameter* n = func.createParam("n");
+    Constant* thirtyTwo = func.createConstant(32, "32");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    auto& right = entry->createInstr<BinaryOp>(InstrKind::Shr, x, n);
+    auto& left = entry->createInstr<BinaryOp>(InstrKind::Shl, x, n);
+    auto& wide = entry->createInstr<BinaryOp>(InstrKind::Shr, x, thirtyTwo);
+    auto& partial = entry->createInstr<BinaryOp>(InstrKind::Add, &right, &left);
+    auto& sum = entry->createInstr<BinaryOp>(InstrKind::Add, &partial, &wide);
+    entry->createInstr<Return>(&sum);
+
+    EXPECT_EQ(Interpreter::run(func, {-1, 32}).value, 0);
+    EXPECT_EQ(Interpreter::run(func, {-1, 40}).value, 0);
+    EXPECT_EQ(Interpreter::run(func, {-1, -1}).value, 0);
+    EXPECT_EQ(Interpreter::run(func, {12, 2}).value, 3 + 48);
+
+    // The peephole rewrites the shift by 32 to 0; the result must not move.
+    std::vector<std::vector<int>> cases = {{-1, 32}, {7, 31}, {12, 2}};
+    std::vector<int> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args).value);
+    }
+    PeepholePass::runOnFunction(func);
+    for (size_t c = 0; c < cases.size(); ++c) {
+        EXPECT_EQ(Interpreter::run(func, cases[c]).value, before[c]) << "case " << c;
+    }
+}
+
+// Invariant arithmetic in an inner loop that has no preheader of its own
+// around it: the outer loop is entered straight from a conditional branch.
+//
+//   entry:  if (n > 0) outer else exit
+//   outer:  i, acc phis; jump inner
+//   inner:  j, sum phis; pq = p * q; k = 7; base = pq + k; t = base + j;
+//           sum' = sum + t; j' = j + 1; if (j' < m) inner else latch
+//   latch:  i' = i + 1; if (i' < n) outer else exit
+//   exit:   return phi [0, entry], [sum', latch]
+TEST_F(OptimizationsTest, LoopInvariantCodeMotionHoistsOutOfNestedLoops) {
+    Function& func = program->createFunction("nested");
+    Parameter* n = func.createParam("n");
+    Parameter* m = func.createParam("m");
+    Parameter* p = func.createParam("p");
+    Parameter* q = func.createParam("q");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* outer = func.createBasicBlock("outer");
+    BasicBlock* inner = func.createBasicBlock("inner");
+    BasicBlock* latch = func.createBasicBlock("latch");
+    BasicBlock* exit = func.createBasicBlock("exit");
+
+    auto& any = entry->createInstr<Cmp>(CmpOp::Gt, n, zero);
+    entry->createInstr<CondJump>(&any, outer, exit);
+    auto& i = outer->createInstr<Phi>();
+    auto& acc = outer->createInstr<Phi>();
+    outer->createInstr<Jump>(inner);
+    auto& j = inner->createInstr<Phi>();
+    auto& sum = inner->createInstr<Phi>();
+    auto& pq = inner->createInstr<BinaryOp>(InstrKind::Mul, p, q);
+    auto& k = inner->createInstr<ConstantInstruction>(func.getConstant(7));
+    auto& base = inner->createInstr<BinaryOp>(InstrKind::Add, &pq, &k);
+    auto& t = inner->createInstr<BinaryOp>(InstrKind::Add, &base, &j);
+    auto& nextSum = inner->createInstr<BinaryOp>(InstrKind::Add, &sum, &t);
+    auto& nextJ = inner->createInstr<BinaryOp>(InstrKind::Add, &j, one);
+    auto& moreJ = inner->createInstr<Cmp>(CmpOp::Lt, &nextJ, m);
+    inner->createInstr<CondJump>(&moreJ, inner, latch);
+    auto& nextI = latch->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    auto& moreI = latch->createInstr<Cmp>(CmpOp::Lt, &nextI, n);
+    latch->createInstr<CondJump>(&moreI, outer, exit);
+    auto& result = exit->createInstr<Phi>();
+    exit->createInstr<Return>(&result);
+    i.addIncoming(entry, zero);
+    i.addIncoming(latch, &nextI);
+    acc.addIncoming(entry, zero);
+    acc.addIncoming(latch, &nextSum);
+    j.addIncoming(outer, zero);
+    j.addIncoming(inner, &nextJ);
+    sum.addIncoming(outer, &acc);
+    sum.addIncoming(inner, &nextSum);
+    result.addIncoming(entry, zero);
+    result.addIncoming(latch, &nextSum);
+    CFGAnalysis::buildCFG(func);
+
+    Interpreter::Result before = Interpreter::run(func, {10, 20, 3, 4});
+    ASSERT_TRUE(before.ok());
+
+    FunctionAnalysisManager analyses(func);
+    ASSERT_TRUE(LoopInvariantCodeMotionPass::runOnFunction(func, analyses));
+
+    // The outer loop got a preheader between entry and outer; the whole
+    // invariant chain ended up there, not just in the inner preheader.
+    const LoopInfo& loopInfo = analyses.getLoopInfo();
+    Loop* outerLoop = loopInfo.getLoopFor(outer);
+    ASSERT_NE(outerLoop, nullptr);
+    BasicBlock* preheader = outerLoop->preheader;
+    ASSERT_NE(preheader, nullptr);
+    EXPECT_EQ(preheader->getPredecessors().size(), 1U);
+    EXPECT_EQ(preheader->getPredecessors()[0], entry);
+    EXPECT_EQ(pq.getParent(), preheader);
+    EXPECT_EQ(k.getParent(), preheader);
+    EXPECT_EQ(base.getParent(), preheader);
+    EXPECT_EQ(t.getParent(), inner);
+    EXPECT_EQ(moreJ.getParent(), inner);
+    EXPECT_EQ(i.getIncomingBlock(0), preheader);
+    EXPECT_EQ(loopInfo.getLoopFor(inner)->preheader, outer);
+    EXPECT_TRUE(analyses.getDominatorTree().verify(func));
+
+    Interpreter::Result after = Interpreter::run(func, {10, 20, 3, 4});
+    ASSERT_TRUE(after.ok());
+    EXPECT_EQ(after.value, before.value);
+    // Three instructions per inner iteration, less the preheader's jump
+    // and the three hoisted instructions run once.
+    EXPECT_EQ(before.instructions - after.instructions, 3U * 200 - 4);
+
+    EXPECT_FALSE(LoopInvariantCodeMotionPass::runOnFunction(func, analyses));
+}
+
+TEST_F(OptimizationsTest, PreheaderMergesPhiEntriesFromSeveralEdges) {
+    Function& func = program->createFunction("two_entries");
+    Parameter* c = func.createParam("c");
+    Parameter* n = func.createParam("n");
+    Constant* one = func.createConstant(1, "1");
+    Constant* two = func.createConstant(2, "2");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* left = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<CondJump>(c, left, right);
+    left->createInstr<Jump>(header);
+    right->createInstr<Jump>(header);
+    auto& x = header->createInstr<Phi>();
+    auto& scaled = header->createInstr<BinaryOp>(InstrKind::Mul, n, two);
+    auto& nextX = header->createInstr<BinaryOp>(InstrKind::Add, &x, &scaled);
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &nextX, n);
+    header->createInstr<CondJump>(&more, header, exit);
+    exit->createInstr<Return>(&nextX);
+    x.addIncoming(left, one);
+    x.addIncoming(right, two);
+    x.addIncoming(header, &nextX);
+    CFGAnalysis::buildCFG(func);
+
+    std::vector<int> results;
+    for (int cond : {0, 1}) {
+        results.push_back(Interpreter::run(func, {cond, 100}).value);
+    }
+
+    ASSERT_TRUE(LoopInvariantCodeMotionPass::runOnFunction(func));
+    BasicBlock* preheader = scaled.getParent();
+    ASSERT_NE(preheader, header);
+    EXPECT_EQ(preheader->getPredecessors().size(), 2U);
+    ASSERT_EQ(x.getNumIncoming(), 2U);
+    auto* merged = dyn_cast<Phi>(&preheader->getInstructions().front());
+    ASSERT_NE(merged, nullptr);
+    EXPECT_EQ(merged->getNumIncoming(), 2U);
+
+    for (int cond : {0, 1}) {
+        EXPECT_EQ(Interpreter::run(func, {cond, 100}).value, results[cond]);
+    }
+}
+
+TEST_F(OptimizationsTest, LoopCheckHoistingGuardsCountedLoop) {
+    Function& func = program->createFunction("sum_array");
+    Parameter* a = func.createParam("a");
+    Parameter* n = func.createParam("n");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    body->createInstr<NullCheck>(a);
+    body->createInstr<BoundsCheck>(a, &i);
+    auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &i);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, zero);
+    i.addIncoming(body, &nextI);
+    sum.addIncoming(entry, zero);
+    sum.addIncoming(body, &nextSum);
+    CFGAnalysis::buildCFG(func);
+
+    // {length, count}: in bounds, running past the end, a null array the
+    // loop never touches, and a null array it does.
+    const std::vector<std::vector<int>> cases = {{10, 10}, {5, 10}, {0, 0}, {0, 3}};
+    std::vector<Interpreter::Result> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args));
+    }
+    EXPECT_EQ(before[0].checks, 20U);
+    EXPECT_FALSE(before[1].ok());
+    EXPECT_TRUE(before[2].ok());
+
+    FunctionAnalysisManager analyses(func);
+    ASSERT_TRUE(LoopCheckHoistingPass::runOnFunction(func, analyses));
+    EXPECT_EQ(countChecks(func, InstrKind::BoundsCheck), 0);
+    EXPECT_EQ(countChecks(func, InstrKind::RangeCheck), 1);
+    for (const auto& instr : body->getInstructions()) {
+        EXPECT_FALSE(LoopCheckHoistingPass::isCheck(&instr));
+    }
+
+    // Both checks wait in a guard that only runs when the loop does; the
+    // loop keeps a preheader behind it.
+    BasicBlock* guard = findBlock(func, "header.guard");
+    ASSERT_NE(guard, nullptr);
+    EXPECT_EQ(countChecksIn(*guard), 2);
+    const LoopInfo& loopInfo = analyses.getLoopInfo();
+    Loop* loop = loopInfo.getLoopFor(header);
+    ASSERT_NE(loop->preheader, nullptr);
+    EXPECT_EQ(loop->preheader->getName(), "header.entry");
+    EXPECT_EQ(analyses.getStats().getComputed(AnalysisKind::Loops), 1U);
+    EXPECT_TRUE(analyses.getDominatorTree().verify(func));
+
+    for (size_t c = 0; c < cases.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, cases[c]);
+        EXPECT_EQ(after.status, before[c].status);
+        EXPECT_EQ(after.value, before[c].value);
+    }
+    EXPECT_EQ(Interpreter::run(func, cases[0]).checks, 2U);
+    EXPECT_EQ(Interpreter::run(func, cases[2]).checks, 0U);
+}
+
+// The guard and the new preheader of an inner loop join the blocks of the
+// outer one in reverse post-order, as a fresh LoopInfo would list them.
+TEST_F(OptimizationsTest, LoopCheckHoistingKeepsOuterLoopOrder) {
+    Function& func = program->createFunction("rows");
+    Parameter* a = func.createParam("a");
+    Parameter* n = func.createParam("n");
+    Parameter* m = func.createParam("m");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* outer = func.createBasicBlock("outer");
+    BasicBlock* row = func.createBasicBlock("row");
+    BasicBlock* inner = func.createBasicBlock("inner");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* latch = func.createBasicBlock("latch");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(outer);
+    auto& j = outer->createInstr<Phi>();
+    auto& moreJ = outer->createInstr<Cmp>(CmpOp::Lt, &j, m);
+    outer->createInstr<CondJump>(&moreJ, row, exit);
+    row->createInstr<Jump>(inner);
+    auto& i = inner->createInstr<Phi>();
+    auto& moreI = inner->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    inner->createInstr<CondJump>(&moreI, body, latch);
+    body->createInstr<BoundsCheck>(a, &i);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    body->createInstr<Jump>(inner);
+    auto& nextJ = latch->createInstr<BinaryOp>(InstrKind::Add, &j, one);
+    latch->createInstr<Jump>(outer);
+    exit->createInstr<Return>(&j);
+    j.addIncoming(entry, zero);
+    j.addIncoming(latch, &nextJ);
+    i.addIncoming(row, zero);
+    i.addIncoming(body, &nextI);
+    CFGAnalysis::buildCFG(func);
+
+    FunctionAnalysisManager analyses(func);
+    ASSERT_TRUE(LoopCheckHoistingPass::runOnFunction(func, analyses));
+    ASSERT_NE(findBlock(func, "inner.guard"), nullptr);
+    const LoopInfo& loopInfo = analyses.getLoopInfo();
+    EXPECT_EQ(analyses.getStats().getComputed(AnalysisKind::Loops), 1U);
+    Loop* loop = loopInfo.getLoopFor(outer);
+    const std::vector<BasicBlock*>& blocks = loop->blocks;
+    ASSERT_EQ(blocks.size(), 7U);
+    EXPECT_EQ(blocks.front(), outer);
+    for (size_t k = 1; k < blocks.size(); ++k) {
+        for (BasicBlock* pred : blocks[k]->getPredecessors()) {
+            if (loopInfo.isBackEdge(pred, blocks[k])) {
+                continue;
+            }
+            auto at = std::find(blocks.begin(), blocks.end(), pred);
+            ASSERT_NE(at, blocks.end()) << pred->getName();
+            EXPECT_LT(static_cast<size_t>(at - blocks.begin()), k)
+                << pred->getName() << " after " << blocks[k]->getName();
+        }
+    }
+    EXPECT_EQ(Interpreter::run(func, {4, 4, 3}).value, 3);
+}
+
+TEST_F(OptimizationsTest, LoopCheckHoistingKeepsChecksThatMightNotRun) {
+    Function& func = program->createFunction("search");
+    Parameter* a = func.createParam("a");
+    Parameter* b = func.createParam("b");
+    Parameter* n = func.createParam("n");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    Constant* three = func.createConstant(3, "3");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* odd = func.createBasicBlock("odd");
+    BasicBlock* latch = func.createBasicBlock("latch");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    header->createInstr<NullCheck>(a);
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    // The bounds check only runs on odd i, and i == 3 leaves early: neither
+    // check may move. The null check in the header runs before every exit.
+    auto& bit = body->createInstr<BinaryOp>(InstrKind::And, &i, one);
+    body->createInstr<CondJump>(&bit, odd, latch);
+    odd->createInstr<BoundsCheck>(b, &i);
+    auto& found = odd->createInstr<Cmp>(CmpOp::Eq, &i, three);
+    odd->createInstr<CondJump>(&found, exit, latch);
+    auto& nextI = latch->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    latch->createInstr<Jump>(header);
+    exit->createInstr<Return>(&i);
+    i.addIncoming(entry, zero);
+    i.addIncoming(latch, &nextI);
+    CFGAnalysis::buildCFG(func);
+
+    const std::vector<std::vector<int>> cases = {{1, 4, 10}, {1, 3, 10}, {0, 4, 0}, {1, 0, 1}};
+    std::vector<Interpreter::Result> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args));
+    }
+
+    ASSERT_TRUE(LoopCheckHoistingPass::runOnFunction(func));
+    EXPECT_EQ(countChecksIn(*header), 0);
+    EXPECT_EQ(countChecksIn(*entry), 1);
+    EXPECT_EQ(countChecksIn(*odd), 1);
+    EXPECT_EQ(findBlock(func, "guard"), nullptr);
+
+    for (size_t c = 0; c < cases.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, cases[c]);
+        EXPECT_EQ(after.status, before[c].status);
+        EXPECT_EQ(after.value, before[c].value);
+    }
+}
+
+// The bounds check dominates the only exit, but the header may skip it
+// and go round the loop forever: it must not move to the preheader.
+TEST_F(OptimizationsTest, LoopCheckHoistingKeepsChecksSkippedOnFirstIteration) {
+    Function& func = program->createFunction("maybe_never");
+    Parameter* len = func.createParam("len");
+    Parameter* go = func.createParam("go");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    Constant* three = func.createConstant(3, "3");
+    Constant* five = func.createConstant(5, "5");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("h");
+    BasicBlock* checked = func.createBasicBlock("a");
+    BasicBlock* latch = func.createBasicBlock("l");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& going = header->createInstr<Cmp>(CmpOp::Ne, go, zero);
+    header->createInstr<CondJump>(&going, checked, latch);
+    checked->createInstr<BoundsCheck>(len, five);
+    auto& done = checked->createInstr<Cmp>(CmpOp::Gt, &i, three);
+    checked->createInstr<CondJump>(&done, exit, latch);
+    auto& nextI = latch->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    latch->createInstr<Jump>(header);
+    exit->createInstr<Return>(&i);
+    i.addIncoming(entry, zero);
+    i.addIncoming(latch, &nextI);
+    CFGAnalysis::buildCFG(func);
+
+    // {len, go}: never leaving, leaving after the check passes, and
+    // trapping in the loop.
+    const std::vector<std::vector<int>> cases = {{0, 0}, {10, 1}, {0, 1}};
+    std::vector<Interpreter::Result> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args, 1000));
+    }
+    EXPECT_EQ(before[0].status, Interpreter::Status::StepLimit);
+
+    LoopCheckHoistingPass::runOnFunction(func);
+    EXPECT_EQ(countChecksIn(*checked), 1);
+    EXPECT_EQ(countChecksIn(*entry), 0);
+
+    for (size_t c = 0; c < cases.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, cases[c], 1000);
+        EXPECT_EQ(after.status, before[c].status) << "case " << c;
+        EXPECT_EQ(after.value, before[c].value) << "case " << c;
+    }
+}
+
+TEST_F(OptimizationsTest, StrengthReductionReplacesProductsAndDuplicates) {
+    Function& func = program->createFunction("scaled_sum");
+    Parameter* n = func.createParam("n");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    // j repeats i, and w counts by fives for nobody.
+    auto& i = header->createInstr<Phi>();
+    auto& j = header->createInstr<Phi>();
+    auto& w = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& i12 = body->createInstr<BinaryOp>(InstrKind::Mul, &i, func.getConstant(12));
+    auto& j8 = body->createInstr<BinaryOp>(InstrKind::Shl, &j, func.getConstant(3));
+    auto& j12 = body->createInstr<BinaryOp>(InstrKind::Mul, func.getConstant(12), &j);
+    auto& s1 = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &i12);
+    auto& s2 = body->createInstr<BinaryOp>(InstrKind::Add, &s1, &j8);
+    auto& s3 = body->createInstr<BinaryOp>(InstrKind::Add, &s2, &j12);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    auto& nextJ = body->createInstr<BinaryOp>(InstrKind::Add, &j, one);
+    auto& nextW = body->createInstr<BinaryOp>(InstrKind::Add, &w, func.getConstant(5));
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, zero);
+    i.addIncoming(body, &nextI);
+    j.addIncoming(entry, zero);
+    j.addIncoming(body, &nextJ);
+    w.addIncoming(entry, one);
+    w.addIncoming(body, &nextW);
+    sum.addIncoming(entry, zero);
+    sum.addIncoming(body, &s3);
+    CFGAnalysis::buildCFG(func);
+
+    const std::vector<int> counts = {0, 7, 100};
+    std::vector<Interpreter::Result> before;
+    for (int count : counts) {
+        before.push_back(Interpreter::run(func, {count}));
+    }
+
+    FunctionAnalysisManager analyses(func);
+    ASSERT_TRUE(StrengthReductionPass::runOnFunction(func, analyses));
+    EXPECT_EQ(countInstructions(func, InstrKind::Mul), 0);
+    EXPECT_EQ(countInstructions(func, InstrKind::Shl), 0);
+    // i, sum, and one phi each for i * 12 and j * 8.
+    EXPECT_EQ(countPhiInstructions(func), 4);
+    EXPECT_EQ(j.getParent(), nullptr);
+    EXPECT_EQ(nextJ.getParent(), nullptr);
+    EXPECT_EQ(w.getParent(), nullptr);
+    EXPECT_EQ(nextW.getParent(), nullptr);
+
+    // Both products by 12 now read the same phi.
+    EXPECT_EQ(s1.getOperand(1), s3.getOperand(1));
+    const InductionVariable* scaled = analyses.getInductionVariables().getInductionVariable(s1.getOperand(1));
+    ASSERT_NE(scaled, nullptr);
+    EXPECT_TRUE(scaled->isBasic());
+    EXPECT_EQ(scaled->start, zero);
+    EXPECT_EQ(scaled->step, 12);
+
+    for (size_t c = 0; c < counts.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, {counts[c]});
+        EXPECT_EQ(after.status, before[c].status);
+        EXPECT_EQ(after.value, before[c].value);
+        if (counts[c] > 0) {
+            EXPECT_LT(after.instructions, before[c].instructions);
+        }
+    }
+}
+
+// The start of a scaled variable that is not a constant is multiplied once
+// in the preheader, which here is the entry block.
+TEST_F(OptimizationsTest, StrengthReductionScalesUnknownStartInPreheader) {
+    Function& func = program->createFunction("from_k");
+    Parameter* k = func.createParam("k");
+    Parameter* n = func.createParam("n");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& last = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& scaled = body->createInstr<BinaryOp>(InstrKind::Mul, &i, func.getConstant(-3));
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Sub, &i, func.getConstant(-2));
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&last);
+    i.addIncoming(entry, k);
+    i.addIncoming(body, &nextI);
+    last.addIncoming(entry, func.getConstant(0));
+    last.addIncoming(body, &scaled);
+    CFGAnalysis::buildCFG(func);
+
+    const std::vector<std::vector<int>> cases = {{5, 20}, {-4, 3}, {9, 0}};
+    std::vector<Interpreter::Result> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args));
+    }
+
+    ASSERT_TRUE(StrengthReductionPass::runOnFunction(func));
+    int products = 0;
+    for (const auto& instr : entry->getInstructions()) {
+        products += instr.getKind() == InstrKind::Mul;
+    }
+    EXPECT_EQ(products, 1);
+    EXPECT_EQ(countInstructions(func, InstrKind::Mul), 1);
+
+    for (size_t c = 0; c < cases.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, cases[c]);
+        EXPECT_EQ(after.status, before[c].status);
+        EXPECT_EQ(after.value, before[c].value);
+    }
+}
+
+// for (i = 0; i < 4; ++i) sum += a[i] * 3, and the same loop tested at
+// the bottom, leaving when the next i reaches 4.
+TEST_F(OptimizationsTest, LoopUnrollingFullyUnrollsConstantTripCounts) {
+    for (bool rotated : {false, true}) {
+        Program program;
+        Function& func = program.createFunction(rotated ? "rotated" : "counted");
+        Parameter* a = func.createParam("a");
+        Constant* zero = func.createConstant(0, "0");
+        Constant* one = func.createConstant(1, "1");
+        BasicBlock* entry = func.createBasicBlock("entry");
+        BasicBlock* header = func.createBasicBlock("header");
+        BasicBlock* body = rotated ? header : func.createBasicBlock("body");
+        BasicBlock* exit = func.createBasicBlock("exit");
+        entry->createInstr<Jump>(header);
+        auto& i = header->createInstr<Phi>();
+        auto& sum = header->createInstr<Phi>();
+        if (!rotated) {
+            auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, func.getConstant(4));
+            header->createInstr<CondJump>(&more, body, exit);
+        }
+        body->createInstr<BoundsCheck>(a, &i);
+        auto& scaled = body->createInstr<BinaryOp>(InstrKind::Mul, &i, func.getConstant(3));
+        auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &scaled);
+        auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+        if (rotated) {
+            auto& more = body->createInstr<Cmp>(CmpOp::Lt, &nextI, func.getConstant(4));
+            body->createInstr<CondJump>(&more, header, exit);
+            exit->createInstr<Return>(&nextSum);
+        } else {
+            body->createInstr<Jump>(header);
+            exit->createInstr<Return>(&sum);
+        }
+        i.addIncoming(entry, zero);
+        i.addIncoming(body, &nextI);
+        sum.addIncoming(entry, zero);
+        sum.addIncoming(body, &nextSum);
+        CFGAnalysis::buildCFG(func);
+
+        const std::vector<std::vector<int>> cases = {{4}, {2}};
+        std::vector<Interpreter::Result> before;
+        for (const auto& args : cases) {
+            before.push_back(Interpreter::run(func, args));
+        }
+        EXPECT_EQ(before[0].value, 18);
+
+        FunctionAnalysisManager analyses(func);
+        ASSERT_TRUE(LoopUnrollingPass::runOnFunction(func, analyses));
+        EXPECT_TRUE(analyses.getLoopInfo().empty());
+        EXPECT_EQ(countPhiInstructions(func), 0);
+        EXPECT_EQ(countChecks(func, InstrKind::BoundsCheck), 4);
+        // The copies run straight into each other and end up in one block.
+        EXPECT_EQ(func.getBasicBlocks().size(), 2U);
+        EXPECT_EQ(countInstructions(func, InstrKind::Mul), 0);
+        EXPECT_EQ(countInstructions(func, InstrKind::Add), 0);
+
+        for (size_t c = 0; c < cases.size(); ++c) {
+            Interpreter::Result after = Interpreter::run(func, cases[c]);
+            EXPECT_EQ(after.status, before[c].status);
+            EXPECT_EQ(after.value, before[c].value);
+            EXPECT_LT(after.instructions, before[c].instructions);
+        }
+    }
+}
+
+// for (i = start; i > n; i -= 2) sum += a[i & 7], which runs an unknown
+// number of times: four copies per iteration while that many remain, and
+// the original loop for the rest.
+TEST_F(OptimizationsTest, LoopUnrollingLeavesRemainderLoop) {
+    Function& func = program->createFunction("countdown");
+    Parameter* start = func.createParam("start");
+    Parameter* n = func.createParam("n");
+    Parameter* a = func.createParam("a");
+    Constant* zero = func.createConstant(0, "0");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Gt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& index = body->createInstr<BinaryOp>(InstrKind::And, &i, func.getConstant(7));
+    body->createInstr<BoundsCheck>(a, &index);
+    auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, &i);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Sub, &i, func.getConstant(2));
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, start);
+    i.addIncoming(body, &nextI);
+    sum.addIncoming(entry, zero);
+    sum.addIncoming(body, &nextSum);
+    CFGAnalysis::buildCFG(func);
+
+    // {start, n, length}: no iterations, fewer than four, a multiple of
+    // four, a remainder, a check that fails late, and a limit that would
+    // wrap past the largest int.
+    const int max = std::numeric_limits<int>::max();
+    const std::vector<std::vector<int>> cases = {{0, 0, 8}, {5, 0, 8}, {16, 0, 8}, {41, 0, 8},
+                                                 {41, 0, 6}, {max, max - 7, 8}};
+    std::vector<Interpreter::Result> before;
+    for (const auto& args : cases) {
+        before.push_back(Interpreter::run(func, args));
+    }
+    EXPECT_FALSE(before[4].ok());
+
+    FunctionAnalysisManager analyses(func);
+    ASSERT_TRUE(LoopUnrollingPass::runOnFunction(func, analyses));
+    EXPECT_EQ(countChecks(func, InstrKind::BoundsCheck), 5);
+    const LoopInfo& loopInfo = analyses.getLoopInfo();
+    EXPECT_EQ(loopInfo.size(), 2U);
+    BasicBlock* unrolled = findBlock(func, "header.unrolled");
+    ASSERT_NE(unrolled, nullptr);
+    EXPECT_TRUE(loopInfo.isLoopHeader(unrolled));
+    EXPECT_TRUE(loopInfo.isLoopHeader(header));
+    // Each unrolled iteration is one block after the test.
+    Loop* loop = loopInfo.getLoopFor(unrolled);
+    EXPECT_EQ(loop->blocks.size(), 2U);
+
+    for (size_t c = 0; c < cases.size(); ++c) {
+        Interpreter::Result after = Interpreter::run(func, cases[c]);
+        EXPECT_EQ(after.status, before[c].status);
+        EXPECT_EQ(after.value, before[c].value);
+    }
+    EXPECT_LT(Interpreter::run(func, cases[3]).instructions, before[3].instructions);
+}
+
+TEST_F(OptimizationsTest, LoopUnrollingStaysWithinBudget) {
+    Function& func = program->createFunction("sum_to");
+    Parameter* n = func.createParam("n");
+    Constant* zero = func.createConstant(0, "0");
+    Constant* one = func.createConstant(1, "1");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& sum = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, func.getConstant(1000));
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& nextSum = body->createInstr<BinaryOp>(InstrKind::Add, &sum, n);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, one);
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, zero);
+    i.addIncoming(body, &nextI);
+    sum.addIncoming(entry, zero);
+    sum.addIncoming(body, &nextSum);
+    CFGAnalysis::buildCFG(func);
+
+    LoopUnrollingPass::Config config;
+    config.maxUnrolledInstructions = 8;
+    EXPECT_FALSE(LoopUnrollingPass::runOnFunction(func, config));
+    EXPECT_EQ(func.getBasicBlocks().size(), 4U);
+
+    // A thousand iterations are too many to unroll fully; the bound is a
+    // constant, so the unrolled loop tests against a constant too.
+    Interpreter::Result before = Interpreter::run(func, {3});
+    config = LoopUnrollingPass::Config();
+    config.unrollFactor = 8;
+    ASSERT_TRUE(LoopUnrollingPass::runOnFunction(func, config));
+    BasicBlock* unrolled = findBlock(func, "header.unrolled");
+    ASSERT_NE(unrolled, nullptr);
+    auto* test = dyn_cast<Cmp>(unrolled->getTerminator()->getOperand(0));
+    ASSERT_NE(test, nullptr);
+    EXPECT_EQ(asConstant(test->getOperand(1))->getValue(), 993);
+    Interpreter::Result after = Interpreter::run(func, {3});
+    EXPECT_EQ(after.value, before.value);
+    EXPECT_LT(after.instructions, before.instructions);
+}
@@ -0,0 +1,687 @@
+#include <gtest/gtest.h>
+#include "program.h"
+#include "analysis_manager.h"
+#include "bin_ops.h"
+#include "cfg.h"
+#include "context.h"
+#include "control_flow.h"
+#include "interpreter.h"
+#include "liveness_analysis.h"
+#include "parallel_copy.h"
+#include "phi_elimination.h"
+#include "register_allocator.h"
+#include "spill_code.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::vector<Value*> collectValues(Function& func, const LivenessAnalysis& liveness) {
+    std::vector<Value*> values(func.getParams().begin(), func.getParams().end());
+    for (auto* bb : liveness.getLinearOrder()) {
+        for (auto& instr : bb->getInstructions()) {
+            values.push_back(&instr);
+        }
+    }
+    return values;
+}
+
+// Every value that is read got a location, its pieces cut its interval
+// without losing or adding anything, pieces in the same register never
+// overlap, and neither do values sharing a slot. With registersForUses,
+// every read that needs a register finds the value in one.
+static void expectValidAllocation(Function& func, const LivenessAnalysis& liveness,
+                                  const RegisterAllocator& allocator, bool registersForUses = true) {
+    std::vector<Value*> values = collectValues(func, liveness);
+    std::vector<const AllocatedInterval*> inRegisters;
+    for (Value* v : values) {
+        const auto& pieces = allocator.getIntervals(v);
+        const LifetimeInterval* interval = liveness.getInterval(v);
+        if (!v->hasUses() || !interval) {
+            EXPECT_TRUE(pieces.empty());
+            continue;
+        }
+        ASSERT_FALSE(pieces.empty());
+        std::vector<LiveRange> ranges;
+        std::vector<UsePosition> uses;
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            const ValueLocation& location = pieces[i]->location;
+            EXPECT_NE(location.isRegister(), location.isSpilled());
+            EXPECT_LT(location.reg, allocator.getNumRegisters());
+            if (location.isSpilled()) {
+                EXPECT_EQ(location.spillSlot, allocator.getSpillSlot(v));
+            } else {
+                inRegisters.push_back(pieces[i]);
+            }
+            if (i > 0) {
+                EXPECT_LE(pieces[i - 1]->interval.getEnd(), pieces[i]->interval.getStart());
+            }
+            for (const LiveRange& r : pieces[i]->interval.getLiveRanges()) {
+                if (!ranges.empty() && ranges.back().to == r.from) {
+                    ranges.back().to = r.to;
+                } else {
+                    ranges.push_back(r);
+                }
+            }
+            for (const UsePosition& use : pieces[i]->interval.getUsePositions()) {
+                uses.push_back(use);
+                if (registersForUses && use.requiresRegister) {
+                    EXPECT_TRUE(location.isRegister()) << "read at " << use.pos;
+                }
+            }
+        }
+        EXPECT_EQ(ranges, interval->getLiveRanges());
+        EXPECT_EQ(uses, interval->getUsePositions());
+    }
+    for (size_t i = 0; i < inRegisters.size(); ++i) {
+        for (size_t j = i + 1; j < inRegisters.size(); ++j) {
+            if (inRegisters[i]->location.reg == inRegisters[j]->location.reg) {
+                EXPECT_FALSE(inRegisters[i]->interval.intersects(inRegisters[j]->interval))
+                    << "r" << inRegisters[i]->location.reg << " taken twice at "
+                    << inRegisters[i]->interval.firstIntersection(inRegisters[j]->interval);
+            }
+        }
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        for (size_t j = i + 1; j < values.size(); ++j) {
+            int slot = allocator.getSpillSlot(values[i]);
+            if (slot >= 0 && slot == allocator.getSpillSlot(values[j])) {
+                EXPECT_FALSE(liveness.getInterval(values[i])->intersects(*liveness.getInterval(values[j])));
+            }
+        }
+    }
+}
+
+static size_t countSpilled(const RegisterAllocator& allocator) {
+    size_t count = 0;
+    for (Value* v : allocator.getAllocatedValues()) {
+        count += allocator.isSpilled(v);
+    }
+    return count;
+}
+
+// a + b + c + d with every operand defined up front. An operand stays live
+// through the instruction that reads it, so p, a, b, c and d are all live
+// at d; with four registers the one read last goes to the stack there and
+// comes back for its read.
+TEST(RegisterAllocatorTest, SpillsValueWithFurthestNextUse) {
+    Program prog;
+    Function& func = prog.createFunction("sum4");
+    Parameter* p = func.createParam("p");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    auto& a = entry->createInstr<BinaryOp>(InstrKind::Add, p, func.getConstant(1));
+    auto& b = entry->createInstr<BinaryOp>(InstrKind::Add, p, func.getConstant(2));
+    auto& c = entry->createInstr<BinaryOp>(InstrKind::Add, p, func.getConstant(3));
+    auto& d = entry->createInstr<BinaryOp>(InstrKind::Mul, p, func.getConstant(4));
+    auto& cd = entry->createInstr<BinaryOp>(InstrKind::Add, &c, &d);
+    auto& bcd = entry->createInstr<BinaryOp>(InstrKind::Add, &b, &cd);
+    auto& sum = entry->createInstr<BinaryOp>(InstrKind::Add, &a, &bcd);
+    entry->createInstr<Return>(&sum);
+    CFGAnalysis::buildCFG(func);
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+
+    RegisterAllocator roomy(8);
+    roomy.allocate(func, liveness);
+    EXPECT_EQ(countSpilled(roomy), 0U);
+    EXPECT_EQ(roomy.getNumSpillSlots(), 0);
+    expectValidAllocation(func, liveness, roomy);
+
+    RegisterAllocator tight(4);
+    tight.allocate(func, liveness);
+    expectValidAllocation(func, liveness, tight);
+    EXPECT_TRUE(tight.isSpilled(&a));
+    EXPECT_EQ(countSpilled(tight), 1U);
+    EXPECT_EQ(tight.getSpillSlot(&a), 0);
+    const auto& pieces = tight.getIntervals(&a);
+    ASSERT_EQ(pieces.size(), 3U);
+    EXPECT_TRUE(pieces[0]->location.isRegister());
+    EXPECT_EQ(pieces[1]->location.spillSlot, 0);
+    EXPECT_EQ(pieces[1]->interval.getStart(), liveness.getInstructionId(&d));
+    EXPECT_TRUE(pieces[2]->location.isRegister());
+    EXPECT_EQ(pieces[2]->interval.getStart(), liveness.getInstructionId(&sum));
+    EXPECT_EQ(tight.getLocationAt(&a, liveness.getInstructionId(&cd)).spillSlot, 0);
+
+    // Without splitting a stays on the stack throughout.
+    RegisterAllocator::Config whole;
+    whole.splitIntervals = false;
+    RegisterAllocator unsplit(4, whole);
+    unsplit.allocate(func, liveness);
+    expectValidAllocation(func, liveness, unsplit, false);
+    EXPECT_EQ(unsplit.getIntervals(&a).size(), 1U);
+    EXPECT_EQ(unsplit.getLocation(&a).spillSlot, 0);
+    for (Value* v : {static_cast<Value*>(&b), static_cast<Value*>(&c), static_cast<Value*>(&d)}) {
+        EXPECT_TRUE(tight.getLocation(v).isRegister());
+    }
+}
+
+// A value defined in the entry and read on one side of a branch is not
+// live on the other side; the values there can use its register.
+//
+//   entry: v = add p, p; condjump p, left, right
+//   left:  w = mul p, 3; x = add w, w; return x
+//   right: u = add v, v; return u
+TEST(RegisterAllocatorTest, ReusesRegistersInLifetimeHoles) {
+    Program prog;
+    Function& func = prog.createFunction("holes");
+    Parameter* p = func.createParam("p");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* left = func.createBasicBlock("left");
+    BasicBlock* right = func.createBasicBlock("right");
+    auto& v = entry->createInstr<BinaryOp>(InstrKind::Add, p, p);
+    entry->createInstr<CondJump>(p, left, right);
+    auto& w = left->createInstr<BinaryOp>(InstrKind::Mul, p, func.getConstant(3));
+    auto& x = left->createInstr<BinaryOp>(InstrKind::Add, &w, &w);
+    left->createInstr<Return>(&x);
+    auto& u = right->createInstr<BinaryOp>(InstrKind::Add, &v, &v);
+    right->createInstr<Return>(&u);
+    CFGAnalysis::buildCFG(func);
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    // v is not live anywhere in left, where p and w, then w and x, need
+    // both registers.
+    EXPECT_FALSE(liveness.isLiveAt(&v, liveness.getBlockFrom(left)));
+
+    RegisterAllocator allocator(2);
+    allocator.allocate(func, liveness);
+    expectValidAllocation(func, liveness, allocator);
+    EXPECT_EQ(countSpilled(allocator), 0U);
+    EXPECT_NE(allocator.getRegister(p), allocator.getRegister(&v));
+    EXPECT_EQ(allocator.getRegister(&w), allocator.getRegister(&v));
+    EXPECT_TRUE(allocator.getLocation(&u).isRegister());
+}
+
+// i = 0; s = 0; while (i < n) { s = s + i * k; i = i + 1 } return s
+TEST(RegisterAllocatorTest, AllocatesLoopValuesAndPrintsAssignment) {
+    Program prog;
+    Function& func = prog.createFunction("loop");
+    Parameter* n = func.createParam("n");
+    Parameter* k = func.createParam("k");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& s = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& scaled = body->createInstr<BinaryOp>(InstrKind::Mul, &i, k);
+    auto& nextS = body->createInstr<BinaryOp>(InstrKind::Add, &s, &scaled);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, func.getConstant(1));
+    body->createInstr<Jump>(header);
+    exit->createInstr<Return>(&s);
+    i.addIncoming(entry, func.getConstant(0));
+    i.addIncoming(body, &nextI);
+    s.addIncoming(entry, func.getConstant(0));
+    s.addIncoming(body, &nextS);
+    CFGAnalysis::buildCFG(func);
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+
+    // n, k, i and s are live across the loop, and s, scaled and nextS
+    // meet at nextS.
+    RegisterAllocator enough(6);
+    enough.allocate(func, liveness);
+    expectValidAllocation(func, liveness, enough);
+    EXPECT_EQ(countSpilled(enough), 0U);
+    EXPECT_EQ(enough.getAllocatedValues().size(), 8U);
+
+    // An add needs its two operands and its result in registers at once.
+    for (int registers : {0, 1, 2, 3, 4, 5}) {
+        RegisterAllocator allocator(registers);
+        allocator.allocate(func, liveness);
+        expectValidAllocation(func, liveness, allocator, registers >= 3);
+        EXPECT_GT(countSpilled(allocator), 0U);
+        EXPECT_LE(allocator.getNumSpillSlots(), static_cast<int>(countSpilled(allocator)));
+    }
+
+    NameContext ctx;
+    std::ostringstream out;
+    RegisterAllocator none(0);
+    none.allocate(func);
+    none.print(out, ctx);
+    std::string text = out.str();
+    EXPECT_NE(text.find(ctx.getValueName(&i) + " -> stack "), std::string::npos);
+    EXPECT_EQ(text.find(" -> r"), std::string::npos);
+    EXPECT_EQ(static_cast<size_t>(std::count(text.begin(), text.end(), '\n')), 8U);
+}
+
+// Without registers every value lives on the stack, and values that are
+// never live together share a slot: a dies at b, b at c.
+TEST(RegisterAllocatorTest, SharesSlotsBetweenDisjointValues) {
+    Program prog;
+    Function& func = prog.createFunction("chain");
+    Parameter* p = func.createParam("p");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    auto& a = entry->createInstr<BinaryOp>(InstrKind::Add, p, func.getConstant(1));
+    auto& b = entry->createInstr<BinaryOp>(InstrKind::Mul, &a, func.getConstant(2));
+    auto& c = entry->createInstr<BinaryOp>(InstrKind::Add, &b, func.getConstant(3));
+    entry->createInstr<Return>(&c);
+    CFGAnalysis::buildCFG(func);
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    RegisterAllocator allocator(0);
+    allocator.allocate(func, liveness);
+    expectValidAllocation(func, liveness, allocator, false);
+    EXPECT_EQ(countSpilled(allocator), 4U);
+    EXPECT_NE(allocator.getSpillSlot(&a), allocator.getSpillSlot(&b));
+    EXPECT_EQ(allocator.getSpillSlot(&a), allocator.getSpillSlot(&c));
+    EXPECT_EQ(allocator.getNumSpillSlots(), 2);
+
+    Interpreter::Result before = Interpreter::run(func, {5});
+    SpillCodePass::Stats stats = SpillCodePass::runOnFunction(func, liveness, allocator);
+    EXPECT_EQ(stats.spills, 4U);
+    EXPECT_EQ(stats.reloads, 4U);
+    Interpreter::Result after = Interpreter::run(func, {5});
+    EXPECT_EQ(after.value, before.value);
+    EXPECT_EQ(after.reloads, 4U);
+}
+
+// for (i = 0; i < n; i++) { for (j = 0; j < m; j++) t += j * a + b; s = t + i }
+// with the inner loop starting from t = s. i and n are live across the
+// inner loop but read only outside it.
+static Function& buildNestedLoops(Program& prog) {
+    Function& func = prog.createFunction("nested");
+    Parameter* n = func.createParam("n");
+    Parameter* m = func.createParam("m");
+    Parameter* a = func.createParam("a");
+    Parameter* b = func.createParam("b");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* outer = func.createBasicBlock("outer");
+    BasicBlock* inner = func.createBasicBlock("inner");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* latch = func.createBasicBlock("latch");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(outer);
+    auto& i = outer->createInstr<Phi>();
+    auto& s = outer->createInstr<Phi>();
+    auto& moreI = outer->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    outer->createInstr<CondJump>(&moreI, inner, exit);
+    auto& j = inner->createInstr<Phi>();
+    auto& t = inner->createInstr<Phi>();
+    auto& moreJ = inner->createInstr<Cmp>(CmpOp::Lt, &j, m);
+    inner->createInstr<CondJump>(&moreJ, body, latch);
+    auto& scaled = body->createInstr<BinaryOp>(InstrKind::Mul, &j, a);
+    auto& term = body->createInstr<BinaryOp>(InstrKind::Add, &scaled, b);
+    auto& nextT = body->createInstr<BinaryOp>(InstrKind::Add, &t, &term);
+    auto& nextJ = body->createInstr<BinaryOp>(InstrKind::Add, &j, func.getConstant(1));
+    body->createInstr<Jump>(inner);
+    auto& nextS = latch->createInstr<BinaryOp>(InstrKind::Add, &t, &i);
+    auto& nextI = latch->createInstr<BinaryOp>(InstrKind::Add, &i, func.getConstant(1));
+    latch->createInstr<Jump>(outer);
+    exit->createInstr<Return>(&s);
+    i.addIncoming(entry, func.getConstant(0));
+    i.addIncoming(latch, &nextI);
+    s.addIncoming(entry, func.getConstant(0));
+    s.addIncoming(latch, &nextS);
+    j.addIncoming(outer, func.getConstant(0));
+    j.addIncoming(body, &nextJ);
+    t.addIncoming(outer, &s);
+    t.addIncoming(body, &nextT);
+    CFGAnalysis::buildCFG(func);
+    return func;
+}
+
+// The function computes the same with its spill code in place for any
+// number of registers, and splitting keeps the values the inner loop does
+// not read out of it. Without splitting, a spilled value is read through a
+// scratch register outside the allocatable ones, one per operand; against
+// that, splitting with two more registers reloads less.
+TEST(RegisterAllocatorTest, SpillCodePreservesResults) {
+    const std::vector<int> args = {7, 9, 3, 5};
+    int expected = 0;
+    {
+        Program prog;
+        expected = Interpreter::run(buildNestedLoops(prog), args).value;
+    }
+
+    const int maxRegisters = 9;
+    std::vector<size_t> reloads[2];
+    for (bool split : {false, true}) {
+        for (int registers = 0; registers <= maxRegisters; ++registers) {
+            SCOPED_TRACE(std::to_string(registers) + (split ? " registers, split" : " registers"));
+            Program prog;
+            Function& func = buildNestedLoops(prog);
+            LivenessAnalysis liveness;
+            liveness.build(func);
+            RegisterAllocator::Config config;
+            config.splitIntervals = split;
+            RegisterAllocator allocator(registers, config);
+            allocator.allocate(func, liveness);
+            expectValidAllocation(func, liveness, allocator, split && registers >= 3);
+            SpillCodePass::runOnFunction(func, liveness, allocator);
+
+            Interpreter::Result result = Interpreter::run(func, args);
+            ASSERT_TRUE(result.ok());
+            EXPECT_EQ(result.value, expected);
+            reloads[split].push_back(result.reloads);
+
+            if (!split) {
+                continue;
+            }
+            Value* n = func.getParams()[0];
+            Value* i = &func.getBasicBlocks()[1]->getInstructions().front();
+            for (BasicBlock* bb : {func.getBasicBlocks()[2], func.getBasicBlocks()[3]}) {
+                for (auto& instr : bb->getInstructions()) {
+                    if (auto* reload = dyn_cast<Reload>(&instr)) {
+                        EXPECT_NE(reload->getReloadedValue(), i) << bb->getName();
+                        EXPECT_NE(reload->getReloadedValue(), n) << bb->getName();
+                    }
+                }
+            }
+        }
+    }
+    for (int registers = 2; registers <= maxRegisters; ++registers) {
+        EXPECT_LE(reloads[true][registers], reloads[false][registers - 2]) << registers << " registers";
+    }
+    EXPECT_EQ(reloads[true][maxRegisters], 0U);
+}
+
+// v1 moves to the stack right below the read of p0, and p0 is reloaded
+// into the register v1 leaves. The store of v1 and the reload both go
+// before that read, and the store has to come first or it saves p0. Only
+// running on the registers shows the difference.
+TEST(RegisterAllocatorTest, SpillCodeStoresBeforeReloads) {
+    Program prog;
+    Function& func = prog.createFunction("straight");
+    Parameter* p0 = func.createParam("p0");
+    Parameter* p1 = func.createParam("p1");
+    Parameter* p2 = func.createParam("p2");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    auto& v0 = entry->createInstr<BinaryOp>(InstrKind::Mul, p2, p1);
+    auto& v1 = entry->createInstr<BinaryOp>(InstrKind::Sub, p2, func.getConstant(3));
+    auto& v2 = entry->createInstr<BinaryOp>(InstrKind::Sub, p0, &v0);
+    auto& v3 = entry->createInstr<BinaryOp>(InstrKind::Add, &v2, &v1);
+    entry->createInstr<Return>(&v3);
+    CFGAnalysis::buildCFG(func);
+    const std::vector<int> args = {7, 3, 11};
+    int expected = Interpreter::run(func, args).value;
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    RegisterAllocator::Config config;
+    config.splitIntervals = true;
+    RegisterAllocator allocator(3, config);
+    allocator.allocate(func, liveness);
+    SpillCodePass::runOnFunction(func, liveness, allocator);
+
+    std::vector<InstrKind> before;
+    for (Instruction* instr = &v2; isa<Spill>(instr->getPrev()) || isa<Reload>(instr->getPrev());
+         instr = instr->getPrev()) {
+        before.insert(before.begin(), instr->getPrev()->getKind());
+    }
+    EXPECT_EQ(before, (std::vector<InstrKind>{InstrKind::Spill, InstrKind::Reload}));
+    Interpreter::Result result = Interpreter::run(func, args, allocator, liveness);
+    ASSERT_TRUE(result.ok());
+    EXPECT_EQ(result.value, expected);
+}
+
+// A swap, a three-cycle, a chain and a constant. Made one at a time on a
+// register file, the copies leave every target with what its source held
+// before any of them, and the two cycles share the one temporary.
+TEST(RegisterAllocatorTest, SequentializesParallelCopies) {
+    Program prog;
+    Function& func = prog.createFunction("copies");
+    std::vector<Value*> v;
+    for (int i = 0; i < 8; ++i) {
+        v.push_back(func.createParam("v" + std::to_string(i)));
+    }
+    auto reg = [](int r) { return ValueLocation{r, -1}; };
+
+    ParallelCopy copy;
+    copy.add(v[0], reg(0), reg(1));
+    copy.add(v[1], reg(1), reg(0));
+    copy.add(v[2], reg(2), reg(3));
+    copy.add(v[3], reg(3), reg(4));
+    copy.add(v[4], reg(4), reg(2));
+    copy.add(v[5], reg(5), reg(6));
+    copy.add(v[6], reg(6), reg(7));
+    copy.add(func.getConstant(42), ValueLocation(), reg(5));
+    copy.add(v[7], reg(8), reg(8));
+    EXPECT_EQ(copy.size(), 8U);
+    EXPECT_EQ(copy.getNumCoalesced(), 1U);
+
+    const ValueLocation temp = reg(9);
+    std::vector<ParallelCopy::Copy> order = copy.sequentialize(temp);
+    EXPECT_EQ(order.size(), 10U);
+    std::vector<int> registers = {0, 1, 2, 3, 4, 5, 6, 7, 8, -1};
+    size_t saves = 0;
+    for (const ParallelCopy::Copy& move : order) {
+        saves += move.to == temp;
+        registers[move.to.reg] = move.from.isNone() ? 42 : registers[move.from.reg];
+    }
+    EXPECT_EQ(saves, 2U);
+    EXPECT_EQ(registers[0], 1);
+    EXPECT_EQ(registers[1], 0);
+    EXPECT_EQ(registers[2], 4);
+    EXPECT_EQ(registers[3], 2);
+    EXPECT_EQ(registers[4], 3);
+    EXPECT_EQ(registers[5], 42);
+    EXPECT_EQ(registers[6], 5);
+    EXPECT_EQ(registers[7], 6);
+    EXPECT_EQ(registers[8], 8);
+
+    ParallelCopy chain;
+    chain.add(v[0], reg(0), reg(1));
+    chain.add(v[1], reg(1), reg(2));
+    for (const ParallelCopy::Copy& move : chain.sequentialize(temp)) {
+        EXPECT_NE(move.to, temp);
+    }
+}
+
+// Out of SSA form, the nested loops still compute the same when every
+// value lives where the allocator put it, for any number of registers.
+// With enough of them, s = t + i is computed right into the register of
+// the phi s. The other values on back edges are read by the instruction
+// computing their next value, which never gets the register it reads, so
+// they move; so do the constants, and t on the critical edge from outer.
+TEST(RegisterAllocatorTest, PhiEliminationPreservesResults) {
+    const std::vector<int> args = {7, 9, 3, 5};
+    int expected = 0;
+    {
+        Program prog;
+        expected = Interpreter::run(buildNestedLoops(prog), args).value;
+    }
+
+    for (bool split : {false, true}) {
+        for (int registers = 0; registers <= 9; ++registers) {
+            SCOPED_TRACE(std::to_string(registers) + (split ? " registers, split" : " registers"));
+            Program prog;
+            Function& func = buildNestedLoops(prog);
+            LivenessAnalysis liveness;
+            liveness.build(func);
+            RegisterAllocator::Config config;
+            config.splitIntervals = split;
+            RegisterAllocator allocator(registers, config);
+            allocator.allocate(func, liveness);
+            SpillCodePass::runOnFunction(func, liveness, allocator);
+            PhiEliminationPass::Stats stats = PhiEliminationPass::runOnFunction(func, liveness, allocator);
+
+            for (BasicBlock* bb : func.getBasicBlocks()) {
+                for (auto& instr : bb->getInstructions()) {
+                    if (auto* phi = dyn_cast<Phi>(&instr)) {
+                        EXPECT_EQ(phi->getNumIncoming(), 0U);
+                    }
+                }
+            }
+            Interpreter::Result result = Interpreter::run(func, args, allocator, liveness);
+            ASSERT_TRUE(result.ok());
+            EXPECT_EQ(result.value, expected);
+            EXPECT_EQ(stats.coalesced + stats.moves - stats.temporaries, 8U);
+            if (split && registers == 9) {
+                EXPECT_EQ(stats.coalesced, 1U);
+                EXPECT_EQ(stats.moves, 7U);
+                EXPECT_EQ(stats.temporaries, 0U);
+                EXPECT_EQ(stats.splitEdges, 1U);
+            }
+        }
+    }
+}
+
+// Through an analysis manager, the edge block the moves needed shows up in
+// the analyses computed afterwards.
+TEST(RegisterAllocatorTest, PhiEliminationInvalidatesSplitCFG) {
+    Program prog;
+    Function& func = buildNestedLoops(prog);
+    FunctionAnalysisManager analyses(func);
+    RegisterAllocator allocator(9);
+    allocator.allocate(func, analyses);
+    BasicBlock* outer = analyses.getLoopInfo().getLoopFor(func.getBasicBlocks()[1])->header;
+    SpillCodePass::Stats spillStats = SpillCodePass::runOnFunction(func, analyses, allocator);
+    ASSERT_EQ(spillStats.spills + spillStats.reloads, 0U);
+
+    PhiEliminationPass::Stats stats = PhiEliminationPass::runOnFunction(func, analyses, allocator);
+    ASSERT_EQ(stats.splitEdges, 1U);
+    BasicBlock* edge = func.getBasicBlocks().back();
+    EXPECT_EQ(edge->getName(), "outer.inner");
+    Loop* loop = analyses.getLoopInfo().getLoopFor(edge);
+    ASSERT_NE(loop, nullptr);
+    EXPECT_EQ(loop->header, outer);
+    EXPECT_EQ(analyses.getStats().getComputed(AnalysisKind::Loops), 2U);
+    EXPECT_TRUE(analyses.getDominatorTree().verify(func));
+}
+
+// The loop exit block does nothing but jump to the join. On the way in,
+// x is reloaded at its top into the register it leaves in, and that
+// reload is no business of the edge to the join: the move carrying x to
+// the phi has to read the register after it, not before. Nothing reads w;
+// it only shapes the allocation.
+TEST(RegisterAllocatorTest, PhiEliminationMovesAfterIncomingReloads) {
+    Program prog;
+    Function& func = prog.createFunction("exit");
+    Parameter* p0 = func.createParam("p0");
+    Parameter* p1 = func.createParam("p1");
+    Parameter* p2 = func.createParam("p2");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* then = func.createBasicBlock("then");
+    BasicBlock* other = func.createBasicBlock("else");
+    BasicBlock* join = func.createBasicBlock("join");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    auto& a = entry->createInstr<BinaryOp>(InstrKind::Add, p1, func.getConstant(3));
+    auto& b = entry->createInstr<BinaryOp>(InstrKind::Add, p2, func.getConstant(4));
+    auto& less = entry->createInstr<Cmp>(CmpOp::Lt, p0, p1);
+    entry->createInstr<CondJump>(&less, then, other);
+    auto& square = then->createInstr<BinaryOp>(InstrKind::Mul, &b, &b);
+    auto& c = then->createInstr<BinaryOp>(InstrKind::Add, &square, func.getConstant(1));
+    then->createInstr<Jump>(join);
+    auto& d = other->createInstr<BinaryOp>(InstrKind::Add, p2, func.getConstant(2));
+    auto& e = other->createInstr<BinaryOp>(InstrKind::Add, &d, func.getConstant(3));
+    other->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& w = header->createInstr<Phi>();
+    auto& x = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, func.getConstant(3));
+    header->createInstr<CondJump>(&more, body, exit);
+    body->createInstr<BinaryOp>(InstrKind::Mul, p0, p1);
+    auto& squareX = body->createInstr<BinaryOp>(InstrKind::Mul, &x, &x);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, func.getConstant(1));
+    body->createInstr<Jump>(header);
+    exit->createInstr<Jump>(join);
+    auto& y = join->createInstr<Phi>();
+    auto& f = join->createInstr<BinaryOp>(InstrKind::Add, &y, &b);
+    auto& g = join->createInstr<BinaryOp>(InstrKind::Add, &f, p1);
+    auto& h = join->createInstr<BinaryOp>(InstrKind::Add, &g, &b);
+    join->createInstr<Return>(&h);
+    i.addIncoming(other, func.getConstant(0));
+    i.addIncoming(body, &nextI);
+    w.addIncoming(other, &d);
+    w.addIncoming(body, &squareX);
+    x.addIncoming(other, &e);
+    x.addIncoming(body, &a);
+    y.addIncoming(then, &c);
+    y.addIncoming(exit, &x);
+    CFGAnalysis::buildCFG(func);
+    const std::vector<std::vector<int>> cases = {{7, 3, 11}, {1, 3, 11}};
+    std::vector<int> expected;
+    for (const auto& args : cases) {
+        expected.push_back(Interpreter::run(func, args).value);
+    }
+
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    RegisterAllocator::Config config;
+    config.splitIntervals = true;
+    RegisterAllocator allocator(4, config);
+    allocator.allocate(func, liveness);
+    SpillCodePass::runOnFunction(func, liveness, allocator);
+    PhiEliminationPass::runOnFunction(func, liveness, allocator);
+
+    auto* reload = dyn_cast<Reload>(&exit->getInstructions().front());
+    ASSERT_NE(reload, nullptr);
+    EXPECT_EQ(reload->getReloadedValue(), &x);
+    for (size_t k = 0; k < cases.size(); ++k) {
+        Interpreter::Result result = Interpreter::run(func, cases[k], allocator, liveness);
+        ASSERT_TRUE(result.ok());
+        EXPECT_EQ(result.value, expected[k]) << k;
+    }
+}
+
+// a and b trade values on every iteration. Both live across the back edge
+// in registers, so the moves there form a cycle that goes through the
+// scratch register.
+TEST(RegisterAllocatorTest, PhiEliminationBreaksSwapCycles) {
+    Program prog;
+    Function& func = prog.createFunction("swap");
+    Parameter* n = func.createParam("n");
+    Parameter* x = func.createParam("x");
+    Parameter* y = func.createParam("y");
+    BasicBlock* entry = func.createBasicBlock("entry");
+    BasicBlock* header = func.createBasicBlock("header");
+    BasicBlock* body = func.createBasicBlock("body");
+    BasicBlock* exit = func.createBasicBlock("exit");
+    entry->createInstr<Jump>(header);
+    auto& i = header->createInstr<Phi>();
+    auto& a = header->createInstr<Phi>();
+    auto& b = header->createInstr<Phi>();
+    auto& more = header->createInstr<Cmp>(CmpOp::Lt, &i, n);
+    header->createInstr<CondJump>(&more, body, exit);
+    auto& nextI = body->createInstr<BinaryOp>(InstrKind::Add, &i, func.getConstant(1));
+    body->createInstr<Jump>(header);
+    auto& scaled = exit->createInstr<BinaryOp>(InstrKind::Mul, &a, func.getConstant(10));
+    auto& sum = exit->createInstr<BinaryOp>(InstrKind::Add, &scaled, &b);
+    exit->createInstr<Return>(&sum);
+    i.addIncoming(entry, func.getConstant(0));
+    i.addIncoming(body, &nextI);
+    a.addIncoming(entry, x);
+    a.addIncoming(body, &b);
+    b.addIncoming(entry, y);
+    b.addIncoming(body, &a);
+    CFGAnalysis::buildCFG(func);
+
+    std::vector<int> expected;
+    for (int iterations : {0, 1, 2, 5}) {
+        expected.push_back(Interpreter::run(func, {iterations, 1, 2}).value);
+    }
+    LivenessAnalysis liveness;
+    liveness.build(func);
+    RegisterAllocator allocator(6);
+    allocator.allocate(func, liveness);
+    SpillCodePass::runOnFunction(func, liveness, allocator);
+    PhiEliminationPass::Stats stats = PhiEliminationPass::runOnFunction(func, liveness, allocator);
+    EXPECT_EQ(stats.temporaries, 1U);
+    EXPECT_EQ(stats.splitEdges, 0U);
+
+    std::ostringstream os;
+    for (auto& instr : body->getInstructions()) {
+        if (auto* move = dyn_cast<Move>(&instr)) {
+            os << move->getFrom().str() << " -> " << move->getTo().str() << "\n";
+        }
+    }
+    std::string scratch = "r" + std::to_string(allocator.getScratchRegister());
+    EXPECT_NE(os.str().find("-> " + scratch), std::string::npos) << os.str();
+    EXPECT_NE(os.str().find(scratch + " ->"), std::string::npos) << os.str();
+
+    for (size_t k = 0; k < expected.size(); ++k) {
+        int iterations = std::vector<int>{0, 1, 2, 5}[k];
+        Interpreter::Result result = Interpreter::run(func, {iterations, 1, 2}, allocator, liveness);
+        ASSERT_TRUE(result.ok());
+        EXPECT_EQ(result.value, expected[k]) << iterations << " iterations";
+    }
+}